@@ -12,21 +12,43 @@
 #pragma once
 
 #include <stdlib.h>
+#include <atomic>
 
 /**
  * Base class for reference counted objects.
+ * The reference count is atomic, so objects can be shared by several threads
+ * (for example, AST nodes and module constants during parallel code generation).
  */
 class RefCountObj
 {
 public:
     int addref()
     {
-        return ++m_refCount;
+        return m_refCount.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+
+    /**
+     * Adds a reference only if the object is still alive (its count has not
+     * reached zero). Used by tables which keep non-owning pointers to objects
+     * which may be being destroyed by another thread.
+     * @return true if the reference has been added.
+     */
+    bool tryAddref()
+    {
+        int count = m_refCount.load(std::memory_order_relaxed);
+        
+        while (count > 0)
+        {
+            if (m_refCount.compare_exchange_weak(count, count + 1, std::memory_order_acq_rel))
+                return true;
+        }
+        
+        return false;
     }
 
     void release()
     {
-        if (--m_refCount == 0)
+        if (m_refCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
             delete this;
     }
 
@@ -39,7 +61,7 @@ protected:
     virtual ~RefCountObj(){}
 
 private:
-    int m_refCount;
+    std::atomic<int> m_refCount;
     
     //Copy operations forbidden
     RefCountObj(const RefCountObj& orig);
@@ -73,6 +95,11 @@ public:
             m_ptr->addref();
     }
 
+    Ref(Ref<ObjType>&& src) noexcept : m_ptr(src.m_ptr)
+    {
+        src.m_ptr = NULL;
+    }
+
     template <class SrcType>
     Ref(const Ref<SrcType>& src)
     {
@@ -103,10 +130,24 @@ public:
         return *this;
     }
 
+    Ref<ObjType> & operator=(Ref<ObjType>&& src) noexcept
+    {
+        if (this != &src)
+        {
+            if (m_ptr != NULL)
+                m_ptr->release();
+
+            m_ptr = src.m_ptr;
+            src.m_ptr = NULL;
+        }
+        
+        return *this;
+    }
+
     template <class SrcType>
     Ref<ObjType> & operator=(const Ref<SrcType>& src)
     {
-        return this->operator =(src.staticCast<ObjType>());
+        return this->operator =(src.template staticCast<ObjType>());
     }
 
     bool isNull()const
@@ -10,6 +10,9 @@
 #include "ascript_pch.hpp"
 #include "ScriptPosition.h"
 
+#include <climits>
+#include <algorithm>
+
 using namespace std;
 
 /**
@@ -24,43 +27,153 @@ string ScriptPosition::toString()const
     return string(buffer);
 }
 
+///Number of entries between position table checkpoints.
+static const size_t POSITION_CHECKPOINT_INTERVAL = 16;
+
 /**
- * Gets an script position from an WM position
- * @param vmPos
+ * Writes an unsigned integer, 7 bits per byte.
+ * @param value
+ * @param data
+ */
+static void writeVarUint (unsigned value, vector<unsigned char>& data)
+{
+    while (value >= 0x80)
+    {
+        data.push_back((unsigned char)(value | 0x80));
+        value >>= 7;
+    }
+    data.push_back((unsigned char)value);
+}
+
+/**
+ * Reads an unsigned integer written by 'writeVarUint'.
+ * @param data
+ * @param pos   [in/out] Read position.
  * @return 
  */
-const ScriptPosition& CodeMap::get(const VmPosition& vmPos)const
+static unsigned readVarUint (const vector<unsigned char>& data, size_t& pos)
 {
-    const static ScriptPosition nullPosition;
+    unsigned    value = 0;
+    int         shift = 0;
     
-    if (m_vm2sc.empty())
-        return nullPosition;
-    else
+    while (data[pos] & 0x80)
     {
-        auto it = m_vm2sc.upper_bound(vmPos);
-        
-        if (it != m_vm2sc.begin())
-            --it;
-        return it->second;
+        value |= unsigned(data[pos++] & 0x7F) << shift;
+        shift += 7;
+    }
+    value |= unsigned(data[pos++]) << shift;
+    
+    return value;
+}
+
+/**
+ * Writes a signed integer ('zigzag' encoding, so small negative values are 
+ * also short).
+ * @param value
+ * @param data
+ */
+static void writeVarInt (int value, vector<unsigned char>& data)
+{
+    writeVarUint ((unsigned(value) << 1) ^ unsigned(value >> 31), data);
+}
+
+static int readVarInt (const vector<unsigned char>& data, size_t& pos)
+{
+    const unsigned value = readVarUint(data, pos);
+    
+    return int(value >> 1) ^ -int(value & 1);
+}
+
+/**
+ * Adds the position of an instruction. Instructions must be added in code 
+ * order; out of order entries are ignored.
+ * @param block
+ * @param offset    Instruction offset inside the block.
+ * @param pos
+ */
+void PositionTable::add (int block, int offset, const ScriptPosition& pos)
+{
+    if (m_count > 0)
+    {
+        if (block < m_last.block || (block == m_last.block && offset <= m_last.offset))
+            return;
+        if (pos.line == m_last.line && pos.column == m_last.column)
+            return;
     }
+    
+    //Offsets are relative to the previous entry, or to the block start.
+    writeVarUint (unsigned(block - m_last.block), m_data);
+    writeVarUint (unsigned(block == m_last.block ? offset - m_last.offset : offset), m_data);
+    writeVarInt (pos.line - m_last.line, m_data);
+    writeVarInt (pos.column - m_last.column, m_data);
+    
+    m_last.block = block;
+    m_last.offset = offset;
+    m_last.line = pos.line;
+    m_last.column = pos.column;
+    m_last.dataPos = m_data.size();
+    
+    if (m_count++ % POSITION_CHECKPOINT_INTERVAL == 0)
+        m_checkpoints.push_back(m_last);
 }
 
 /**
- * Adds a new entry to the map.
- * @param vmPos
- * @param scPos
+ * Gets the source position of an instruction: the one of the last entry not 
+ * after it.
+ * @param block
+ * @param offset
  * @return 
  */
-bool CodeMap::add (const VmPosition& vmPos, const ScriptPosition& scPos)
+ScriptPosition PositionTable::get (int block, int offset)const
 {
-    auto it = m_sc2vm.find(scPos);
+    //Last checkpoint not after the instruction.
+    auto it = std::upper_bound (m_checkpoints.begin(), m_checkpoints.end(), 
+                                make_pair(block, offset), 
+                                [](const pair<int,int>& key, const Entry& entry) {
+                                    return !entry.isBefore(key.first, key.second);
+                                });
+    if (it == m_checkpoints.begin())
+        return ScriptPosition();
+    
+    Entry   entry = *(it - 1);
     
-    if (it == m_sc2vm.end() || vmPos < it->second)
+    while (entry.dataPos < m_data.size())
     {
-        m_sc2vm[scPos] = vmPos;
-        m_vm2sc[vmPos] = scPos;
-        return true;
+        Entry next = entry;
+        
+        decodeNext(next);
+        if (!next.isBefore(block, offset))
+            break;
+        entry = next;
     }
-    else 
-        return false;
+    
+    return ScriptPosition(entry.line, entry.column);
+}
+
+/**
+ * Decodes the entry which follows another one.
+ * @param entry     [in/out]
+ */
+void PositionTable::decodeNext (Entry& entry)const
+{
+    size_t      pos = entry.dataPos;
+    const int   blockDelta = (int)readVarUint(m_data, pos);
+    const int   offset = (int)readVarUint(m_data, pos);
+    
+    entry.offset = blockDelta == 0 ? entry.offset + offset : offset;
+    entry.block += blockDelta;
+    entry.line += readVarInt(m_data, pos);
+    entry.column += readVarInt(m_data, pos);
+    entry.dataPos = pos;
+}
+
+/**
+ * Removes all entries.
+ */
+void PositionTable::clear ()
+{
+    m_data.clear();
+    m_checkpoints.clear();
+    m_last = Entry();
+    m_count = 0;
 }
@@ -14,6 +14,7 @@
 
 #include "RefCountObj.h"
 #include <string>
+#include <vector>
 
 /**
  * Indicates a position inside a script file
@@ -122,21 +123,50 @@ struct VmPosition
 };//struct VmPosition
 
 /**
- * Maps 'VmPositions' to 'ScriptPositions'. Used to give the source location
- * of run time errors.
+ * Source positions of the instructions of a routine. 
+ * Entries are appended in code order, and only when the position changes. They 
+ * are delta encoded (variable length integers) in a byte vector. Every few 
+ * entries, a checkpoint with the full state allows a binary search. It is 
+ * only decoded to report errors.
  */
-class CodeMap
+class PositionTable
 {
 public:
-    const ScriptPosition& get(const VmPosition& vmPos)const;
-    bool add (const VmPosition& vmPos, const ScriptPosition& scPos);
+    void            add (int block, int offset, const ScriptPosition& pos);
+    ScriptPosition  get (int block, int offset)const;
+    void            clear ();
+    
+    size_t size()const
+    {
+        return m_count;
+    }
+    
+    size_t byteSize()const
+    {
+        return m_data.size() + m_checkpoints.size() * sizeof(Entry);
+    }
     
 private:
-    typedef std::map<VmPosition, ScriptPosition>    VM2SCmap;
-    typedef std::map<ScriptPosition, VmPosition>    SC2VMmap;
+    struct Entry
+    {
+        int     block = 0;
+        int     offset = 0;
+        int     line = -1;
+        int     column = -1;
+        size_t  dataPos = 0;    //Data position of the next entry.
+        
+        bool isBefore (int b, int o)const
+        {
+            return block < b || (block == b && offset <= o);
+        }
+    };
+    
+    void    decodeNext (Entry& entry)const;
     
-    VM2SCmap    m_vm2sc;
-    SC2VMmap    m_sc2vm;
+    std::vector<unsigned char>  m_data;
+    std::vector<Entry>          m_checkpoints;
+    Entry                       m_last;
+    size_t                      m_count = 0;
 };
 
 #endif	/* SCRIPTPOSITION_H */
@@ -1,471 +1,1380 @@
-/* 
+/*
  * File:   actorRuntime.cpp
  * Author: ghernan
- * 
+ *
  * Actor system runtime support.
- * 
+ *
  * Created on December 24, 2016, 11:50 AM... Merry Christmas!!!
  */
 
 #include "ascript_pch.hpp"
 #include "actorRuntime.h"
 #include "microVM.h"
+#include "ScriptException.h"
 #include "scriptMain.h"
+#include "ioActors.h"
 #include "jsArray.h"
-#include "ScriptException.h"
 
-using namespace std;
+#include <string.h>
 
-void execMessageLoop (Ref<ActorRuntime> runtime, CodeMap* pMap);
+using namespace std;
 
-ASValue    connectOperator (ExecutionContext* ec);
+static ValueVector messageParams (ExecutionContext* ec, ASValue handler, size_t first = 0);
+static size_t handlerParamCount (ASValue handler, size_t defaultCount);
+static void failReply (Ref<AsFuture> reply, Ref<AsActor> actor, const char* reason);
 
+/**
+ * Worker of the runtime which runs on the current thread. NULL on threads
+ * which are not actor runtime workers.
+ */
+static thread_local void* tl_currentWorker = NULL;
 
 /**
- * Actor class which executes a piece of MVM code at startup and then finishes.
+ * Creates an actor. It is the call function of actor classes.
+ * Constructor parameters become actor fields. The actor constructor code runs
+ * as the first message of the new actor.
+ * @param ec
+ * @return An 'AsActorRef' to the new actor.
  */
-class RoutineActor : public AsActor
+ASValue actorCreate (ExecutionContext* ec)
 {
-public:
-    /**
-     * Creates a routine actor.
-     * @param code
-     * @param globals
-     * @param parent
-     * @return 
-     */
-    static Ref<AsActorRef> create(Ref<MvmRoutine> code, 
-                                  Ref<GlobalScope> globals, 
-                                  Ref<AsActorRef> parent)
+    auto cls = actorCast<AsActorClass>(ec->getThis());
+
+    if (cls.isNull())
+        rtError ("Actor class expected");
+    if (ec->actors == NULL)
+        rtError ("Actor system not available");
+
+    auto module = mvmCurrentModule(ec);
+
+    if (module == NULL)
+        rtError ("Module globals not found creating actor '%s'", cls->getName().c_str());
+
+    auto                globals = module->snapshot();
+    auto                actor = AsActor::create(cls, globals, ref(ec->curActor));
+    auto&               params = cls->getParams();
+    ASValue::ValuesMap  transformed;
+    ValueVector         values;
+
+    for (size_t i = 0; i < params.size(); ++i)
     {
-        auto            constructor = AsEndPoint::createNative("@start", 
-                                                               StringVector(),
-                                                               routineActorExec);
-        VarMap          members;
+        auto value = ec->getParam(i).deepFreeze(transformed);
+
+        actor->writeField(params[i], value, false);
+        values.push_back(value);
+    }
+
+    ec->actors->send(actor, actor->getConstructor(), std::move(values));
 
-        members.varWrite(constructor->getName(), constructor, true);
+    return AsActorRef::create(actor)->value();
+}
+
+/**
+ * Gets the actor and the input handler which receive the messages sent to an
+ * end point. Messages sent through an output are received by the input which
+ * is connected to it.
+ * @param ec
+ * @param value     End point reference.
+ * @param pActor    [out] Receiver actor.
+ * @param pHandler  [out] Input message handler.
+ * @return false if the end point is an output which is not connected.
+ */
+static bool endPointTarget (ExecutionContext* ec, ASValue value, Ref<AsActor>* pActor, ASValue* pHandler)
+{
+    auto endPoint = actorCast<AsEndPointRef>(value);
+
+    if (endPoint.isNull())
+        rtError ("Message end point expected");
+    if (ec->actors == NULL)
+        rtError ("Actor system not available");
+
+    auto actor = endPoint->getActor();
 
-        auto            ownClass = AsActorClass::create("", members, StringVector());
-        RoutineActor*   newActor = new RoutineActor (ownClass, globals, parent);
+    if (!endPoint->isInput())
+    {
+        if (actor.getPointer() != ec->curActor)
+            rtError ("Output message '%s' can only be sent by its actor", endPoint->getName().c_str());
+
+        endPoint = actor->getConnection(endPoint->getName());
+        if (endPoint.isNull())
+            return false;
 
-        newActor->m_code = code;
-        return AsActorRef::create(refFromNew(newActor));
-        
+        actor = endPoint->getActor();
     }
 
-    /**
-     * Executes the routine actor.
-     * @param pScope
-     * @return 
-     */
-    static ASValue routineActorExec (ExecutionContext* ec)
-    {
-        auto actor = pScope->getThis().staticCast<RoutineActor>();
-        auto actorRef = AsActorRef::create(actor);
-        auto globals = ::getGlobals().staticCast<GlobalScope>();
-        
-        globals->newNotSharedVar("@curActor", actorRef, true);
-        
-        return mvmExecute(actor->m_code, globals, Ref<IScope>());
+    *pActor = actor;
+    *pHandler = actor->getHandler(endPoint->getName());
+    return true;
+}
+
+/**
+ * Call function of end point references. Sends a message to an input, or
+ * through an output, to the input which is connected to it.
+ * @param ec
+ * @return
+ */
+ASValue actorEndPointCall (ExecutionContext* ec)
+{
+    Ref<AsActor>    actor;
+    ASValue         handler;
+
+    if (endPointTarget(ec, ec->getThis(), &actor, &handler))
+        ec->actors->sendInput(ec, actor, handler, messageParams(ec, handler));
+
+    return jsNull();
+}
+
+/**
+ * Connect operator ('<-'). Connects an output message of another actor to
+ * an input message of the current actor.
+ * @param ec
+ * @return
+ */
+ASValue actorConnect (ExecutionContext* ec)
+{
+    auto input = ec->getParam(0);
+    auto src = actorCast<AsEndPointRef>(ec->getParam(1));
+
+    if (ec->curActor == NULL)
+        rtError ("Connect operator used outside an actor");
+    if (src.isNull() || src->isInput())
+        rtError ("Source is not an output message");
+
+    auto actor = ref(ec->curActor);
+    auto name = input.toString();
+
+    if (!actor->getActorClass()->isInput(name))
+        rtError ("'%s' is not an input message", name.c_str());
+
+    src->getActor()->connect(src->getName(), AsEndPointRef::create(actor, name, true));
+    return jsNull();
+}
+
+/**
+ * Default handler for 'childStopped' message. If the child actor has failed,
+ * the current actor is stopped with the same error.
+ * @param ec
+ * @return
+ */
+ASValue actorChildStoppedDefaultHandler (ExecutionContext* ec)
+{
+    auto child = actorCast<AsActorRef>(ec->getParam(0));
+    auto error = ec->getParam(2);
+
+    if (!error.isNull() && ec->curActor != NULL && ec->actors != NULL)
+    {
+        ScriptPosition  pos;
+
+        if (child.notNull())
+            pos = child->getActor()->getErrorPosition();
+
+        ec->actors->stopActor(ref(ec->curActor), jsNull(), error, pos);
     }
-    
-private:
-    RoutineActor (Ref<AsActorClass> cls, Ref<GlobalScope> globals, Ref<AsActorRef> parent) : 
-    AsActor (cls, globals, parent)
-    {        
+
+    return jsNull();
+}
+
+/**
+ * Gets the actor referenced by a script value.
+ * @param value     An actor reference, or an actor ('this' in actor code).
+ * @return
+ */
+static Ref<AsActor> actorArgument (ASValue value)
+{
+    auto actorRef = actorCast<AsActorRef>(value);
+
+    if (actorRef.notNull())
+        return actorRef->getActor();
+
+    auto actor = actorCast<AsActor>(value);
+
+    if (actor.isNull())
+        rtError ("Actor expected");
+
+    return actor;
+}
+
+/**
+ * 'Mailbox.setLimit' function. Sets the capacity of an actor mailbox, and its
+ * overflow policy: 'block', 'dropOldest', 'dropNewest' or 'fail'.
+ * @param ec
+ * @return
+ */
+ASValue actorSetMailboxLimit (ExecutionContext* ec)
+{
+    auto            actor = actorArgument(ec->getParam(0));
+    const double    capacity = ec->getParam(1).toDouble();
+    ASValue         policyParam = ec->getParam(2);
+    OverflowPolicy  policy = OVERFLOW_BLOCK;
+
+    if (!(capacity >= 0))
+        rtError ("Invalid mailbox capacity");
+
+    if (!policyParam.isNull())
+    {
+        const string name = policyParam.toString();
+
+        if (name == "block")
+            policy = OVERFLOW_BLOCK;
+        else if (name == "dropOldest")
+            policy = OVERFLOW_DROP_OLDEST;
+        else if (name == "dropNewest")
+            policy = OVERFLOW_DROP_NEWEST;
+        else if (name == "fail")
+            policy = OVERFLOW_FAIL;
+        else
+            rtError ("Unknown mailbox overflow policy: '%s'", name.c_str());
     }
-    
-    Ref<MvmRoutine>     m_code;
-};
 
+    actor->setMailboxLimit((size_t)capacity, policy);
+
+    //Blocked messages may fit with the new limit.
+    if (actor->hasBlockedSenders() && ec->actors != NULL)
+        ec->actors->deliverBlocked(actor.getPointer());
+    return jsNull();
+}
 
 /**
- * Executes a compiled actor script, and blocks the current thread until all created
- * actors have been stopped.
- * @param code
- * @param globals
- * @return pair of 'JSValue'. The first value is success, the second is error.
+ * 'Mailbox.stats' function. Gets the state of an actor mailbox.
+ * @param ec
+ * @return An object with the current number of queued messages ('depth'), its
+ * maximum value ('highWatermark'), the mailbox limits and the number of
+ * discarded messages.
  */
-pair<ASValue, ASValue > asBlockingExec(Ref<MvmRoutine> code, 
-                                                      Ref<GlobalScope> globals, 
-                                                      CodeMap* pMap)
+ASValue actorMailboxStats (ExecutionContext* ec)
 {
-    auto    rootActor = RoutineActor::create (code, globals, Ref<AsActorRef>());
-    auto    runtime = ActorRuntime::create(rootActor);
-    
-    globals->newVar("@actorRT", runtime, true);
-    addNative1("@connect", "src", connectOperator, globals);
-    
-    execMessageLoop (runtime, pMap);
-    
-    auto errVal = rootActor->getError();
-    
-    if (!errVal->isNull())
-        return make_pair (jsNull(), errVal);
-    else   
-        return make_pair (rootActor->getResult(), jsNull());
+    static const char* policyNames[] = {"block", "dropOldest", "dropNewest", "fail"};
+
+    auto    actor = actorArgument(ec->getParam(0));
+    auto    stats = JSObject::create();
+
+    stats->writeField("depth", jsDouble((double)actor->mailboxDepth()), false);
+    stats->writeField("highWatermark", jsDouble((double)actor->mailboxHighWatermark()), false);
+    stats->writeField("capacity", jsDouble((double)actor->mailboxCapacity()), false);
+    stats->writeField("policy", jsString(policyNames[actor->overflowPolicy()]), false);
+    stats->writeField("dropped", jsDouble((double)actor->droppedMessages()), false);
+
+    return stats->value();
 }
 
 /**
- * Executes the message loop, until there is no message left.
- * @param runtime
+ * Starts a timer from a 'Timer.after' or 'Timer.every' call. The parameters
+ * after the input message are the message parameters.
+ * @param ec
+ * @param periodic
+ * @return
  */
-void execMessageLoop (Ref<ActorRuntime> runtime, CodeMap* pMap)
+static ASValue startScriptTimer (ExecutionContext* ec, bool periodic)
 {
-    //TODO: This function must become more complex when taking I/O into account.
-    while (runtime->dispatchMessage(pMap));
+    const double    time = ec->getParam(0).toDouble();
+    auto            input = actorCast<AsEndPointRef>(ec->getParam(1));
+
+    if (ec->actors == NULL)
+        rtError ("Actor system not available");
+    if (!(time >= 0) || (periodic && !(time > 0)))
+        rtError ("Invalid timer %s: %g", periodic ? "period" : "delay", time);
+    if (input.isNull() || !input->isInput())
+        rtError ("Timer message shall be an actor input message");
+
+    auto actor = input->getActor();
+    auto handler = actor->getHandler(input->getName());
+
+    return ec->actors->startTimer(actor,
+                                  handler,
+                                  messageParams(ec, handler, 2),
+                                  time,
+                                  periodic ? time : 0)->value();
 }
 
 /**
- * The connect operator ('<-') establishes a connection between and output message
- * and an input message.
- * @param pScope
- * @return 
+ * 'Timer.after' function. Sends a message to an actor input after a delay, in
+ * milliseconds.
+ * @param ec
+ * @return The timer object.
  */
-ASValue connectOperator (ExecutionContext* ec)
+ASValue actorTimerAfter (ExecutionContext* ec)
 {
-    auto runtime = ActorRuntime::getRuntime(pScope);
-    auto src = ec->getParam("src");
-    auto dst = pScope->getThis();
-    
-    if (src->getType() != VT_OUTPUT_EP_REF)
-        rtError ("Source is not an output message");
-    
-    if (dst->getType() != VT_INPUT_EP_REF)
-        rtError ("Destination is not an input message");
-    
-//    runtime.staticCast<ActorRuntime>()->connectMessages(
-//        dst.staticCast<AsMessageRef>(), src.staticCast<AsMessageRef>());
-    
-    const auto srcActorRef = src.staticCast<AsEndPointRef>()->getActor();
-    
-    if (!srcActorRef->isRunning())
-        return jsNull();
-    
-    const auto srcActor = srcActorRef->getActor();
-    const auto msgName = src.staticCast<AsEndPointRef>()->getEndPoint()->getName();
-    
-    srcActor->setOutputConnection (msgName, dst.staticCast<AsEndPointRef>());
-    
-    return jsNull();    
+    return startScriptTimer (ec, false);
 }
 
 /**
- * Handles calls to input endpoints, which are executed as message sends
- * @param endPoint
- * @param scope
- * @return 
+ * 'Timer.every' function. Sends a message to an actor input periodically. The
+ * period is in milliseconds.
+ * @param ec
+ * @return The timer object.
  */
-ASValue inputEpCall(Ref<AsEndPointRef> endPoint, Ref<FunctionScope> scope)
+ASValue actorTimerEvery (ExecutionContext* ec)
 {
-    auto runtime = ActorRuntime::getRuntime(scope.getPointer());
-    auto params = scope->get("arguments").staticCast<JSArray>();
-    
-    runtime->sendMessage (endPoint, params);
+    return startScriptTimer (ec, true);
+}
+
+/**
+ * Handler of 'Timer.delay' timers. Completes the future.
+ * @param ec
+ * @return
+ */
+static ASValue timerDelayHandler (ExecutionContext* ec)
+{
+    auto future = actorCast<AsFuture>(ec->getParam(0));
+
+    if (future.notNull())
+        future->complete(jsNull(), jsNull());
+
     return jsNull();
 }
 
 /**
- * Handles calls to output endpoints. It looks for the connected input end point,
- * and sends a message to it.
- * 
- * @param endPoint
- * @param scope
- * @return 
+ * 'Timer.delay' function. Used with 'Future.await' to wait for some time.
+ * @param ec
+ * @return A future completed after a delay, in milliseconds.
  */
-ASValue outputEpCall(Ref<AsEndPointRef> endPoint, Ref<FunctionScope> scope)
+ASValue actorTimerDelay (ExecutionContext* ec)
 {
-    //TODO: Check that it is invoked from the owning actor.
-    auto actor = endPoint->getActor()->getActor();
-    auto destination = actor->getConnectedEp(endPoint->getEndPoint()->getName());
-    
-    if (destination.isNull())
-        return jsNull();
+    static auto     fn = JSFunction::createNative("@timerDelay", StringVector(1, "future"), timerDelayHandler);
+    const double    time = ec->getParam(0).toDouble();
+    auto            future = AsFuture::create();
+
+    if (ec->actors == NULL || ec->curActor == NULL)
+        rtError ("'Timer.delay' can only be used in actors");
+    if (!(time >= 0))
+        rtError ("Invalid timer delay: %g", time);
+
+    ec->actors->startTimer(ref(ec->curActor), fn->value(), ValueVector(1, future->value()), time, 0);
+    return future->value();
+}
+
+/**
+ * 'Timer.cancel' function.
+ * @param ec
+ * @return true if the timer was pending. Messages already sent by the timer
+ * are not cancelled.
+ */
+ASValue actorTimerCancel (ExecutionContext* ec)
+{
+    auto timer = actorCast<AsTimer>(ec->getParam(0));
+
+    if (timer.isNull())
+        rtError ("Timer expected");
+    if (ec->actors == NULL)
+        rtError ("Actor system not available");
+
+    return jsBool(ec->actors->cancelTimer(timer));
+}
+
+/**
+ * 'Future.request' function. Sends a request message to an input, or through
+ * an output. The parameters after the message are the message parameters.
+ * @param ec
+ * @return A future, completed with the value returned by the input handler.
+ */
+ASValue actorFutureRequest (ExecutionContext* ec)
+{
+    Ref<AsActor>    actor;
+    ASValue         handler;
+    auto            reply = AsFuture::create();
+
+    if (endPointTarget(ec, ec->getParam(0), &actor, &handler))
+        ec->actors->sendInput(ec, actor, handler, messageParams(ec, handler, 1), reply);
     else
-        return inputEpCall(destination, scope);    
+        reply->complete(jsNull(), jsString("Output message is not connected"));
+
+    return reply->value();
 }
 
 /**
- * Handles actor constructors calls
- * @param actorClass
- * @param scope
- * @return 
- */
-ASValue actorConstructor(Ref<AsActorClass> actorClass, Ref<FunctionScope> scope)
-{
-    auto curGlobals = ::getGlobals().staticCast<GlobalScope>();
-    auto newGlobals = curGlobals->share();
-    auto runtime = ActorRuntime::getRuntime(scope.getPointer());
-    auto curActor = curGlobals->get("@curActor").staticCast<AsActorRef>();
-    auto newActor = AsActor::create(actorClass, newGlobals, curActor);
-    auto actorRef = AsActorRef::create(newActor);
-    auto constructor = actorClass->getConstructor();
-    auto params = constructor->getParams();
-    auto msgParams = JSArray::create();
-    
-    //Set the new current actor at the new global scope.
-    newGlobals->newNotSharedVar("@curActor", actorRef, true);
-    
-    //Parameters become actor fields, and parameters for 'start' message
-    for (size_t i=0; i<params.size(); ++i)
+ * 'Future.then' function. When the future is completed, sends its value and
+ * error to an actor input, followed by the parameters after the input message.
+ * @param ec
+ * @return
+ */
+ASValue actorFutureThen (ExecutionContext* ec)
+{
+    auto                future = actorCast<AsFuture>(ec->getParam(0));
+    auto                input = actorCast<AsEndPointRef>(ec->getParam(1));
+    ActorRuntime* const runtime = ec->actors;
+    const size_t        nArgs = ec->frames.back().numParams;
+    ASValue::ValuesMap  transformed;
+    ValueVector         extra;
+
+    if (future.isNull())
+        rtError ("Future expected");
+    if (runtime == NULL)
+        rtError ("Actor system not available");
+    if (input.isNull() || !input->isInput())
+        rtError ("Future continuation shall be an actor input message");
+
+    for (size_t i = 2; i < nArgs; ++i)
+        extra.push_back(ec->getParam(i).deepFreeze(transformed));
+
+    auto actor = input->getActor();
+    auto handler = actor->getHandler(input->getName());
+
+    future->then([runtime, actor, handler, extra](ASValue value, ASValue error)
+    {
+        ValueVector params;
+
+        params.push_back(value);
+        params.push_back(error);
+        params.insert(params.end(), extra.begin(), extra.end());
+        params.resize(handlerParamCount(handler, params.size()));
+
+        runtime->sendInput(NULL, actor, handler, std::move(params));
+    });
+
+    return jsNull();
+}
+
+/**
+ * 'Future.await' function. Suspends the current message handler until the
+ * future is completed, without blocking the worker thread. The actor handles
+ * other messages meanwhile.
+ * It can only be used from script functions called by the handler, not from
+ * functions called by native code.
+ * @param ec
+ * @return The value of the future. Its error is raised as a runtime error.
+ */
+ASValue actorFutureAwait (ExecutionContext* ec)
+{
+    auto    future = actorCast<AsFuture>(ec->getParam(0));
+    ASValue value;
+    ASValue error;
+
+    if (future.isNull())
+        rtError ("Future expected");
+    if (ec->actors == NULL || ec->curActor == NULL)
+        rtError ("'Future.await' can only be used in actor message handlers");
+
+    if (!future->getResult(&value, &error))
+        mvmSuspend(ec, future);
+    else if (!error.isNull())
+        rtError ("%s", error.toString().c_str());
+
+    return value;
+}
+
+/**
+ * 'Future.all' function. Combines an array of futures.
+ * @param ec
+ * @return A future completed with the array of their values, when all of them
+ * are completed, or with the first error.
+ */
+ASValue actorFutureAll (ExecutionContext* ec)
+{
+    struct State
+    {
+        std::mutex      mutex;
+        ValueVector     values;
+        size_t          remaining;
+        Ref<AsFuture>   result;
+    };
+
+    auto                    array = actorCast<JSArray>(ec->getParam(0));
+    auto                    result = AsFuture::create();
+    std::shared_ptr<State>  state = std::make_shared<State>();
+
+    if (array.isNull())
+        rtError ("Array of futures expected");
+
+    const size_t    count = array->length();
+
+    for (size_t i = 0; i < count; ++i)
     {
-        auto value = scope->getParam(params[i]);
-        newActor->writeField(params[i], value, false);
-        msgParams->push(value);
+        if (actorCast<AsFuture>(array->getAt(i)).isNull())
+            rtError ("Future expected at index %d", (int)i);
     }
-    
-    //Send start message
-    runtime->sendMessage(actorRef, "@start", msgParams);
-    
-    return actorRef;
+
+    state->values.resize(count);
+    state->remaining = count;
+    state->result = result;
+
+    if (count == 0)
+        result->complete(JSArray::create()->value().deepFreeze(), jsNull());
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        actorCast<AsFuture>(array->getAt(i))->then([state, i](ASValue value, ASValue error)
+        {
+            if (!error.isNull())
+            {
+                state->result->complete(jsNull(), error);
+                return;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(state->mutex);
+
+                state->values[i] = value;
+                if (--state->remaining > 0)
+                    return;
+            }
+
+            state->result->complete(JSArray::fromVector(state->values)->value().deepFreeze(), jsNull());
+        });
+    }
+
+    return result->value();
 }
 
 /**
- * Default handler for 'childStopped' message.
- * @param pScope
- * @return 
+ * Registers the actor system functions which are visible from script code.
+ * @param scope
  */
-ASValue actorChildStoppedDefaultHandler(ExecutionContext* ec)
+void registerActorFunctions (Ref<JSObject> scope)
 {
-    auto actor = pScope->getThis().staticCast<AsActor>();
-    auto actorRef = AsActorRef::create(actor);
-    auto runtime = ActorRuntime::getRuntime(pScope);
-    
-    auto result = ec->getParam("result");
-    auto errVal = ec->getParam("error");
-    
-    runtime->stopActor(actorRef, result, errVal);
+    addNative("function Mailbox.setLimit(target, capacity, policy)", actorSetMailboxLimit, scope);
+    addNative("function Mailbox.stats(target)", actorMailboxStats, scope);
+    addNative("function Timer.after(delay, message)", actorTimerAfter, scope);
+    addNative("function Timer.every(period, message)", actorTimerEvery, scope);
+    addNative("function Timer.cancel(timer)", actorTimerCancel, scope);
+    addNative("function Timer.delay(delay)", actorTimerDelay, scope);
+    addNative("function Future.request(message)", actorFutureRequest, scope);
+    addNative("function Future.then(future, message)", actorFutureThen, scope);
+    addNative("function Future.all(futures)", actorFutureAll, scope);
+    addNative("function Future.await(future)", actorFutureAwait, scope);
 
-    return jsNull();
+    registerIoActors(scope);
 }
 
 /**
- * Creates the actor runtime.
- * @param rootActor
- * @return 
+ * Gets the parameters of a message from the current native call frame. They
+ * are deep-frozen, and adjusted to the number of parameters of the handler.
+ * Values which are already deep-frozen are not copied.
+ * @param ec
+ * @param handler
+ * @param first     Index of the first native call parameter which is a message
+ * parameter.
+ * @return
  */
-Ref<ActorRuntime> ActorRuntime::create(Ref<AsActorRef> rootActor)
+static ValueVector messageParams (ExecutionContext* ec, ASValue handler, size_t first)
 {
-    auto result = refFromNew(new ActorRuntime(rootActor));
-    
-//    result = deepFreeze(result).staticCast<ActorRuntime>();
-//    
-    result->sendMessage0 (rootActor, "@start");    
-    
-    return result;
+    const size_t        nArgs = ec->frames.back().numParams;
+    const size_t        n = handlerParamCount(handler, nArgs - min(first, nArgs));
+    ASValue::ValuesMap  transformed;
+    ValueVector         params;
+
+    for (size_t i = 0; i < n; ++i)
+        params.push_back(ec->getParam(i + first).deepFreeze(transformed));
+
+    return params;
 }
 
 /**
- * Obtains the actor runtime from a function scope
- * @param fnScope
- * @return 
+ * Gets the number of parameters of a message handler.
+ * @param handler
+ * @param defaultCount  Returned if the handler is not a function.
+ * @return
  */
-Ref<ActorRuntime> ActorRuntime::getRuntime(FunctionScope* fnScope)
+static size_t handlerParamCount (ASValue handler, size_t defaultCount)
 {
-    auto runtime = ::getGlobals()->get("@actorRT");
-    
-    if (!runtime->isObject())
-        rtError ("Missing actor runtime");
+    Ref<JSFunction>     function;
+
+    if (handler.getType() == VT_CLOSURE)
+        function = handler.staticCast<JSClosure>()->getFunction();
+    else if (handler.getType() == VT_FUNCTION)
+        function = handler.staticCast<JSFunction>();
 
-    return runtime.staticCast<ActorRuntime>();
+    return function.notNull() ? function->getParams().size() : defaultCount;
 }
 
 /**
- * Sends a message with no parameters.
- * @param dstActor
- * @param epName
+ * Completes with an error the reply of a request message which is not
+ * processed.
+ * @param reply
+ * @param actor     Receiver actor.
+ * @param reason
  */
-void ActorRuntime::sendMessage0 (Ref<AsActorRef> dstActor, const std::string& epName)
+static void failReply (Ref<AsFuture> reply, Ref<AsActor> actor, const char* reason)
 {
-    auto params = JSArray::create();
+    const string message = "Actor '" + actor->getActorClass()->getName() + "' " + reason;
 
-    sendMessage(dstActor, epName, params);
+    reply->complete(jsNull(), jsString(message));
 }
 
 /**
- * Sends a message with one parameter.
- * @param dstActor
- * @param epName
- * @param p1
+ * Creates an actor runtime.
+ * @param modulePath    Path of the module which starts the actor system.
+ * @param modules       Modules table, shared by all actors.
+ * @param nThreads      Number of worker threads. If zero, one per hardware
+ * thread.
+ * @param drainQuota    Maximum number of messages of an actor processed each
+ * time it is run. Higher values improve throughput; lower values, fairness.
+ * @return
  */
-void ActorRuntime::sendMessage1 (Ref<AsActorRef> dstActor, 
-                                 const std::string& epName, 
-                                 ASValue p1)
+Ref<ActorRuntime> ActorRuntime::create (const std::string& modulePath,
+                                        Modules* modules,
+                                        int nThreads,
+                                        size_t drainQuota)
 {
-    auto params = JSArray::create();
-    
-    params->push(p1);
+    if (nThreads <= 0)
+        nThreads = max (1, (int)std::thread::hardware_concurrency());
 
-    sendMessage(dstActor, epName, params);
+    return refFromNew (new ActorRuntime(modulePath, modules, nThreads, max(drainQuota, size_t(1))));
+}
+
+ActorRuntime::ActorRuntime (const std::string& modulePath, Modules* modules, int nThreads, size_t drainQuota)
+: m_modulePath(modulePath), m_modules(modules), m_nThreads(nThreads), m_drainQuota(drainQuota),
+m_queued(0), m_pending(0),
+m_startTime(Clock::now()), m_timerCount(0), m_nextWake(UINT64_MAX),
+m_ioCount(0)
+{
+    for (int i = 0; i < nThreads; ++i)
+    {
+        m_workers.push_back(std::unique_ptr<Worker>(new Worker));
+        m_workers.back()->runtime = this;
+        m_workers.back()->index = i;
+    }
 }
 
 /**
- * Sends a message with two parameters.
- * @param dstActor
- * @param epName
- * @param p1
- * @param p2
+ * Stops the I/O reactor and the file I/O service, and releases the timers
+ * which have not expired.
  */
-void ActorRuntime::sendMessage2 (Ref<AsActorRef> dstActor, 
-                                 const std::string& epName, 
-                                 ASValue p1,
-                                 ASValue p2)
+ActorRuntime::~ActorRuntime ()
 {
-    auto params = JSArray::create();
-    
-    params->push(p1);
-    params->push(p2);
+    std::vector<TimerEntry*>    timers;
+
+    m_reactor.reset();
+    m_fileIo.reset();
 
-    sendMessage(dstActor, epName, params);
+    m_timers.clear(&timers);
+    for (auto it = timers.begin(); it != timers.end(); ++it)
+        static_cast<AsTimer*>(*it)->release();
 }
 
 /**
- * Sends a message with three parameters.
- * @param dstActor
- * @param epName
- * @param p1
- * @param p2
- * @param p3
+ * Sends a message to an actor. Messages sent to stopped actors, or to inputs
+ * which do not exist, are discarded.
+ * These messages are not limited by the mailbox capacity; it is used for the
+ * messages sent by the runtime (actor construction, 'childStopped'...).
+ * Parameters are deep-frozen, so they are passed by reference: the receiver
+ * shares them with the sender, without copying.
+ * @param actor
+ * @param handler   Input message handler.
+ * @param params    Message parameters. They shall be deep-frozen.
  */
-void ActorRuntime::sendMessage3 (Ref<AsActorRef> dstActor, 
-                                 const std::string& epName, 
-                                 ASValue p1,
-                                 ASValue p2,
-                                 ASValue p3)
+void ActorRuntime::send (Ref<AsActor> actor, ASValue handler, ValueVector params)
 {
-    auto params = JSArray::create();
-    
-    params->push(p1);
-    params->push(p2);
-    params->push(p3);
+    if (!actor->isRunning() || handler.isNull())
+        return;
+
+    ActorMessage    msg;
 
-    sendMessage(dstActor, epName, params);
+    msg.handler = std::move(handler);
+    msg.params = std::move(params);
+
+    actor->reserve(false);
+    post (actor, std::move(msg));
 }
 
 /**
- * 'sendMessage' version which looks up for the message name
- * @param dstActor
- * @param epName
- * @param params
+ * Sends a message from script code to an actor input. The overflow policy of
+ * the receiver mailbox is applied when it is full.
+ * With the 'block' policy, the message handler which sends the message is
+ * suspended until it is placed in the mailbox. Senders which cannot be 
+ * suspended (the main script, timers, or code called by native functions) go
+ * on, and their messages wait out of the mailbox until it has room.
+ * @param ec        Execution context of the sender. NULL for messages sent by
+ * timers, which are discarded instead of failing.
+ * @param actor
+ * @param handler   Input message handler.
+ * @param params    Message parameters. They shall be deep-frozen.
+ * @param reply     Future completed with the result of the handler, for request
+ * messages. If the message is discarded, it is completed with an error.
  */
-void ActorRuntime::sendMessage (Ref<AsActorRef> dstActor, 
-                                const std::string& epName, 
-                                Ref<JSArray> params)
+void ActorRuntime::sendInput (ExecutionContext* ec,
+                              Ref<AsActor> actor,
+                              ASValue handler,
+                              ValueVector params,
+                              Ref<AsFuture> reply)
 {
-    auto ep = dstActor->getEndPoint(epName);
-    
-    if (ep.isNull())
-        rtError ("End point '%s' does not exist", epName.c_str());
-    else
-        sendMessage (ep, params);
+    if (!actor->isRunning() || handler.isNull())
+    {
+        if (reply.notNull())
+            failReply(reply, actor, "is not running");
+        return;
+    }
+
+    const OverflowPolicy    policy = actor->overflowPolicy();
+    ActorMessage            msg;
+
+    msg.handler = std::move(handler);
+    msg.params = std::move(params);
+    msg.bounded = true;
+    msg.reply = std::move(reply);
+
+    if (policy == OVERFLOW_BLOCK)
+    {
+        if (actor->hasBlockedSenders() || !actor->reserve(true))
+            blockSender(ec, actor, std::move(msg));
+        else
+            post (actor, std::move(msg));
+        return;
+    }
+
+    if (actor->reserve(true))
+    {
+        post (actor, std::move(msg));
+        return;
+    }
+
+    if (policy == OVERFLOW_DROP_OLDEST)
+    {
+        ActorMessage    evicted;
+
+        if (actor->replaceOldest(msg, &evicted))
+            msg = std::move(evicted);
+    }
+    else if (policy == OVERFLOW_FAIL && ec != NULL)
+        rtError ("Mailbox of actor '%s' is full", actor->getActorClass()->getName().c_str());
+
+    actor->messageDropped();
+    if (msg.reply.notNull())
+        failReply(msg.reply, actor, "has discarded the message");
 }
 
 /**
- * Sends a message to an actor, through one of its input endpoints
- * @param dstEndPoint
- * @param params
+ * Holds a message sent to a full mailbox with the 'block' policy, until the
+ * mailbox has room. The sender message handler is suspended meanwhile, if 
+ * possible. The actor keeps handling its other messages, so actors which 
+ * block each other do not deadlock.
+ * @param ec        Execution context of the sender. May be NULL.
+ * @param actor     Receiver actor.
+ * @param msg
  */
-void ActorRuntime::sendMessage (Ref<AsEndPointRef> dstEndPoint, Ref<JSArray> params)
+void ActorRuntime::blockSender (ExecutionContext* ec, Ref<AsActor> actor, ActorMessage&& msg)
 {
-    if (dstEndPoint->getType() != VT_INPUT_EP_REF)
-        rtError ("Destination is not an input end point");
+    BlockedMessage  blocked;
     
-    m_messageQueue.push_back(SMessage(dstEndPoint, params));
+    if (ec != NULL && ec->curActor != NULL && mvmCanSuspend(ec))
+        blocked.delivered = AsFuture::create();
+
+    auto    delivered = blocked.delivered;
+    ASValue value;
+    ASValue error;
+
+    blocked.msg = std::move(msg);
+    actor->block(std::move(blocked));
+    deliverBlocked(actor.getPointer());
+
+    if (delivered.notNull() && !delivered->getResult(&value, &error))
+        mvmSuspend(ec, delivered);
+}
+
+/**
+ * Moves the blocked messages of an actor to its mailbox while it has room, 
+ * and resumes their senders.
+ * @param actor
+ */
+void ActorRuntime::deliverBlocked (AsActor* actor)
+{
+    typedef std::pair< Ref<AsFuture>, ASValue > Resumption;
+
+    Ref<AsActor>            target = ref(actor);
+    std::vector<Resumption> senders;
+
+    actor->deliverBlocked([this, &target, &senders](BlockedMessage& blocked)
+    {
+        //Senders resume with the value returned by the send function.
+        if (blocked.delivered.notNull())
+        {
+            auto reply = blocked.msg.reply;
+
+            senders.push_back(Resumption(blocked.delivered, reply.notNull() ? reply->value() : jsNull()));
+        }
+
+        post (target, std::move(blocked.msg));
+    });
+
+    for (auto it = senders.begin(); it != senders.end(); ++it)
+        it->first->complete(it->second, jsNull());
 }
 
 /**
- * Stops an actor execution
- * @param actorRef
- * @param value
+ * Stops an actor, and notifies its parent. Errors of the actors without
+ * parent are recorded as the error of the actor system.
+ * @param actor
+ * @param result
  * @param error
+ * @param errorPos
  */
-void ActorRuntime::stopActor (Ref<AsActorRef> actorRef, ASValue value, ASValue error)
+void ActorRuntime::stopActor (Ref<AsActor> actor, ASValue result, ASValue error, const ScriptPosition& errorPos)
 {
-    auto actor = actorRef->getActor();
-    
-    actor->stop(value, error);
+    if (!actor->isRunning())
+        return;
+
+    actor->stop(result, error, errorPos);
 
     auto parent = actor->getParent();
-    
+
     if (parent.notNull())
-        sendMessage3 (parent, "childStopped", actorRef, value, error);
+    {
+        ASValue::ValuesMap  transformed;
+        ValueVector         params;
+
+        params.push_back(AsActorRef::create(actor)->value());
+        params.push_back(result.deepFreeze(transformed));
+        params.push_back(error.deepFreeze(transformed));
+
+        send (parent, parent->getHandler("childStopped"), std::move(params));
+    }
+    else if (!error.isNull())
+    {
+        std::lock_guard<std::mutex> lock(m_errorMutex);
+
+        if (!m_failed)
+        {
+            m_failed = true;
+            m_errorMessage = error.toString();
+            m_errorPosition = errorPos;
+        }
+    }
+}
+
+/**
+ * Starts a timer which sends a message to an actor input.
+ * @param actor
+ * @param handler   Input message handler.
+ * @param params    Message parameters. They shall be deep-frozen.
+ * @param delay     Milliseconds until the first message.
+ * @param period    Milliseconds between messages. Zero for one-shot timers.
+ * @return
+ */
+Ref<AsTimer> ActorRuntime::startTimer (Ref<AsActor> actor,
+                                       ASValue handler,
+                                       ValueVector params,
+                                       double delay,
+                                       double period)
+{
+    const uint64_t  periodTicks = period > 0 ? max ((uint64_t)period, uint64_t(1)) : 0;
+    auto            timer = AsTimer::create(actor, handler, params, periodTicks);
+    const uint64_t  expires = currentTick() + (uint64_t)delay;
+
+    {
+        std::lock_guard<std::mutex> lock(m_timerMutex);
+
+        timer->expires = expires;
+        timer->addref();
+        m_timers.insert(timer.getPointer());
+        m_timerCount = m_timers.size();
+    }
+
+    //Wakes up the thread which expires timers, if it is waiting for a later tick.
+    if (expires < m_nextWake)
+    {
+        std::lock_guard<std::mutex> lock(m_idleMutex);
+
+        if (expires < m_nextWake)
+            m_quiescent.notify_all();
+    }
+
+    return timer;
 }
 
 /**
- * Dispatch next message in the queue.
- * @return true if a message has been processed, false if the message queue is 
- * empty.
+ * Cancels a timer.
+ * @param timer
+ * @return false if the timer had already expired or been cancelled.
  */
-bool ActorRuntime::dispatchMessage(CodeMap* pMap)
+bool ActorRuntime::cancelTimer (Ref<AsTimer> timer)
 {
-    if (m_messageQueue.empty())
+    std::lock_guard<std::mutex> lock(m_timerMutex);
+
+    if (timer->isCancelled())
         return false;
-    
-    SMessage    msg = m_messageQueue.front();
-    auto        actorRef = msg.destination->getActor();
 
-    m_messageQueue.pop_front();
-    
-    if (actorRef->isRunning())
+    timer->cancel();
+    if (!m_timers.remove(timer.getPointer()))
+        return timer->getPeriod() > 0;     //Periodic timer being expired.
+
+    timer->release();
+    m_timerCount = m_timers.size();
+    return true;
+}
+
+/**
+ * Sends a message through an output of an actor, to the input connected to
+ * it. Used by actors implemented in native code. The message is discarded if
+ * the output is not connected.
+ * @param actor
+ * @param output    Output message name.
+ * @param params    Message parameters. They shall be deep-frozen. They are
+ * adjusted to the number of parameters of the input.
+ */
+void ActorRuntime::sendOutput (Ref<AsActor> actor, const std::string& output, ValueVector params)
+{
+    auto endPoint = actor->getConnection(output);
+
+    if (endPoint.isNull())
+        return;
+
+    auto target = endPoint->getActor();
+    auto handler = target->getHandler(endPoint->getName());
+
+    params.resize(handlerParamCount(handler, params.size()));
+    sendInput(NULL, target, handler, std::move(params));
+}
+
+/**
+ * Gets the I/O reactor. It is created on first use.
+ * @return
+ */
+IoReactor* ActorRuntime::reactor ()
+{
+    std::call_once (m_reactorCreated, [this]()
+    {
+        m_reactor.reset(new IoReactor);
+    });
+
+    return m_reactor.get();
+}
+
+/**
+ * Gets the file I/O service. It is created on first use. It uses 'io_uring',
+ * unless it is not available or the 'ASCRIPT_FILE_IO' environment variable is
+ * set to 'threads'.
+ * @return
+ */
+FileIoService* ActorRuntime::fileIo ()
+{
+    std::call_once (m_fileIoCreated, [this]()
+    {
+        const char* backend = getenv("ASCRIPT_FILE_IO");
+
+        m_fileIo.reset(FileIoService::create(backend == NULL || strcmp(backend, "threads") != 0));
+    });
+
+    return m_fileIo.get();
+}
+
+/**
+ * Called when an I/O object starts. The actor system keeps running while
+ * there are active I/O objects.
+ */
+void ActorRuntime::ioStarted ()
+{
+    ++m_ioCount;
+}
+
+/**
+ * Called when an I/O object finishes.
+ */
+void ActorRuntime::ioFinished ()
+{
+    if (--m_ioCount == 0)
+    {
+        std::lock_guard<std::mutex> lock(m_idleMutex);
+        m_quiescent.notify_all();
+    }
+}
+
+/**
+ * Runs the actor system on the worker threads, until there are no messages,
+ * timers nor active I/O objects left. Blocks the calling thread, which expires the timers.
+ */
+void ActorRuntime::run ()
+{
+    if (m_pending == 0 && m_timerCount == 0 && m_ioCount == 0)
+        return;
+
+    m_stopping = false;
+    for (auto it = m_workers.begin(); it != m_workers.end(); ++it)
+    {
+        Worker* worker = it->get();
+        worker->thread = std::thread([this, worker]() {
+            workerLoop(worker);
+        });
+    }
+
     {
-        auto actor = actorRef->getActor();
-        auto globals = actor->getGlobals();
-        GlobalsSetter   g(globals);
-        
-        try
+        std::unique_lock<std::mutex>    lock(m_idleMutex);
+
+        while (m_pending > 0 || m_timerCount > 0 || m_ioCount > 0)
         {
-            try
+            if (m_timerCount == 0)
             {
-                auto endPoint = msg.destination->getEndPoint();
-                auto scope = FunctionScope::create(endPoint, actor, msg.params);
-
-                if (endPoint->isNative())
-                    endPoint->nativePtr()(scope.getPointer());
-                else
-                {
-                    auto routine = endPoint->getCodeMVM().staticCast<MvmRoutine>();
-                    mvmExecute (routine, globals, scope);
-                }
+                m_nextWake = UINT64_MAX;
+                m_quiescent.wait(lock);
             }
-            catch (RuntimeError& ex)
+            else
             {
-                ScriptPosition scPos;
+                uint64_t    next;
+                {
+                    std::lock_guard<std::mutex> timerLock(m_timerMutex);
+                    next = m_timers.nextTick();
+                }
+                
+                m_nextWake = next;
+                m_quiescent.wait_until(lock, m_startTime + std::chrono::milliseconds(next));
 
-                if (pMap != NULL)
-                    scPos = pMap->get(ex.Position);
-                errorAt(scPos, "%s", ex.what());
+                //Timers started from now on notify this thread.
+                m_nextWake = 0;
+                lock.unlock();
+                expireTimers();
+                lock.lock();
             }
         }
-        catch (std::exception& ex)
+        m_stopping = true;
+    }
+    m_workAvailable.notify_all();
+
+    for (auto it = m_workers.begin(); it != m_workers.end(); ++it)
+        (*it)->thread.join();
+}
+
+/**
+ * Gets the error of the first failed actor without parent.
+ * @param pMessage  [out]
+ * @param pPosition [out]
+ * @return false if no actor has failed.
+ */
+bool ActorRuntime::getError (std::string* pMessage, ScriptPosition* pPosition)const
+{
+    std::lock_guard<std::mutex> lock(m_errorMutex);
+
+    if (m_failed)
+    {
+        *pMessage = m_errorMessage;
+        *pPosition = m_errorPosition;
+    }
+    return m_failed;
+}
+
+/**
+ * Places an actor in a run queue. Workers place actors in their own queue;
+ * other threads use the injection queue.
+ * @param actor
+ */
+void ActorRuntime::schedule (Ref<AsActor> actor)
+{
+    Worker* worker = (Worker*)tl_currentWorker;
+
+    if (worker != NULL && worker->runtime == this)
+    {
+        std::lock_guard<std::mutex> lock(worker->mutex);
+        worker->queue.push_back(actor);
+    }
+    else
+    {
+        std::lock_guard<std::mutex> lock(m_injectedMutex);
+        m_injected.push_back(actor);
+    }
+
+    //Wake up an idle worker. The lock prevents missing the notification
+    //if the worker is about to wait.
+    {
+        std::lock_guard<std::mutex> lock(m_idleMutex);
+        ++m_queued;
+    }
+    m_workAvailable.notify_one();
+}
+
+/**
+ * Main loop of worker threads.
+ * @param worker
+ */
+void ActorRuntime::workerLoop (Worker* worker)
+{
+    ExecutionContext    ec (m_modulePath, m_modules);
+
+    ec.actors = this;
+    tl_currentWorker = worker;
+
+    for (;;)
+    {
+        Ref<AsActor>    actor;
+
+        if (nextActor(worker, &actor))
+            runActor(actor, &ec);
+        else
         {
-            actorCrashed (actorRef, ex.what());
-        }        
+            std::unique_lock<std::mutex>    lock(m_idleMutex);
+
+            m_workAvailable.wait(lock, [this]() {
+                return m_stopping || m_queued > 0;
+            });
+            if (m_stopping)
+                break;
+        }
     }
-    
+
+    tl_currentWorker = NULL;
+}
+
+/**
+ * Gets the next actor to run: the oldest one in the worker queue, or in the
+ * injection queue. Otherwise, it steals the newest actor from the queue of
+ * another worker.
+ * @param worker
+ * @param pActor    [out]
+ * @return false if there are no actors to run.
+ */
+bool ActorRuntime::nextActor (Worker* worker, Ref<AsActor>* pActor)
+{
+    if (tryPop(worker, pActor))
+        return true;
+
+    {
+        std::lock_guard<std::mutex> lock(m_injectedMutex);
+
+        if (!m_injected.empty())
+        {
+            *pActor = m_injected.front();
+            m_injected.pop_front();
+            --m_queued;
+            return true;
+        }
+    }
+
+    const size_t n = m_workers.size();
+
+    for (size_t i = 1; i < n; ++i)
+    {
+        Worker*                     victim = m_workers[(worker->index + i) % n].get();
+        std::lock_guard<std::mutex> lock(victim->mutex);
+
+        if (!victim->queue.empty())
+        {
+            *pActor = victim->queue.back();
+            victim->queue.pop_back();
+            --m_queued;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Takes the oldest actor of the worker own queue.
+ * @param worker
+ * @param pActor    [out]
+ * @return false if the queue is empty.
+ */
+bool ActorRuntime::tryPop (Worker* worker, Ref<AsActor>* pActor)
+{
+    std::lock_guard<std::mutex> lock(worker->mutex);
+
+    if (worker->queue.empty())
+        return false;
+
+    *pActor = worker->queue.front();
+    worker->queue.pop_front();
+    --m_queued;
     return true;
 }
 
 /**
- * Handles exceptions inside actors.
- * @param actorRef
- * @param ex
+ * Processes the messages of a scheduled actor, up to the drain quota. The 
+ * actor is scheduled again if it has more messages, so other actors are not
+ * starved.
+ * @param actor
+ * @param ec
  */
-void ActorRuntime::actorCrashed(Ref<AsActorRef> actorRef, const char* msg)
+void ActorRuntime::runActor (Ref<AsActor> actor, ExecutionContext* ec)
 {
-    auto actor = actorRef->getActor();
+    size_t  processed = 0;
+    
+    ec->curActor = actor.getPointer();
     
-    this->stopActor(actorRef, jsNull(), jsString(msg));
+    do
+    {
+        ActorMessage    msg;
 
-    //TODO: Better error logging
-    if (actor->getParent().notNull())
-        fprintf (stderr, "Actor crashed: %s\n", msg);
-    else
-        fprintf (stderr, "Root actor crashed: %s\n", msg);
+        actor->dequeue(&msg);
+        if (actor->hasBlockedSenders())
+            deliverBlocked(actor.getPointer());
+
+        if (actor->isRunning())
+            dispatch(actor, msg, ec);
+        else if (msg.reply.notNull())
+            failReply(msg.reply, actor, "is not running");
+    } while (++processed < m_drainQuota && actor->hasMessages(processed));
+    
+    ec->curActor = NULL;
+    messagesDone(processed);
+
+    if (actor->endRun(processed))
+        schedule(actor);
 }
 
-Ref<JSObject> ActorRuntime::clone (bool _mutable)
+/**
+ * Executes the handler of a message. Errors stop the actor.
+ * @param actor
+ * @param msg     Its parameters are moved to the stack.
+ * @param ec
+ */
+void ActorRuntime::dispatch (Ref<AsActor> actor, ActorMessage& msg, ExecutionContext* ec)
 {
-    ASSERT (!"clone operation not allowed on 'ActorRuntime'");
-    return Ref<JSObject>(this);
+    ASValue result;
+    ASValue error;
+
+    ec->suspendable = true;
+    try
+    {
+        if (msg.resume.notNull())
+        {
+            msg.resume->restore(ec);
+            if (!msg.params[1].isNull())
+                rtError ("%s", msg.params[1].toString().c_str());
+
+            result = mvmResume(ec, msg.params[0]);
+        }
+        else
+        {
+            for (auto it = msg.params.begin(); it != msg.params.end(); ++it)
+                ec->push(std::move(*it));
+            ec->push(msg.handler);
+            ec->setThisParam(actor->value());
+
+            mvmExecCall((int)msg.params.size(), ec);
+            if (!ec->suspended)
+                result = ec->pop();
+        }
+
+        if (ec->suspended)
+        {
+            suspend (actor, MvmSuspension::capture(ec), msg.reply);
+            msg.reply = Ref<AsFuture>();
+        }
+        else if (msg.reply.notNull())
+            result = result.deepFreeze();
+    }
+    catch (const RuntimeError& e)
+    {
+        VmPosition  pos = e.Position;
+
+        if (pos.Routine.isNull())
+            pos = mvmCurrentPosition(ec);
+
+        error = jsString(e.what());
+        stopActor(actor, jsNull(), error, mvmSourcePosition(pos));
+    }
+    catch (const CScriptException& e)
+    {
+        error = jsString(e.what());
+        stopActor(actor, jsNull(), error, e.Position);
+    }
+
+    //Failed calls leave their frames on the stack.
+    ec->stack.clear();
+    ec->frames.clear();
+    ec->getThisParam();
+    ec->suspendable = false;
+    ec->suspended = false;
+    ec->callInstruction = false;
+    ec->suspendToken = Ref<RefCountObj>();
+
+    if (msg.reply.notNull())
+        msg.reply->complete(error.isNull() ? result : jsNull(), error);
+}
+
+/**
+ * Keeps a suspended message handler execution until the future it waits for
+ * is completed. Then, a message which resumes it is sent to the actor. 
+ * The actor handles other messages meanwhile.
+ * @param actor
+ * @param state     Suspended execution. Its token is the future.
+ * @param reply     Reply future of the message whose handler was suspended.
+ */
+void ActorRuntime::suspend (Ref<AsActor> actor, Ref<MvmSuspension> state, Ref<AsFuture> reply)
+{
+    auto future = ref(dynamic_cast<AsFuture*>(state->getToken().getPointer()));
+
+    ASSERT (future.notNull());
+
+    future->then([this, actor, state, reply](ASValue value, ASValue error)
+    {
+        ActorMessage    msg;
+
+        msg.params.push_back(value);
+        msg.params.push_back(error);
+        msg.reply = reply;
+        msg.resume = state;
+
+        actor->reserve(false);
+        ++m_pending;
+        if (actor->enqueue(std::move(msg)))
+            schedule(actor);
+    });
+}
+
+/**
+ * Adds a message to the mailbox of an actor, and schedules it if it was idle.
+ * Room for the message shall have been reserved in the mailbox.
+ * @param actor
+ * @param msg
+ */
+void ActorRuntime::post (Ref<AsActor> actor, ActorMessage&& msg)
+{
+    ++m_pending;
+    if (actor->enqueue(std::move(msg)))
+        schedule(actor);
 }
 
+/**
+ * Gets the current timer tick: milliseconds since the runtime creation.
+ * @return
+ */
+uint64_t ActorRuntime::currentTick ()const
+{
+    auto elapsed = Clock::now() - m_startTime;
+
+    return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count();
+}
+
+/**
+ * Sends the messages of the expired timers, and re-inserts periodic timers.
+ * Timers of stopped actors are not re-inserted.
+ */
+void ActorRuntime::expireTimers ()
+{
+    std::vector<TimerEntry*>    expired;
+
+    {
+        std::lock_guard<std::mutex> lock(m_timerMutex);
+        m_timers.advance(currentTick(), &expired);
+    }
+
+    for (auto it = expired.begin(); it != expired.end(); ++it)
+    {
+        //Takes the reference held by the timer wheel.
+        auto timer = ref(static_cast<AsTimer*>(*it));
+        timer->release();
+
+        auto actor = timer->getActor();
+
+        sendInput(NULL, actor, timer->getHandler(), timer->getParams());
+
+        if (timer->getPeriod() > 0)
+        {
+            std::lock_guard<std::mutex> lock(m_timerMutex);
+
+            if (!timer->isCancelled() && actor->isRunning())
+            {
+                //Periods missed by a late expiration are skipped.
+                timer->expires = max (timer->expires + timer->getPeriod(), m_timers.currentTick());
+                timer->addref();
+                m_timers.insert(timer.getPointer());
+            }
+        }
+    }
+
+    //Updated after sending the messages, so the actor system is never seen
+    //idle while they are being sent.
+    std::lock_guard<std::mutex> lock(m_timerMutex);
+    m_timerCount = m_timers.size();
+}
+
+/**
+ * Called when messages have been processed. Wakes up the thread which runs
+ * the actor system when all messages have been processed.
+ * @param count
+ */
+void ActorRuntime::messagesDone (size_t count)
+{
+    if (m_pending.fetch_sub(count) == count)
+    {
+        std::lock_guard<std::mutex> lock(m_idleMutex);
+        m_quiescent.notify_all();
+    }
+}
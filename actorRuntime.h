@@ -1,4 +1,4 @@
-/* 
+/*
  * File:   actorRuntime.h
  * Author: ghernan
  *
@@ -13,92 +13,165 @@
 #pragma once
 
 #include "asActors.h"
-#include "jsArray.h"
-#include <deque>
-
-struct MvmRoutine;
-class FunctionScope;
-class CScriptException;
+#include "ScriptPosition.h"
+#include "ioReactor.h"
+#include "fileIo.h"
 
-std::pair<ASValue, ASValue > asBlockingExec(Ref<MvmRoutine> code, 
-                                                      Ref<GlobalScope> globals, 
-                                                      CodeMap* pMap);
+#include <deque>
+#include <memory>
+#include <thread>
+#include <condition_variable>
+#include <chrono>
 
-ASValue actorChildStoppedDefaultHandler(ExecutionContext* ec);
+struct Modules;
 
-ASValue    inputEpCall(Ref<AsEndPointRef> endPoint, Ref<FunctionScope> scope);
-ASValue    outputEpCall(Ref<AsEndPointRef> endPoint, Ref<FunctionScope> scope);
-ASValue    actorConstructor(Ref<AsActorClass> actorClass, Ref<FunctionScope> scope);
+ASValue actorCreate (ExecutionContext* ec);
+ASValue actorEndPointCall (ExecutionContext* ec);
+ASValue actorConnect (ExecutionContext* ec);
+ASValue actorChildStoppedDefaultHandler (ExecutionContext* ec);
 
+void registerActorFunctions (Ref<JSObject> scope);
 
 /**
- * Keeps shared state of the actor system.
- * It contains the message queue. It only supports single-threaded dispatching
- * at this time.
- * 
- * @param rootActor
- * @return 
+ * Keeps shared state of the actor system, and dispatches the messages sent to
+ * actors.
+ *
+ * Messages are dispatched by a pool of worker threads. An actor is scheduled
+ * (placed in a run queue) when a message arrives to its empty mailbox, and it
+ * stays scheduled until its mailbox is empty again, so it is never run by two
+ * threads at the same time. Each time an actor is run, it processes several
+ * of its messages, up to the drain quota.
+ * Each worker has its own run queue. Actors which receive messages from code
+ * run by a worker are scheduled on its queue; the ones which receive messages
+ * from other threads are placed on a shared injection queue. Idle workers
+ * steal actors from the other end of the queues of the busy ones.
+ * Actors with bounded mailboxes apply backpressure to the actors which send
+ * them messages: with the 'block' policy, a message handler which sends a 
+ * message to a full mailbox is suspended until the message fits in it.
+ * Request messages carry a reply future, which is completed with the value
+ * returned by their handler. Its continuations send messages to the actors
+ * waiting for the reply, so no worker is blocked waiting for it.
+ * Message handlers can also wait for a future: their execution is suspended,
+ * and its stack and frames are kept until the future is completed. Then, a
+ * message which resumes it is sent to the actor.
+ * Timers are kept in a hierarchical timer wheel, with one millisecond ticks.
+ * The thread which runs the actor system expires them, and sends their
+ * messages. The actor system runs until there are no pending messages nor
+ * timers.
+ * I/O actors watch their file descriptors with an I/O reactor, which is
+ * created when the first one starts. Active I/O actors also keep the actor
+ * system running. File actors use the file I/O service instead, also created
+ * on first use.
  */
-class ActorRuntime : public JSObject
+class ActorRuntime : public RefCountObj
 {
 public:
-
-    static Ref<ActorRuntime> create(Ref<AsActorRef> rootActor);
-    static Ref<ActorRuntime> getRuntime(FunctionScope* fnScope);
-
-    //void connectMessages (Ref<AsMessageRef> dst, Ref<AsMessageRef> src);
-
-    void sendMessage0(Ref<AsActorRef> dstActor, const std::string& msgName);
-    void sendMessage1(Ref<AsActorRef> dstActor,
-                      const std::string& msgName,
-                      ASValue p1);
-    void sendMessage2(Ref<AsActorRef> dstActor,
-                      const std::string& msgName,
-                      ASValue p1,
-                      ASValue p2);
-    void sendMessage3(Ref<AsActorRef> dstActor,
-                      const std::string& msgName,
-                      ASValue p1,
-                      ASValue p2,
-                      ASValue p3);
-    void sendMessage(Ref<AsActorRef> dstActor, 
-                     const std::string& msgName, 
-                     Ref<JSArray> params);
-    void sendMessage(Ref<AsEndPointRef> dstMessage, Ref<JSArray> params);
+    static const size_t DEFAULT_DRAIN_QUOTA = 32;
     
-    void stopActor (Ref<AsActorRef> actorRef, ASValue value, ASValue error);
-
-    bool dispatchMessage(CodeMap* pMap);
-    
-protected:
-    void actorCrashed(Ref<AsActorRef> actor, const char* msg);
-
-    virtual Ref<JSObject>   clone (bool _mutable);
-
-private:
-    struct SMessage
+    static Ref<ActorRuntime> create (const std::string& modulePath,
+                                     Modules* modules,
+                                     int nThreads = 0,
+                                     size_t drainQuota = DEFAULT_DRAIN_QUOTA);
+
+    void send (Ref<AsActor> actor, ASValue handler, ValueVector params);
+    void sendInput (ExecutionContext* ec,
+                    Ref<AsActor> actor,
+                    ASValue handler,
+                    ValueVector params,
+                    Ref<AsFuture> reply = Ref<AsFuture>());
+    void stopActor (Ref<AsActor> actor, ASValue result, ASValue error, const ScriptPosition& errorPos);
+    void deliverBlocked (AsActor* actor);
+
+    Ref<AsTimer> startTimer (Ref<AsActor> actor,
+                             ASValue handler,
+                             ValueVector params,
+                             double delay,
+                             double period);
+    bool cancelTimer (Ref<AsTimer> timer);
+
+    void sendOutput (Ref<AsActor> actor, const std::string& output, ValueVector params);
+    IoReactor* reactor ();
+    FileIoService* fileIo ();
+    void ioStarted ();
+    void ioFinished ();
+
+    void run ();
+
+    bool getError (std::string* pMessage, ScriptPosition* pPosition)const;
+
+    int threadCount()const
     {
-        Ref<AsEndPointRef> destination;
-        Ref<JSArray> params;
+        return m_nThreads;
+    }
 
-        SMessage(Ref<AsEndPointRef> _dest, Ref<JSArray> _params) :
-        destination(_dest), params(_params)
-        {
-        }
-    };
+    size_t drainQuota()const
+    {
+        return m_drainQuota;
+    }
 
-    typedef std::deque<SMessage> MessageQueue;
+private:
+    ActorRuntime (const std::string& modulePath, Modules* modules, int nThreads, size_t drainQuota);
+    ~ActorRuntime ();
 
-    ActorRuntime(Ref<AsActorRef> rootActor)
-    : JSObject(DefaultClass, MT_DEEPFROZEN)
-    , m_rootActor(rootActor)
+    /**
+     * Worker thread state.
+     */
+    struct Worker
     {
-    }
+        ActorRuntime*                   runtime;
+        size_t                          index;
+        std::deque< Ref<AsActor> >      queue;
+        std::mutex                      mutex;
+        std::thread                     thread;
+    };
 
-    Ref<AsActorRef> m_rootActor;
-    MessageQueue m_messageQueue;
+    void schedule (Ref<AsActor> actor);
+    void workerLoop (Worker* worker);
+    bool nextActor (Worker* worker, Ref<AsActor>* pActor);
+    bool tryPop (Worker* worker, Ref<AsActor>* pActor);
+    void runActor (Ref<AsActor> actor, ExecutionContext* ec);
+    void dispatch (Ref<AsActor> actor, ActorMessage& msg, ExecutionContext* ec);
+    void suspend (Ref<AsActor> actor, Ref<MvmSuspension> state, Ref<AsFuture> reply);
+    void messagesDone (size_t count);
+    void post (Ref<AsActor> actor, ActorMessage&& msg);
+    void blockSender (ExecutionContext* ec, Ref<AsActor> actor, ActorMessage&& msg);
+    uint64_t currentTick ()const;
+    void expireTimers ();
+
+    const std::string                       m_modulePath;
+    Modules* const                          m_modules;
+    const int                               m_nThreads;
+    const size_t                            m_drainQuota;
+
+    std::vector< std::unique_ptr<Worker> >  m_workers;
+    std::deque< Ref<AsActor> >              m_injected;
+    std::mutex                              m_injectedMutex;
+
+    std::atomic<size_t>                     m_queued;       //Actors in run queues.
+    std::atomic<size_t>                     m_pending;      //Messages not yet processed.
+    bool                                    m_stopping = false;
+    std::mutex                              m_idleMutex;
+    std::condition_variable                 m_workAvailable;
+    std::condition_variable                 m_quiescent;
+
+    typedef std::chrono::steady_clock       Clock;
+    const Clock::time_point                 m_startTime;
+    std::mutex                              m_timerMutex;
+    TimerWheel                              m_timers;       //Holds a reference to each timer.
+    std::atomic<size_t>                     m_timerCount;
+    std::atomic<uint64_t>                   m_nextWake;     //Tick at which 'run' wakes up to expire timers.
+
+    std::unique_ptr<IoReactor>              m_reactor;
+    std::once_flag                          m_reactorCreated;
+    std::unique_ptr<FileIoService>          m_fileIo;
+    std::once_flag                          m_fileIoCreated;
+    std::atomic<size_t>                     m_ioCount;      //Active I/O objects.
+
+    mutable std::mutex                      m_errorMutex;
+    bool                                    m_failed = false;
+    std::string                             m_errorMessage;
+    ScriptPosition                          m_errorPosition;
 };
 
 
 #endif	/* ACTORRUNTIME_H */
-
@@ -1,9 +1,9 @@
-/* 
+/*
  * File:   asVars.cpp
  * Author: ghernan
- * 
+ *
  * Async script basic data types. Contains the data types related to actor system.
- * 
+ *
  * Created on December 25, 2016, 12:53 PM
  */
 
@@ -14,233 +14,660 @@
 using namespace std;
 
 /**
- * Actor class construction function
+ * Actor class construction function. Adds the default 'childStopped' input
+ * message if the class does not define it.
  * @param name
- * @param members
- * @return 
+ * @param params        Actor constructor parameters.
+ * @param constructor   Actor constructor function.
+ * @param inputs        Input message handlers.
+ * @param outputs       Output message names.
+ * @return
  */
-Ref<AsActorClass> AsActorClass::create (const std::string& name, 
-                                        const VarMap& members,
-                                        const StringVector& params)
+Ref<AsActorClass> AsActorClass::create (const std::string& name,
+                                        const StringVector& params,
+                                        Ref<JSFunction> constructor,
+                                        const VarMap& inputs,
+                                        const StringVector& outputs)
 {
-    auto newMembers = createDefaultEndPoints(members);
+    const char* childStopped = "childStopped";
+    VarMap      allInputs = inputs;
+    ASValue     handler;
+
+    if (!inputs.tryGetValue(childStopped, &handler))
+    {
+        StringVector    handlerParams;
+
+        handlerParams.push_back("child");
+        handlerParams.push_back("result");
+        handlerParams.push_back("error");
+
+        handler = JSFunction::createNative(childStopped,
+                                           handlerParams,
+                                           actorChildStoppedDefaultHandler)->value();
+        allInputs.varWrite(childStopped, handler, true);
+    }
 
-    return refFromNew (new AsActorClass(name, newMembers, params));
+    return refFromNew (new AsActorClass(name, params, constructor, allInputs, outputs));
 }
 
 /**
  * Actor class constructor.
- * @param name
  */
-AsActorClass::AsActorClass(const std::string& name,
-                           const VarMap& members,
-                           const StringVector& params)
-: m_name(name),
-m_members(members),
-m_params(params)
+AsActorClass::AsActorClass (const std::string& name,
+                            const StringVector& params,
+                            Ref<JSFunction> constructor,
+                            const VarMap& inputs,
+                            const StringVector& outputs)
+: JSObject (DefaultClass, MT_DEEPFROZEN),
+m_name(name),
+m_params(params),
+m_constructor(constructor),
+m_inputs(inputs),
+m_outputs(outputs.begin(), outputs.end())
 {
 }
 
 /**
- * Creates default endPoints of an actor class, if they are missing.
+ * Actor classes are called to create actors.
+ * @param key
+ * @return
  */
-VarMap AsActorClass::createDefaultEndPoints (const VarMap& members)
+ASValue AsActorClass::readField(const std::string& key)const
 {
-    const char* childStopped = "childStopped";
-    if (members.find(childStopped) == members.end())
+    if (key == "call")
     {
-        StringVector    params;
-        auto            newMembers = members;
-        
-        params.push_back("child");
-        params.push_back("result");
-        params.push_back("error");
-        auto            endPoint = AsEndPoint::createNative(childStopped, 
-                                                            params,
-                                                            actorChildStoppedDefaultHandler);
-        
-        newMembers.varWrite(childStopped, endPoint, true);
-        
-        return newMembers;
+        static auto fn = JSFunction::createNative("@actorCreate", StringVector(), actorCreate);
+        return fn->value();
     }
     else
-        return members;
+        return jsNull();
+}
+
+bool AsActorClass::isInput (const std::string& name)const
+{
+    ASValue handler;
+
+    return m_inputs.tryGetValue(name, &handler);
+}
+
+bool AsActorClass::isOutput (const std::string& name)const
+{
+    return m_outputs.count(name) > 0;
 }
 
 /**
- * Call to an actor class (invokes the actor constructor).
- * @param scope
- * @param ec
- * @return 
+ * Actor classes are immutable, they are not copied.
+ * @param _mutable
+ * @return
  */
-ASValue AsActorClass::call (Ref<FunctionScope> scope)
+Ref<JSObject> AsActorClass::clone (bool _mutable)
 {
-    return actorConstructor(Ref<AsActorClass>(this), scope);
+    return ref(this);
 }
 
 /**
- * Gets the names of the class members
- * @param inherited
- * @return 
+ * Creates an actor.
+ * @param cls
+ * @param globals   Globals seen by the actor code. They shall not be shared
+ * with other actors.
+ * @param parent    Actor which has created it. May be NULL.
+ * @return
  */
-StringSet AsActorClass::getFields(bool inherited)const
+Ref<AsActor> AsActor::create (Ref<AsActorClass> cls,
+                              Ref<JSModule> globals,
+                              Ref<AsActor> parent)
 {
-    StringSet    result;
-    
-    for (auto it = m_members.begin(); it != m_members.end(); ++it)
-        result.insert(it->first);
+    return refFromNew (new AsActor(cls, globals, parent));
+}
+
+/**
+ * Actor constructor. Creates the closures of its message handlers, whose
+ * environment is the actor globals.
+ */
+AsActor::AsActor (Ref<AsActorClass> cls, Ref<JSModule> globals, Ref<AsActor> parent)
+: JSObject (DefaultClass, MT_MUTABLE),
+m_cls(cls),
+m_globals(globals),
+m_parent(parent),
+m_mailboxCount(0),
+m_mailboxDepth(0),
+m_mailboxHighWatermark(0),
+m_mailboxCapacity(0),
+m_overflowPolicy(OVERFLOW_BLOCK),
+m_droppedMessages(0),
+m_evictors(0),
+m_dequeuing(false),
+m_hasBlockedSenders(false),
+m_running(true)
+{
+    ASValue env = globals->value();
     
-    return result;
+    m_mailboxTail = new MailboxNode;
+    m_mailboxHead = m_mailboxTail;
+
+    m_handlers = cls->getInputs().map([&env](const string& name, ASValue value) -> ASValue {
+        auto fn = value.staticCast<JSFunction>();
+
+        if (fn->isNative())
+            return value;
+        else
+            return JSClosure::create(fn, &env, 1)->value();
+    });
+
+    auto constructor = cls->getConstructor();
+
+    if (constructor->isNative())
+        m_constructor = constructor->value();
+    else
+        m_constructor = JSClosure::create(constructor, &env, 1)->value();
+}
+
+AsActor::~AsActor()
+{
+    while (m_mailboxTail != NULL)
+    {
+        MailboxNode* next = m_mailboxTail->next;
+        
+        delete m_mailboxTail;
+        m_mailboxTail = next;
+    }
 }
 
 /**
- * Finds by name an actor member.
+ * Reads an actor field. Input and output messages are also readable as fields.
  * @param key
- * @return 
+ * @return
  */
-ASValue AsActorClass::readField(const std::string& key)const
+ASValue AsActor::readField(const std::string& key)const
 {
-    auto it = m_members.find(key);
+    ASValue value;
+
+    if (m_members.tryGetValue(key, &value))
+        return value;
+
+    const bool  input = m_cls->isInput(key);
 
-    if (it != m_members.end())
-        return it->second.value();
+    if (input || m_cls->isOutput(key))
+        return AsEndPointRef::create(ref(const_cast<AsActor*>(this)), key, input)->value();
     else
-        return jsNull();    
+        return jsNull();
+}
+
+/**
+ * Actors are not copied when sent in messages; a reference is sent instead.
+ * @param transformed
+ * @return
+ */
+ASValue AsActor::deepFreeze(ASValue::ValuesMap& transformed)
+{
+    return AsActorRef::create(ref(this))->value();
 }
 
 /**
- * Gets one of the endpoints defined in the class.
+ * Gets the handler of an input message.
  * @param name
- * @return 
+ * @return A closure, a native function, or null if there is no such message.
  */
-Ref<AsEndPoint> AsActorClass::getEndPoint (const std::string& name)
+ASValue AsActor::getHandler (const std::string& name)const
 {
-    auto it = m_members.find(name);
-    
-    if (it == m_members.end())
-        return Ref<AsEndPoint>();
-    
-    auto item = it->second.value();
-    auto type = item->getType();
-    
-    if (type == VT_INPUT_EP || type == VT_OUTPUT_EP)
-        return item.staticCast<AsEndPoint>();
+    ASValue handler;
+
+    if (m_handlers.tryGetValue(name, &handler))
+        return handler;
     else
-        return Ref<AsEndPoint>();
+        return jsNull();
 }
 
 /**
- * Gets one of the referenced actor end points
- * @param name
- * @return 
+ * Connects an output message to an input message of another actor.
+ * @param output
+ * @param dst
+ */
+void AsActor::connect (const std::string& output, Ref<AsEndPointRef> dst)
+{
+    std::lock_guard<std::mutex> lock(m_connectionsMutex);
+
+    m_connections[output] = dst;
+}
+
+/**
+ * Gets the input message connected to an output message.
+ * @param output
+ * @return A null reference if not connected.
  */
-Ref<AsEndPointRef> AsActorRef::getEndPoint (const std::string& name)const
+Ref<AsEndPointRef> AsActor::getConnection (const std::string& output)const
 {
-    auto ep = m_ref->getEndPoint(name);
+    std::lock_guard<std::mutex> lock(m_connectionsMutex);
+    auto                        it = m_connections.find(output);
 
-    if (ep.isNull())
+    if (it == m_connections.end())
         return Ref<AsEndPointRef>();
     else
-        return AsEndPointRef::create(ep, Ref<AsActorRef>(const_cast<AsActorRef*>(this)));
+        return it->second;
 }
 
 /**
- * Stops an actor execution
+ * Stops an actor execution. Messages it receives afterwards are discarded.
  * @param result
  * @param error
+ * @param errorPos  Position of the error in the script.
  */
-void AsActor::stop(ASValue result, ASValue error)
+void AsActor::stop (ASValue result, ASValue error, const ScriptPosition& errorPos)
 {
     m_result = result;
     m_error = error;
-    m_finished = true;
+    m_errorPosition = errorPos;
+    m_running = false;
 }
 
-AsEndPoint::AsEndPoint (const std::string& name, 
-                        const StringVector& params, 
-                        Ref<MvmRoutine> code) :
-                        JSFunction(name, params, code), m_isInput(true)
-{    
-}
+/**
+ * Reserves room in the mailbox for a new message. It shall be called before
+ * 'enqueue'.
+ * @param bounded   If false, room is reserved even if the mailbox is full.
+ * @return false if the message is bounded and the mailbox is full.
+ */
+bool AsActor::reserve (bool bounded)
+{
+    const size_t    capacity = m_mailboxCapacity;
+    size_t          depth = m_mailboxDepth;
+
+    do
+    {
+        if (bounded && capacity > 0 && depth >= capacity)
+            return false;
+    } while (!m_mailboxDepth.compare_exchange_weak(depth, depth + 1));
+
+    size_t  high = m_mailboxHighWatermark;
 
-AsEndPoint::AsEndPoint (const std::string& name, 
-                        const StringVector& params, 
-                        JSNativeFn pNative):
-                        JSFunction(name, params, pNative), m_isInput(true)
-{    
+    while (depth + 1 > high && !m_mailboxHighWatermark.compare_exchange_weak(high, depth + 1))
+        ;
+
+    return true;
 }
 
 /**
- * String representation of an end point.
- * @return 
+ * Adds a message to the actor mailbox. Wait-free: it can be called from any
+ * thread.
+ * @param msg
+ * @return true if the actor shall be scheduled: the mailbox was empty.
  */
-std::string AsEndPoint::toString()const
+bool AsActor::enqueue (ActorMessage&& msg)
 {
-    const string header = isInput() ? "input" : "output";
+    MailboxNode*    node = new MailboxNode;
     
-    return header + JSFunction::toString().substr(8);
+    node->msg = std::move(msg);
+    
+    MailboxNode*    prev = m_mailboxHead.exchange(node, std::memory_order_acq_rel);
+    prev->next.store(node, std::memory_order_release);
+    
+    return m_mailboxCount.fetch_add(1, std::memory_order_acq_rel) == 0;
 }
 
 /**
- * Call made to a end point reference (will send a message)
- * @param scope
- * @return 
+ * Takes the oldest message from the actor mailbox. Only called by the thread
+ * which runs the actor, when the mailbox is not empty.
+ * It is lock-free, unless some producer is evicting a message of the mailbox
+ * at the same time.
+ * @param pMsg  [out]
  */
-ASValue AsEndPointRef::call (Ref<FunctionScope> scope)
+void AsActor::dequeue (ActorMessage* pMsg)
 {
-    if (isInput())
-        return inputEpCall(Ref<AsEndPointRef>(this), scope);
+    //Either the consumer sees the evicting producer, and takes the mutex, or 
+    //the producer sees the consumer, and waits for it.
+    m_dequeuing.store(true);
+    if (m_evictors.load() == 0)
+    {
+        takeOldest(pMsg);
+        m_dequeuing.store(false, std::memory_order_release);
+    }
     else
-        return outputEpCall(Ref<AsEndPointRef>(this), scope);
+    {
+        m_dequeuing.store(false, std::memory_order_release);
+
+        std::lock_guard<std::mutex> lock(m_mailboxMutex);
+        takeOldest(pMsg);
+    }
 }
 
 /**
- * Reads a field from an actor.
- * @param key
- * @return 
+ * Takes the oldest message from the mailbox list. The caller shall prevent
+ * evicting producers from changing the list at the same time.
+ * @param pMsg  [out]
  */
-ASValue AsActor::readField(const std::string& key)const
+void AsActor::takeOldest (ActorMessage* pMsg)
 {
-    auto it = m_members.find(key);
+    MailboxNode*    tail = m_mailboxTail;
+    MailboxNode*    next = tail->next.load(std::memory_order_acquire);
     
-    // if not found at object fields, it may be an endpoint
-    if (it == m_members.end())
+    //The message may be counted, but not linked yet by its producer.
+    while (next == NULL)
     {
-        auto ep = getEndPoint(key);
-        
-        if (ep.notNull())
-            return AsEndPointRef::create(ep, AsActorRef::create(Ref<AsActor>(const_cast<AsActor*>(this))));
-        else
-            return jsNull();
+        std::this_thread::yield();
+        next = tail->next.load(std::memory_order_acquire);
     }
-    else
-        return it->second.value();
+    
+    //The node becomes the list first node; its message has been moved out.
+    *pMsg = std::move(next->msg);
+    m_mailboxTail = next;
+    delete tail;
+
+    m_mailboxDepth.fetch_sub(1);
 }
 
 /**
- * Writes a field
- * @param key
- * @param value
- * @return 
+ * Replaces the oldest bounded message of a full mailbox with a new one, for 
+ * the 'drop oldest' policy. The new message takes the place of the evicted 
+ * one at the end of the queue, so the number of messages does not change.
+ * It can be called from any thread.
+ * @param msg       New message. It is moved to the mailbox if it returns true.
+ * @param pEvicted  [out] Evicted message.
+ * @return false if the mailbox has no bounded message which can be evicted.
  */
-ASValue AsActor::writeField(const std::string& key, ASValue value, bool isConst)
+bool AsActor::replaceOldest (ActorMessage& msg, ActorMessage* pEvicted)
 {
-    //TODO: Check class fields
-    checkedVarWrite(m_members, key, value, isConst);
-    return value;
+    bool    replaced;
+    
+    m_evictors.fetch_add(1);
+    {
+        std::lock_guard<std::mutex> lock(m_mailboxMutex);
+
+        //Waits for a consumer which has not seen this producer.
+        while (m_dequeuing.load(std::memory_order_acquire))
+            std::this_thread::yield();
+
+        replaced = evictOldest(msg, pEvicted);
+    }
+    m_evictors.fetch_sub(1, std::memory_order_release);
+    
+    return replaced;
 }
 
 /**
- * Looks for the connected input end point of an output end point
- * @param msgName
+ * Implementation of 'replaceOldest'. The caller shall have excluded the 
+ * consumer and other evicting producers.
+ * @param msg
+ * @param pEvicted  [out]
  * @return 
  */
-Ref<AsEndPointRef> AsActor::getConnectedEp (const std::string& msgName)const
+bool AsActor::evictOldest (ActorMessage& msg, ActorMessage* pEvicted)
 {
-    auto    it = m_outputConections.find(msgName);
+    MailboxNode*    prev = m_mailboxTail;
+    MailboxNode*    node = prev->next.load(std::memory_order_acquire);
     
-    if (it != m_outputConections.end())
-        return it->second;
+    while (node != NULL && !node->msg.bounded)
+    {
+        prev = node;
+        node = node->next.load(std::memory_order_acquire);
+    }
+    
+    if (node == NULL)
+        return false;
+    
+    *pEvicted = std::move(node->msg);
+    
+    MailboxNode*    next = node->next.load(std::memory_order_acquire);
+    
+    //The last linked node may be receiving the link of a new node, so it 
+    //cannot be removed. As it is the newest message, the new one just takes
+    //its place.
+    if (next == NULL)
+    {
+        node->msg = std::move(msg);
+        return true;
+    }
+    
+    //The node is moved to the head of the list.
+    prev->next.store(next, std::memory_order_release);
+    node->msg = std::move(msg);
+    node->next.store(NULL, std::memory_order_relaxed);
+    
+    MailboxNode*    head = m_mailboxHead.exchange(node, std::memory_order_acq_rel);
+    head->next.store(node, std::memory_order_release);
+    
+    return true;
+}
+
+/**
+ * Adds a message to the list of messages which wait for room in the mailbox.
+ * 'deliverBlocked' shall be called afterwards, as the mailbox may have room
+ * by then.
+ * @param msg
+ */
+void AsActor::block (BlockedMessage&& msg)
+{
+    std::lock_guard<std::mutex> lock(m_mailboxMutex);
+    
+    m_blockedMessages.push_back(std::move(msg));
+    m_hasBlockedSenders = true;
+}
+
+/**
+ * Moves blocked messages to the mailbox, in the order in which they were 
+ * sent, while it has room. It can be called from any thread.
+ * @param deliver   Called for each message after reserving its room in the 
+ * mailbox, in order to enqueue it.
+ */
+void AsActor::deliverBlocked (const std::function<void (BlockedMessage&)>& deliver)
+{
+    std::lock_guard<std::mutex> lock(m_mailboxMutex);
+    
+    while (!m_blockedMessages.empty() && reserve(true))
+    {
+        deliver(m_blockedMessages.front());
+        m_blockedMessages.pop_front();
+    }
+    
+    m_hasBlockedSenders = !m_blockedMessages.empty();
+}
+
+/**
+ * Called when a thread stops running the actor.
+ * @param processed     Number of messages processed in this run.
+ * @return true if the actor shall be scheduled again, because it has pending
+ * messages.
+ */
+bool AsActor::endRun (size_t processed)
+{
+    return m_mailboxCount.fetch_sub(processed, std::memory_order_acq_rel) > processed;
+}
+
+/**
+ * Sets the mailbox capacity limit, and what happens when it is exceeded.
+ * @param capacity  Maximum number of messages. Zero for unbounded mailboxes.
+ * @param policy
+ */
+void AsActor::setMailboxLimit (size_t capacity, OverflowPolicy policy)
+{
+    m_overflowPolicy = policy;
+    m_mailboxCapacity = capacity;
+}
+
+/**
+ * Creates an actor reference.
+ * @param actor
+ * @return
+ */
+Ref<AsActorRef> AsActorRef::create (Ref<AsActor> actor)
+{
+    return refFromNew (new AsActorRef(actor));
+}
+
+AsActorRef::AsActorRef (Ref<AsActor> actor)
+: JSObject (DefaultClass, MT_DEEPFROZEN), m_actor(actor)
+{
+}
+
+/**
+ * Input and output messages of the referenced actor are its fields.
+ * @param key
+ * @return
+ */
+ASValue AsActorRef::readField(const std::string& key)const
+{
+    auto        cls = m_actor->getActorClass();
+    const bool  input = cls->isInput(key);
+
+    if (input || cls->isOutput(key))
+        return AsEndPointRef::create(m_actor, key, input)->value();
     else
-        return Ref<AsEndPointRef>();
+        return jsNull();
+}
+
+Ref<JSObject> AsActorRef::clone (bool _mutable)
+{
+    return ref(this);
+}
+
+/**
+ * Creates an end point reference
+ * @param actor
+ * @param name      Message name.
+ * @param input     true for input messages, false for output messages.
+ * @return
+ */
+Ref<AsEndPointRef> AsEndPointRef::create (Ref<AsActor> actor, const std::string& name, bool input)
+{
+    return refFromNew (new AsEndPointRef(actor, name, input));
+}
+
+AsEndPointRef::AsEndPointRef (Ref<AsActor> actor, const std::string& name, bool input)
+: JSObject (DefaultClass, MT_DEEPFROZEN), m_actor(actor), m_name(name), m_input(input)
+{
+}
+
+/**
+ * End points are called to send messages.
+ * @param key
+ * @return
+ */
+ASValue AsEndPointRef::readField(const std::string& key)const
+{
+    if (key == "call")
+    {
+        static auto fn = JSFunction::createNative("@endPointCall", StringVector(), actorEndPointCall);
+        return fn->value();
+    }
+    else
+        return jsNull();
+}
+
+Ref<JSObject> AsEndPointRef::clone (bool _mutable)
+{
+    return ref(this);
+}
+
+/**
+ * Creates a timer.
+ * @param actor     Destination actor.
+ * @param handler   Input message handler.
+ * @param params    Message parameters. They shall be deep-frozen.
+ * @param period    Period, in ticks, of periodic timers. Zero for one-shot timers.
+ * @return
+ */
+Ref<AsTimer> AsTimer::create (Ref<AsActor> actor,
+                              ASValue handler,
+                              const ValueVector& params,
+                              uint64_t period)
+{
+    return refFromNew (new AsTimer(actor, handler, params, period));
+}
+
+AsTimer::AsTimer (Ref<AsActor> actor, ASValue handler, const ValueVector& params, uint64_t period)
+: JSObject (DefaultClass, MT_DEEPFROZEN),
+m_actor(actor),
+m_handler(handler),
+m_params(params),
+m_period(period)
+{
+}
+
+Ref<JSObject> AsTimer::clone (bool _mutable)
+{
+    return ref(this);
+}
+
+Ref<AsFuture> AsFuture::create ()
+{
+    return refFromNew (new AsFuture);
+}
+
+AsFuture::AsFuture ()
+: JSObject (DefaultClass, MT_DEEPFROZEN)
+{
+}
+
+/**
+ * Completes the future, and calls its continuations.
+ * @param value     Deep-frozen value.
+ * @param error     Null on success.
+ * @return false if it was already completed. It is not modified.
+ */
+bool AsFuture::complete (ASValue value, ASValue error)
+{
+    std::vector<Continuation>   continuations;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (m_completed)
+            return false;
+
+        m_completed = true;
+        m_value = value;
+        m_error = error;
+        continuations.swap(m_continuations);
+    }
+
+    for (auto it = continuations.begin(); it != continuations.end(); ++it)
+        (*it)(value, error);
+
+    return true;
+}
+
+/**
+ * Adds a continuation. If the future is already completed, it is called
+ * immediately, on the current thread.
+ * @param fn
+ */
+void AsFuture::then (const Continuation& fn)
+{
+    ASValue value;
+    ASValue error;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (!m_completed)
+        {
+            m_continuations.push_back(fn);
+            return;
+        }
+        value = m_value;
+        error = m_error;
+    }
+
+    fn (value, error);
+}
+
+/**
+ * Gets the result of the future, if it is completed.
+ * @param pValue    [out]
+ * @param pError    [out]
+ * @return false if it is not completed yet.
+ */
+bool AsFuture::getResult (ASValue* pValue, ASValue* pError)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (!m_completed)
+        return false;
+
+    *pValue = m_value;
+    *pError = m_error;
+    return true;
+}
+
+Ref<JSObject> AsFuture::clone (bool _mutable)
+{
+    return ref(this);
 }
@@ -1,320 +1,484 @@
-/* 
- * File:   asVars.h
+/*
+ * File:   asActors.h
  * Author: ghernan
- * 
+ *
  * Async script basic data types. Contains the data types related to actor system.
- * The rest are in 'jsVars.*'
+ * The rest are in 'jsVars.*' and 'asObjects.*'
  *
  * Created on December 25, 2016, 12:53 PM
  */
 
-#ifndef ASVARS_H
-#define	ASVARS_H
+#ifndef ASACTORS_H
+#define	ASACTORS_H
 
 #pragma once
 
 #include "asObjects.h"
 #include "microVM.h"
+#include "timerWheel.h"
+
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <deque>
 
-class AsEndPoint;
-class MvmRoutine;
+class AsEndPointRef;
 
 /**
- * Actor class runtime object
+ * Actor class runtime object. It is immutable, so it can be shared by all
+ * the threads which run actors.
+ * Calling it creates a new actor.
  */
-class AsActorClass : public JSValueBase<VT_ACTOR_CLASS>
+class AsActorClass : public JSObject
 {
 public:
-    static Ref<AsActorClass> create (const std::string& name, 
-                                     const VarMap& members, 
-                                     const StringVector& params);
+    static Ref<AsActorClass> create (const std::string& name,
+                                     const StringVector& params,
+                                     Ref<JSFunction> constructor,
+                                     const VarMap& inputs,
+                                     const StringVector& outputs);
+
+    virtual std::string toString(ExecutionContext* ec)const
+    {
+        return std::string("actor ") + getName();
+    }
 
-    //virtual ASValue call (Ref<FunctionScope> scope);
-    
-    virtual StringSet getFields(bool inherited = true)const;
     virtual ASValue readField(const std::string& key)const;
-    
-    Ref<AsEndPoint> getEndPoint (const std::string& name);
 
-    Ref<AsEndPoint> getConstructor ()
+    const std::string& getName()const
     {
-        return getEndPoint("@start");
+        return m_name;
     }
-    
-    virtual const StringVector& getParams()const
+
+    const StringVector& getParams()const
     {
         return m_params;
     }
 
-    virtual const std::string& getName()const
+    Ref<JSFunction> getConstructor()const
     {
-        return m_name;
+        return m_constructor;
     }
 
+    const VarMap& getInputs()const
+    {
+        return m_inputs;
+    }
+
+    bool isInput (const std::string& name)const;
+    bool isOutput (const std::string& name)const;
+
 protected:
-    AsActorClass(const std::string& name,
-                 const VarMap& members,
-                 const StringVector& params);
+    AsActorClass (const std::string& name,
+                  const StringVector& params,
+                  Ref<JSFunction> constructor,
+                  const VarMap& inputs,
+                  const StringVector& outputs);
+
+    virtual Ref<JSObject>   clone (bool _mutable);
 
-    static VarMap createDefaultEndPoints (const VarMap& members);
-    
 private:
-    std::string     m_name;
-    VarMap          m_members;
-    StringVector    m_params;
+    const std::string       m_name;
+    const StringVector      m_params;
+    const Ref<JSFunction>   m_constructor;
+    VarMap                  m_inputs;
+    const StringSet         m_outputs;
 };
 
-class AsActorRef;
-class AsEndPointRef;
-typedef std::vector < Ref<AsActorRef> > AsActorList;
+/**
+ * Reply of a request message: it is completed once, with the value returned
+ * by the message handler, or with an error. It is deep-frozen, so it can be
+ * sent in messages.
+ * Continuations are called, on the thread which completes the future, when it
+ * is completed. They usually send a message to the actor which waits for the
+ * reply, so no thread is blocked waiting for it.
+ */
+class AsFuture : public JSObject
+{
+public:
+    typedef std::function<void (ASValue value, ASValue error)> Continuation;
+
+    static Ref<AsFuture> create ();
+
+    virtual std::string toString(ExecutionContext* ec)const
+    {
+        return "[future]";
+    }
+
+    bool complete (ASValue value, ASValue error);
+    void then (const Continuation& fn);
+    bool getResult (ASValue* pValue, ASValue* pError);
+
+protected:
+    AsFuture ();
+
+    virtual Ref<JSObject>   clone (bool _mutable);
+
+private:
+    std::mutex                  m_mutex;
+    bool                        m_completed = false;
+    ASValue                     m_value;    //Deep-frozen.
+    ASValue                     m_error;
+    std::vector<Continuation>   m_continuations;
+};
 
 /**
- * Actor runtime object
+ * Message sent to an actor.
  */
-class AsActor : public JSValueBase<VT_ACTOR>
+struct ActorMessage
+{
+    ASValue         handler;    //Input message handler (closure or native function)
+    ValueVector     params;
+    bool            bounded = false;    //Subject to the mailbox capacity limit.
+    Ref<AsFuture>   reply;      //Completed with the handler result. Null for one-way messages.
+    Ref<MvmSuspension> resume;  //Suspended handler execution which the message resumes.
+};
+
+/**
+ * Message which waits for room in a full mailbox with the 'block' policy.
+ */
+struct BlockedMessage
+{
+    ActorMessage    msg;
+    Ref<AsFuture>   delivered;  //Completed when the message is placed in the mailbox.
+                                //Null if its sender has not been suspended.
+};
+
+/**
+ * What happens when a message is sent to an actor whose mailbox is full.
+ */
+enum OverflowPolicy
+{
+    OVERFLOW_BLOCK,         //The sender actor is suspended until the mailbox has room.
+    OVERFLOW_DROP_OLDEST,   //The oldest messages are discarded.
+    OVERFLOW_DROP_NEWEST,   //The new message is discarded.
+    OVERFLOW_FAIL           //The send operation fails.
+};
+
+/**
+ * Actor runtime object. It is the 'this' object of the actor code, so its
+ * fields hold the actor state. It can only be accessed from the thread which
+ * is running the actor; other actors reference it through 'AsActorRef' objects.
+ */
+class AsActor : public JSObject
 {
 public:
-    
-    static Ref<AsActor> create (Ref<AsActorClass> cls, 
-                                Ref<GlobalScope> globals,
-                                Ref<AsActorRef> parent)
+    static Ref<AsActor> create (Ref<AsActorClass> cls,
+                                Ref<JSModule> globals,
+                                Ref<AsActor> parent);
+
+    virtual ASValue readField(const std::string& key)const;
+    virtual ASValue deepFreeze(ASValue::ValuesMap& transformed);
+
+    Ref<AsActorClass> getActorClass()const
     {
-        return refFromNew(new AsActor(cls, globals, parent));
+        return m_cls;
     }
 
-    virtual JSValueTypes getType()const
+    Ref<JSModule> getGlobals()const
     {
-        return VT_ACTOR;
+        return m_globals;
     }
-    
-    virtual ASValue readField(const std::string& key)const;    
-    virtual ASValue writeField(const std::string& key, ASValue value, bool isConst);
-    
-    void setOutputConnection (const std::string& msgName, Ref<AsEndPointRef> dst)
+
+    Ref<AsActor> getParent()const
     {
-        m_outputConections[msgName] = dst;
+        return m_parent;
     }
-    
-    Ref<AsEndPointRef> getConnectedEp (const std::string& msgName)const;
-    
-    bool isRunning()const
+
+    ASValue getConstructor()const
     {
-        return !m_finished;
+        return m_constructor;
     }
-    
-    void stop(ASValue result, ASValue error);
-        
-    ASValue getResult()
+
+    ASValue getHandler (const std::string& name)const;
+
+    /**
+     * State of actors implemented in native code, such as I/O actors.
+     */
+    Ref<RefCountObj> getNativeState()const
     {
-        return m_result;
+        return m_nativeState;
     }
-        
-    ASValue getError()
+
+    void setNativeState (Ref<RefCountObj> state)
     {
-        return m_error;
+        m_nativeState = state;
     }
-    
-    Ref<AsEndPoint> getEndPoint (const std::string& name)const
+
+    void                connect (const std::string& output, Ref<AsEndPointRef> dst);
+    Ref<AsEndPointRef>  getConnection (const std::string& output)const;
+
+    bool isRunning()const
     {
-        return m_cls->getEndPoint(name);
+        return m_running;
     }
 
-    Ref<GlobalScope> getGlobals()const
+    void stop (ASValue result, ASValue error, const ScriptPosition& errorPos);
+
+    ASValue getResult()const
     {
-        return m_globals;
+        return m_result;
     }
-    
-    Ref<AsActorRef> getParent()const
+
+    ASValue getError()const
     {
-        return m_parent;
+        return m_error;
     }
-    
-protected:
-    AsActor (Ref<AsActorClass> cls, Ref<GlobalScope> globals, Ref<AsActorRef> parent) :
-        m_cls (cls)
-        , m_globals (globals)
-        , m_parent (parent)
-        , m_result(jsNull())
-        , m_error(jsNull())
-        , m_finished(false)
+
+    const ScriptPosition& getErrorPosition()const
     {
+        return m_errorPosition;
     }
-        
-private:
-    const Ref<AsActorClass> m_cls;
-    Ref<GlobalScope>    m_globals;
-    Ref<AsActorRef>     m_parent;
 
-    VarMap              m_members;
-    
-    AsActorList         m_childActors;
+    //Mailbox. Used by the actor runtime.
+    bool reserve (bool bounded);
+    bool enqueue (ActorMessage&& msg);
+    void dequeue (ActorMessage* pMsg);
+    bool replaceOldest (ActorMessage& msg, ActorMessage* pEvicted);
+    bool endRun (size_t processed);
     
-    typedef std::map<std::string, Ref<AsEndPointRef> > ConnectionMap;
-    ConnectionMap       m_outputConections;
-    ASValue        m_result;
-    ASValue        m_error;
-    
-    bool                m_finished;
-};
+    bool hasMessages (size_t processed)const
+    {
+        return m_mailboxCount.load(std::memory_order_acquire) > processed;
+    }
 
+    void setMailboxLimit (size_t capacity, OverflowPolicy policy);
 
-/**
- * Actor reference object
- * @param cls
- * @return 
- */
-class AsActorRef : public JSValueBase<VT_ACTOR_REF>
-{
-public:
-    static Ref<AsActorRef> create (Ref<AsActor> actor)
+    size_t mailboxCapacity()const
     {
-        return refFromNew(new AsActorRef(actor));
+        return m_mailboxCapacity;
     }
-    
-    virtual ASValue readField(const std::string& key)const
+
+    OverflowPolicy overflowPolicy()const
     {
-        return getEndPoint(key);
+        return m_overflowPolicy;
     }
 
-    bool isRunning()
+    size_t mailboxDepth()const
     {
-        return m_ref->isRunning();
+        return m_mailboxDepth;
     }
-        
-    Ref<AsActor> getActor()const
+
+    size_t mailboxHighWatermark()const
     {
-        return m_ref;
+        return m_mailboxHighWatermark;
     }
-    
-    ASValue getResult()
+
+    size_t droppedMessages()const
     {
-        if (isRunning())
-            return jsNull();
-        else
-            return m_ref->getResult();
+        return m_droppedMessages;
     }
-    
-    ASValue getError()
+
+    void messageDropped()
     {
-        if (isRunning())
-            return jsNull();
-        else
-            return m_ref->getError();
+        ++m_droppedMessages;
     }
-    
-    Ref<AsEndPointRef> getEndPoint (const std::string& name)const;
-    
-protected:
-    AsActorRef (Ref<AsActor> actor) : m_ref (actor)
+
+    //Backpressure. Used by the actor runtime.
+    void block (BlockedMessage&& msg);
+    void deliverBlocked (const std::function<void (BlockedMessage&)>& deliver);
+
+    bool hasBlockedSenders()const
     {
+        return m_hasBlockedSenders;
     }
-    
+
+protected:
+    AsActor (Ref<AsActorClass> cls, Ref<JSModule> globals, Ref<AsActor> parent);
+    ~AsActor();
+
 private:
-    const Ref<AsActor> m_ref;
+    void takeOldest (ActorMessage* pMsg);
+    bool evictOldest (ActorMessage& msg, ActorMessage* pEvicted);
+
+    const Ref<AsActorClass> m_cls;
+    const Ref<JSModule>     m_globals;
+    const Ref<AsActor>      m_parent;
+
+    ASValue                 m_constructor;
+    VarMap                  m_handlers;
+    Ref<RefCountObj>        m_nativeState;
+
+    typedef std::map<std::string, Ref<AsEndPointRef> > ConnectionMap;
+    ConnectionMap           m_connections;
+    mutable std::mutex      m_connectionsMutex;
+
+    /**
+     * Mailbox node. The mailbox is a lock-free multiple producer, single 
+     * consumer queue: a linked list whose first node is a consumed message.
+     * Producers link new nodes at the head, the actor takes them from the tail.
+     * The mailbox mutex is only taken by the producers which evict the oldest 
+     * message of a full mailbox. The consumer only takes it while there are
+     * such producers; otherwise, it announces that it is taking a message, 
+     * and evicting producers wait for it to finish.
+     */
+    struct MailboxNode
+    {
+        ActorMessage                msg;
+        std::atomic<MailboxNode*>   next;
+        
+        MailboxNode() : next(NULL)
+        {}
+    };
     
+    std::atomic<MailboxNode*>   m_mailboxHead;
+    MailboxNode*                m_mailboxTail;
+    std::atomic<size_t>         m_mailboxCount;     //Messages not yet processed.
+
+    std::atomic<size_t>         m_mailboxDepth;     //Messages not yet taken from the mailbox.
+    std::atomic<size_t>         m_mailboxHighWatermark;
+    std::atomic<size_t>         m_mailboxCapacity;  //Zero means unbounded.
+    std::atomic<OverflowPolicy> m_overflowPolicy;
+    std::atomic<size_t>         m_droppedMessages;
+
+    std::mutex                  m_mailboxMutex;     //Also guards blocked messages.
+    std::atomic<int>            m_evictors;         //Producers evicting messages.
+    std::atomic<bool>           m_dequeuing;        //Consumer taking a message without the mutex.
+    std::deque<BlockedMessage>  m_blockedMessages;
+    std::atomic<bool>           m_hasBlockedSenders;
+
+    std::atomic<bool>       m_running;
+    ASValue                 m_result;
+    ASValue                 m_error;
+    ScriptPosition          m_errorPosition;
 };
 
 /**
- * Message input or output end point object
+ * Actor reference object. It is deep-frozen, so it can be sent in messages.
+ * Its fields are the input and output messages of the actor.
  */
-class AsEndPoint : public JSFunction
+class AsActorRef : public JSObject
 {
 public:
-    static Ref<AsEndPoint> create (const std::string& name, 
-                                   const StringVector& params,  
-                                   bool input)
+    static Ref<AsActorRef> create (Ref<AsActor> actor);
+
+    virtual ASValue readField(const std::string& key)const;
+
+    Ref<AsActor> getActor()const
     {
-        return refFromNew (new AsEndPoint (name, params, input));
+        return m_actor;
     }
 
-    static Ref<AsEndPoint> createInput (const std::string& name, 
-                                        const StringVector& params, 
-                                        Ref<MvmRoutine> code)
+protected:
+    AsActorRef (Ref<AsActor> actor);
+
+    virtual Ref<JSObject>   clone (bool _mutable);
+
+private:
+    const Ref<AsActor>  m_actor;
+};
+
+/**
+ * Reference to an input or output message of an actor. Calling it sends the
+ * message. It is deep-frozen, so it can be sent in messages.
+ */
+class AsEndPointRef : public JSObject
+{
+public:
+    static Ref<AsEndPointRef> create (Ref<AsActor> actor, const std::string& name, bool input);
+
+    virtual ASValue readField(const std::string& key)const;
+
+    Ref<AsActor> getActor()const
     {
-        return refFromNew (new AsEndPoint (name, params, code));
+        return m_actor;
     }
 
-    static Ref<AsEndPoint> createNative(const std::string& name,
-                                        const StringVector& params,
-                                        JSNativeFn fnPtr
-                                        )
+    const std::string& getName()const
     {
-        return refFromNew (new AsEndPoint (name, params, fnPtr));
+        return m_name;
     }
-    
-    
+
     bool isInput()const
     {
-        return m_isInput;
+        return m_input;
     }
 
-    virtual JSValueTypes getType()const
-    {
-        return isInput() ? VT_INPUT_EP : VT_OUTPUT_EP;
-    }
-    
-    virtual std::string toString()const;
-    
 protected:
-    AsEndPoint (const std::string& name, const StringVector& params, bool input) :
-    JSFunction(name, params, NULL), m_isInput (input)
-    {
-    }
+    AsEndPointRef (Ref<AsActor> actor, const std::string& name, bool input);
+
+    virtual Ref<JSObject>   clone (bool _mutable);
 
-    AsEndPoint (const std::string& name, const StringVector& params, Ref<MvmRoutine> code);
-    AsEndPoint (const std::string& name, const StringVector& params, JSNativeFn pNative);
-   
 private:
-    const bool m_isInput;
+    const Ref<AsActor>  m_actor;
+    const std::string   m_name;
+    const bool          m_input;
 };
 
-//TODO: May be, I am abusing of subclassing from 'JSFunction'. There should
-//be something like a 'JSCallable' base class.
-
 /**
- * Async Script message reference.
- * Holds a reference to the message, and to the actor.
+ * Timer which sends a message to an actor input after a delay, once or
+ * periodically. It is deep-frozen, so it can be sent in messages. Script code
+ * uses it to cancel the timer.
+ * Its timer wheel entry is only accessed by the actor runtime, under its lock.
  */
-class AsEndPointRef : public JSValueBase<VT_INPUT_EP_REF>
+class AsTimer : public JSObject, public TimerEntry
 {
 public:
-    static Ref<AsEndPointRef> create (Ref<AsEndPoint> endPoint, Ref<AsActorRef> actor)
+    static Ref<AsTimer> create (Ref<AsActor> actor,
+                                ASValue handler,
+                                const ValueVector& params,
+                                uint64_t period);
+
+    virtual std::string toString(ExecutionContext* ec)const
     {
-        return refFromNew (new AsEndPointRef (endPoint, actor));
+        return "[timer]";
     }
-    
-    bool isInput()const
+
+    Ref<AsActor> getActor()const
+    {
+        return m_actor;
+    }
+
+    ASValue getHandler()const
     {
-        return m_endPoint->isInput();
+        return m_handler;
     }
-    
-    virtual JSValueTypes getType()const
+
+    const ValueVector& getParams()const
     {
-        return (m_endPoint->getType() == VT_OUTPUT_EP) ? VT_OUTPUT_EP_REF : VT_INPUT_EP_REF;
+        return m_params;
     }
-    
-    ASValue call (Ref<FunctionScope> scope);
-    
-    Ref<AsActorRef> getActor()const
+
+    uint64_t getPeriod()const
     {
-        return m_actor;
+        return m_period;
     }
-    
-    Ref<AsEndPoint> getEndPoint()const
+
+    //Cancellation state. Only accessed by the actor runtime, under its lock.
+    bool isCancelled()const
     {
-        return m_endPoint;
+        return m_cancelled;
     }
-    
-protected:
-    AsEndPointRef (Ref<AsEndPoint> endPoint, Ref<AsActorRef> actor)
-        : m_endPoint (endPoint), m_actor(actor)
+
+    void cancel()
     {
+        m_cancelled = true;
     }
-    
+
+protected:
+    AsTimer (Ref<AsActor> actor, ASValue handler, const ValueVector& params, uint64_t period);
+
+    virtual Ref<JSObject>   clone (bool _mutable);
+
 private:
-    const Ref<AsEndPoint>   m_endPoint;
-    const Ref<AsActorRef>   m_actor;
+    const Ref<AsActor>  m_actor;
+    const ASValue       m_handler;
+    const ValueVector   m_params;
+    const uint64_t      m_period;   //Zero for one-shot timers.
+    bool                m_cancelled = false;
 };
 
-#endif	/* ASVARS_H */
+/**
+ * Casts a value to an actor system object type.
+ * @return A null reference if the value is not of the requested type.
+ */
+template <class T>
+Ref<T> actorCast (ASValue value)
+{
+    if (value.getType() != VT_OBJECT)
+        return Ref<T>();
+    else
+        return ref(dynamic_cast<T*>(value.staticCast<JSObject>().getPointer()));
+}
 
+#endif	/* ASACTORS_H */
@@ -0,0 +1,137 @@
+/* 
+ * File:   asIntern.cpp
+ * Author: ghernan
+ * 
+ * Intern table (hash-consing) for deep-frozen values. Structurally equal 
+ * interned values share a single instance, so they can be compared by address.
+ *
+ * Created on October 18, 2026, 10:12 AM
+ */
+
+#include "ascript_pch.hpp"
+#include "asIntern.h"
+
+#include <unordered_map>
+#include <mutex>
+
+using namespace std;
+
+typedef unordered_multimap<size_t, JSObject*>   InternMap;
+
+/**
+ * Gets the table of interned objects.
+ * It is never destroyed, because interned objects may outlive static objects
+ * and they access the table on destruction.
+ * @return 
+ */
+static InternMap& internMap()
+{
+    static InternMap* table = new InternMap;
+    
+    return *table;
+}
+
+/**
+ * Guards the table. Values are interned and destroyed from all the threads
+ * which run actors.
+ * @return 
+ */
+static std::mutex& internMutex()
+{
+    static std::mutex* mutex = new std::mutex;
+    
+    return *mutex;
+}
+
+static bool s_autoIntern = false;
+
+/**
+ * Looks for an object structurally equal to 'candidate' in the table. If it is
+ * found, returns the existing object. If not, 'candidate' is added to the table
+ * and returned.
+ * 'candidate' must be deep-frozen, and its members must be already interned 
+ * (for maximum sharing, not for correctness)
+ * @param candidate
+ * @return 
+ */
+Ref<JSObject> InternTable::insert (Ref<JSObject> candidate)
+{
+    ASSERT (candidate->getMutability() == MT_DEEPFROZEN);
+    
+    if (candidate->isInterned())
+        return candidate;
+    
+    const size_t            h = candidate->hash();
+    
+    //References taken to the compared objects. They are released after 
+    //unlocking the table, as the destruction of an object removes it.
+    vector< Ref<JSObject> > compared;
+    lock_guard<mutex>       lock (internMutex());
+    auto&                   table = internMap();
+    auto                    range = table.equal_range(h);
+    
+    for (auto it = range.first; it != range.second; ++it)
+    {
+        //Objects whose count has reached zero are being destroyed by another
+        //thread, which is waiting to remove them from the table.
+        if (!it->second->tryAddref())
+            continue;
+        
+        compared.push_back(ref(it->second));
+        it->second->release();
+        
+        if (it->second->structuralEquals(*candidate.getPointer()))
+            return compared.back();
+    }
+    
+    table.insert(make_pair(h, candidate.getPointer()));
+    candidate->m_interned.store(true, std::memory_order_release);
+    
+    return candidate;
+}
+
+/**
+ * Removes an object from the table. Called from 'JSObject' destructor.
+ * @param obj
+ */
+void InternTable::remove (JSObject* obj)
+{
+    lock_guard<mutex> lock (internMutex());
+    auto&   table = internMap();
+    auto    range = table.equal_range(obj->m_hash.load(std::memory_order_relaxed));
+    
+    for (auto it = range.first; it != range.second; ++it)
+    {
+        if (it->second == obj)
+        {
+            table.erase(it);
+            break;
+        }
+    }
+    
+    obj->m_interned.store(false, std::memory_order_release);
+}
+
+/**
+ * Number of interned objects currently alive.
+ * @return 
+ */
+size_t InternTable::size ()
+{
+    lock_guard<mutex> lock (internMutex());
+    return internMap().size();
+}
+
+/**
+ * Enables or disables automatic interning of 'deepFreeze' results.
+ * @param enabled
+ */
+void InternTable::setAutoIntern (bool enabled)
+{
+    s_autoIntern = enabled;
+}
+
+bool InternTable::autoIntern ()
+{
+    return s_autoIntern;
+}
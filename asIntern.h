@@ -0,0 +1,34 @@
+/* 
+ * File:   asIntern.h
+ * Author: ghernan
+ * 
+ * Intern table (hash-consing) for deep-frozen values. Structurally equal 
+ * interned values share a single instance, so they can be compared by address.
+ *
+ * Created on October 18, 2026, 10:12 AM
+ */
+
+#pragma once
+#ifndef ASINTERN_H
+#define	ASINTERN_H
+
+#include "asObjects.h"
+
+/**
+ * Global table of interned objects.
+ * It holds weak references: objects remove themselves from the table when 
+ * they are destroyed.
+ */
+class InternTable
+{
+public:
+    static Ref<JSObject>    insert (Ref<JSObject> candidate);
+    static void             remove (JSObject* obj);
+    static size_t           size ();
+    
+    static void             setAutoIntern (bool enabled);
+    static bool             autoIntern ();
+};
+
+#endif	/* ASINTERN_H */
+
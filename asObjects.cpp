@@ -14,6 +14,9 @@
 #include "microVM.h"
 #include "jsArray.h"
 #include "ScriptException.h"
+#include "asIntern.h"
+
+#include <typeinfo>
 
 using namespace std;
 
@@ -168,7 +171,7 @@ ASValue JSClass::scSetEnv(ExecutionContext* ec)
 
 
 JSObject::JSObject(Ref<JSClass> cls, JSMutability mutability) : 
-m_cls (cls), m_mutability(mutability)
+m_cls (cls), m_hash(0), m_interned(false), m_mutability(mutability)
 {
     ASSERT(cls.notNull());
 }
@@ -177,6 +180,8 @@ m_cls (cls), m_mutability(mutability)
 JSObject::~JSObject()
 {
     //printf ("Destroying object: %s\n", this->getJSON(0).c_str());
+    if (isInterned())
+        InternTable::remove(this);
 }
 
 /**
@@ -241,6 +246,94 @@ ASValue JSObject::deepFreeze(ASValue::ValuesMap& transformed)
 }
 
 
+/**
+ * Gets the canonical instance of a deep-frozen object from the intern table.
+ * Members are interned first (bottom-up), so structurally equal object graphs
+ * end up sharing the same instances.
+ * Objects which are not deep-frozen, or which belong to a specialized runtime 
+ * class, are returned unchanged.
+ * @param transformed   Already interned values. Also used to detect cycles.
+ * @return 
+ */
+ASValue JSObject::intern(ASValue::ValuesMap& transformed)
+{
+    auto me = value();
+    
+    if (isInterned() || m_mutability != MT_DEEPFROZEN || typeid(*this) != typeid(JSObject))
+        return me;
+
+    auto it = transformed.find(me);
+    if (it != transformed.end())
+        return it->second;
+    
+    //Cycles are not interned: the object is left as is if it is reached again 
+    //while its members are being interned.
+    transformed[me] = me;
+    
+    bool changed = false;
+    VarMap members = m_members.map([&transformed, &changed](const string& name, ASValue val){
+        auto canonical = val.intern(transformed);
+        changed = changed || !canonical.isIdentical(val);
+        return canonical;
+    });
+    
+    Ref<JSObject>   candidate (this);
+    if (changed)
+    {
+        candidate = JSObject::create(m_cls);
+        candidate->m_members = members;
+        candidate->m_mutability = MT_DEEPFROZEN;
+    }
+    
+    auto result = InternTable::insert(candidate)->value();
+    transformed[me] = result;
+    
+    return result;
+}
+
+/**
+ * Returns the structural hash of the object, calculating it on the first call.
+ * It is only stable on deep-frozen objects.
+ * @return 
+ */
+size_t JSObject::hash()const
+{
+    size_t  result = m_hash.load(std::memory_order_relaxed);
+    
+    if (result == 0)
+    {
+        result = structuralHash();
+        if (result == 0)
+            result = 1;
+        m_hash.store(result, std::memory_order_relaxed);
+    }
+    
+    return result;
+}
+
+/**
+ * Calculates a hash from object class and members.
+ * @return 
+ */
+size_t JSObject::structuralHash()const
+{
+    return hashCombine (std::hash<void*>()(m_cls.getPointer()), m_members.shallowHash());
+}
+
+/**
+ * Checks if two objects have the same runtime type, the same class and the same
+ * member values. Members are compared by identity, it is not a recursive comparison.
+ * @param b
+ * @return 
+ */
+bool JSObject::structuralEquals(const JSObject& b)const
+{
+    if (typeid(*this) != typeid(b) || m_cls.getPointer() != b.m_cls.getPointer())
+        return false;
+    else
+        return m_members.shallowEquals(b.m_members);
+}
+
 /**
  * Creates a mutable copy of an object
  * @param forceClone
@@ -383,6 +476,8 @@ double JSObject::compare(const ASValue& b, ExecutionContext* ec)const
 JSObject::JSObject(const JSObject& src, bool _mutable)
 : m_members (src.m_members)
 , m_cls (src.m_cls)
+, m_hash (0)
+, m_interned (false)
 , m_mutability (selectMutability(src, _mutable))
 {
 }
@@ -662,6 +757,336 @@ ASValue JSObject::getFieldProperty (const std::string& field, const std::string&
 
 
 
+// JSModule
+//
+//////////////////////////////////////////////////
+
+/**
+ * Creates an empty module globals object.
+ * @return 
+ */
+Ref<JSModule> JSModule::create()
+{
+    return refFromNew(new JSModule);
+}
+
+JSModule::JSModule() : JSObject(DefaultClass, MT_MUTABLE)
+{
+}
+
+/**
+ * Assigns a slot to a module symbol, or returns the existing one.
+ * If the symbol is already a field of the object, its value is moved to the slot.
+ * @param name
+ * @return Slot index.
+ */
+int JSModule::declareSlot (const std::string& name)
+{
+    auto it = m_slotIndexes.find(name);
+    
+    if (it != m_slotIndexes.end())
+        return it->second;
+    
+    Slot    slot;
+    
+    slot.name = name;
+    slot.defined = m_members.tryGetValue(name, &slot.value);
+    slot.isConst = m_members.isConst(name);
+    m_members.removeValue(name);
+    
+    const int index = (int)m_slots.size();
+    
+    m_slots.push_back(slot);
+    m_slotIndexes[name] = index;
+    
+    return index;
+}
+
+/**
+ * Gets the slot assigned to a symbol.
+ * @param name
+ * @return Slot index, or -1 if the symbol has not a slot.
+ */
+int JSModule::getSlot (const std::string& name)const
+{
+    auto it = m_slotIndexes.find(name);
+    
+    if (it != m_slotIndexes.end())
+        return it->second;
+    else
+        return -1;
+}
+
+/**
+ * Reads a slot value. If the slot has not been written yet, the read is 
+ * resolved as a regular field read (which can find class members).
+ * @param index
+ * @return 
+ */
+ASValue JSModule::readSlot (int index)const
+{
+    ASSERT (index >= 0 && index < (int)m_slots.size());
+    const Slot& slot = m_slots[index];
+    
+    if (slot.defined)
+        return slot.value;
+    else
+        return JSObject::readField(slot.name);
+}
+
+/**
+ * Writes a slot value. Follows the same rules as 'writeField'.
+ * @param index
+ * @param value
+ * @param isConst
+ * @return The value of the slot after the operation.
+ */
+ASValue JSModule::writeSlot (int index, ASValue value, bool isConst)
+{
+    ASSERT (index >= 0 && index < (int)m_slots.size());
+    Slot&   slot = m_slots[index];
+    
+    if (!isWritable(slot.name))
+        return readSlot(index);
+    
+    slot.value = value;
+    slot.defined = true;
+    slot.isConst = isConst;
+    
+    return value;
+}
+
+/**
+ * Creates a 'deep-frozen' copy of the module, as a plain object.
+ * @param transformed
+ * @return 
+ */
+ASValue JSModule::deepFreeze(ASValue::ValuesMap& transformed)
+{
+    auto me = value();
+    auto it = transformed.find(me);
+    
+    if (it != transformed.end())
+        return it->second;
+    
+    auto newObject = JSObject::create(getClass());
+    transformed[me] = newObject->value();
+    
+    auto fields = getFields(false);
+    for (auto itField = fields.begin(); itField != fields.end(); ++itField)
+    {
+        auto newValue = readField(*itField).deepFreeze(transformed);
+        newObject->writeField(*itField, newValue, !isWritable(*itField));
+    }
+    
+    newObject->setFrozen();
+    return newObject->value();
+}
+
+bool JSModule::isWritable(const std::string& key)const
+{
+    const int index = getSlot(key);
+    
+    if (index < 0)
+        return JSObject::isWritable(key);
+    else
+        return getMutability() == MT_MUTABLE && !m_slots[index].isConst;
+}
+
+ASValue JSModule::readField(const std::string& key)const
+{
+    const int index = getSlot(key);
+    
+    if (index >= 0)
+        return readSlot(index);
+    else
+        return JSObject::readField(key);
+}
+
+ASValue JSModule::writeField(const std::string& key, ASValue value, bool isConst)
+{
+    const int index = getSlot(key);
+    
+    if (index >= 0)
+        return writeSlot(index, value, isConst);
+    else
+        return JSObject::writeField(key, value, isConst);
+}
+
+ASValue JSModule::deleteField(const std::string& key)
+{
+    const int index = getSlot(key);
+    
+    if (index < 0)
+        return JSObject::deleteField(key);
+    
+    Slot&   slot = m_slots[index];
+    ASValue result = readSlot(index);
+    
+    if (isWritable(key))
+    {
+        slot.value = jsNull();
+        slot.defined = false;
+    }
+    
+    return result;
+}
+
+StringSet JSModule::getFields(bool inherited)const
+{
+    StringSet result = JSObject::getFields(inherited);
+    
+    for (auto it = m_slots.begin(); it != m_slots.end(); ++it)
+    {
+        if (it->defined)
+            result.insert(it->name);
+    }
+    
+    return result;
+}
+
+std::string JSModule::getJSON(int indent)
+{
+    return clone(true)->getJSON(indent);
+}
+
+/**
+ * Creates a copy of the module globals, which is given to a new actor, so it
+ * can access them without sharing mutable state with other threads.
+ * Values are deep-frozen, except closures whose environment is this module:
+ * they are bound to the copy, so module functions see the actor globals.
+ * Other code of the module, such as class methods, is redirected to the copy
+ * when it runs in the actor (see 'getOrigin').
+ * The copy keeps slot indexes, so the same code can run on both modules.
+ * @return 
+ */
+Ref<JSModule> JSModule::snapshot()const
+{
+    auto        result = refFromNew(new JSModule);
+    ValuesMap   transformed;
+    
+    result->m_origin = ref(getOrigin());
+    
+    auto copyValue = [this, &result, &transformed](ASValue value) -> ASValue
+    {
+        if (value.getType() != VT_CLOSURE)
+            return value.deepFreeze(transformed);
+        
+        auto closure = value.staticCast<JSClosure>();
+        auto env = closure->getEnv();
+        
+        if (env.getType() != VT_OBJECT || env.staticCast<JSObject>().getPointer() != this)
+            return value.deepFreeze(transformed);
+        
+        ValueVector     values (1, result->value());
+        auto&           params = closure->getParams();
+        
+        for (auto it = params.begin(); it != params.end(); ++it)
+            values.push_back(it->deepFreeze(transformed));
+        
+        return JSClosure::create(closure->getFunction(), values.data(), values.size())->value();
+    };
+    
+    result->m_slots = m_slots;
+    result->m_slotIndexes = m_slotIndexes;
+    for (auto it = result->m_slots.begin(); it != result->m_slots.end(); ++it)
+        it->value = copyValue(it->value);
+    
+    result->m_members = m_members.map([&copyValue](const string& name, ASValue value) {
+        return copyValue(value);
+    });
+    
+    return result;
+}
+
+/**
+ * Gets the module from which this one has been copied by 'snapshot', 
+ * following the whole chain of copies.
+ * @return The module itself if it is not a copy.
+ */
+JSModule* JSModule::getOrigin()const
+{
+    if (m_origin.notNull())
+        return m_origin.getPointer();
+    else
+        return const_cast<JSModule*>(this);
+}
+
+/**
+ * Module copies are plain objects, with slots transformed into regular fields.
+ * @param _mutable
+ * @return 
+ */
+Ref<JSObject> JSModule::clone (bool _mutable)
+{
+    auto result = JSObject::create(getClass());
+    auto fields = getFields(false);
+    
+    for (auto it = fields.begin(); it != fields.end(); ++it)
+        result->writeField(*it, readField(*it), !isWritable(*it));
+    
+    if (!_mutable)
+        result->setFrozen();
+    
+    return result;
+}
+
+// JSBox
+//
+//////////////////////////////////////////////////
+
+/**
+ * Creates a new box, which holds the given value.
+ * @param value
+ * @return 
+ */
+Ref<JSBox> JSBox::create(ASValue value)
+{
+    return refFromNew(new JSBox(value));
+}
+
+JSBox::JSBox(ASValue value) : JSObject(DefaultClass, MT_MUTABLE), m_value(value)
+{
+}
+
+/**
+ * Deep-frozen boxes hold a deep-frozen copy of the value.
+ * @param transformed
+ * @return 
+ */
+ASValue JSBox::deepFreeze(ASValue::ValuesMap& transformed)
+{
+    if (m_mutability == MT_DEEPFROZEN)
+        return value();
+    
+    auto it = transformed.find(value());
+    if (it != transformed.end())
+        return it->second;
+    
+    auto newBox = refFromNew(new JSBox(jsNull()));
+    transformed[value()] = newBox->value();
+    
+    newBox->m_value = m_value.deepFreeze(transformed);
+    newBox->m_mutability = MT_DEEPFROZEN;
+    
+    return newBox->value();
+}
+
+std::string JSBox::getJSON(int indent)
+{
+    return m_value.getJSON(indent);
+}
+
+Ref<JSObject> JSBox::clone (bool _mutable)
+{
+    auto newBox = refFromNew(new JSBox(m_value));
+    
+    if (!_mutable)
+        newBox->m_mutability = MT_FROZEN;
+    
+    return newBox;
+}
+
 ASValue scObjectFreeze(ExecutionContext* ec)
 {
     auto obj = ec->getThis();
@@ -676,6 +1101,13 @@ ASValue scObjectDeepFreeze(ExecutionContext* ec)
     return obj.deepFreeze();
 }
 
+ASValue scObjectIntern(ExecutionContext* ec)
+{
+    auto obj = ec->getThis();
+    
+    return obj.intern();
+}
+
 ASValue scObjectUnfreeze(ExecutionContext* ec)
 {
     auto obj = ec->getThis();
@@ -713,6 +1145,7 @@ Ref<JSClass> createObjectClass()
 
     addNative("function freeze()", scObjectFreeze, members);
     addNative("function deepFreeze()", scObjectDeepFreeze, members);
+    addNative("function intern()", scObjectIntern, members);
     addNative("function unfreeze(forceClone)", scObjectUnfreeze, members);
     addNative("function isFrozen(forceClone)", scObjectIsFrozen, members);
     addNative("function isDeepFrozen(forceClone)", scObjectIsDeepFrozen, members);
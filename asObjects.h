@@ -16,6 +16,8 @@
 #include "jsVars.h"
 #include "microVM.h"
 
+#include <atomic>
+
 
 /**
  * Runtime object for classes
@@ -99,12 +101,25 @@ public:
     virtual ASValue    freeze();
     virtual ASValue    deepFreeze(ASValue::ValuesMap& transformed);
     virtual ASValue    unFreeze(bool forceClone=false);
+    virtual ASValue    intern(ASValue::ValuesMap& transformed);
     
     void setFrozen();
     
+    size_t hash()const;
+    
+    bool hasCachedHash()const
+    {
+        return m_hash.load(std::memory_order_relaxed) != 0;
+    }
+    
+    bool isInterned()const
+    {
+        return m_interned.load(std::memory_order_acquire);
+    }
+    
     std::vector <ASValue > getKeys()const;
     
-    bool isWritable(const std::string& key)const;
+    virtual bool isWritable(const std::string& key)const;
 
     // JSValue
     /////////////////////////////////////////
@@ -161,13 +176,114 @@ protected:
     ASValue    callMemberFn (ASValue function, ExecutionContext* ec)const;
     ASValue    callMemberFn (ASValue function, ASValue p1, ExecutionContext* ec)const;
     ASValue    callMemberFn (ASValue function, ASValue p1, ASValue p2, ExecutionContext* ec)const;
-private:
+    
+    virtual size_t  structuralHash()const;
+    virtual bool    structuralEquals(const JSObject& b)const;
+    
+    friend class InternTable;
+    
+protected:
     VarMap          m_members;
+    
+private:
     Ref<JSClass>    m_cls;
+    //Lazily calculated. Shared objects may be hashed from several threads;
+    //all of them calculate the same value.
+    mutable std::atomic<size_t> m_hash;
+    //Written by the intern table, read without its lock.
+    std::atomic<bool>           m_interned;
     
 protected:
     JSMutability    m_mutability;
 };
 
+/**
+ * Module globals object.
+ * 
+ * Module level symbols can be assigned to slots of a dense table, which are 
+ * accessed by index from generated code ('RD_GLOBAL', 'WR_GLOBAL' instructions).
+ * Slots are still visible as fields of the object (for 'getJSON', 'eval', 
+ * module mixing...).
+ */
+class JSModule : public JSObject
+{
+public:
+    static Ref<JSModule> create();
+    
+    int     declareSlot (const std::string& name);
+    int     getSlot (const std::string& name)const;
+    
+    ASValue readSlot (int index)const;
+    ASValue writeSlot (int index, ASValue value, bool isConst);
+    
+    size_t  slotCount()const
+    {
+        return m_slots.size();
+    }
+    
+    Ref<JSModule>   snapshot()const;
+    JSModule*       getOrigin()const;
+    
+    virtual ASValue     deepFreeze(ASValue::ValuesMap& transformed);
+    virtual bool        isWritable(const std::string& key)const;
+
+    virtual ASValue     readField(const std::string& key)const;
+    virtual ASValue     writeField(const std::string& key, ASValue value, bool isConst);
+    virtual ASValue     deleteField(const std::string& key);
+    virtual StringSet   getFields(bool inherited = true)const;
+    
+    virtual std::string getJSON(int indent);
+    
+protected:
+    JSModule();
+    
+    virtual Ref<JSObject>   clone (bool _mutable);
+    
+private:
+    struct Slot
+    {
+        std::string     name;
+        ASValue         value;
+        bool            defined;
+        bool            isConst;
+    };
+    
+    std::vector<Slot>           m_slots;
+    std::map<std::string, int>  m_slotIndexes;
+    Ref<JSModule>               m_origin;
+};
+
+/**
+ * Box which holds a captured variable which is modified after being captured.
+ * It is shared by the function which declares the variable and the closures
+ * which capture it.
+ */
+class JSBox : public JSObject
+{
+public:
+    static Ref<JSBox> create(ASValue value);
+    
+    ASValue get()const
+    {
+        return m_value;
+    }
+    
+    void set(ASValue value)
+    {
+        m_value = value;
+    }
+    
+    virtual ASValue     deepFreeze(ASValue::ValuesMap& transformed);
+    virtual std::string getJSON(int indent);
+    
+protected:
+    JSBox(ASValue value);
+    
+    virtual Ref<JSObject>   clone (bool _mutable);
+    
+private:
+    ASValue     m_value;
+};
+
 #endif	/* ASOBJECTS_H */
 
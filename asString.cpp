@@ -9,6 +9,7 @@
 
 #include "ascript_pch.hpp"
 #include "asString.h"
+#include "asIntern.h"
 #include "jsArray.h"
 #include "scriptMain.h"
 #include <string>
@@ -72,7 +73,44 @@ std::string JSString::getJSON(int indent)
  */
 double JSString::compare (const ASValue& b, ExecutionContext* ec)const
 {
-    return m_text.compare (b.toString(ec));
+    if (b.getType() == VT_STRING && b.staticCast<JSObject>().getPointer() == this)
+        return 0;
+    else
+        return m_text.compare (b.toString(ec));
+}
+
+/**
+ * Returns the canonical instance of the string from the intern table.
+ * @param transformed
+ * @return 
+ */
+ASValue JSString::intern(ASValue::ValuesMap& transformed)
+{
+    if (isInterned())
+        return ASValue(this, VT_STRING);
+    else
+        return ASValue(InternTable::insert(ref(this)).getPointer(), VT_STRING);
+}
+
+/**
+ * String hash is calculated from its text
+ * @return 
+ */
+size_t JSString::structuralHash()const
+{
+    return std::hash<std::string>()(m_text);
+}
+
+/**
+ * Strings are structurally equal if they have the same text.
+ * @param b
+ * @return 
+ */
+bool JSString::structuralEquals(const JSObject& b)const
+{
+    auto strB = dynamic_cast<const JSString*>(&b);
+    
+    return strB != NULL && m_text == strB->m_text;
 }
 
 
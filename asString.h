@@ -25,6 +25,7 @@ public:
     static Ref<JSString> create(const std::string& value);
 
     virtual ASValue unFreeze(bool forceClone=false);
+    virtual ASValue intern(ASValue::ValuesMap& transformed);
 
     virtual bool toBoolean()const
     {
@@ -52,6 +53,9 @@ protected:
     : JSObject(StringClass, MT_DEEPFROZEN), m_text(text)
     {
     }
+    
+    virtual size_t  structuralHash()const;
+    virtual bool    structuralEquals(const JSObject& b)const;
 
 private:
     const std::string m_text;
@@ -29,6 +29,11 @@ Ref<AstNode> astCreateBlock(CScriptToken token)
     return refFromNew( new AstBranchNode(AST_BLOCK, token.getPosition()));    
 }
 
+Ref<AstNode> astCreateBlock(ScriptPosition pos)
+{
+    return refFromNew( new AstBranchNode(AST_BLOCK, pos));    
+}
+
 Ref<AstNode> astCreateIf (ScriptPosition pos, 
                           Ref<AstNode> condition,
                           Ref<AstNode> thenSt,
@@ -310,6 +315,18 @@ Ref<AstLiteral> AstLiteral::create(ScriptPosition pos, int value)
     return refFromNew(new AstLiteral(pos, jsInt(value)));
 }
 
+/**
+ * Creates a literal from a value. Used by optimization passes to replace 
+ * constant expressions.
+ * @param pos
+ * @param value
+ * @return 
+ */
+Ref<AstLiteral> AstLiteral::create(ScriptPosition pos, ASValue value)
+{
+    return refFromNew(new AstLiteral(pos, value));
+}
+
 /**
  * Creates a 'null' literal
  * @param pos
@@ -466,8 +483,9 @@ std::string astTypeToString(AstNodeTypes type)
 {
     typedef map<AstNodeTypes, string>   TypesMap;
     static TypesMap types;
+    static std::once_flag initialized;
     
-    if (types.empty())
+    std::call_once (initialized, []()
     {
         types[AST_SCRIPT] = "AST_SCRIPT";
         types[AST_BLOCK] = "AST_BLOCK";
@@ -499,7 +517,7 @@ std::string astTypeToString(AstNodeTypes type)
         types[AST_EXPORT] = "AST_EXPORT";
         types[AST_IMPORT] = "AST_IMPORT";
         //types[AST_TYPES_COUNT] = "AST_TYPES_COUNT";
-    }
+    });
     
     TypesMap::const_iterator it = types.find(type);
     
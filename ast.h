@@ -70,6 +70,7 @@ std::string astTypeToString(AstNodeTypes type);
 //Constructor functions
 Ref<AstNode> astCreateScript(ScriptPosition pos);
 Ref<AstNode> astCreateBlock(CScriptToken token);
+Ref<AstNode> astCreateBlock(ScriptPosition pos);
 Ref<AstNode> astCreateIf (ScriptPosition pos, 
                           Ref<AstNode> condition,
                           Ref<AstNode> thenSt,
@@ -153,6 +154,11 @@ public:
         ASSERT(!"addChildren unsupported");
     }
     
+    virtual void setChild(size_t index, Ref<AstNode> child)
+    {
+        ASSERT(!"setChild unsupported");
+    }
+    
     virtual void addParam(const std::string& paramName)
     {
         ASSERT(!"addParam unsupported");
@@ -221,6 +227,12 @@ public:
         m_children.push_back(child);
     }
     
+    virtual void setChild(size_t index, Ref<AstNode> child)
+    {
+        ASSERT (index < m_children.size());
+        m_children[index] = child;
+    }
+    
     AstBranchNode(AstNodeTypes type, const ScriptPosition& pos) : AstNode(type, pos)
     {
     }
@@ -362,6 +374,7 @@ class AstLiteral : public AstNode
 public:
     static Ref<AstLiteral> create(CScriptToken token);
     static Ref<AstLiteral> create(ScriptPosition pos, int value);
+    static Ref<AstLiteral> create(ScriptPosition pos, ASValue value);
     static Ref<AstLiteral> createNull(ScriptPosition pos);
     
     virtual ASValue getValue()const
@@ -442,6 +455,12 @@ public:
         return m_properties;
     }
     
+    void setPropertyExpr (size_t index, Ref<AstNode> expr)
+    {
+        ASSERT (index < m_properties.size());
+        m_properties[index].expr = expr;
+    }
+    
     virtual ASValue toJS()const;
 
 protected:
@@ -0,0 +1,376 @@
+/* 
+ * File:   astOptimizer.cpp
+ * Author: ghernan
+ * 
+ * Optimization passes over the Abstract Syntax Tree. They are run after 
+ * semantic check, and before code generation.
+ * 
+ * Constant folding: operators whose operands are literals are evaluated at 
+ * compile time, by calling the same native functions used at runtime, so the
+ * results are exactly the same. Conditional operators and 'if' statements with
+ * a constant condition are replaced by the taken branch.
+ *
+ * Created on October 18, 2026, 12:40 PM
+ */
+
+#include "ascript_pch.hpp"
+#include "astOptimizer.h"
+#include "mvmCodegen.h"
+#include "mvmFunctions.h"
+#include "ScriptException.h"
+
+#include <math.h>
+
+using namespace std;
+
+Ref<AstNode> optimizeNode (Ref<AstNode> node);
+void optimizeChildren (Ref<AstNode> node);
+
+Ref<AstNode> foldBinaryOp (Ref<AstNode> node);
+Ref<AstNode> foldPrefixOp (Ref<AstNode> node);
+Ref<AstNode> foldLogicalOp (Ref<AstNode> node);
+Ref<AstNode> foldConditional (Ref<AstNode> node);
+Ref<AstNode> foldIf (Ref<AstNode> node);
+
+bool isLiteral (Ref<AstNode> node);
+bool isDeclaration (Ref<AstNode> node);
+bool callOperator (const string& fnName, const ValueVector& params, ASValue* result);
+Ref<AstNode> createLiteral (const ScriptPosition& pos, ASValue value);
+
+/**
+ * Optimizes an script AST. The tree is modified in place.
+ * @param script
+ */
+void optimizeAst (Ref<AstNode> script)
+{
+    ASSERT (script->getType() == AST_SCRIPT);
+    
+    optimizeChildren(script);
+}
+
+/**
+ * Optimizes a node.
+ * @param node
+ * @return The same node or a replacement node.
+ */
+Ref<AstNode> optimizeNode (Ref<AstNode> node)
+{
+    if (node.isNull())
+        return node;
+    
+    optimizeChildren(node);
+    
+    switch (node->getType())
+    {
+    case AST_BINARYOP:      return foldBinaryOp(node);
+    case AST_PREFIXOP:      return foldPrefixOp(node);
+    case AST_CONDITIONAL:   return foldConditional(node);
+    case AST_IF:            return foldIf(node);
+    default:                return node;
+    }
+}
+
+/**
+ * Optimizes the children of a node (which include function bodies and 
+ * object properties)
+ * @param node
+ */
+void optimizeChildren (Ref<AstNode> node)
+{
+    switch (node->getType())
+    {
+    case AST_FUNCTION:
+    case AST_INPUT:
+    case AST_OUTPUT:
+    {
+        auto fnNode = node.staticCast<AstFunction>();
+        fnNode->setCode(optimizeNode(fnNode->getCode()));
+        break;
+    }
+    
+    case AST_OBJECT:
+    {
+        auto objNode = node.staticCast<AstObject>();
+        auto& properties = objNode->getProperties();
+        
+        for (size_t i = 0; i < properties.size(); ++i)
+            objNode->setPropertyExpr(i, optimizeNode(properties[i].expr));
+        break;
+    }
+    
+    default:
+    {
+        auto& children = node->children();
+        
+        for (size_t i = 0; i < children.size(); ++i)
+        {
+            auto newChild = optimizeNode(children[i]);
+            
+            if (newChild.getPointer() != children[i].getPointer())
+                node->setChild(i, newChild);
+        }
+        break;
+    }
+    }
+}
+
+/**
+ * Folds binary operators with constant operands.
+ * @param node
+ * @return 
+ */
+Ref<AstNode> foldBinaryOp (Ref<AstNode> node)
+{
+    auto    opNode = node.staticCast<AstOperator>();
+    
+    if (opNode->code == LEX_OROR || opNode->code == LEX_ANDAND)
+        return foldLogicalOp(node);
+    
+    const string    fnName = binaryOperatorFunction(opNode->code);
+    if (fnName.empty())
+        return node;
+    
+    auto    left = node->children()[0];
+    auto    right = node->children()[1];
+    
+    if (isLiteral(left) && isLiteral(right))
+    {
+        ValueVector params;
+        ASValue     result;
+        
+        params.push_back(left->getValue());
+        params.push_back(right->getValue());
+        
+        if (callOperator(fnName, params, &result))
+            return createLiteral(node->position(), result);
+    }
+    else if (opNode->code == '+' && isLiteral(right) && right->getValue().getType() == VT_STRING
+             && left->getType() == AST_BINARYOP)
+    {
+        //'(x + "a") + "b"' is transformed into 'x + "ab"'. The inner addition
+        //always yields a string, so both expressions are equivalent.
+        auto    leftOp = left.staticCast<AstOperator>();
+        auto    innerRight = left->children()[1];
+        
+        if (leftOp->code == '+' && isLiteral(innerRight) && innerRight->getValue().getType() == VT_STRING)
+        {
+            ASValue result = jsString(innerRight->getValue().toString() + right->getValue().toString());
+            
+            left->setChild(1, createLiteral(innerRight->position(), result));
+            return left;
+        }
+    }
+    
+    return node;
+}
+
+/**
+ * Folds unary prefix operators with a constant operand.
+ * @param node
+ * @return 
+ */
+Ref<AstNode> foldPrefixOp (Ref<AstNode> node)
+{
+    auto    opNode = node.staticCast<AstOperator>();
+    auto    child = node->children()[0];
+    
+    if (!isLiteral(child))
+        return node;
+    
+    //Unary plus does not generate any code
+    if (opNode->code == '+')
+        return createLiteral(node->position(), child->getValue());
+    
+    const string    fnName = prefixOperatorFunction(opNode->code);
+    if (fnName.empty())
+        return node;
+    
+    ValueVector params;
+    ASValue     result;
+
+    params.push_back(child->getValue());
+
+    if (callOperator(fnName, params, &result))
+        return createLiteral(node->position(), result);
+    else
+        return node;
+}
+
+/**
+ * Folds logical operators ('&&', '||') when the left operand is constant.
+ * Logical operators yield the value of the last evaluated operand.
+ * @param node
+ * @return 
+ */
+Ref<AstNode> foldLogicalOp (Ref<AstNode> node)
+{
+    auto    opNode = node.staticCast<AstOperator>();
+    auto    left = node->children()[0];
+    auto    right = node->children()[1];
+    
+    if (!isLiteral(left))
+        return node;
+    
+    const bool  leftValue = left->getValue().toBoolean();
+    
+    if (opNode->code == LEX_OROR)
+        return leftValue ? left : right;
+    else
+        return leftValue ? right : left;
+}
+
+/**
+ * Folds conditional operator ('?') with a constant condition.
+ * @param node
+ * @return 
+ */
+Ref<AstNode> foldConditional (Ref<AstNode> node)
+{
+    auto    condition = node->children()[0];
+    
+    if (!isLiteral(condition))
+        return node;
+    
+    return node->children()[condition->getValue().toBoolean() ? 1 : 2];
+}
+
+/**
+ * Removes dead branches of an 'if' statement with a constant condition.
+ * The taken branch is placed in a block, as 'if' statements, and blocks, 
+ * yield 'null'. Branches which are declarations are not removed, because the
+ * declaration is visible after the 'if' statement.
+ * @param node
+ * @return 
+ */
+Ref<AstNode> foldIf (Ref<AstNode> node)
+{
+    auto    condition = node->children()[0];
+    
+    if (!isLiteral(condition))
+        return node;
+    
+    const bool      conditionValue = condition->getValue().toBoolean();
+    Ref<AstNode>    taken;
+    Ref<AstNode>    dead;
+    
+    if (node->childExists(1))
+        (conditionValue ? taken : dead) = node->children()[1];
+    if (node->childExists(2))
+        (conditionValue ? dead : taken) = node->children()[2];
+    
+    if (isDeclaration(taken) || isDeclaration(dead))
+        return node;
+    
+    if (taken.notNull() && taken->getType() == AST_BLOCK)
+        return taken;
+
+    auto block = astCreateBlock(node->position());
+    if (taken.notNull())
+        block->addChild(taken);
+    
+    return block;
+}
+
+/**
+ * Checks if a node is a primitive literal (number, string, boolean, null)
+ * @param node
+ * @return 
+ */
+bool isLiteral (Ref<AstNode> node)
+{
+    return node.notNull() && node->getType() == AST_LITERAL;
+}
+
+/**
+ * Checks if a node declares a symbol in the current scope.
+ * @param node
+ * @return 
+ */
+bool isDeclaration (Ref<AstNode> node)
+{
+    if (node.isNull())
+        return false;
+    
+    switch (node->getType())
+    {
+    case AST_VAR:
+    case AST_CONST:
+    case AST_FUNCTION:
+    case AST_CLASS:
+    case AST_ACTOR:
+    case AST_EXPORT:
+    case AST_IMPORT:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/**
+ * Calls the native function which implements an operator.
+ * @param fnName
+ * @param params
+ * @param result    [out] Operation result.
+ * @return false if the operator cannot be evaluated at compile time. In this 
+ * case, it is left to be evaluated (and maybe report an error) at runtime.
+ */
+bool callOperator (const string& fnName, const ValueVector& params, ASValue* result)
+{
+    static Ref<JSObject>   operators;
+    static std::once_flag  initialized;
+    
+    std::call_once (initialized, []()
+    {
+        operators = JSObject::create();
+        registerMvmFunctions(operators);
+    });
+    
+    ASValue fnVal = operators->readField(fnName);
+    if (fnVal.isNull())
+        return false;
+    
+    ExecutionContext    ec ("", NULL);
+    
+    try
+    {
+        ec.stack = params;
+        ec.push(fnVal);
+        mvmExecCall ((int)params.size(), &ec);
+        *result = ec.pop();
+    }
+    catch (const RuntimeError&)
+    {
+        return false;
+    }
+    
+    switch (result->getType())
+    {
+    case VT_NULL:
+    case VT_BOOL:
+    case VT_STRING:
+        return true;
+
+    case VT_NUMBER:
+    {
+        //'NaN' and '-0' are not folded, as constant tables cannot tell them 
+        //apart from other numbers.
+        const double value = result->toDouble();
+        return !isnan(value) && !(value == 0 && signbit(value));
+    }
+    
+    default:
+        return false;
+    }
+}
+
+/**
+ * Creates a literal node to replace a folded expression. It keeps the position
+ * of the original expression.
+ * @param pos
+ * @param value
+ * @return 
+ */
+Ref<AstNode> createLiteral (const ScriptPosition& pos, ASValue value)
+{
+    return AstLiteral::create(pos, value);
+}
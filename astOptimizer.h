@@ -0,0 +1,20 @@
+/* 
+ * File:   astOptimizer.h
+ * Author: ghernan
+ * 
+ * Optimization passes over the Abstract Syntax Tree. They are run after 
+ * semantic check, and before code generation.
+ *
+ * Created on October 18, 2026, 12:40 PM
+ */
+
+#pragma once
+#ifndef ASTOPTIMIZER_H
+#define	ASTOPTIMIZER_H
+
+#include "ast.h"
+
+void optimizeAst (Ref<AstNode> script);
+
+#endif	/* ASTOPTIMIZER_H */
+
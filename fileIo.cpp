@@ -0,0 +1,424 @@
+/*
+ * File:   fileIo.cpp
+ * Author: ghernan
+ *
+ * Asynchronous file I/O: positional reads and writes of regular files, whose
+ * completions are notified on a service thread. It uses Linux 'io_uring'
+ * when it is available, and a pool of threads doing blocking 'pread' and
+ * 'pwrite' calls otherwise.
+ *
+ * Created on October 18, 2026, 11:55 PM
+ */
+
+#include "ascript_pch.hpp"
+#include "fileIo.h"
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+using namespace std;
+
+/**
+ * Performs a request with a blocking system call.
+ * @param request
+ * @return Number of bytes transferred, or a negated 'errno' value.
+ */
+static ssize_t performRequest (FileIoRequest* request)
+{
+    for (;;)
+    {
+        const ssize_t n = request->op == FileIoRequest::READ
+            ? pread(request->fd, &request->buffer[0], request->buffer.size(), request->offset)
+            : pwrite(request->fd, request->buffer.data(), request->buffer.size(), request->offset);
+
+        if (n >= 0)
+            return n;
+        else if (errno != EINTR)
+            return -errno;
+    }
+}
+
+/**
+ * File I/O service based on a pool of threads, which perform the requests
+ * with blocking system calls.
+ */
+class ThreadPoolFileIo : public FileIoService
+{
+public:
+    static const int THREADS = 4;
+
+    ThreadPoolFileIo ()
+    {
+        for (int i = 0; i < THREADS; ++i)
+            m_threads.push_back(std::thread([this]() { loop(); }));
+    }
+
+    /**
+     * Stops the threads. Requests not yet started are discarded.
+     */
+    ~ThreadPoolFileIo ()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+        }
+        m_available.notify_all();
+
+        for (auto it = m_threads.begin(); it != m_threads.end(); ++it)
+            it->join();
+    }
+
+    virtual void submit (Ref<FileIoRequest> request)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_queue.push_back(request);
+        }
+        m_available.notify_one();
+    }
+
+    virtual const char* backend ()const
+    {
+        return "threads";
+    }
+
+private:
+    void loop ()
+    {
+        for (;;)
+        {
+            Ref<FileIoRequest>  request;
+
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+
+                m_available.wait(lock, [this]() { return m_stopping || !m_queue.empty(); });
+                if (m_stopping)
+                    return;
+
+                request = m_queue.front();
+                m_queue.pop_front();
+            }
+
+            request->onComplete(performRequest(request.getPointer()));
+        }
+    }
+
+    std::vector<std::thread>            m_threads;
+    std::mutex                          m_mutex;
+    std::condition_variable             m_available;
+    std::deque< Ref<FileIoRequest> >    m_queue;
+    bool                                m_stopping = false;
+};
+
+/**
+ * File I/O service based on Linux 'io_uring'. It uses the system calls
+ * directly, so it does not depend on 'liburing'.
+ * Requests are placed on the submission queue by the thread which submits
+ * them; a service thread waits for the completions. The number of requests
+ * in flight is limited to the size of the submission queue, so the completion
+ * queue, which is twice as big, never overflows. Other requests wait in a
+ * backlog.
+ */
+class UringFileIo : public FileIoService
+{
+public:
+    static const unsigned ENTRIES = 64;
+
+    static UringFileIo* create ();
+
+    /**
+     * Stops the completion thread with a 'no operation' request. Requests in
+     * flight are discarded.
+     */
+    ~UringFileIo ()
+    {
+        if (m_thread.joinable())
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+
+                //There is always room for it, as one entry is kept free.
+                io_uring_sqe* sqe = nextSqe();
+                sqe->opcode = IORING_OP_NOP;
+                sqe->user_data = 0;
+                commitSqe();
+            }
+            m_thread.join();
+        }
+
+        if (m_sqes != MAP_FAILED)
+            munmap (m_sqes, m_sqesSize);
+        if (m_cqRing != MAP_FAILED && m_cqRing != m_sqRing)
+            munmap (m_cqRing, m_cqRingSize);
+        if (m_sqRing != MAP_FAILED)
+            munmap (m_sqRing, m_sqRingSize);
+        if (m_fd >= 0)
+            close (m_fd);
+    }
+
+    virtual void submit (Ref<FileIoRequest> request)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (m_inFlight.size() >= m_entries - 1)
+            m_backlog.push_back(request);
+        else
+            startRequest(request);
+    }
+
+    virtual const char* backend ()const
+    {
+        return "io_uring";
+    }
+
+private:
+    UringFileIo ()
+    {}
+
+    bool setup ();
+    io_uring_sqe* nextSqe ();
+    void commitSqe ();
+    void startRequest (Ref<FileIoRequest> request);
+    void loop ();
+
+    int                     m_fd = -1;
+    unsigned                m_entries = 0;
+
+    void*                   m_sqRing = MAP_FAILED;
+    size_t                  m_sqRingSize = 0;
+    void*                   m_cqRing = MAP_FAILED;
+    size_t                  m_cqRingSize = 0;
+    io_uring_sqe*           m_sqes = (io_uring_sqe*)MAP_FAILED;
+    size_t                  m_sqesSize = 0;
+
+    unsigned*               m_sqTail = NULL;
+    unsigned*               m_sqMask = NULL;
+    unsigned*               m_sqArray = NULL;
+    unsigned*               m_cqHead = NULL;
+    unsigned*               m_cqTail = NULL;
+    unsigned*               m_cqMask = NULL;
+    io_uring_cqe*           m_cqes = NULL;
+
+    std::thread             m_thread;
+    std::mutex              m_mutex;        //Guards submission queue, in flight requests and backlog.
+    std::map<FileIoRequest*, Ref<FileIoRequest> >   m_inFlight;
+    std::deque< Ref<FileIoRequest> >                m_backlog;
+};
+
+/**
+ * Creates the 'io_uring' service.
+ * @return NULL if 'io_uring' is not available, or lacks required features.
+ */
+UringFileIo* UringFileIo::create ()
+{
+    UringFileIo* service = new UringFileIo;
+
+    if (!service->setup())
+    {
+        delete service;
+        return NULL;
+    }
+
+    service->m_thread = std::thread([service]() { service->loop(); });
+    return service;
+}
+
+/**
+ * Creates the ring, and maps its queues.
+ * @return
+ */
+bool UringFileIo::setup ()
+{
+    io_uring_params params;
+
+    memset (&params, 0, sizeof(params));
+    m_fd = (int)syscall(__NR_io_uring_setup, ENTRIES, &params);
+    if (m_fd < 0)
+        return false;
+
+    //'IORING_OP_READ' and 'IORING_OP_WRITE' were added in the same kernel
+    //version as this feature.
+    if (!(params.features & IORING_FEAT_RW_CUR_POS))
+        return false;
+
+    m_entries = params.sq_entries;
+    m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+        m_sqRingSize = m_cqRingSize = max(m_sqRingSize, m_cqRingSize);
+
+    m_sqRing = mmap(NULL, m_sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    m_fd, IORING_OFF_SQ_RING);
+    if (m_sqRing == MAP_FAILED)
+        return false;
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+        m_cqRing = m_sqRing;
+    else
+    {
+        m_cqRing = mmap(NULL, m_cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        m_fd, IORING_OFF_CQ_RING);
+        if (m_cqRing == MAP_FAILED)
+            return false;
+    }
+
+    m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    m_sqes = (io_uring_sqe*)mmap(NULL, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                 m_fd, IORING_OFF_SQES);
+    if (m_sqes == MAP_FAILED)
+        return false;
+
+    char* sq = (char*)m_sqRing;
+    char* cq = (char*)m_cqRing;
+
+    m_sqTail = (unsigned*)(sq + params.sq_off.tail);
+    m_sqMask = (unsigned*)(sq + params.sq_off.ring_mask);
+    m_sqArray = (unsigned*)(sq + params.sq_off.array);
+    m_cqHead = (unsigned*)(cq + params.cq_off.head);
+    m_cqTail = (unsigned*)(cq + params.cq_off.tail);
+    m_cqMask = (unsigned*)(cq + params.cq_off.ring_mask);
+    m_cqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+
+    return true;
+}
+
+/**
+ * Gets the next free submission queue entry, cleared. Called with the mutex
+ * locked.
+ * @return
+ */
+io_uring_sqe* UringFileIo::nextSqe ()
+{
+    const unsigned  tail = *m_sqTail;
+    io_uring_sqe*   sqe = &m_sqes[tail & *m_sqMask];
+
+    memset (sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+/**
+ * Publishes the entry returned by 'nextSqe', and submits it to the kernel.
+ * Called with the mutex locked.
+ */
+void UringFileIo::commitSqe ()
+{
+    const unsigned  tail = *m_sqTail;
+    const unsigned  index = tail & *m_sqMask;
+
+    m_sqArray[index] = index;
+    __atomic_store_n (m_sqTail, tail + 1, __ATOMIC_RELEASE);
+
+    while (syscall(__NR_io_uring_enter, m_fd, 1, 0, 0, NULL, 0) < 0)
+    {
+        if (errno != EINTR)
+        {
+            //The entry stays in the queue, and it is submitted with the next one.
+            perror ("UringFileIo: io_uring_enter");
+            break;
+        }
+    }
+}
+
+/**
+ * Places a request on the submission queue. Called with the mutex locked.
+ * @param request
+ */
+void UringFileIo::startRequest (Ref<FileIoRequest> request)
+{
+    FileIoRequest*  req = request.getPointer();
+    io_uring_sqe*   sqe = nextSqe();
+
+    //Longer transfers are completed partially, and are continued by the caller.
+    sqe->opcode = req->op == FileIoRequest::READ ? IORING_OP_READ : IORING_OP_WRITE;
+    sqe->fd = req->fd;
+    sqe->off = req->offset;
+    sqe->addr = (uint64_t)(uintptr_t)req->buffer.data();
+    sqe->len = (uint32_t)min(req->buffer.size(), size_t(INT32_MAX));
+    sqe->user_data = (uint64_t)(uintptr_t)req;
+
+    m_inFlight[req] = request;
+    commitSqe();
+}
+
+/**
+ * Completion thread loop.
+ */
+void UringFileIo::loop ()
+{
+    typedef std::pair<Ref<FileIoRequest>, ssize_t> Completion;
+
+    bool                    stopping = false;
+    std::vector<Completion> completions;
+
+    while (!stopping)
+    {
+        if (syscall(__NR_io_uring_enter, m_fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            perror ("UringFileIo: io_uring_enter");
+            break;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            unsigned                    head = *m_cqHead;
+            const unsigned              tail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+
+            for (; head != tail; ++head)
+            {
+                const io_uring_cqe& cqe = m_cqes[head & *m_cqMask];
+                auto                it = m_inFlight.find((FileIoRequest*)(uintptr_t)cqe.user_data);
+
+                if (cqe.user_data == 0)
+                    stopping = true;
+                else if (it != m_inFlight.end())
+                {
+                    completions.push_back(Completion(it->second, cqe.res));
+                    m_inFlight.erase(it);
+                }
+            }
+            __atomic_store_n (m_cqHead, head, __ATOMIC_RELEASE);
+
+            while (!stopping && !m_backlog.empty() && m_inFlight.size() < m_entries - 1)
+            {
+                startRequest(m_backlog.front());
+                m_backlog.pop_front();
+            }
+        }
+
+        //Handlers may submit new requests.
+        for (auto it = completions.begin(); it != completions.end() && !stopping; ++it)
+            it->first->onComplete(it->second);
+        completions.clear();
+    }
+}
+
+/**
+ * Creates a file I/O service.
+ * @param useUring  If false, the thread pool implementation is used even if
+ * 'io_uring' is available.
+ * @return
+ */
+FileIoService* FileIoService::create (bool useUring)
+{
+    FileIoService* service = NULL;
+
+    if (useUring)
+        service = UringFileIo::create();
+
+    if (service == NULL)
+        service = new ThreadPoolFileIo;
+
+    return service;
+}
@@ -0,0 +1,79 @@
+/*
+ * File:   fileIo.h
+ * Author: ghernan
+ *
+ * Asynchronous file I/O: positional reads and writes of regular files, whose
+ * completions are notified on a service thread. It uses Linux 'io_uring'
+ * when it is available, and a pool of threads doing blocking 'pread' and
+ * 'pwrite' calls otherwise.
+ *
+ * Created on October 18, 2026, 11:55 PM
+ */
+
+#ifndef FILEIO_H
+#define	FILEIO_H
+
+#pragma once
+
+#include "RefCountObj.h"
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <string>
+
+/**
+ * File read or write request.
+ */
+class FileIoRequest : public RefCountObj
+{
+public:
+    enum Operation {READ, WRITE};
+
+    /**
+     * @param op
+     * @param fd
+     * @param offset    File offset. Ignored by writes on files opened in
+     * append mode.
+     * @param buffer    Data to write. For reads, it is resized to the number of
+     * bytes to read.
+     */
+    FileIoRequest (Operation op, int fd, uint64_t offset, const std::string& buffer)
+    : op(op), fd(fd), offset(offset), buffer(buffer)
+    {}
+
+    /**
+     * Called from a service thread when the request completes.
+     * @param result    Number of bytes transferred, or a negated 'errno' value.
+     * Reads return less bytes than requested at the end of the file, and
+     * writes may be short too.
+     */
+    virtual void onComplete (ssize_t result) = 0;
+
+    const Operation op;
+    const int       fd;
+    uint64_t        offset;
+    std::string     buffer;
+};
+
+/**
+ * Asynchronous file I/O service. Requests may be submitted from any thread.
+ * They may complete in any order.
+ */
+class FileIoService
+{
+public:
+    static FileIoService* create (bool useUring = true);
+
+    virtual ~FileIoService ()
+    {}
+
+    virtual void submit (Ref<FileIoRequest> request) = 0;
+
+    /**
+     * Name of the backend: 'io_uring' or 'threads'.
+     * @return
+     */
+    virtual const char* backend ()const = 0;
+};
+
+#endif	/* FILEIO_H */
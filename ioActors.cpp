@@ -0,0 +1,1411 @@
+/*
+ * File:   ioActors.cpp
+ * Author: ghernan
+ *
+ * I/O actors: actors implemented in native code which expose non-blocking
+ * file descriptors (standard input, pipes, Unix domain and loopback TCP
+ * sockets) and regular files to script code.
+ *
+ * Readiness events of their file descriptors are handled on the I/O reactor
+ * thread, and become messages sent through the actor outputs:
+ *  - Streams: 'data(stream, text)' and 'closed(stream, error)'. 'closed' is
+ * sent when the end of the input is reached. The stream is released when it
+ * has also been closed by script code, with its 'close' input.
+ *  - Servers: 'listening(address)', 'connection(socket)', and the 'data' and
+ * 'closed' messages of all accepted sockets.
+ *  - Standard input reader: 'lineOut(line)' and 'closed(stream, error)'.
+ *
+ * Regular files are always 'ready', so they are read and written with the
+ * file I/O service instead. Their completions are sent in request order:
+ * 'data(file, offset, text)', 'written(file, bytes)' and 'closed(file, error)'.
+ *
+ * I/O actors start watching their file descriptors after the actor which has
+ * created them finishes its current message, so it can connect their outputs
+ * before any event is sent.
+ *
+ * Created on October 18, 2026, 11:20 PM
+ */
+
+#include "ascript_pch.hpp"
+#include "ioActors.h"
+#include "actorRuntime.h"
+#include "scriptMain.h"
+#include "ScriptException.h"
+
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+using namespace std;
+
+static Ref<AsActorClass> socketClass ();
+
+/**
+ * State of an I/O actor.
+ */
+class IoObject : public IoHandler
+{
+public:
+    virtual void start () = 0;
+    virtual void close () = 0;
+
+protected:
+    IoObject (ActorRuntime* runtime, Ref<AsActor> actor)
+    : m_runtime(runtime), m_actor(actor)
+    {}
+
+    ActorRuntime* const m_runtime;
+    Ref<AsActor>        m_actor;        //Released when finished.
+    bool                m_started = false;
+    std::mutex          m_mutex;
+};
+
+/**
+ * Byte stream over one or two file descriptors: a socket, a pipe, or the
+ * standard input.
+ */
+class IoStream : public IoObject
+{
+public:
+    /**
+     * @param runtime
+     * @param actor     Stream actor.
+     * @param target    Actor whose outputs send the stream events.
+     * @param readFd    -1 if not readable.
+     * @param writeFd   -1 if not writable. May be the same as 'readFd'.
+     * @param socket    Sockets are written with 'send'.
+     * @param lines     Input is split in lines, sent in 'lineOut' messages.
+     * @param connecting    The socket connection is in progress. Data written
+     * meanwhile is sent when it completes.
+     */
+    IoStream (ActorRuntime* runtime, Ref<AsActor> actor, Ref<AsActor> target,
+              int readFd, int writeFd, bool socket, bool lines, bool connecting = false)
+    : IoObject (runtime, actor), m_target(target), m_readFd(readFd), m_writeFd(writeFd),
+    m_socket(socket), m_lines(lines), m_readDone(readFd < 0), m_writeDone(writeFd < 0),
+    m_connecting(connecting)
+    {}
+
+    ~IoStream ()
+    {
+        closeFds();
+    }
+
+    virtual void start ();
+    virtual void close ();
+    virtual void onEvents (int fd, uint32_t events);
+
+    void write (const std::string& data);
+
+private:
+    void connected ();
+    void readData (bool nonBlocking);
+    void endRead (ASValue error);
+    void emitData (const std::string& data);
+    void flush ();
+    void shutdownWrite ();
+    void update ();
+    void closeFds ();
+
+    Ref<AsActor>    m_target;
+    int             m_readFd;
+    int             m_writeFd;
+    const bool      m_socket;
+    const bool      m_lines;
+    bool            m_readDone;
+    bool            m_writeDone;
+    bool            m_connecting;
+    bool            m_closing = false;
+    bool            m_finished = false;
+    std::string     m_pending;      //Data not written yet.
+    std::string     m_partialLine;
+};
+
+/**
+ * Listening socket. Accepted sockets are stream actors, children of the server
+ * actor, whose events are sent through the server outputs.
+ */
+class IoServer : public IoObject
+{
+public:
+    /**
+     * @param runtime
+     * @param actor
+     * @param fd        Listening socket.
+     * @param address   Sent in the 'listening' message.
+     * @param path      Path of Unix domain sockets, removed when the server is
+     * closed. Empty for TCP sockets.
+     */
+    IoServer (ActorRuntime* runtime, Ref<AsActor> actor, int fd, ASValue address, const std::string& path)
+    : IoObject (runtime, actor), m_fd(fd), m_address(address), m_path(path)
+    {}
+
+    ~IoServer ()
+    {
+        if (m_fd >= 0)
+            ::close (m_fd);
+    }
+
+    virtual void start ();
+    virtual void close ();
+    virtual void onEvents (int fd, uint32_t events);
+
+private:
+    int                 m_fd;
+    const ASValue       m_address;
+    const std::string   m_path;
+};
+
+class IoFile;
+
+/**
+ * Read or write request of a file actor.
+ */
+class FileOperation : public FileIoRequest
+{
+public:
+    FileOperation (Ref<IoFile> file, Operation op, int fd, uint64_t offset, const std::string& buffer)
+    : FileIoRequest(op, fd, offset, buffer), file(file), start(offset)
+    {}
+
+    virtual void onComplete (ssize_t result);
+
+    Ref<IoFile>     file;               //Released when the operation is delivered.
+    const uint64_t  start;
+    size_t          transferred = 0;
+    ssize_t         result = 0;
+    bool            done = false;
+};
+
+/**
+ * Regular file. Requests are performed by the file I/O service, so they can
+ * be pipelined, and their completions are sent in request order.
+ * The actor is only referenced while there are requests in progress, so an
+ * idle file which is no longer referenced by script code is released, and
+ * its file descriptor closed.
+ */
+class IoFile : public IoObject
+{
+public:
+    static const size_t DEFAULT_CHUNK = 64 * 1024;
+    static const size_t MAX_CHUNK = 64 * 1024 * 1024;
+
+    IoFile (ActorRuntime* runtime, Ref<AsActor> actor, int fd)
+    : IoObject (runtime, actor), m_fd(fd)
+    {}
+
+    ~IoFile ()
+    {
+        if (m_fd >= 0)
+            ::close (m_fd);
+    }
+
+    virtual void start ();
+    virtual void close ();
+    virtual void onEvents (int fd, uint32_t events)
+    {}
+
+    void read (Ref<AsActor> actor, ASValue size, ASValue offset);
+    void write (Ref<AsActor> actor, const std::string& data, ASValue offset);
+    void close (Ref<AsActor> actor);
+    void completed (FileOperation* op, ssize_t result);
+
+private:
+    void enqueue (Ref<AsActor> actor, FileIoRequest::Operation op, uint64_t offset, const std::string& buffer);
+    void deliver ();
+    void sendClosed (ASValue error);
+
+    int                                 m_fd;
+    uint64_t                            m_readPos = 0;
+    uint64_t                            m_writePos = 0;
+    bool                                m_closing = false;
+    bool                                m_closedSent = false;
+    bool                                m_active = false;   //Requests in progress.
+    std::deque< Ref<FileOperation> >    m_queue;    //In request order.
+};
+
+/**
+ * Gets the I/O object of an I/O actor.
+ * @param actor
+ * @return
+ */
+static Ref<IoObject> ioObject (Ref<AsActor> actor)
+{
+    auto io = ref(dynamic_cast<IoObject*>(actor->getNativeState().getPointer()));
+
+    if (io.isNull())
+        rtError ("'%s' is not an I/O actor", actor->getActorClass()->getName().c_str());
+
+    return io;
+}
+
+/**
+ * Gets the I/O object of the current actor.
+ * @param ec
+ * @return
+ */
+static Ref<IoObject> currentIoObject (ExecutionContext* ec)
+{
+    auto actor = actorCast<AsActor>(ec->getThis());
+
+    if (actor.isNull())
+        rtError ("I/O actor expected");
+
+    return ioObject(actor);
+}
+
+/**
+ * Raises an error for a failed system call.
+ * @param operation
+ */
+static void ioError (const char* operation)
+{
+    rtError ("%s failed: %s", operation, strerror(errno));
+}
+
+/**
+ * Starts the I/O object of an actor. Runs as a message of its parent.
+ * @param ec
+ * @return
+ */
+static ASValue ioStartHandler (ExecutionContext* ec)
+{
+    auto actor = actorCast<AsActorRef>(ec->getParam(0));
+
+    if (actor.notNull())
+        ioObject(actor->getActor())->start();
+
+    return jsNull();
+}
+
+/**
+ * Sets the I/O object of a new I/O actor, and starts it after the actor which
+ * has created it finishes its current message.
+ * @param ec
+ * @param actor
+ * @param io
+ */
+static void startIoObject (ExecutionContext* ec, Ref<AsActor> actor, Ref<IoObject> io)
+{
+    auto parent = actor->getParent();
+
+    actor->setNativeState(io);
+
+    if (parent.isNull())
+        io->start();
+    else
+    {
+        static auto fn = JSFunction::createNative("@ioStart", StringVector(1, "actor"), ioStartHandler);
+
+        ec->actors->send(parent, fn->value(), ValueVector(1, AsActorRef::create(actor)->value()));
+    }
+}
+
+/**
+ * Gets the current actor, which shall be a new I/O actor, in its constructor.
+ * @param ec
+ * @return
+ */
+static Ref<AsActor> newIoActor (ExecutionContext* ec)
+{
+    auto actor = actorCast<AsActor>(ec->getThis());
+
+    if (actor.isNull() || ec->actors == NULL)
+        rtError ("I/O actor constructor called outside the actor system");
+
+    return actor;
+}
+
+/**
+ * Starts watching the stream file descriptors.
+ * Standard input may be a regular file, which cannot be watched. It is read
+ * at once.
+ */
+void IoStream::start ()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (m_started)
+        return;
+
+    m_started = true;
+    m_runtime->ioStarted();
+
+    if (!m_readDone && m_readFd != m_writeFd)
+    {
+        if (!m_runtime->reactor()->watch(m_readFd, EPOLLIN, ref(this)))
+        {
+            while (!m_readDone)
+                readData(false);
+        }
+    }
+    update();
+}
+
+/**
+ * 'close' input. The write side of the stream is closed when all pending data
+ * has been written. Read-only streams stop reading.
+ */
+void IoStream::close ()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (m_closing)
+        return;
+
+    m_closing = true;
+    if (m_writeFd < 0)
+        m_readDone = true;
+    else if (m_pending.empty() && !m_connecting)
+        shutdownWrite();
+
+    if (m_started)
+        update();
+}
+
+/**
+ * 'write' input.
+ * @param data
+ */
+void IoStream::write (const std::string& data)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (m_writeFd < 0 && !m_closing)
+        rtError ("Stream is not writable");
+    if (m_closing || m_writeDone)
+        rtError ("Write on a closed stream");
+
+    m_pending += data;
+    if (!m_connecting)
+        flush();
+
+    if (m_started)
+        update();
+}
+
+/**
+ * Handles readiness events, on the reactor thread.
+ * @param fd
+ * @param events
+ */
+void IoStream::onEvents (int fd, uint32_t events)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (m_finished)
+        return;
+
+    if (m_connecting)
+    {
+        if (events & (EPOLLOUT | EPOLLHUP | EPOLLERR))
+            connected();
+        update();
+        return;
+    }
+
+    if (fd == m_readFd && !m_readDone && (events & (EPOLLIN | EPOLLHUP | EPOLLERR)))
+        readData(m_readFd != STDIN_FILENO);
+
+    if (fd == m_writeFd && !m_writeDone && (events & (EPOLLOUT | EPOLLHUP | EPOLLERR)))
+        flush();
+
+    update();
+}
+
+/**
+ * Called when a socket connection in progress completes. Connection errors
+ * close the stream.
+ */
+void IoStream::connected ()
+{
+    int         error = 0;
+    socklen_t   length = sizeof(error);
+
+    if (getsockopt (m_writeFd, SOL_SOCKET, SO_ERROR, &error, &length) != 0)
+        error = errno;
+
+    m_connecting = false;
+    if (error != 0)
+    {
+        const string message = string("connect: ") + strerror(error);
+
+        endRead(jsString(message));
+    }
+    else
+        flush();
+}
+
+/**
+ * Reads the available data, and sends it.
+ * @param nonBlocking   If true, it reads until no more data is available.
+ * Otherwise, it reads once.
+ */
+void IoStream::readData (bool nonBlocking)
+{
+    char    buffer[4096];
+
+    for (;;)
+    {
+        const ssize_t n = ::read(m_readFd, buffer, sizeof(buffer));
+
+        if (n > 0)
+        {
+            emitData(string(buffer, n));
+            if (!nonBlocking)
+                break;
+        }
+        else if (n == 0)
+        {
+            endRead(jsNull());
+            break;
+        }
+        else if (errno == EAGAIN || errno == EWOULDBLOCK)
+            break;
+        else if (errno != EINTR)
+        {
+            endRead(jsString(strerror(errno)));
+            break;
+        }
+    }
+}
+
+/**
+ * Called when the end of the input has been reached, or on read errors. After
+ * errors, the stream is no longer written.
+ * @param error
+ */
+void IoStream::endRead (ASValue error)
+{
+    m_readDone = true;
+
+    if (m_lines && !m_partialLine.empty())
+    {
+        m_runtime->sendOutput(m_target, "lineOut", ValueVector(1, jsString(m_partialLine)));
+        m_partialLine.clear();
+    }
+
+    if (!error.isNull())
+    {
+        m_pending.clear();
+        m_writeDone = true;
+    }
+
+    ValueVector params;
+
+    params.push_back(AsActorRef::create(m_actor)->value());
+    params.push_back(error);
+    m_runtime->sendOutput(m_target, "closed", std::move(params));
+}
+
+/**
+ * Sends the data read from the stream.
+ * @param data
+ */
+void IoStream::emitData (const std::string& data)
+{
+    if (!m_lines)
+    {
+        ValueVector params;
+
+        params.push_back(AsActorRef::create(m_actor)->value());
+        params.push_back(jsString(data));
+        m_runtime->sendOutput(m_target, "data", std::move(params));
+        return;
+    }
+
+    size_t  begin = 0;
+    size_t  end;
+
+    while ((end = data.find('\n', begin)) != string::npos)
+    {
+        string line = m_partialLine + data.substr(begin, end - begin);
+
+        if (!line.empty() && line[line.size() - 1] == '\r')
+            line.erase(line.size() - 1);
+
+        m_partialLine.clear();
+        m_runtime->sendOutput(m_target, "lineOut", ValueVector(1, jsString(line)));
+        begin = end + 1;
+    }
+    m_partialLine += data.substr(begin);
+}
+
+/**
+ * Writes as much pending data as possible without blocking.
+ */
+void IoStream::flush ()
+{
+    while (!m_pending.empty())
+    {
+        const ssize_t n = m_socket
+            ? ::send(m_writeFd, m_pending.data(), m_pending.size(), MSG_NOSIGNAL)
+            : ::write(m_writeFd, m_pending.data(), m_pending.size());
+
+        if (n >= 0)
+            m_pending.erase(0, n);
+        else if (errno == EAGAIN || errno == EWOULDBLOCK)
+            break;
+        else if (errno != EINTR)
+        {
+            //The other end is gone. The read side reports it.
+            m_pending.clear();
+            m_writeDone = true;
+            return;
+        }
+    }
+
+    if (m_pending.empty() && m_closing)
+        shutdownWrite();
+}
+
+/**
+ * Closes the write side of the stream.
+ */
+void IoStream::shutdownWrite ()
+{
+    if (m_writeDone)
+        return;
+
+    m_writeDone = true;
+    if (m_socket)
+        shutdown (m_writeFd, SHUT_WR);
+    else if (m_writeFd != m_readFd)
+    {
+        if (m_started)
+            m_runtime->reactor()->watch(m_writeFd, 0, ref(this));
+        ::close (m_writeFd);
+        m_writeFd = -1;
+    }
+}
+
+/**
+ * Updates the watched events, and finishes the stream when both sides are
+ * done.
+ */
+void IoStream::update ()
+{
+    if (m_finished)
+        return;
+
+    auto                reactor = m_runtime->reactor();
+    Ref<IoHandler>      self = ref(this);
+
+    if (m_readDone && m_writeDone)
+    {
+        m_finished = true;
+        closeFds();
+
+        //Breaks the reference cycle with the actor.
+        m_actor = Ref<AsActor>();
+        m_target = Ref<AsActor>();
+        m_runtime->ioFinished();
+        return;
+    }
+
+    //Connection completion is notified as writability.
+    const uint32_t  readEvents = (m_readDone || m_connecting) ? 0 : EPOLLIN;
+    const uint32_t  writeEvents = (m_writeDone || (m_pending.empty() && !m_connecting)) ? 0 : EPOLLOUT;
+
+    if (m_readFd == m_writeFd)
+        reactor->watch(m_readFd, readEvents | writeEvents, self);
+    else
+    {
+        if (m_readFd >= 0)
+            reactor->watch(m_readFd, readEvents, self);
+        if (m_writeFd >= 0)
+            reactor->watch(m_writeFd, writeEvents, self);
+    }
+}
+
+/**
+ * Stops watching and closes the stream file descriptors.
+ */
+void IoStream::closeFds ()
+{
+    const int fds[2] = {m_readFd, m_writeFd};
+
+    for (int i = 0; i < 2; ++i)
+    {
+        if (fds[i] < 0 || (i == 1 && fds[1] == fds[0]))
+            continue;
+
+        if (m_started)
+            m_runtime->reactor()->watch(fds[i], 0, Ref<IoHandler>());
+        ::close (fds[i]);
+    }
+    m_readFd = m_writeFd = -1;
+}
+
+/**
+ * Starts accepting connections.
+ */
+void IoServer::start ()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (m_started || m_fd < 0)
+        return;
+
+    m_started = true;
+    m_runtime->ioStarted();
+    m_runtime->reactor()->watch(m_fd, EPOLLIN, ref(this));
+    m_runtime->sendOutput(m_actor, "listening", ValueVector(1, m_address));
+}
+
+/**
+ * 'close' input. Stops listening. Accepted sockets are not closed.
+ * Servers keep the actor system running until they are closed.
+ */
+void IoServer::close ()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (m_fd < 0)
+        return;
+
+    if (m_started)
+    {
+        m_runtime->reactor()->watch(m_fd, 0, Ref<IoHandler>());
+        m_runtime->ioFinished();
+    }
+
+    ::close (m_fd);
+    m_fd = -1;
+    m_actor = Ref<AsActor>();
+
+    if (!m_path.empty())
+        unlink (m_path.c_str());
+}
+
+/**
+ * Accepts the pending connections, on the reactor thread.
+ * @param fd
+ * @param events
+ */
+void IoServer::onEvents (int fd, uint32_t events)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    while (m_fd >= 0)
+    {
+        const int socket = accept4(m_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+        if (socket < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            break;
+        }
+
+        auto actor = AsActor::create(socketClass(), m_actor->getGlobals(), m_actor);
+        auto stream = refFromNew(new IoStream(m_runtime, actor, m_actor, socket, socket, true, false));
+
+        actor->setNativeState(stream);
+        m_runtime->sendOutput(m_actor, "connection", ValueVector(1, AsActorRef::create(actor)->value()));
+        stream->start();
+    }
+}
+
+/**
+ * Converts a file offset parameter.
+ * @param offset
+ * @return
+ */
+static uint64_t fileOffset (ASValue offset)
+{
+    const double value = offset.toDouble();
+
+    if (!(value >= 0 && value <= 9007199254740992.0) || value != floor(value))
+        rtError ("Invalid file offset: %s", offset.toString().c_str());
+
+    return (uint64_t)value;
+}
+
+/**
+ * Called from a file I/O service thread.
+ * @param result
+ */
+void FileOperation::onComplete (ssize_t result)
+{
+    file->completed(this, result);
+}
+
+/**
+ * Submits the requests made before the file was started.
+ */
+void IoFile::start ()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (m_started)
+        return;
+
+    m_started = true;
+    for (auto it = m_queue.begin(); it != m_queue.end(); ++it)
+        m_runtime->fileIo()->submit(*it);
+
+    if (m_queue.empty())
+        m_actor = Ref<AsActor>();
+}
+
+/**
+ * Not used: the 'close' input of files is 'close(actor)', as idle files do
+ * not keep a reference to their actor.
+ */
+void IoFile::close ()
+{
+    ASSERT (!"IoFile::close() called");
+}
+
+/**
+ * 'read(size, offset)' input.
+ * @param actor
+ * @param size      Maximum size of the chunk. Less data is read at the end of
+ * the file. Null reads a chunk of the default size.
+ * @param offset    Null reads the chunk after the previous one.
+ */
+void IoFile::read (Ref<AsActor> actor, ASValue size, ASValue offset)
+{
+    const double length = size.isNull() ? DEFAULT_CHUNK : size.toDouble();
+
+    if (!(length >= 1 && length <= MAX_CHUNK))
+        rtError ("Invalid read size: %s", size.toString().c_str());
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const uint64_t              position = offset.isNull() ? m_readPos : fileOffset(offset);
+
+    enqueue (actor, FileIoRequest::READ, position, string((size_t)length, '\0'));
+    m_readPos = position + (uint64_t)length;
+}
+
+/**
+ * 'write(text, offset)' input.
+ * @param actor
+ * @param data
+ * @param offset    Null writes after the previous write. Ignored in append
+ * mode.
+ */
+void IoFile::write (Ref<AsActor> actor, const std::string& data, ASValue offset)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const uint64_t              position = offset.isNull() ? m_writePos : fileOffset(offset);
+
+    enqueue (actor, FileIoRequest::WRITE, position, data);
+    m_writePos = position + data.size();
+}
+
+/**
+ * 'close()' input. The file is closed when the requests in progress complete.
+ * @param actor
+ */
+void IoFile::close (Ref<AsActor> actor)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (m_closing)
+        return;
+
+    m_closing = true;
+    if (m_queue.empty())
+    {
+        m_actor = actor;
+        deliver();
+    }
+}
+
+/**
+ * Queues a request, and submits it if the file has started.
+ * @param actor     File actor. It is kept while there are requests in progress.
+ * @param op
+ * @param offset
+ * @param buffer
+ */
+void IoFile::enqueue (Ref<AsActor> actor, FileIoRequest::Operation op, uint64_t offset, const std::string& buffer)
+{
+    if (m_closing || m_closedSent)
+        rtError ("%s on a closed file", op == FileIoRequest::READ ? "Read" : "Write");
+
+    auto request = refFromNew(new FileOperation(ref(this), op, m_fd, offset, buffer));
+
+    m_actor = actor;
+    if (!m_active)
+    {
+        m_active = true;
+        m_runtime->ioStarted();
+    }
+
+    m_queue.push_back(request);
+    if (m_started)
+        m_runtime->fileIo()->submit(request);
+}
+
+/**
+ * Called when a request completes. Short writes are continued.
+ * @param op
+ * @param result
+ */
+void IoFile::completed (FileOperation* op, ssize_t result)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (result > 0 && op->op == FileIoRequest::WRITE && (size_t)result < op->buffer.size())
+    {
+        op->transferred += result;
+        op->offset += result;
+        op->buffer.erase(0, result);
+        m_runtime->fileIo()->submit(ref(op));
+        return;
+    }
+
+    if (result >= 0)
+    {
+        op->transferred += result;
+        if (op->op == FileIoRequest::READ)
+            op->buffer.resize(result);
+    }
+
+    op->result = result;
+    op->done = true;
+    deliver();
+}
+
+/**
+ * Sends the completions of the finished requests at the head of the queue.
+ * After an error, the remaining completions are discarded. When the queue is
+ * empty, the file is closed if requested, and the actor is released.
+ */
+void IoFile::deliver ()
+{
+    while (!m_queue.empty() && m_queue.front()->done)
+    {
+        Ref<FileOperation>  op = m_queue.front();
+        ValueVector         params;
+
+        m_queue.pop_front();
+        op->file = Ref<IoFile>();
+
+        if (m_closedSent)
+            continue;
+
+        if (op->result < 0)
+        {
+            sendClosed(jsString(strerror((int)-op->result)));
+            continue;
+        }
+
+        params.push_back(AsActorRef::create(m_actor)->value());
+        if (op->op == FileIoRequest::READ)
+        {
+            params.push_back(jsDouble((double)op->start));
+            params.push_back(jsString(op->buffer));
+            m_runtime->sendOutput(m_actor, "data", std::move(params));
+        }
+        else
+        {
+            params.push_back(jsSizeT(op->transferred));
+            m_runtime->sendOutput(m_actor, "written", std::move(params));
+        }
+    }
+
+    if (!m_queue.empty())
+        return;
+
+    if (m_closing && !m_closedSent)
+        sendClosed(jsNull());
+
+    if (m_closedSent && m_fd >= 0)
+    {
+        ::close (m_fd);
+        m_fd = -1;
+    }
+
+    m_actor = Ref<AsActor>();
+    if (m_active)
+    {
+        m_active = false;
+        m_runtime->ioFinished();
+    }
+}
+
+/**
+ * Sends the 'closed' message.
+ * @param error
+ */
+void IoFile::sendClosed (ASValue error)
+{
+    ValueVector params;
+
+    m_closedSent = true;
+    params.push_back(AsActorRef::create(m_actor)->value());
+    params.push_back(error);
+    m_runtime->sendOutput(m_actor, "closed", std::move(params));
+}
+
+/**
+ * Creates a TCP socket address on the loopback interface.
+ * @param port
+ * @return
+ */
+static sockaddr_in loopbackAddress (ASValue port)
+{
+    const double    value = port.toDouble();
+    sockaddr_in     address;
+
+    if (!(value >= 0 && value <= 65535))
+        rtError ("Invalid TCP port: %s", port.toString().c_str());
+
+    memset (&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons((uint16_t)value);
+    return address;
+}
+
+/**
+ * Creates a Unix domain socket address.
+ * @param path
+ * @return
+ */
+static sockaddr_un unixAddress (ASValue path)
+{
+    const string    text = path.toString();
+    sockaddr_un     address;
+
+    memset (&address, 0, sizeof(address));
+    if (text.empty() || text.size() >= sizeof(address.sun_path))
+        rtError ("Invalid Unix socket path: '%s'", text.c_str());
+
+    address.sun_family = AF_UNIX;
+    strcpy (address.sun_path, text.c_str());
+    return address;
+}
+
+/**
+ * Creates a listening socket.
+ * @param domain
+ * @param address
+ * @param length
+ * @return
+ */
+static int listenSocket (int domain, const sockaddr* address, socklen_t length)
+{
+    const int   fd = socket(domain, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    const int   one = 1;
+
+    if (fd < 0)
+        ioError ("socket");
+
+    if (domain == AF_INET)
+        setsockopt (fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    if (bind (fd, address, length) != 0 || listen (fd, SOMAXCONN) != 0)
+    {
+        const int error = errno;
+
+        ::close (fd);
+        errno = error;
+        ioError ("listen");
+    }
+
+    return fd;
+}
+
+/**
+ * Creates a non-blocking socket, and starts connecting it. Connections which
+ * do not complete immediately are completed by the stream, on the I/O reactor.
+ * Immediate errors are raised here.
+ * @param domain
+ * @param address
+ * @param length
+ * @param pConnecting   [out] Set to true if the connection is in progress.
+ * @return
+ */
+static int connectSocket (int domain, const sockaddr* address, socklen_t length, bool* pConnecting)
+{
+    const int   fd = socket(domain, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    int         result;
+
+    if (fd < 0)
+        ioError ("socket");
+
+    do
+    {
+        result = connect (fd, address, length);
+    } while (result != 0 && errno == EINTR);
+
+    *pConnecting = result != 0 && errno == EINPROGRESS;
+    if (result != 0 && !*pConnecting)
+    {
+        const int error = errno;
+
+        ::close (fd);
+        errno = error;
+        ioError ("connect");
+    }
+
+    return fd;
+}
+
+/**
+ * 'IO.TcpServer(port)' constructor. Listens on the loopback interface. Port
+ * zero chooses a free port, which is sent in the 'listening' message.
+ * @param ec
+ * @return
+ */
+static ASValue ioTcpServer (ExecutionContext* ec)
+{
+    auto        actor = newIoActor(ec);
+    sockaddr_in address = loopbackAddress(ec->getParam(0));
+    socklen_t   length = sizeof(address);
+    const int   fd = listenSocket(AF_INET, (sockaddr*)&address, length);
+
+    getsockname (fd, (sockaddr*)&address, &length);
+
+    auto io = refFromNew(new IoServer(ec->actors, actor, fd, jsInt(ntohs(address.sin_port)), ""));
+
+    startIoObject (ec, actor, io);
+    return jsNull();
+}
+
+/**
+ * 'IO.UnixServer(path)' constructor. A previous socket file at the same path
+ * is replaced.
+ * @param ec
+ * @return
+ */
+static ASValue ioUnixServer (ExecutionContext* ec)
+{
+    auto        actor = newIoActor(ec);
+    sockaddr_un address = unixAddress(ec->getParam(0));
+    struct stat info;
+
+    if (stat (address.sun_path, &info) == 0 && S_ISSOCK(info.st_mode))
+        unlink (address.sun_path);
+
+    const int   fd = listenSocket(AF_UNIX, (sockaddr*)&address, sizeof(address));
+    auto        io = refFromNew(new IoServer(ec->actors, actor, fd, jsString(address.sun_path), address.sun_path));
+
+    startIoObject (ec, actor, io);
+    return jsNull();
+}
+
+/**
+ * 'IO.TcpSocket(port)' constructor. Connects to a port of the loopback interface.
+ * @param ec
+ * @return
+ */
+static ASValue ioTcpSocket (ExecutionContext* ec)
+{
+    auto        actor = newIoActor(ec);
+    sockaddr_in address = loopbackAddress(ec->getParam(0));
+    bool        connecting;
+    const int   fd = connectSocket(AF_INET, (sockaddr*)&address, sizeof(address), &connecting);
+
+    startIoObject (ec, actor, refFromNew(new IoStream(ec->actors, actor, actor, fd, fd, true, false, connecting)));
+    return jsNull();
+}
+
+/**
+ * 'IO.UnixSocket(path)' constructor.
+ * @param ec
+ * @return
+ */
+static ASValue ioUnixSocket (ExecutionContext* ec)
+{
+    auto        actor = newIoActor(ec);
+    sockaddr_un address = unixAddress(ec->getParam(0));
+    bool        connecting;
+    const int   fd = connectSocket(AF_UNIX, (sockaddr*)&address, sizeof(address), &connecting);
+
+    startIoObject (ec, actor, refFromNew(new IoStream(ec->actors, actor, actor, fd, fd, true, false, connecting)));
+    return jsNull();
+}
+
+/**
+ * 'IO.Pipe()' constructor. Data written to the pipe is read back from it, and
+ * sent in 'data' messages.
+ * @param ec
+ * @return
+ */
+static ASValue ioPipe (ExecutionContext* ec)
+{
+    auto    actor = newIoActor(ec);
+    int     fds[2];
+
+    if (pipe2 (fds, O_NONBLOCK | O_CLOEXEC) != 0)
+        ioError ("pipe");
+
+    startIoObject (ec, actor, refFromNew(new IoStream(ec->actors, actor, actor, fds[0], fds[1], false, false)));
+    return jsNull();
+}
+
+/**
+ * 'IO.StdinLineReader()' constructor. Sends the lines read from the standard
+ * input. Its file descriptor is duplicated, so closing the reader does not
+ * close the standard input.
+ * @param ec
+ * @return
+ */
+static ASValue ioStdinLineReader (ExecutionContext* ec)
+{
+    auto        actor = newIoActor(ec);
+    const int   fd = fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 0);
+
+    if (fd < 0)
+        ioError ("dup");
+
+    startIoObject (ec, actor, refFromNew(new IoStream(ec->actors, actor, actor, fd, -1, false, true)));
+    return jsNull();
+}
+
+/**
+ * 'IO.File(path, mode)' constructor. Modes are the ones of 'fopen': 'r' (the
+ * default), 'r+', 'w', 'w+', 'a' and 'a+'. The file is opened synchronously.
+ * @param ec
+ * @return
+ */
+static ASValue ioFile (ExecutionContext* ec)
+{
+    auto            actor = newIoActor(ec);
+    const string    path = ec->getParam(0).toString();
+    const ASValue   modeParam = ec->getParam(1);
+    const string    mode = modeParam.isNull() ? "r" : modeParam.toString();
+    int             flags;
+
+    if (mode == "r")
+        flags = O_RDONLY;
+    else if (mode == "r+")
+        flags = O_RDWR;
+    else if (mode == "w")
+        flags = O_WRONLY | O_CREAT | O_TRUNC;
+    else if (mode == "w+")
+        flags = O_RDWR | O_CREAT | O_TRUNC;
+    else if (mode == "a")
+        flags = O_WRONLY | O_CREAT | O_APPEND;
+    else if (mode == "a+")
+        flags = O_RDWR | O_CREAT | O_APPEND;
+    else
+        rtError ("Invalid file mode: '%s'", mode.c_str());
+
+    const int fd = open(path.c_str(), flags | O_CLOEXEC, 0666);
+
+    if (fd < 0)
+        rtError ("Cannot open '%s': %s", path.c_str(), strerror(errno));
+
+    startIoObject (ec, actor, refFromNew(new IoFile(ec->actors, actor, fd)));
+    return jsNull();
+}
+
+/**
+ * Gets the current file actor, and its file object.
+ * @param ec
+ * @param pActor    [out]
+ * @return
+ */
+static Ref<IoFile> currentFile (ExecutionContext* ec, Ref<AsActor>* pActor)
+{
+    *pActor = actorCast<AsActor>(ec->getThis());
+    if (pActor->isNull())
+        rtError ("File actor expected");
+
+    auto file = ref(dynamic_cast<IoFile*>(ioObject(*pActor).getPointer()));
+
+    if (file.isNull())
+        rtError ("File actor expected");
+
+    return file;
+}
+
+/**
+ * 'read(size, offset)' input of files.
+ * @param ec
+ * @return
+ */
+static ASValue ioFileRead (ExecutionContext* ec)
+{
+    Ref<AsActor>    actor;
+    auto            file = currentFile(ec, &actor);
+
+    file->read(actor, ec->getParam(0), ec->getParam(1));
+    return jsNull();
+}
+
+/**
+ * 'write(text, offset)' input of files.
+ * @param ec
+ * @return
+ */
+static ASValue ioFileWrite (ExecutionContext* ec)
+{
+    Ref<AsActor>    actor;
+    auto            file = currentFile(ec, &actor);
+
+    file->write(actor, ec->getParam(0).toString(), ec->getParam(1));
+    return jsNull();
+}
+
+/**
+ * 'close()' input of files.
+ * @param ec
+ * @return
+ */
+static ASValue ioFileClose (ExecutionContext* ec)
+{
+    Ref<AsActor>    actor;
+    auto            file = currentFile(ec, &actor);
+
+    file->close(actor);
+    return jsNull();
+}
+
+/**
+ * Constructor of accepted sockets class. They are only created by servers.
+ * @param ec
+ * @return
+ */
+static ASValue ioAcceptedSocket (ExecutionContext* ec)
+{
+    rtError ("Sockets can only be created by servers");
+    return jsNull();
+}
+
+/**
+ * 'write(text)' input of streams.
+ * @param ec
+ * @return
+ */
+static ASValue ioWrite (ExecutionContext* ec)
+{
+    auto stream = ref(dynamic_cast<IoStream*>(currentIoObject(ec).getPointer()));
+
+    if (stream.isNull())
+        rtError ("'write' input of a non-stream I/O actor");
+
+    stream->write(ec->getParam(0).toString());
+    return jsNull();
+}
+
+/**
+ * 'close()' input of I/O actors.
+ * @param ec
+ * @return
+ */
+static ASValue ioClose (ExecutionContext* ec)
+{
+    currentIoObject(ec)->close();
+    return jsNull();
+}
+
+/**
+ * Creates an I/O actor class.
+ * @param name
+ * @param header        Constructor header ('function Name(params)').
+ * @param constructor
+ * @param writable      Streams have a 'write' input.
+ * @param outputs
+ * @return
+ */
+static Ref<AsActorClass> ioActorClass (const std::string& name,
+                                       const std::string& header,
+                                       JSNativeFn constructor,
+                                       bool writable,
+                                       const char** outputs)
+{
+    VarMap          inputs;
+    StringVector    outputNames;
+    VarMap          constructorScope;
+
+    auto fn = addNative(header, constructor, constructorScope);
+
+    if (writable)
+        addNative("function write(text)", ioWrite, inputs);
+    addNative("function close()", ioClose, inputs);
+
+    for (; *outputs != NULL; ++outputs)
+        outputNames.push_back(*outputs);
+
+    return AsActorClass::create(name, fn->getParams(), fn, inputs, outputNames);
+}
+
+static const char* streamOutputs[] = {"data", "closed", NULL};
+static const char* serverOutputs[] = {"listening", "connection", "data", "closed", NULL};
+static const char* lineReaderOutputs[] = {"lineOut", "closed", NULL};
+static const char* fileOutputs[] = {"data", "written", "closed", NULL};
+
+/**
+ * Class of the sockets accepted by servers.
+ * @return
+ */
+static Ref<AsActorClass> socketClass ()
+{
+    static auto cls = ioActorClass("Socket", "function Socket()", ioAcceptedSocket, true, streamOutputs);
+
+    return cls;
+}
+
+/**
+ * Creates the class of file actors. Their inputs differ from the ones of
+ * streams.
+ * @return
+ */
+static Ref<AsActorClass> fileClass ()
+{
+    VarMap          inputs;
+    VarMap          constructorScope;
+    StringVector    outputNames;
+
+    auto fn = addNative("function File(path, mode)", ioFile, constructorScope);
+
+    addNative("function read(size, offset)", ioFileRead, inputs);
+    addNative("function write(text, offset)", ioFileWrite, inputs);
+    addNative("function close()", ioFileClose, inputs);
+
+    for (const char** output = fileOutputs; *output != NULL; ++output)
+        outputNames.push_back(*output);
+
+    return AsActorClass::create("File", fn->getParams(), fn, inputs, outputNames);
+}
+
+/**
+ * Registers the I/O actor classes, in the 'IO' namespace. Actor classes are
+ * immutable, so they are created once and shared by all scopes.
+ * @param scope
+ */
+void registerIoActors (Ref<JSObject> scope)
+{
+    static std::once_flag   initialized;
+    static VarMap           classes;
+
+    std::call_once (initialized, []()
+    {
+        classes.varWrite("TcpServer", ioActorClass("TcpServer", "function TcpServer(port)",
+                                                   ioTcpServer, false, serverOutputs)->value(), true);
+        classes.varWrite("UnixServer", ioActorClass("UnixServer", "function UnixServer(path)",
+                                                    ioUnixServer, false, serverOutputs)->value(), true);
+        classes.varWrite("TcpSocket", ioActorClass("TcpSocket", "function TcpSocket(port)",
+                                                   ioTcpSocket, true, streamOutputs)->value(), true);
+        classes.varWrite("UnixSocket", ioActorClass("UnixSocket", "function UnixSocket(path)",
+                                                    ioUnixSocket, true, streamOutputs)->value(), true);
+        classes.varWrite("Pipe", ioActorClass("Pipe", "function Pipe()",
+                                              ioPipe, true, streamOutputs)->value(), true);
+        classes.varWrite("StdinLineReader", ioActorClass("StdinLineReader", "function StdinLineReader()",
+                                                         ioStdinLineReader, false, lineReaderOutputs)->value(), true);
+        classes.varWrite("File", fileClass()->value(), true);
+    });
+
+    auto io = JSObject::create();
+
+    classes.map([&io](const string& name, ASValue value) -> ASValue {
+        io->writeField(name, value, true);
+        return value;
+    });
+
+    scope->writeField("IO", io->value(), true);
+}
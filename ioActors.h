@@ -0,0 +1,21 @@
+/*
+ * File:   ioActors.h
+ * Author: ghernan
+ *
+ * I/O actors: actors implemented in native code which expose non-blocking
+ * file descriptors (standard input, pipes, Unix domain and loopback TCP
+ * sockets) and regular files to script code.
+ *
+ * Created on October 18, 2026, 11:20 PM
+ */
+
+#ifndef IOACTORS_H
+#define	IOACTORS_H
+
+#pragma once
+
+#include "asObjects.h"
+
+void registerIoActors (Ref<JSObject> scope);
+
+#endif	/* IOACTORS_H */
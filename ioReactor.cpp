@@ -0,0 +1,154 @@
+/*
+ * File:   ioReactor.cpp
+ * Author: ghernan
+ *
+ * I/O reactor: waits for readiness events of non-blocking file descriptors
+ * on its own thread, using Linux 'epoll'.
+ *
+ * Created on October 18, 2026, 10:50 PM
+ */
+
+#include "ascript_pch.hpp"
+#include "ioReactor.h"
+#include "ScriptException.h"
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+using namespace std;
+
+/**
+ * Creates the reactor and starts its thread.
+ */
+IoReactor::IoReactor ()
+: m_stopping(false)
+{
+    m_epoll = epoll_create1(EPOLL_CLOEXEC);
+    if (m_epoll < 0)
+        rtError ("I/O reactor creation failed: %s", strerror(errno));
+
+    m_wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (m_wakeFd < 0)
+    {
+        close (m_epoll);
+        rtError ("I/O reactor creation failed: %s", strerror(errno));
+    }
+
+    epoll_event ev;
+
+    memset (&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = m_wakeFd;
+    epoll_ctl (m_epoll, EPOLL_CTL_ADD, m_wakeFd, &ev);
+
+    m_thread = std::thread([this]() {
+        loop();
+    });
+}
+
+/**
+ * Stops the reactor thread. The watched file descriptors are not closed.
+ */
+IoReactor::~IoReactor ()
+{
+    const uint64_t  one = 1;
+
+    m_stopping = true;
+    if (write (m_wakeFd, &one, sizeof(one)) < 0)
+        perror ("IoReactor: eventfd write");
+    m_thread.join();
+
+    close (m_wakeFd);
+    close (m_epoll);
+}
+
+/**
+ * Sets the events watched on a file descriptor.
+ * @param fd
+ * @param events    'epoll' event flags. Zero stops watching the descriptor.
+ * @param handler   Handler of the events. It is released when the descriptor
+ * is no longer watched.
+ * @return false if the descriptor cannot be watched, for example, because it
+ * is a regular file.
+ */
+bool IoReactor::watch (int fd, uint32_t events, Ref<IoHandler> handler)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto                        it = m_watches.find(fd);
+    epoll_event                 ev;
+
+    memset (&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.fd = fd;
+
+    if (it == m_watches.end())
+    {
+        if (events == 0)
+            return true;
+        if (epoll_ctl (m_epoll, EPOLL_CTL_ADD, fd, &ev) != 0)
+            return false;
+
+        Watch&  w = m_watches[fd];
+        w.handler = handler;
+        w.events = events;
+    }
+    else if (events == 0)
+    {
+        epoll_ctl (m_epoll, EPOLL_CTL_DEL, fd, &ev);
+        m_watches.erase(it);
+    }
+    else if (events != it->second.events)
+    {
+        if (epoll_ctl (m_epoll, EPOLL_CTL_MOD, fd, &ev) != 0)
+            return false;
+        it->second.events = events;
+    }
+
+    return true;
+}
+
+/**
+ * Reactor thread loop.
+ */
+void IoReactor::loop ()
+{
+    const int   MAX_EVENTS = 64;
+    epoll_event events[MAX_EVENTS];
+
+    while (!m_stopping)
+    {
+        const int n = epoll_wait(m_epoll, events, MAX_EVENTS, -1);
+
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            perror ("IoReactor: epoll_wait");
+            break;
+        }
+
+        for (int i = 0; i < n; ++i)
+        {
+            const int       fd = events[i].data.fd;
+            Ref<IoHandler>  handler;
+
+            if (fd == m_wakeFd)
+                continue;
+
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                auto                        it = m_watches.find(fd);
+
+                //It may have been removed by a previous event handler.
+                if (it != m_watches.end())
+                    handler = it->second.handler;
+            }
+
+            if (handler.notNull())
+                handler->onEvents(fd, events[i].events);
+        }
+    }
+}
@@ -0,0 +1,72 @@
+/*
+ * File:   ioReactor.h
+ * Author: ghernan
+ *
+ * I/O reactor: waits for readiness events of non-blocking file descriptors
+ * on its own thread, using Linux 'epoll'.
+ *
+ * Created on October 18, 2026, 10:50 PM
+ */
+
+#ifndef IOREACTOR_H
+#define	IOREACTOR_H
+
+#pragma once
+
+#include "RefCountObj.h"
+
+#include <stdint.h>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <atomic>
+
+/**
+ * Receives the readiness events of the file descriptors it watches.
+ */
+class IoHandler : public RefCountObj
+{
+public:
+    /**
+     * Called from the reactor thread.
+     * @param fd
+     * @param events    'epoll' event flags.
+     */
+    virtual void onEvents (int fd, uint32_t events) = 0;
+};
+
+/**
+ * I/O reactor. Handlers are called from the reactor thread, one event at a
+ * time. Events are level-triggered.
+ */
+class IoReactor
+{
+public:
+    IoReactor ();
+    ~IoReactor ();
+
+    bool watch (int fd, uint32_t events, Ref<IoHandler> handler);
+
+private:
+    void loop ();
+
+    struct Watch
+    {
+        Ref<IoHandler>  handler;
+        uint32_t        events;
+    };
+
+    int                     m_epoll;
+    int                     m_wakeFd;       //'eventfd' used to stop the thread.
+    std::atomic<bool>       m_stopping;
+    std::thread             m_thread;
+
+    std::mutex              m_mutex;
+    std::map<int, Watch>    m_watches;
+
+    //Copy operations forbidden
+    IoReactor (const IoReactor&);
+    IoReactor& operator= (const IoReactor&);
+};
+
+#endif	/* IOREACTOR_H */
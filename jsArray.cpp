@@ -13,6 +13,7 @@
 #include "scriptMain.h"
 #include "mvmFunctions.h"
 #include "ScriptException.h"
+#include "asIntern.h"
 
 #include <math.h>
 
@@ -72,7 +73,7 @@ Ref<JSArray> JSArray::createStrArray(const std::vector<std::string>& strList)
  */
 Ref<JSArray> JSArray::fromVector(const ValueVector& values)
 {
-    auto    newArr = JSArray::create(values.size());
+    auto    newArr = JSArray::create();
     size_t  i;
     
     for (i=0; i <values.size(); ++i)
@@ -318,6 +319,89 @@ ASValue JSArray::deepFreeze(ASValue::ValuesMap& transformed)
     return newArray->value();
 }        
 
+/**
+ * Returns the canonical instance of a deep-frozen array from the intern table.
+ * Elements are interned first. 
+ * @param transformed
+ * @return 
+ */
+ASValue JSArray::intern(ASValue::ValuesMap& transformed)
+{
+    auto me = value();
+    
+    if (isInterned() || getMutability() != MT_DEEPFROZEN)
+        return me;
+
+    auto it = transformed.find(me);
+    if (it != transformed.end())
+        return it->second;
+    
+    //Cycle guard. See 'JSObject::intern'
+    transformed[me] = me;
+
+    ValueVector content;
+    bool        changed = false;
+    
+    content.reserve(m_content.size());
+    for (size_t i = 0; i < m_content.size(); ++i )
+    {
+        auto canonical = m_content[i].intern(transformed);
+        changed = changed || !canonical.isIdentical(m_content[i]);
+        content.push_back(canonical);
+    }
+    
+    Ref<JSArray>    candidate (this);
+    if (changed)
+    {
+        candidate = JSArray::create();
+        candidate->m_content.swap(content);
+        candidate->m_mutability = MT_DEEPFROZEN;
+    }
+    
+    auto result = InternTable::insert(candidate)->value();
+    transformed[me] = result;
+    
+    return result;
+}
+
+/**
+ * Array hash is calculated from its elements.
+ * @return 
+ */
+size_t JSArray::structuralHash()const
+{
+    size_t result = JSObject::structuralHash();
+    
+    for (size_t i = 0; i < m_content.size(); ++i )
+        result = hashCombine (result, m_content[i].hash());
+    
+    return result;
+}
+
+/**
+ * Arrays are structurally equal if they have identical elements.
+ * @param b
+ * @return 
+ */
+bool JSArray::structuralEquals(const JSObject& b)const
+{
+    if (!JSObject::structuralEquals(b))
+        return false;
+    
+    auto&   contentB = static_cast<const JSArray&>(b).m_content;
+    
+    if (m_content.size() != contentB.size())
+        return false;
+    
+    for (size_t i = 0; i < m_content.size(); ++i )
+    {
+        if (!m_content[i].isIdentical(contentB[i]))
+            return false;
+    }
+    
+    return true;
+}
+
 /**
  * Creates a mutable copy of the array
  * @param forceClone
@@ -374,8 +458,9 @@ ASValue JSArrayIterator::create(Ref<JSArray> arr, size_t index)
 Ref<JSClass> JSArrayIterator::getClass()
 {
     static Ref<JSClass>     cls;
+    static std::once_flag   initialized;
     
-    if (cls.isNull())
+    std::call_once (initialized, []()
     {
         VarMap  members;
 
@@ -387,7 +472,7 @@ Ref<JSClass> JSArrayIterator::getClass()
                                      members, 
                                      StringVector(),
                                      scConstructor);
-    }
+    });
 
     return cls;
 }
@@ -472,7 +557,7 @@ ASValue scArrayIndexOf(ExecutionContext* ec)
     for (; n < len; n++) {
         auto item = arr->getAt (n);
         
-        if (item.compare(searchElement, ec) == 0)
+        if (item.equals(searchElement, ec))
             return jsInt(n);
     }
     return jsInt(-1);
@@ -43,6 +43,7 @@ public:
     virtual ASValue freeze();
     virtual ASValue deepFreeze(ASValue::ValuesMap& transformed);
     virtual ASValue unFreeze(bool forceClone=false);
+    virtual ASValue intern(ASValue::ValuesMap& transformed);
 
     virtual ASValue     readField(const std::string& key)const;
     virtual ASValue     writeField(const std::string& key, ASValue value, bool isConst);
@@ -58,6 +59,11 @@ public:
     static Ref<JSClass> ArrayClass;
     
     static std::string join(Ref<JSArray> arr, ASValue sep, ExecutionContext* ec);
+    
+protected:
+    virtual size_t  structuralHash()const;
+    virtual bool    structuralEquals(const JSObject& b)const;
+
 private:
 
     JSArray() : JSObject(ArrayClass, MT_MUTABLE)
@@ -18,6 +18,7 @@
 #include <sstream>
 #include <cstdlib>
 #include <stdio.h>
+#include <mutex>
 
 using namespace std;
 
@@ -287,8 +288,9 @@ CScriptToken CScriptToken::parseId(const char * code)const
 {
     typedef map<string, LEX_TYPES> KEYWORD_MAP;
     static KEYWORD_MAP keywords;
+    static std::once_flag initialized;
 
-    if (keywords.size() == 0)
+    std::call_once (initialized, []()
     {
         keywords["if"] = LEX_R_IF;
         keywords["else"] = LEX_R_ELSE;
@@ -316,7 +318,7 @@ CScriptToken CScriptToken::parseId(const char * code)const
 
         keywords["export"] = LEX_R_EXPORT;
         keywords["import"] = LEX_R_IMPORT;
-    }
+    });
 
     const char* end = code + 1;
     while (isAlpha(*end) || isNumeric(*end))
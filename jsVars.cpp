@@ -13,9 +13,11 @@
 #include "asString.h"
 #include "microVM.h"
 #include "ScriptException.h"
+#include "asIntern.h"
 
 #include <cstdlib>
 #include <math.h>
+#include <string.h>
 
 using namespace std;
 
@@ -27,8 +29,9 @@ std::string getTypeName(JSValueTypes vType)
 {
     typedef map<JSValueTypes, string> TypesMap;
     static TypesMap types;
+    static std::once_flag initialized;
 
-    if (types.empty())
+    std::call_once (initialized, []()
     {
         types[VT_NULL] = "null";
         types[VT_NUMBER] = "Number";
@@ -38,10 +41,10 @@ std::string getTypeName(JSValueTypes vType)
         types[VT_STRING] = "String";
         types[VT_FUNCTION] = "Function";
         types[VT_CLOSURE] = "Closure";
-    }
+    });
 
     ASSERT(types.find(vType) != types.end());
-    return types[vType];
+    return types.at(vType);
 }
 
 ASValue jsNull()
@@ -179,6 +182,80 @@ double ASValue::compare(const ASValue& b, ExecutionContext* ec)const
         return double(this->m_content.ptr - b.m_content.ptr);
 }
 
+/**
+ * Checks if two values are equal. It gives the same result as 'compare () == 0',
+ * but it takes advantage of interned (hash-consed) strings: two interned strings
+ * are equal only if they are the same instance. Cached string hashes are also 
+ * used to discard different strings without comparing their text.
+ * @param b
+ * @param ec
+ * @return 
+ */
+bool ASValue::equals(const ASValue& b, ExecutionContext* ec)const
+{
+    if (m_type == VT_STRING && b.m_type == VT_STRING)
+    {
+        if (m_content.ptr == b.m_content.ptr)
+            return true;
+        
+        auto strA = staticCast<JSObject>();
+        auto strB = b.staticCast<JSObject>();
+        
+        if (strA->isInterned() && strB->isInterned())
+            return false;
+        else if (strA->hasCachedHash() && strB->hasCachedHash() && strA->hash() != strB->hash())
+            return false;
+    }
+    
+    return compare(b, ec) == 0;
+}
+
+/**
+ * Checks if two values are identical: they have the same type and, in the case
+ * of reference types, point to the same object. 
+ * Numbers are compared by its bit pattern, so 'NaN' values are identical to 
+ * themselves, and '0' and '-0' are not identical.
+ * @param b
+ * @return 
+ */
+bool ASValue::isIdentical (const ASValue& b)const
+{
+    if (m_type != b.m_type)
+        return false;
+    
+    switch (m_type)
+    {
+    case VT_NULL:   return true;
+    case VT_BOOL:   return m_content.boolean == b.m_content.boolean;
+    case VT_NUMBER: return memcmp (&m_content.number, &b.m_content.number, sizeof(double)) == 0;
+    default:        return m_content.ptr == b.m_content.ptr;
+    }
+}
+
+/**
+ * Hash code of the value. 
+ * Strings and interned objects are hashed by its contents (the hash is cached 
+ * in the object, so it is only calculated once). Other reference types are 
+ * hashed by address.
+ * @return 
+ */
+size_t ASValue::hash ()const
+{
+    switch (m_type)
+    {
+    case VT_NULL:   return 0;
+    case VT_BOOL:   return std::hash<bool>()(m_content.boolean);
+    case VT_NUMBER: return std::hash<double>()(m_content.number);
+    case VT_STRING: return staticCast<JSObject>()->hash();
+    case VT_OBJECT:
+        if (staticCast<JSObject>()->isInterned())
+            return staticCast<JSObject>()->hash();
+        //Fall through
+    default:
+        return std::hash<void*>()(m_content.ptr);
+    }
+}
+
 /**
  * Converts a 'JSValue' into a 32 bit signed integer.
  * If the conversion is not posible, it returns zero. Therefore, the use
@@ -256,6 +333,20 @@ Ref<JSFunction> JSFunction::createJS(const std::string& name,
     return refFromNew(new JSFunction(name, params, code));
 }
 
+/**
+ * Creates a Javascript function whose code is generated on its first call.
+ * @param name      Function name
+ * @param params    Parameter names
+ * @param lazyCode  Object which compiles the function.
+ * @return A new function object
+ */
+Ref<JSFunction> JSFunction::createLazyJS(const std::string& name,
+                                         const StringVector& params,
+                                         Ref<JSLazyCode> lazyCode)
+{
+    return refFromNew(new JSFunction(name, params, lazyCode));
+}
+
 /**
  * Creates an object which represents a native function
  * @param name  Function name
@@ -288,6 +379,48 @@ m_pNative(NULL)
 {
 }
 
+JSFunction::JSFunction(const std::string& name,
+                       const StringVector& params,
+                       Ref<JSLazyCode> lazyCode) :
+m_name(name),
+m_params(params),
+m_pNative(NULL),
+m_lazyCode(lazyCode)
+{
+}
+
+/**
+ * Gets function MVM code. Lazy functions are compiled on the first call. 
+ * Concurrent first calls wait for the compilation, which is done only once 
+ * (unless it fails, in which case it is tried again on the next call).
+ * @return 
+ */
+Ref<RefCountObj> JSFunction::getCodeMVM()const
+{
+    if (m_lazyCode.notNull())
+    {
+        std::call_once (m_compiled, [this]() {
+            m_codeMVM = m_lazyCode->compile();
+        });
+    }
+    
+    return m_codeMVM;
+}
+
+/**
+ * Sets the code of a deferred function, compiled ahead of its first call.
+ * It has no effect if the function has already been compiled.
+ * @param code
+ */
+void JSFunction::setCompiledCode (Ref<RefCountObj> code)
+{
+    ASSERT (m_lazyCode.notNull());
+    
+    std::call_once (m_compiled, [this, code]() {
+        m_codeMVM = code;
+    });
+}
+
 JSFunction::~JSFunction()
 {
     //    printf ("Destroying function: %s\n", m_name.c_str());
@@ -528,7 +661,12 @@ ASValue ASValue::freeze()const
 ASValue ASValue::deepFreeze()const
 {
     ValuesMap   tmpMap;
-    return deepFreeze (tmpMap);
+    auto result = deepFreeze (tmpMap);
+    
+    if (InternTable::autoIntern())
+        return result.intern();
+    else
+        return result;
 }
 
 ASValue ASValue::deepFreeze(ValuesMap& transformed)const
@@ -541,6 +679,36 @@ ASValue ASValue::deepFreeze(ValuesMap& transformed)const
     }
 }
 
+/**
+ * Returns the canonical instance of a value, from the intern table. Structurally
+ * equal interned values are the same instance, so they can be compared by address.
+ * The value is deep-frozen before being interned.
+ * @return 
+ */
+ASValue ASValue::intern()const
+{
+    ValuesMap   tmpMap;
+    ValuesMap   frozenMap;
+    
+    return deepFreeze (frozenMap).intern (tmpMap);
+}
+
+/**
+ * 'intern' implementation. 
+ * @param transformed   Map of already interned values, used to handle shared 
+ * and cyclic references.
+ * @return 
+ */
+ASValue ASValue::intern(ValuesMap& transformed)const
+{
+    switch (m_type)
+    {
+    case VT_OBJECT:     
+    case VT_STRING:     return staticCast<JSObject>()->intern(transformed);
+    default:            return *this;
+    }
+}
+
 ASValue ASValue::unFreeze(bool forceClone)const
 {
     if (m_type != VT_OBJECT)
@@ -767,6 +935,17 @@ std::string ASValue::getJSON(int indent)const
 
 bool ASValue::operator < (const ASValue& b)const
 {
+    //Strings are ordered by hash first. As hashes are cached, most comparisons
+    //between map keys do not need to inspect the text.
+    if (m_type == VT_STRING && b.m_type == VT_STRING && m_content.ptr != b.m_content.ptr)
+    {
+        const size_t hashA = hash();
+        const size_t hashB = b.hash();
+        
+        if (hashA != hashB)
+            return hashA < hashB;
+    }
+    
     return typedCompare (b, NULL) < 0;
 }
 
@@ -905,6 +1084,17 @@ ASValue VarMap::varDelete (CSTR& name)
     return result;
 }
 
+/**
+ * Removes the value of a variable and its 'const' flag, keeping the remaining
+ * properties. Used when the variable storage is moved elsewhere.
+ * @param name
+ */
+void VarMap::removeValue (CSTR& name)
+{
+    m_content.erase(name);
+    m_content.erase(name + ".const");
+}
+
 /**
  * Gets a field property. 
  * If the field has not this property, or does not exist at all, it returns null.
@@ -1002,6 +1192,46 @@ bool VarMap::any (BoolItemFn fn)const
     return false;
 }
 
+/**
+ * Calculates a hash of the map contents: variables and properties. Values are
+ * hashed by 'ASValue::hash', which does not inspect referenced objects unless 
+ * they are interned.
+ * @return 
+ */
+size_t VarMap::shallowHash ()const
+{
+    size_t  result = m_content.size();
+    
+    for (auto it = m_content.begin(); it != m_content.end(); ++it)
+    {
+        result = hashCombine (result, std::hash<string>()(it->first));
+        result = hashCombine (result, it->second.hash());
+    }
+    
+    return result;
+}
+
+/**
+ * Checks if two maps have the same variables and properties, and their values 
+ * are identical ('ASValue::isIdentical')
+ * @param b
+ * @return 
+ */
+bool VarMap::shallowEquals (const VarMap& b)const
+{
+    if (m_content.size() != b.m_content.size())
+        return false;
+    
+    auto itB = b.m_content.begin();
+    for (auto it = m_content.begin(); it != m_content.end(); ++it, ++itB)
+    {
+        if (it->first != itB->first || !it->second.isIdentical(itB->second))
+            return false;
+    }
+    
+    return true;
+}
+
 /**
  * Calls the 'fn' function for each property of the given variable.
  * @param varName
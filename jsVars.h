@@ -18,6 +18,7 @@
 #include <set>
 #include <sstream>
 #include <vector>
+#include <mutex>
 
 class CScriptToken;
 class ExecutionContext;
@@ -70,6 +71,33 @@ public:
     ASValue (const ASValue& src);
     ASValue& operator=(const ASValue& src);
     
+    /**
+     * Move operations transfer the reference without touching the reference
+     * count, which is atomic. The source value becomes null.
+     */
+    ASValue (ASValue&& src) noexcept : m_content (src.m_content), m_type(src.m_type)
+    {
+        src.m_type = VT_NULL;
+    }
+    
+    ASValue& operator=(ASValue&& src) noexcept
+    {
+        if (this != &src)
+        {
+            //'src' is read before releasing the old value, which may own it.
+            const Content       content = src.m_content;
+            const JSValueTypes  type = src.m_type;
+            
+            src.m_type = VT_NULL;
+            if (m_type >= VT_CLASS)
+                m_content.ptr->release();
+            
+            m_content = content;
+            m_type = type;
+        }
+        return *this;
+    }
+    
     JSValueTypes getType()const
     {
         return m_type;
@@ -78,6 +106,13 @@ public:
     {
         return m_type == VT_NULL;
     }
+    
+    ///Numeric value. Only valid for 'VT_NUMBER' values.
+    double getNumber()const
+    {
+        ASSERT (m_type == VT_NUMBER);
+        return m_content.number;
+    }
 
     typedef std::map< ASValue, ASValue >    ValuesMap;
 
@@ -87,6 +122,8 @@ public:
     ASValue         deepFreeze()const;
     ASValue         deepFreeze(ValuesMap& transformed)const;
     ASValue         unFreeze(bool forceClone=false)const;
+    ASValue         intern()const;
+    ASValue         intern(ValuesMap& transformed)const;
 
     std::string     toString(ExecutionContext* ec = NULL)const;
     bool            toBoolean(ExecutionContext* ec = NULL)const;
@@ -107,6 +144,9 @@ public:
     bool            operator < (const ASValue& b)const;
     double          typedCompare (const ASValue& b, ExecutionContext* ec)const;
     double          compare (const ASValue& b, ExecutionContext* ec)const;
+    bool            equals (const ASValue& b, ExecutionContext* ec)const;
+    bool            isIdentical (const ASValue& b)const;
+    size_t          hash ()const;
 
     int             toInt32 ()const;
     unsigned long long toUint64 ()const;
@@ -173,6 +213,7 @@ public:
     void    checkedVarWrite (CSTR& name, ASValue value, bool isConst);
     ASValue varWrite (CSTR& name, ASValue value, bool isConst);
     ASValue varDelete (CSTR& name);
+    void    removeValue (CSTR& name);
     
     ASValue getProperty (CSTR& name, CSTR& propName)const;
     ASValue setProperty (CSTR& name, CSTR& propName, ASValue propValue);
@@ -187,6 +228,9 @@ public:
 
     void    forEachProperty (CSTR& varName, VoidItemFn fn)const;
     
+    size_t  shallowHash ()const;
+    bool    shallowEquals (const VarMap& b)const;
+    
 private:
     typedef std::map<std::string, ASValue>  ContentMap;
     ContentMap    m_content;
@@ -197,6 +241,16 @@ private:
 /// Native functions must have this signature
 typedef ASValue (*JSNativeFn)(ExecutionContext* var);
 
+/**
+ * Generates the code of a function whose compilation has been deferred until
+ * its first call.
+ */
+class JSLazyCode : public RefCountObj
+{
+public:
+    virtual Ref<RefCountObj> compile() = 0;
+};
+
 /**
  * Javascript function class.
  */
@@ -206,6 +260,9 @@ public:
     static Ref<JSFunction> createJS(const std::string& name, 
                                     const StringVector& params,
                                     Ref<RefCountObj> code);
+    static Ref<JSFunction> createLazyJS(const std::string& name, 
+                                        const StringVector& params,
+                                        Ref<JSLazyCode> lazyCode);
     static Ref<JSFunction> createNative(const std::string& name, 
                                         const StringVector& params, 
                                         JSNativeFn fnPtr);
@@ -225,9 +282,12 @@ public:
         m_codeMVM = code;
     }
     
-    Ref<RefCountObj> getCodeMVM()const
+    Ref<RefCountObj> getCodeMVM()const;
+    void             setCompiledCode (Ref<RefCountObj> code);
+    
+    bool isCompiled()const
     {
-        return m_codeMVM;
+        return m_lazyCode.isNull() || m_codeMVM.notNull();
     }
 
     bool isNative()const
@@ -251,13 +311,17 @@ protected:
 
     JSFunction(const std::string& name, const StringVector& params, JSNativeFn pNative);
     JSFunction(const std::string& name, const StringVector& params, Ref<RefCountObj> code);
+    JSFunction(const std::string& name, const StringVector& params, Ref<JSLazyCode> lazyCode);
     ~JSFunction();
 
 private:
     const std::string m_name;
     StringVector m_params;
-    Ref<RefCountObj> m_codeMVM;
+    mutable Ref<RefCountObj> m_codeMVM;
     JSNativeFn m_pNative;
+    
+    Ref<JSLazyCode> m_lazyCode;
+    mutable std::once_flag m_compiled;
 };
 
 /**
@@ -274,6 +338,16 @@ public:
         return m_fn;
     }
     
+    ASValue getEnv()const 
+    {
+        return m_env;
+    }
+    
+    const ValueVector& getParams()const 
+    {
+        return m_params;
+    }
+    
     std::string toString()const;
     
     ASValue value()
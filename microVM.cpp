@@ -13,8 +13,12 @@
 #include "microVM.h"
 #include "ScriptException.h"
 #include "asObjects.h"
+#include "asActors.h"
+#include "mvmFunctions.h"
+#include "mvmVerifier.h"
 
 #include <vector>
+#include <algorithm>
 
 using namespace std;
 
@@ -24,7 +28,19 @@ using namespace std;
 
 typedef void (*OpFunction) (const int opCode, ExecutionContext* ec);
 
-int execBlock (const MvmBlock& block, ExecutionContext* ec);
+ASValue execRoutine (Ref<MvmRoutine> code, ExecutionContext* ec, int nParams, bool fromCall);
+void runFrameCode (Ref<MvmRoutine> code, ExecutionContext* ec, size_t pc);
+ASValue resumeFrame (ExecutionContext* ec, size_t index);
+void execFlatCode (Ref<MvmRoutine> code, ExecutionContext* ec, size_t pc);
+void execVerifiedCode (Ref<MvmRoutine> code, ExecutionContext* ec, size_t pc);
+void callFunction (int nArgs, ExecutionContext* ec);
+void execCallV8 (const int opCode, ExecutionContext* ec);
+void execCpV8 (const int opCode, ExecutionContext* ec);
+void execWrV8 (const int opCode, ExecutionContext* ec);
+void execSwapV (const int opCode, ExecutionContext* ec);
+void execPopV (const int opCode, ExecutionContext* ec);
+size_t readJumpTarget (const ByteVector& code, size_t offset);
+void writeJumpTarget (ByteVector& code, size_t offset, size_t target);
 void execInstruction16 (const int opCode, ExecutionContext* ec);
 void execInstruction8 (const int opCode, ExecutionContext* ec);
 void execPushC8 (const int opCode, ExecutionContext* ec);
@@ -45,6 +61,26 @@ void execRdLocal (const int opCode, ExecutionContext* ec);
 void execWrLocal (const int opCode, ExecutionContext* ec);
 void execRdGlobal (const int opCode, ExecutionContext* ec);
 void execWrGlobal (const int opCode, ExecutionContext* ec);
+void execNewConstGlobal (const int opCode, ExecutionContext* ec);
+void execRdCapture (const int opCode, ExecutionContext* ec);
+void execNewBox (const int opCode, ExecutionContext* ec);
+void execRdBox (const int opCode, ExecutionContext* ec);
+void execWrBox (const int opCode, ExecutionContext* ec);
+void execAdd (const int opCode, ExecutionContext* ec);
+void execSub (const int opCode, ExecutionContext* ec);
+void execMul (const int opCode, ExecutionContext* ec);
+void execDiv (const int opCode, ExecutionContext* ec);
+void execLt (const int opCode, ExecutionContext* ec);
+void execLe (const int opCode, ExecutionContext* ec);
+void execAddNum (const int opCode, ExecutionContext* ec);
+void execSubNum (const int opCode, ExecutionContext* ec);
+void execMulNum (const int opCode, ExecutionContext* ec);
+void execDivNum (const int opCode, ExecutionContext* ec);
+void execLtNum (const int opCode, ExecutionContext* ec);
+void execLeNum (const int opCode, ExecutionContext* ec);
+JSModule* getFrameModule (ExecutionContext* ec);
+JSModule* resolveFrameModule (CallFrame& frame, const ExecutionContext* ec);
+const char* suspendError (const ExecutionContext* ec);
 void execRdField (const int opCode, ExecutionContext* ec);
 void execWrField (const int opCode, ExecutionContext* ec);
 void execRdIndex (const int opCode, ExecutionContext* ec);
@@ -88,31 +124,92 @@ static const OpFunction s_instructions[64] =
     execWrThisP,    invalidOp,      invalidOp,      invalidOp,
     
     //40
-    invalidOp,      invalidOp,      invalidOp,      invalidOp,
-    invalidOp,      invalidOp,      invalidOp,      invalidOp,
+    invalidOp,      execRdGlobal,   execWrGlobal,   execNewConstGlobal,
+    execRdCapture,  execNewBox,     execRdBox,      execWrBox,
     
     //48
-    invalidOp,      invalidOp,      invalidOp,      invalidOp,
-    invalidOp,      invalidOp,      invalidOp,      invalidOp,
+    execAdd,        execSub,        execMul,        execDiv,
+    execLt,         execLe,         execAddNum,     execSubNum,
     
     //56
-    invalidOp,      invalidOp,      invalidOp,      invalidOp,
+    execMulNum,     execDivNum,     execLtNum,      execLeNum,
+    invalidOp,      invalidOp,      invalidOp,      execNop
+};
+
+// 8 bit instruction dispatch table for verified code. 
+// Stack manipulation instructions do not check stack size.
+///////////////////////////////////////
+static const OpFunction s_verifiedInstructions[64] = 
+{
+    //0
+    execCallV8,     execCallV8,     execCallV8,     execCallV8, 
+    execCallV8,     execCallV8,     execCallV8,     execCallV8, 
+    
+    //8
+    execCpV8,       execCpV8,       execCpV8,       execCpV8,
+    execCpV8,       execCpV8,       execCpV8,       execCpV8,
+    
+    //16
+    execWrV8,       execWrV8,       execWrV8,       execWrV8,
+    execWrV8,       execWrV8,       execWrV8,       execWrV8,
+    
+    //24
+    execSwapV,      execPopV,       execRdField,    execWrField,
+    execRdIndex,    execWrIndex,    execNewConstField, invalidOp,
+    
+    //32
+    execRdParam,    execWrParam,    execNumParams,  execPushThis,
+    execWrThisP,    invalidOp,      invalidOp,      invalidOp,
+    
+    //40
+    invalidOp,      execRdGlobal,   execWrGlobal,   execNewConstGlobal,
+    execRdCapture,  execNewBox,     execRdBox,      execWrBox,
+    
+    //48
+    execAdd,        execSub,        execMul,        execDiv,
+    execLt,         execLe,         execAddNum,     execSubNum,
+    
+    //56
+    execMulNum,     execDivNum,     execLtNum,      execLeNum,
     invalidOp,      invalidOp,      invalidOp,      execNop
 };
 
 /**
  * Executes a Micro VM routine
+ * If a runtime error is thrown, the call frames are not removed, so the 
+ * position of the error can be read from them ('mvmCurrentPosition'). The 
+ * execution context cannot be used to run more code after an error.
  *
  * @param code
  * @param ec        Execution context
  * @return 
  */
 ASValue mvmExecRoutine (Ref<MvmRoutine> code, ExecutionContext* ec, int nParams)
+{
+    return execRoutine (code, ec, nParams, false);
+}
+
+/**
+ * Executes a Micro VM routine (see 'mvmExecRoutine').
+ * If the execution is suspended, the routine frame and its stack are kept,
+ * and null is returned.
+ * @param code
+ * @param ec
+ * @param nParams
+ * @param fromCall  Called by a call instruction.
+ * @return 
+ */
+ASValue execRoutine (Ref<MvmRoutine> code, ExecutionContext* ec, int nParams, bool fromCall)
 {
     if (code->blocks.empty())
         return jsNull();
     
-    int nextBlock = 0;
+    //Routines may be shared by actors running on different threads.
+    std::call_once (code->prepared, [&code]()
+    {
+        mvmVerify(code);
+        mvmFlatten(code);
+    });
     
     //Create stack frame
     const size_t stackSize = ec->frames.size();
@@ -120,25 +217,13 @@ ASValue mvmExecRoutine (Ref<MvmRoutine> code, ExecutionContext* ec, int nParams)
                        ec->stack.size()-nParams, 
                        nParams,
                        ec->getThisParam());
+    frame.routine = code;
+    frame.fromCall = fromCall;
     ec->frames.push_back(frame);
     
-    while (nextBlock >= 0)
-    {
-        try
-        {
-            nextBlock = execBlock (code->blocks[nextBlock], ec);
-        }
-        catch (const RuntimeError& e)
-        {
-            if (e.Position.Block < 0)
-            {
-                VmPosition pos (code, nextBlock, e.Position.Instruction);
-                throw RuntimeError (e.what(), pos);
-            }
-            else
-                throw e;
-        }
-    }
+    runFrameCode (code, ec, 0);
+    if (ec->suspended)
+        return jsNull();
     
     //Scope stack unwind.
     ec->frames.pop_back();
@@ -149,59 +234,456 @@ ASValue mvmExecRoutine (Ref<MvmRoutine> code, ExecutionContext* ec, int nParams)
 }
 
 /**
- * Executes a block of code.
- * @param block
+ * Runs the code of the routine of the last frame, from a given instruction.
+ * @param code
+ * @param ec
+ * @param pc    Flat code offset.
+ */
+void runFrameCode (Ref<MvmRoutine> code, ExecutionContext* ec, size_t pc)
+{
+    //Verified code runs without stack checks. Traces use the checked version.
+    if (code->verified && ec->frames.back().numParams >= (size_t)code->stackParams && ec->trace == NULL)
+    {
+        ec->reserveStack(code->maxStack);
+        execVerifiedCode (code, ec, pc);
+    }
+    else
+        execFlatCode (code, ec, pc);
+}
+
+/**
+ * Suspends the current execution. Called by the native function which waits
+ * for something; its caller frames are unwound from the C++ stack, but kept
+ * in the execution context, which can then be captured ('MvmSuspension').
+ * The execution can only be suspended if all its frames have been called by
+ * call instructions, from the root call, which is made by code which handles
+ * suspensions (the actor message dispatcher).
+ * @param ec
+ * @param token     What the execution waits for. Interpreted by the code which
+ * handles the suspension.
+ */
+void mvmSuspend (ExecutionContext* ec, Ref<RefCountObj> token)
+{
+    const char* error = suspendError(ec);
+    
+    if (error != NULL)
+        rtError ("%s", error);
+    
+    ec->suspended = true;
+    ec->suspendToken = token;
+}
+
+/**
+ * Checks if the current execution can be suspended (see 'mvmSuspend').
+ * @param ec
+ * @return 
+ */
+bool mvmCanSuspend (const ExecutionContext* ec)
+{
+    return suspendError(ec) == NULL;
+}
+
+/**
+ * Checks the conditions to suspend the current execution.
+ * @param ec
+ * @return Why it cannot be suspended. NULL if it can be suspended.
+ */
+const char* suspendError (const ExecutionContext* ec)
+{
+    const size_t    n = ec->frames.size();
+    
+    if (!ec->suspendable || n < 2)
+        return "Execution cannot be suspended here";
+    
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (i > 0 && !ec->frames[i].fromCall)
+            return "Execution cannot be suspended from a function called by native code";
+        if (i < n - 1 && ec->frames[i].routine.isNull())
+            return "Execution cannot be suspended inside a native function";
+    }
+    
+    return NULL;
+}
+
+/**
+ * Resumes a suspended execution, which shall have been restored into the 
+ * execution context (see 'MvmSuspension::restore').
+ * @param ec
+ * @param value     Return value of the function which suspended it.
+ * @return Return value of the root call. Null if the execution has been 
+ * suspended again.
+ */
+ASValue mvmResume (ExecutionContext* ec, ASValue value)
+{
+    ASSERT (!ec->frames.empty() && !ec->stack.empty());
+    
+    ec->stack.back() = value;
+    return resumeFrame (ec, 0);
+}
+
+/**
+ * Resumes the execution of a frame of a suspended execution. Inner frames are
+ * resumed first, and their results complete the call instructions which have
+ * called them.
+ * @param ec
+ * @param index
+ * @return 
+ */
+ASValue resumeFrame (ExecutionContext* ec, size_t index)
+{
+    Ref<MvmRoutine> code = ec->frames[index].routine;
+    
+    if (index + 1 < ec->frames.size())
+    {
+        const size_t    paramsIndex = ec->frames[index + 1].paramsIndex;
+        ASValue         result = resumeFrame (ec, index + 1);
+        
+        if (ec->suspended)
+            return jsNull();
+        
+        //Same as 'callFunction', after the call.
+        ec->stack.resize(paramsIndex);
+        ec->push(result);
+    }
+    
+    runFrameCode (code, ec, ec->frames[index].pc);
+    if (ec->suspended)
+        return jsNull();
+    
+    ec->frames.pop_back();
+    return ec->pop();
+}
+
+/**
+ * Moves the stack and call frames of a suspended execution out of the
+ * execution context.
+ * @param ec
+ * @return 
+ */
+Ref<MvmSuspension> MvmSuspension::capture (ExecutionContext* ec)
+{
+    ASSERT (ec->suspended);
+    
+    auto state = refFromNew (new MvmSuspension);
+    
+    state->m_stack = std::move(ec->stack);
+    state->m_frames = std::move(ec->frames);
+    state->m_token = ec->suspendToken;
+    
+    ec->stack.clear();
+    ec->frames.clear();
+    ec->suspended = false;
+    ec->suspendToken = Ref<RefCountObj>();
+    
+    return state;
+}
+
+/**
+ * Moves the stack and frames back to an execution context, in order to 
+ * resume the execution ('mvmResume'). The context shall not be running code.
+ * @param ec
+ */
+void MvmSuspension::restore (ExecutionContext* ec)
+{
+    ASSERT (ec->frames.empty());
+    
+    ec->stack = std::move(m_stack);
+    ec->frames = std::move(m_frames);
+}
+
+/**
+ * Executes the flat version of a routine, until a 'RET' instruction is found.
+ * The return value is left on the top of the stack.
+ * @param code
  * @param ec
- * @return Returns the next block to be executed.
  */
-int execBlock (const MvmBlock& block, ExecutionContext* ec)
+void execFlatCode (Ref<MvmRoutine> code, ExecutionContext* ec, size_t pc)
 {
-    for (size_t i = 0; i < block.instructions.size();)
+    const ByteVector&   flat = code->flatCode;
+    const size_t        size = flat.size();
+    size_t              i = pc;
+    
+    while (true)
     {
-        const int instructionIndex = i;
+        //Called functions push and pop their frames, so 'back' is always 
+        //the frame of this routine here.
+        ec->frames.back().pc = i;
+        if (i >= size)
+            rtError("Unexpected end of code");
+
+        int opCode = flat[i++];
+
+        if (opCode & OC_EXT_FLAG)
+        {
+            if (i >= size)
+                rtError("Unexpected end of instruction");
+            opCode = (opCode << 8) | flat[i++];
+            execInstruction16 (opCode, ec);
+        }
+        else if (opCode >= OC_JMP && opCode <= OC_RET)
+        {
+            if (ec->trace != NULL)
+                ec->trace (opCode, ec);
+
+            if (opCode == OC_RET)
+                break;
+
+            if (i + 4 > size)
+                rtError("Unexpected end of instruction");
+            const size_t target = readJumpTarget (flat, i);
+            i += 4;
+
+            if (opCode == OC_JMP)
+                i = target;
+            else if (ec->stack.back().toBoolean(ec) == (opCode == OC_JT))
+                i = target;
+        }
+        else
+            execInstruction8 (opCode, ec);
         
-        try
+        //The execution is suspended by called functions. It resumes on the
+        //next instruction.
+        if (ec->suspended)
         {
-            int opCode = block.instructions[i++];
+            ec->frames.back().pc = i;
+            return;
+        }
+    }
+}
+
+/**
+ * Gets the position of the instruction being executed by the innermost MVM
+ * routine of an execution context. Used to locate runtime errors, as call
+ * frames are not removed when they are thrown.
+ * @param ec
+ * @return An empty position if no routine is being executed.
+ */
+VmPosition mvmCurrentPosition (const ExecutionContext* ec)
+{
+    for (auto it = ec->frames.rbegin(); it != ec->frames.rend(); ++it)
+    {
+        const auto routine = it->routine;
+        
+        if (routine.isNull() || routine->blockStarts.empty())
+            continue;
+        
+        //Translate flat code offset into block & instruction offset.
+        const auto& starts = routine->blockStarts;
+        auto        itBlock = upper_bound (starts.begin(), starts.end(), (int)it->pc);
+        const int   block = int(itBlock - starts.begin()) - 1;
+
+        if (block >= 0)
+            return VmPosition (routine, block, int(it->pc) - starts[block]);
+    }
+    
+    return VmPosition();
+}
+
+/**
+ * Executes the flat version of a verified routine (see 'mvmVerify'), until a 
+ * 'RET' instruction is found. The verifier guarantees that the code is well 
+ * formed, and that stack accesses are inside the frame, so neither the code 
+ * bounds nor the stack size are checked here (only for the instructions which
+ * have a specific version; the remaining ones are shared with the checked 
+ * interpreter).
+ * @param code
+ * @param ec
+ */
+void execVerifiedCode (Ref<MvmRoutine> code, ExecutionContext* ec, size_t pc)
+{
+    const unsigned char*    flat = code->flatCode.data();
+    const ValueVector&      constants = code->constants;
+    ValueVector&            stack = ec->stack;
+    size_t                  i = pc;
+    
+    while (true)
+    {
+        ec->frames.back().pc = i;
+
+        int opCode = flat[i++];
 
-            if (opCode & OC_EXT_FLAG)
+        if (opCode >= OC_PUSHC && opCode < OC_EXT_FLAG)
+            stack.push_back(constants[opCode - OC_PUSHC]);
+        else if (opCode & OC_EXT_FLAG)
+        {
+            const int decoded = ((opCode << 8) | flat[i++]) & 0x3FFF;
+            
+            if (decoded >= OC16_PUSHC)
+                stack.push_back(constants[decoded - (OC16_PUSHC - 64)]);
+            else if (decoded <= OC16_CALL_MAX)
+            {
+                ec->callInstruction = true;
+                callFunction ((OC_CALL_MAX - OC_CALL) + 1 + (decoded - OC16_CALL), ec);
+                if (ec->suspended)
+                {
+                    ec->frames.back().pc = i;
+                    return;
+                }
+            }
+            else if (decoded <= OC16_CP_MAX)
             {
-                if (i >= block.instructions.size())
-                    rtError("Unexpected end of instruction");
-                opCode = (opCode << 8) | block.instructions[i++];
-                execInstruction16 (opCode, ec);
+                const size_t    offset = (decoded - OC16_CP) + (OC_CP_MAX - OC_CP) + 1;
+                const ASValue   value = stack[stack.size() - offset - 1];
+                
+                stack.push_back(value);
             }
             else
-                execInstruction8 (opCode, ec);
+            {
+                const size_t    offset = (decoded - OC16_WR) + (OC_WR_MAX - OC_WR) + 2;
+                
+                stack[stack.size() - offset - 1] = stack.back();
+            }
+        }
+        else if (opCode >= OC_JMP && opCode <= OC_RET)
+        {
+            if (opCode == OC_RET)
+                break;
+
+            const size_t target = readJumpTarget (code->flatCode, i);
+            i += 4;
+
+            if (opCode == OC_JMP)
+                i = target;
+            else if (stack.back().toBoolean(ec) == (opCode == OC_JT))
+                i = target;
         }
-        catch (const RuntimeError& e)
+        else
         {
-            if (e.Position.Instruction < 0)
+            s_verifiedInstructions[opCode](opCode, ec);
+            
+            //Only calls can suspend the execution.
+            if (opCode <= OC_CALL_MAX && ec->suspended)
             {
-                VmPosition  pos (Ref<RefCountObj>(), -1, instructionIndex);
-                throw RuntimeError(e.what(), pos);
+                ec->frames.back().pc = i;
+                return;
             }
-            else 
-                throw e;
         }
     }
+}
+
+/**
+ * Reads the target of a jump instruction.
+ * @param code
+ * @param offset    Offset of the target field (just after the op code)
+ * @return 
+ */
+size_t readJumpTarget (const ByteVector& code, size_t offset)
+{
+    return size_t(code[offset]) 
+        | (size_t(code[offset+1]) << 8) 
+        | (size_t(code[offset+2]) << 16) 
+        | (size_t(code[offset+3]) << 24);
+}
+
+/**
+ * Writes the target of a jump instruction.
+ * @param code
+ * @param offset    Offset of the target field (just after the op code)
+ * @param target
+ */
+void writeJumpTarget (ByteVector& code, size_t offset, size_t target)
+{
+    code[offset] = target & 0xFF;
+    code[offset+1] = (target >> 8) & 0xFF;
+    code[offset+2] = (target >> 16) & 0xFF;
+    code[offset+3] = (target >> 24) & 0xFF;
+}
+
+/**
+ * Emits the code which leaves a block through one of its exits.
+ * @param flat          Flat code buffer
+ * @param fixups        Jump targets to patch (offset -> target block)
+ * @param target        Target block. Negative means return from the routine.
+ * @param fallThrough   Block which follows the generated code, if any (-1 if none).
+ */
+void flattenExit (ByteVector& flat, 
+                  vector<pair<size_t, int> >& fixups, 
+                  int target,
+                  int fallThrough)
+{
+    if (target < 0)
+        flat.push_back(OC_RET);
+    else
+    {
+        flat.push_back(OC_POP);
+        if (target != fallThrough)
+        {
+            flat.push_back(OC_JMP);
+            fixups.push_back(make_pair(flat.size(), target));
+            flat.insert(flat.end(), 4, 0);
+        }
+    }
+}
+
+/**
+ * Gets the source position of a VM instruction, from the position table of
+ * its routine.
+ * @param vmPos
+ * @return An empty position if it is not known.
+ */
+ScriptPosition mvmSourcePosition (const VmPosition& vmPos)
+{
+    if (vmPos.Routine.isNull() || vmPos.Block < 0)
+        return ScriptPosition();
     
-    auto result = ec->pop();
-    int next = -1;
+    auto routine = vmPos.Routine.staticCast<MvmRoutine>();
     
-    if (block.nextBlocks[0] == block.nextBlocks[1])
-        next = block.nextBlocks[0];
-    else
+    return routine->positions.get(vmPos.Block, vmPos.Instruction);
+}
+
+/**
+ * Generates the flat version of a routine code, in which block transitions 
+ * are translated into jump instructions. Blocks are still the canonical
+ * representation of the code (used by code generation, disassembly and 
+ * position tables); flat code is the one executed.
+ * 
+ * Block instructions are copied verbatim, so an offset in flat code can be 
+ * translated back into a block position using 'blockStarts'.
+ * 
+ * @param code
+ */
+void mvmFlatten (Ref<MvmRoutine> code)
+{
+    ByteVector&                 flat = code->flatCode;
+    vector<int>&                starts = code->blockStarts;
+    vector<pair<size_t, int> >  fixups;
+    const int                   nBlocks = (int)code->blocks.size();
+    
+    flat.clear();
+    starts.clear();
+    
+    for (int b = 0; b < nBlocks; ++b)
     {
-        const bool r = result.toBoolean(ec);
+        const MvmBlock& block = code->blocks[b];
+        const int       fBlock = block.nextBlocks[0];
+        const int       tBlock = block.nextBlocks[1];
         
-        next = block.nextBlocks[r?1:0];
+        starts.push_back((int)flat.size());
+        flat.insert(flat.end(), block.instructions.begin(), block.instructions.end());
+        
+        if (fBlock == tBlock)
+            flattenExit (flat, fixups, tBlock, b+1);
+        else
+        {
+            //The exit which jumps is placed last, so it can fall through
+            //to the next block.
+            const bool      jumpIfFalse = (fBlock == b+1);
+            const int       jumpBlock = jumpIfFalse ? fBlock : tBlock;
+            const int       otherBlock = jumpIfFalse ? tBlock : fBlock;
+            
+            flat.push_back(jumpIfFalse ? OC_JF : OC_JT);
+            const size_t    jumpField = flat.size();
+            flat.insert(flat.end(), 4, 0);
+            
+            flattenExit (flat, fixups, otherBlock, -1);
+            writeJumpTarget (flat, jumpField, flat.size());
+            flattenExit (flat, fixups, jumpBlock, b+1);
+        }
     }
     
-    if (next < 0)
-        ec->push(result);
-    
-    return next;
+    for (auto it = fixups.begin(); it != fixups.end(); ++it)
+        writeJumpTarget (flat, it->first, starts[it->second]);
 }
 
 /**
@@ -282,6 +764,7 @@ void execPushC16 (const int opCode, ExecutionContext* ec)
 void execCall8 (const int opCode, ExecutionContext* ec)
 {
     ASSERT (opCode >= OC_CALL && opCode <= OC_CALL_MAX);
+    ec->callInstruction = true;
     mvmExecCall (opCode - OC_CALL, ec);
 }
 
@@ -295,9 +778,21 @@ void execCall16 (const int opCode, ExecutionContext* ec)
     ASSERT (opCode >= OC16_CALL && opCode <= OC16_CALL_MAX);
     const int   nArgs = (OC_CALL_MAX - OC_CALL) + 1 + (opCode - OC16_CALL);
     
+    ec->callInstruction = true;
     mvmExecCall(nArgs, ec);
 }
 
+/**
+ * Executes a function call instruction, 8 bit version, for verified code.
+ * @param opCode
+ * @param ec
+ */
+void execCallV8 (const int opCode, ExecutionContext* ec)
+{
+    ec->callInstruction = true;
+    callFunction (opCode - OC_CALL, ec);
+}
+
 /**
  * Executes call instruction.
  * @param nArgs     Argument count
@@ -308,9 +803,23 @@ void mvmExecCall (int nArgs, ExecutionContext* ec)
     if (nArgs + 1 > (int)ec->stack.size())
         rtError ("Stack underflow executing function call");
     
+    callFunction (nArgs, ec);
+}
+
+/**
+ * Calls the function on the top of the stack. The stack shall contain the 
+ * function and its arguments.
+ * @param nArgs     Argument count
+ * @param ec
+ */
+void callFunction (int nArgs, ExecutionContext* ec)
+{
     ASValue     thisPtr = jsNull();
     ASValue     fnVal = ec->pop();
     ASValue     result = jsNull();
+    const bool  fromCall = ec->callInstruction;
+    
+    ec->callInstruction = false;
     
     //Find function value.
     fnVal = getFunction(fnVal, &thisPtr);
@@ -342,13 +851,18 @@ void mvmExecCall (int nArgs, ExecutionContext* ec)
                                            ec->stack.size()-nArgs, 
                                            nArgs,
                                            ec->getThisParam()));
+            ec->frames.back().fromCall = fromCall;
             result = function->nativePtr()(ec);
             ec->frames.pop_back();
         }
         else
         {
             auto code = function->getCodeMVM().staticCast<MvmRoutine>();
-            result = mvmExecRoutine(code, ec, nArgs);
+            result = execRoutine(code, ec, nArgs, fromCall);
+            
+            //The frame and the parameters of a suspended routine are kept.
+            if (ec->suspended)
+                return;
         }
     }
     else
@@ -544,6 +1058,39 @@ void execWr16 (const int opCode, ExecutionContext* ec)
     *(ec->stack.rbegin() + offset) = ec->stack.back();
 }
 
+/**
+ * Stack manipulation instructions for verified code. They do not check the
+ * stack size.
+ * @param opCode
+ * @param ec
+ */
+void execCpV8 (const int opCode, ExecutionContext* ec)
+{
+    ValueVector&    stack = ec->stack;
+    const ASValue   value = stack[stack.size() - (opCode - OC_CP) - 1];
+    
+    stack.push_back(value);
+}
+
+void execWrV8 (const int opCode, ExecutionContext* ec)
+{
+    ValueVector&    stack = ec->stack;
+    
+    stack[stack.size() - (opCode - OC_WR) - 2] = stack.back();
+}
+
+void execSwapV (const int opCode, ExecutionContext* ec)
+{
+    ValueVector&    stack = ec->stack;
+    
+    std::swap (stack[stack.size() - 1], stack[stack.size() - 2]);
+}
+
+void execPopV (const int opCode, ExecutionContext* ec)
+{
+    ec->stack.pop_back();
+}
+
 /**
  * Exchanges the top two elements of the stack
  * @param opCode
@@ -698,6 +1245,329 @@ void execWrParam (const int opCode, ExecutionContext* ec)
     ec->push(value);
 }
 
+/**
+ * Reads a module global variable. 
+ * Pops the slot index from the stack and pushes the variable value.
+ * @param opCode
+ * @param ec
+ */
+void execRdGlobal (const int opCode, ExecutionContext* ec)
+{
+    const int index = ec->pop().toInt32();
+    
+    ec->push(getFrameModule(ec)->readSlot(index));
+}
+
+/**
+ * Writes a module global variable.
+ * Pops the slot index and the value from the stack, and pushes back the value.
+ * @param opCode
+ * @param ec
+ */
+void execWrGlobal (const int opCode, ExecutionContext* ec)
+{
+    const ASValue   value = ec->pop();
+    const int       index = ec->pop().toInt32();
+    
+    getFrameModule(ec)->writeSlot(index, value, false);
+    ec->push(value);
+}
+
+/**
+ * Creates a new module constant.
+ * Pops the slot index and the value from the stack, and pushes back the value.
+ * @param opCode
+ * @param ec
+ */
+void execNewConstGlobal (const int opCode, ExecutionContext* ec)
+{
+    const ASValue   value = ec->pop();
+    const int       index = ec->pop().toInt32();
+    
+    getFrameModule(ec)->writeSlot(index, value, true);
+    ec->push(value);
+}
+
+/**
+ * Gets the module globals object of the current call frame.
+ * It is found from the environment, which is always the last parameter of the
+ * frame (directly for scripts, through closures for functions). 
+ * The result is cached in the frame.
+ * @param ec
+ * @return 
+ */
+JSModule* getFrameModule (ExecutionContext* ec)
+{
+    JSModule* module = resolveFrameModule(ec->frames.back(), ec);
+    
+    if (module == NULL)
+        rtError ("Module globals not found");
+    
+    return module;
+}
+
+/**
+ * Looks for the module globals object of a call frame, and caches it.
+ * Inside an actor, code bound to the module from which the actor globals were
+ * copied (class methods, for example) uses the actor globals instead, so 
+ * actors do not share module globals.
+ * @param frame
+ * @param ec
+ * @return NULL if the frame has no environment.
+ */
+JSModule* resolveFrameModule (CallFrame& frame, const ExecutionContext* ec)
+{
+    if (frame.module == NULL)
+    {
+        ASValue env;
+        
+        if (frame.numParams > 0)
+            env = ec->stack[frame.paramsIndex + frame.numParams - 1];
+        
+        while (env.getType() == VT_CLOSURE)
+            env = env.staticCast<JSClosure>()->getEnv();
+        
+        if (env.getType() == VT_OBJECT)
+            frame.module = dynamic_cast<JSModule*>(env.staticCast<JSObject>().getPointer());
+        
+        if (frame.module != NULL && ec->curActor != NULL)
+        {
+            JSModule*   globals = ec->curActor->getGlobals().getPointer();
+            
+            if (frame.module != globals && frame.module->getOrigin() == globals->getOrigin())
+                frame.module = globals;
+        }
+    }
+    
+    return frame.module;
+}
+
+/**
+ * Gets the module globals of the innermost MVM routine being executed which 
+ * has an environment. Used by native functions which need the globals of their
+ * caller.
+ * @param ec
+ * @return NULL if no routine frame has an environment.
+ */
+JSModule* mvmCurrentModule (ExecutionContext* ec)
+{
+    for (auto it = ec->frames.rbegin(); it != ec->frames.rend(); ++it)
+    {
+        if (it->routine.isNull())
+            continue;
+        
+        JSModule* module = resolveFrameModule(*it, ec);
+        
+        if (module != NULL)
+            return module;
+    }
+    
+    return NULL;
+}
+
+/**
+ * Reads a variable captured by the closure being executed.
+ * Pops the capture index from the stack, and pushes the captured value.
+ * The closure is the last parameter of the frame.
+ * @param opCode
+ * @param ec
+ */
+void execRdCapture (const int opCode, ExecutionContext* ec)
+{
+    const int           index = ec->pop().toInt32();
+    const CallFrame&    frame = ec->frames.back();
+    
+    if (frame.numParams == 0)
+        rtError ("Captured variable read outside a closure");
+    
+    const ASValue&  closure = ec->stack[frame.paramsIndex + frame.numParams - 1];
+    
+    if (closure.getType() != VT_CLOSURE)
+        rtError ("Captured variable read outside a closure");
+    
+    const ValueVector& captured = closure.staticCast<JSClosure>()->getParams();
+    
+    if (index < 0 || index >= (int)captured.size())
+        rtError ("Invalid captured variable index: %d", index);
+    
+    ec->push(captured[index]);
+}
+
+/**
+ * Replaces the value on the top of the stack by a box which contains it.
+ * @param opCode
+ * @param ec
+ */
+void execNewBox (const int opCode, ExecutionContext* ec)
+{
+    const ASValue value = ec->pop();
+    
+    ec->push(JSBox::create(value)->value());
+}
+
+/**
+ * Replaces the box on the top of the stack by its content.
+ * @param opCode
+ * @param ec
+ */
+void execRdBox (const int opCode, ExecutionContext* ec)
+{
+    const ASValue box = ec->pop();
+    
+    ASSERT (box.getType() == VT_OBJECT);
+    ec->push(box.staticCast<JSBox>()->get());
+}
+
+/**
+ * Writes a value into a box.
+ * Pops the value and the box from the stack, and pushes back the value.
+ * Boxes of frozen closures cannot be written, as they may be shared by 
+ * several actors.
+ * @param opCode
+ * @param ec
+ */
+void execWrBox (const int opCode, ExecutionContext* ec)
+{
+    const ASValue value = ec->pop();
+    const ASValue box = ec->pop();
+    
+    ASSERT (box.getType() == VT_OBJECT);
+    if (!box.isMutable())
+        rtError ("Cannot modify a variable captured by a frozen closure");
+    box.staticCast<JSBox>()->set(value);
+    ec->push(value);
+}
+
+/**
+ * Arithmetic and comparison instructions. Both operands are taken from the 
+ * stack, and replaced by the result. If any of them is not a number, the 
+ * generic operator implementation is used.
+ * 
+ * Comparisons are made with a subtraction, as 'ASValue::compare' does, so the
+ * results are the same in both paths.
+ * @param opCode
+ * @param ec
+ */
+void execAdd (const int opCode, ExecutionContext* ec)
+{
+    const ASValue b = ec->pop();
+    const ASValue a = ec->pop();
+    
+    if (a.getType() == VT_NUMBER && b.getType() == VT_NUMBER)
+        ec->push(jsDouble(a.getNumber() + b.getNumber()));
+    else
+        ec->push(mvmAddValues(a, b, ec));
+}
+
+void execSub (const int opCode, ExecutionContext* ec)
+{
+    const ASValue b = ec->pop();
+    const ASValue a = ec->pop();
+    
+    if (a.getType() == VT_NUMBER && b.getType() == VT_NUMBER)
+        ec->push(jsDouble(a.getNumber() - b.getNumber()));
+    else
+        ec->push(mvmSubValues(a, b, ec));
+}
+
+void execMul (const int opCode, ExecutionContext* ec)
+{
+    const ASValue b = ec->pop();
+    const ASValue a = ec->pop();
+    
+    if (a.getType() == VT_NUMBER && b.getType() == VT_NUMBER)
+        ec->push(jsDouble(a.getNumber() * b.getNumber()));
+    else
+        ec->push(mvmMultiplyValues(a, b, ec));
+}
+
+void execDiv (const int opCode, ExecutionContext* ec)
+{
+    const ASValue b = ec->pop();
+    const ASValue a = ec->pop();
+    
+    if (a.getType() == VT_NUMBER && b.getType() == VT_NUMBER)
+        ec->push(jsDouble(a.getNumber() / b.getNumber()));
+    else
+        ec->push(mvmDivideValues(a, b, ec));
+}
+
+void execLt (const int opCode, ExecutionContext* ec)
+{
+    const ASValue b = ec->pop();
+    const ASValue a = ec->pop();
+    
+    if (a.getType() == VT_NUMBER && b.getType() == VT_NUMBER)
+        ec->push(jsBool(a.getNumber() - b.getNumber() < 0));
+    else
+        ec->push(mvmLessValues(a, b, ec));
+}
+
+void execLe (const int opCode, ExecutionContext* ec)
+{
+    const ASValue b = ec->pop();
+    const ASValue a = ec->pop();
+    
+    if (a.getType() == VT_NUMBER && b.getType() == VT_NUMBER)
+        ec->push(jsBool(a.getNumber() - b.getNumber() <= 0));
+    else
+        ec->push(mvmLequalValues(a, b, ec));
+}
+
+/**
+ * Arithmetic and comparison instructions for operands which the code generator
+ * has proven to be numbers. No type checks are made.
+ * @param opCode
+ * @param ec
+ */
+void execAddNum (const int opCode, ExecutionContext* ec)
+{
+    const double    b = ec->pop().getNumber();
+    ASValue&        a = ec->stack.back();
+    
+    a = jsDouble(a.getNumber() + b);
+}
+
+void execSubNum (const int opCode, ExecutionContext* ec)
+{
+    const double    b = ec->pop().getNumber();
+    ASValue&        a = ec->stack.back();
+    
+    a = jsDouble(a.getNumber() - b);
+}
+
+void execMulNum (const int opCode, ExecutionContext* ec)
+{
+    const double    b = ec->pop().getNumber();
+    ASValue&        a = ec->stack.back();
+    
+    a = jsDouble(a.getNumber() * b);
+}
+
+void execDivNum (const int opCode, ExecutionContext* ec)
+{
+    const double    b = ec->pop().getNumber();
+    ASValue&        a = ec->stack.back();
+    
+    a = jsDouble(a.getNumber() / b);
+}
+
+void execLtNum (const int opCode, ExecutionContext* ec)
+{
+    const double    b = ec->pop().getNumber();
+    ASValue&        a = ec->stack.back();
+    
+    a = jsBool(a.getNumber() - b < 0);
+}
+
+void execLeNum (const int opCode, ExecutionContext* ec)
+{
+    const double    b = ec->pop().getNumber();
+    ASValue&        a = ec->stack.back();
+    
+    a = jsBool(a.getNumber() - b <= 0);
+}
+
 /**
  * Places on the top of the stack the number of parameters passed to the 
  * actual function being executed
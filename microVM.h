@@ -13,17 +13,30 @@
 #pragma once
 
 #include "jsVars.h"
+#include "ScriptPosition.h"
 #include <vector>
 #include <string>
+#include <algorithm>
+#include <mutex>
 
 struct MvmRoutine;
 struct ExecutionContext;
+class JSModule;
+class ActorRuntime;
+class AsActor;
 
 typedef std::vector<unsigned char>      ByteVector;
 
 ASValue         mvmExecRoutine (Ref<MvmRoutine> code, ExecutionContext* ec, int nParams);
+void            mvmFlatten (Ref<MvmRoutine> code);
 void            mvmExecCall (int nArgs, ExecutionContext* ec);
+void            mvmSuspend (ExecutionContext* ec, Ref<RefCountObj> token);
+bool            mvmCanSuspend (const ExecutionContext* ec);
+ASValue         mvmResume (ExecutionContext* ec, ASValue value);
 std::string     mvmDisassembly (Ref<MvmRoutine> code);
+ScriptPosition  mvmSourcePosition (const VmPosition& vmPos);
+VmPosition      mvmCurrentPosition (const ExecutionContext* ec);
+JSModule*       mvmCurrentModule (ExecutionContext* ec);
 std::string     mvmDisassemblyInstruction (int opCode, const ValueVector& constants);
 Ref<JSObject>   toJSObject (Ref<MvmRoutine> code);
 
@@ -52,6 +65,42 @@ enum OpCodes8
     OC_NUM_PARAMS = 34,
     OC_PUSH_THIS = 35,
     OC_WR_THISP = 36,
+    
+    //Control flow instructions. Only valid in flat code (see 'mvmFlatten').
+    //Jump instructions are followed by a 32 bit (little endian) target offset.
+    OC_JMP = 37,
+    OC_JT = 38,
+    OC_JF = 39,
+    OC_RET = 40,
+    
+    //Module globals access. Slot index is taken from the stack.
+    OC_RD_GLOBAL = 41,
+    OC_WR_GLOBAL = 42,
+    OC_NEW_CONST_GLOBAL = 43,
+    
+    //Captured variables. Index is taken from the stack.
+    OC_RD_CAPTURE = 44,
+    OC_NEW_BOX = 45,
+    OC_RD_BOX = 46,
+    OC_WR_BOX = 47,
+    
+    //Arithmetic and comparison operators, with a fast path for numbers. Other
+    //types fall back to the generic operator implementation.
+    OC_ADD = 48,
+    OC_SUB = 49,
+    OC_MUL = 50,
+    OC_DIV = 51,
+    OC_LT = 52,
+    OC_LE = 53,
+    
+    //Same operators, for operands which are known to be numbers.
+    OC_ADD_NUM = 54,
+    OC_SUB_NUM = 55,
+    OC_MUL_NUM = 56,
+    OC_DIV_NUM = 57,
+    OC_LT_NUM = 58,
+    OC_LE_NUM = 59,
+    
     OC_NOP = 63,
     OC_PUSHC = 64,
     OC_EXT_FLAG = 128
@@ -104,6 +153,23 @@ public:
     ValueVector constants;
     BlockVector blocks;
     
+    //Flat version of the code, in which control flow between blocks is 
+    //expressed with jump instructions. Generated by 'mvmFlatten'.
+    ByteVector          flatCode;
+    std::vector<int>    blockStarts;
+    
+    //Source positions of the instructions. Only read to report errors.
+    PositionTable       positions;
+    
+    //Set by 'mvmVerify'. Verified routines run without stack checks, if 
+    //called with at least 'stackParams' parameters.
+    bool                verified = false;
+    int                 maxStack = 0;
+    int                 stackParams = 0;
+    
+    //Verification and flattening are done on the first execution.
+    std::once_flag      prepared;
+    
 protected:
     MvmRoutine()   
     {
@@ -120,6 +186,16 @@ struct CallFrame
     size_t          paramsIndex;
     size_t          numParams;
     ASValue         thisValue;
+    JSModule*       module = NULL;      //Module globals. Resolved on first use.
+    
+    //Executed routine (NULL on native functions frames) and flat code offset 
+    //of the current instruction. Only read to locate errors.
+    Ref<MvmRoutine> routine;
+    size_t          pc = 0;
+    
+    //Called by a call instruction of the previous frame. Only executions
+    //made of such frames can be suspended.
+    bool            fromCall = false;
     
     CallFrame (ValueVector* consts, size_t paramsIdx, size_t nParams, ASValue thisVal)
     : constants(consts), paramsIndex(paramsIdx), numParams(nParams), thisValue(thisVal)
@@ -131,6 +207,32 @@ typedef std::vector <CallFrame> FrameVector;
 typedef void (*TraceFN)(int opCode, const ExecutionContext* ec);
 struct Modules;
 
+/**
+ * Stack and call frames of a suspended execution. They are moved out of the
+ * execution context, so it can run other code, and moved back to resume it,
+ * on any thread.
+ */
+class MvmSuspension : public RefCountObj
+{
+public:
+    static Ref<MvmSuspension> capture (ExecutionContext* ec);
+    
+    void restore (ExecutionContext* ec);
+    
+    Ref<RefCountObj> getToken()const
+    {
+        return m_token;
+    }
+    
+private:
+    MvmSuspension ()
+    {}
+    
+    ValueVector         m_stack;
+    FrameVector         m_frames;
+    Ref<RefCountObj>    m_token;
+};
+
 /**
  * MVM execution context
  */
@@ -141,6 +243,18 @@ struct ExecutionContext
     const std::string   modulePath;
     TraceFN             trace = NULL;
     Modules* const      modules;
+    
+    //Actor system which runs the code, and actor whose message is being 
+    //handled (NULL when running script top level code).
+    ActorRuntime*       actors = NULL;
+    AsActor*            curActor = NULL;
+    
+    //Suspension state (see 'mvmSuspend'). 'suspendable' is set by the code 
+    //which handles the suspension of its root call.
+    bool                suspendable = false;
+    bool                suspended = false;
+    bool                callInstruction = false;    //Next call is made by a call instruction.
+    Ref<RefCountObj>    suspendToken;
 
 private:
     ASValue             thisParam;
@@ -166,6 +280,18 @@ public:
         return value;
     }
     
+    /**
+     * Ensures that the stack can grow 'n' elements without reallocation.
+     * @param n
+     */
+    void reserveStack (size_t n)
+    {
+        const size_t needed = stack.size() + n;
+        
+        if (needed > stack.capacity())
+            stack.reserve(std::max(needed, stack.capacity() * 2));
+    }
+    
     ASValue getThisParam ()
     {
         ASValue temp = thisParam;
@@ -9,15 +9,32 @@
 
 #include "ascript_pch.hpp"
 #include "mvmCodegen.h"
+#include "mvmOptimizer.h"
+#include "ssaOptimizer.h"
+#include "typeInference.h"
 #include "asObjects.h"
+#include "asActors.h"
 #include "ScriptException.h"
 
 #include <set>
 #include <map>
 #include <string>
+#include <algorithm>
+#include <mutex>
+#include <thread>
+#include <atomic>
 
 using namespace std;
 
+///Maximum size, in AST nodes, of the expression of an inlined function.
+static const int MAX_INLINE_NODES = 16;
+
+///Maximum nesting of inlined calls.
+static const int MAX_INLINE_DEPTH = 4;
+
+///Maximum size, in AST nodes, of a loop which is duplicated to hoist invariant reads.
+static const int MAX_VERSIONED_LOOP_NODES = 256;
+
 /**
  * Code generation scope
  */
@@ -55,6 +72,45 @@ private:
 
 typedef map<ASValue, int> ConstantsMap;
 
+/**
+ * Functions which can be inlined at their call sites. Shared by all functions
+ * compiled from the same script.
+ */
+struct InlineState
+{
+    map<string, Ref<AstFunction> >  functions;
+    set<string>                     expanding;      //Functions being inlined.
+};
+
+/**
+ * Code generation state shared by all functions of a script. It is kept alive
+ * by the functions whose compilation is deferred until their first call.
+ */
+class CodegenContext : public RefCountObj
+{
+public:
+    static Ref<CodegenContext> create (Ref<JSModule> module, CodegenPipeline pipeline)
+    {
+        return refFromNew(new CodegenContext(module, pipeline));
+    }
+    
+    const Ref<JSModule>     module;
+    const CodegenPipeline   pipeline;
+    InlineState             inlineState;
+    
+    std::mutex              mutex;          //Serializes deferred compilations.
+    std::mutex              moduleMutex;    //Guards module slots during parallel compilation.
+    
+    //Deferred functions, recorded to be compiled in parallel.
+    bool                    recordDeferred = false;
+    vector< pair<Ref<JSFunction>, Ref<JSLazyCode> > >   deferred;
+    
+protected:
+    CodegenContext (Ref<JSModule> _module, CodegenPipeline _pipeline)
+    : module(_module), pipeline(_pipeline)
+    {}
+};
+
 /**
  * State of a codegen operation
  */
@@ -65,9 +121,23 @@ struct CodegenState
     ConstantsMap                constants;
     map<string, ASValue >  symbols;
     ScriptPosition              curPos;
-    CodeMap*                    pCodeMap = NULL;
+    Ref<JSModule>               module;
+    Ref<CodegenContext>         context;
     int                         stackSize = 0;
     
+    CodegenState*               parent = NULL;      //Enclosing function, for closures.
+    StringVector                captures;           //Variables captured from 'parent'
+    set<string>                 boxed;              //Local variables which need a box.
+    bool                        usesEnv = false;
+    
+    InlineState*                pInline = NULL;
+    int                         inlineDepth = 0;    //Nesting of inlined function bodies.
+    
+    LocalTypes                  varTypes;           //Inferred local variable types.
+    CodegenPipeline             pipeline = CGP_DIRECT;
+    
+    map<const AstNode*, string> hoisted;            //Invariant reads, and the hidden locals which hold them.
+    
     void declare (const std::string& name)
     {
         assert (!m_scopes.empty());
@@ -118,6 +188,17 @@ struct CodegenState
         return -1;
     }
     
+    const AstNode* getDeclaringScope(const string& name)const
+    {
+        for (auto it = m_scopes.rbegin(); it != m_scopes.rend(); ++it)
+        {
+            if (it->isDeclared(name))
+                return it->ownerNode.getPointer();
+        }
+        
+        return NULL;
+    }
+    
     int getParamIndex(const string& name)const
     {
         for (auto it = m_scopes.rbegin(); it != m_scopes.rend(); ++it)
@@ -154,6 +235,134 @@ private:
     vector<CodegenScope>        m_scopes;
 };
 
+/**
+ * Locks the module of a code generation state, if it belongs to a script 
+ * context, while its slots are accessed.
+ */
+class ModuleLock
+{
+public:
+    ModuleLock (CodegenState* pState)
+    {
+        if (pState->context.notNull())
+        {
+            m_pMutex = &pState->context->moduleMutex;
+            m_pMutex->lock();
+        }
+    }
+    
+    ~ModuleLock()
+    {
+        if (m_pMutex != NULL)
+            m_pMutex->unlock();
+    }
+    
+private:
+    std::mutex*     m_pMutex = NULL;
+};
+
+/**
+ * Function whose code is generated on its first call.
+ */
+class LazyFunctionCode : public JSLazyCode
+{
+public:
+    static Ref<LazyFunctionCode> create (Ref<AstNode> node, 
+                                         const StringVector& params,
+                                         Ref<CodegenContext> context)
+    {
+        return refFromNew(new LazyFunctionCode(node, params, context));
+    }
+    
+    virtual Ref<RefCountObj> compile();
+    Ref<MvmRoutine>          generate (CodegenState* pState);
+    
+    Ref<AstNode> node()const
+    {
+        return m_node;
+    }
+    
+private:
+    LazyFunctionCode (Ref<AstNode> node, const StringVector& params, Ref<CodegenContext> context)
+    : m_node(node), m_params(params), m_context(context)
+    {}
+    
+    const Ref<AstNode>          m_node;
+    const StringVector          m_params;
+    const Ref<CodegenContext>   m_context;
+};
+
+/**
+ * Information needed to create a closure.
+ */
+struct ClosureInfo
+{
+    StringVector    captures;
+    bool            usesEnv = false;
+};
+
+/**
+ * Variable usage in a function, used to decide which variables need to be boxed
+ * when captured by closures.
+ */
+struct VarUsage
+{
+    set<string>     declared;       //Declared by the function.
+    set<string>     captured;       //Referenced from nested functions.
+    set<string>     mutated;        //Modified after its declaration.
+};
+
+/**
+ * Field reads of a loop which may be moved out of it, and the information
+ * needed to decide it.
+ */
+struct LoopReads
+{
+    map<string, AstNodeList>    reads;          //Read nodes, by access path ('this.a.b')
+    set<string>                 assigned;       //Variables written in the loop.
+    set<string>                 declared;       //Variables declared in the loop.
+    int                         nodes = 0;
+    bool                        duplicable = true;
+};
+
+/**
+ * State of the lowering of a SSA function to MVM code.
+ * Values which are used more than once, or far from where they are computed,
+ * are kept in stack slots at the bottom of the function stack. Slots are 
+ * shared by values which are not alive at the same time. Constants, parameters
+ * and 'this' are not stored, but pushed again on each use.
+ */
+struct SsaLoweringState
+{
+    const SsaFunction&  fn;
+    CodegenState*       pState;
+    vector<int>         uses;
+    vector<ExprType>    types;
+    vector<int>         slots;          //(-1) for values not stored in slots.
+    vector<bool>        onStack;        //Used by the next instruction, left on the stack.
+    int                 nSlots = 0;
+    int                 pending = -1;   //Value on top of the stack.
+    
+    SsaLoweringState (const SsaFunction& _fn, CodegenState* _pState) 
+    : fn(_fn), pState(_pState)
+    {}
+};
+
+/**
+ * Gives the inferred types of local variables to the type inference functions.
+ */
+class CodegenTypeResolver : public TypeResolver
+{
+public:
+    CodegenTypeResolver (CodegenState* pState) : m_pState (pState)
+    {}
+    
+    virtual ExprType identifierType (Ref<AstNode> identifier)const;
+    
+private:
+    CodegenState*   m_pState;
+};
+
 //Forward declarations
 
 typedef void (*NodeCodegenFN)(Ref<AstNode> node, CodegenState* pState);
@@ -168,17 +377,52 @@ void varCodegen (Ref<AstNode> statement, CodegenState* pState);
 void varCodegen (const string& name, Ref<AstNode> valueNode, bool isConst, CodegenState* pState);
 void ifCodegen (Ref<AstNode> statement, CodegenState* pState);
 void forCodegen (Ref<AstNode> statement, CodegenState* pState);
+int  forLoopCodegen (Ref<AstNode> statement, CodegenState* pState);
+void versionedLoopCodegen (Ref<AstNode> statement, const LoopReads& loopReads, CodegenState* pState);
+bool invariantReads (Ref<AstNode> statement, CodegenState* pState, LoopReads* pReads);
+void loopReadsAnalysis (Ref<AstNode> node, LoopReads* pReads);
+string accessPath (Ref<AstNode> node);
 void forEachCodegen (Ref<AstNode> statement, CodegenState* pState);
 void returnCodegen (Ref<AstNode> statement, CodegenState* pState);
 void functionCodegen (Ref<AstNode> statement, CodegenState* pState);
-void closureCodegen (Ref<JSFunction> fn, CodegenState* pState);
-Ref<JSFunction> createFunction (Ref<AstNode> node, CodegenState* pState);
+void closureCodegen (Ref<JSFunction> fn, const ClosureInfo& info, CodegenState* pState);
+Ref<JSFunction> createFunction (Ref<AstNode> node, CodegenState* pState, ClosureInfo* pClosure = NULL);
+Ref<MvmRoutine> functionBodyCodegen (Ref<AstNode> node, CodegenState* pState, ClosureInfo* pClosure);
+bool canDeferCodegen (Ref<AstNode> node, CodegenState* pState, ClosureInfo* pClosure);
+CodegenState contextState (Ref<CodegenContext> context);
+Ref<JSFunction> deferredFunction (Ref<AstNode> node, const string& name, const StringVector& params, CodegenState* pState);
+void parallelCodegen (Ref<CodegenContext> context, int nThreads);
+void declareScriptSlots (Ref<JSModule> module, Ref<AstNode> script);
+void collectIdentifiers (Ref<AstNode> node, StringVector* pNames);
+void boxParamsCodegen (const StringVector& params, CodegenState* pState);
+set<string> boxedVariables (const AstNodeList& statements, const StringVector& params);
+bool ssaCodegen (Ref<AstFunction> fnNode, CodegenState* pFnState, CodegenState* pState);
+void ssaLowering (const SsaFunction& fn, CodegenState* pState);
+int  ssaFirstPushed (const SsaValue& v);
+bool ssaIsRematerialized (const SsaValue& v);
+void ssaAssignSlots (SsaLoweringState* pState);
+void ssaBlockLiveness (const SsaFunction& fn, int b, const vector<bool>& stored, set<int>& live, vector< set<int> >* pInterference);
+void ssaPushValue (int id, SsaLoweringState* pState);
+void ssaValueCodegen (int id, SsaLoweringState* pState);
+void ssaPhiCopies (int source, int target, SsaLoweringState* pState);
+void varUsageAnalysis (Ref<AstNode> node, bool nested, VarUsage* pUsage);
+int  captureIndex (const string& name, CodegenState* pState);
+bool isBoxedVar (const string& name, CodegenState* pState);
+void varStorageCodegen (const string& name, CodegenState* pState);
+int  globalSlot (const string& name, CodegenState* pState);
 void assignmentCodegen (Ref<AstNode> statement, CodegenState* pState);
 void varWriteCodegen (Ref<AstNode> node, CodegenState* pState);
 void fieldWriteCodegen (Ref<AstNode> node, CodegenState* pState);
 void arrayWriteCodegen (Ref<AstNode> node, CodegenState* pState);
 void fncallCodegen (Ref<AstNode> statement, CodegenState* pState);
 void thisCallCodegen (Ref<AstNode> statement, CodegenState* pState);
+bool inlineCallCodegen (Ref<AstNode> node, CodegenState* pState);
+Ref<AstNode> inlineExpression (Ref<AstFunction> fnNode);
+bool canInline (Ref<AstNode> node, const string& fnName, int* pBudget);
+void registerInlineFunction (Ref<AstNode> node, CodegenState* pState);
+bool isLocalName (const string& name, CodegenState* pState);
+bool knownValue (Ref<AstNode> node, CodegenState* pState, ASValue* pValue);
+bool knownValue (const string& name, CodegenState* pState, ASValue* pValue);
 void literalCodegen (Ref<AstNode> statement, CodegenState* pState);
 void varReadCodegen (Ref<AstNode> node, CodegenState* pState);
 void varReadCodegen (const string& name, CodegenState* pState);
@@ -193,13 +437,15 @@ void postfixOpCodegen (Ref<AstNode> statement, CodegenState* pState);
 void logicalOpCodegen (const int opCode, Ref<AstNode> statement, CodegenState* pState);
 
 void actorCodegen (Ref<AstNode> node, CodegenState* pState);
+Ref<JSFunction> actorConstructorCodegen (Ref<AstNode> node, CodegenState* pState);
+Ref<MvmRoutine> actorBodyCodegen (Ref<AstNode> node, const StringVector& params, CodegenState* pState);
 void connectCodegen (Ref<AstNode> node, CodegenState* pState);
-void messageCodegen (Ref<AstNode> node, CodegenState* pState);
 
 void clearLocals (int targetStackSize, CodegenState* pState);
 
 void classCodegen (Ref<AstNode> node, CodegenState* pState);
 Ref<JSFunction> classConstructorCodegen (Ref<AstNode> node, CodegenState* pState);
+Ref<MvmRoutine> constructorBodyCodegen (Ref<AstNode> node, const StringVector& params, CodegenState* pState);
 void baseConstructorCallCodegen (Ref<AstNode> node, CodegenState* pState);
 StringVector classConstructorParams(Ref<AstNode> node, CodegenState* pState);
 Ref<JSClass> getParentClass (Ref<AstNode> node, CodegenState* pState);
@@ -223,7 +469,9 @@ void instruction8 (int opCode, CodegenState* pState);
 void instruction16 (int opCode, CodegenState* pState);
 int  getLastInstruction (CodegenState* pState);
 int  removeLastInstruction (CodegenState* pState);
-void binaryOperatorCode (int tokenCode, CodegenState* pState, const ScriptPosition& pos);
+void binaryOperatorCode (int tokenCode, CodegenState* pState, const ScriptPosition& pos, bool numeric = false);
+ExprType exprType (Ref<AstNode> node, CodegenState* pState);
+ExprType localVarType (const string& name, CodegenState* pState);
 void getEnvCodegen (CodegenState* pState);
 
 void endBlock (int trueJump, int falseJump, CodegenState* pState);
@@ -238,24 +486,36 @@ int  getAssignOp (Ref<AstNode> node);
 int calcStackOffset8(int opCode);
 int calcStackOffset16(int opCode);
 
-CodegenState initFunctionState (Ref<AstNode> node, const StringVector& params, CodeMap* pMap);
-CodegenState initFunctionState (Ref<AstNode> node, CodeMap* pMap);
+CodegenState initFunctionState (Ref<AstNode> node, const StringVector& params);
+CodegenState initFunctionState (Ref<AstNode> node);
 
 /**
  * Generates MVM code for a script.
  * @param script    Script AST node.
+ * @param globals   Globals object which the script is compiled for. If it is
+ * a 'JSModule', global symbols are assigned to its slots. Otherwise, they are
+ * accessed by name.
+ * @param options
  * @return 
  */
-Ref<MvmRoutine> scriptCodegen (Ref<AstNode> script, CodeMap* pMap)
+Ref<MvmRoutine> scriptCodegen (Ref<AstNode> script, 
+                                Ref<JSObject> globals, 
+                                const CodegenOptions& options)
 {
-    CodegenState    state;
+    auto            module = ref(dynamic_cast<JSModule*>(globals.getPointer()));
+    auto            context = CodegenContext::create(module, options.pipeline);
+    CodegenState    state = contextState(context);
+    
+    context->recordDeferred = options.threads > 1;
     
     ASSERT (script->getType() == AST_SCRIPT);
     
     state.curRoutine = MvmRoutine::create();
     state.pushScope(script, false, false);
-    state.pCodeMap = pMap;
     state.curPos = script->position();
+    state.boxed = boxedVariables(script->children(), StringVector());
+    state.varTypes = inferLocalTypes(script, StringVector(), script->children(), state.boxed);
+    declareScriptSlots(module, script);
     
     auto statements = script->children();
     
@@ -267,6 +527,11 @@ Ref<MvmRoutine> scriptCodegen (Ref<AstNode> script, CodeMap* pMap)
         codegen (statements[i], &state);
     }
     
+    mvmOptimize (state.curRoutine);
+    
+    if (context->recordDeferred)
+        parallelCodegen (context, options.threads);
+
     return state.curRoutine;
 }
 
@@ -274,8 +539,9 @@ Ref<MvmRoutine> scriptCodegen (Ref<AstNode> script, CodeMap* pMap)
 void codegen (Ref<AstNode> statement, CodegenState* pState)
 {
     static NodeCodegenFN types[AST_TYPES_COUNT] = {NULL, NULL};
+    static std::once_flag initialized;
     
-    if (types [0] == NULL)
+    std::call_once (initialized, []()
     {
         types [AST_SCRIPT] = invalidNodeCodegen;
         types [AST_BLOCK] = blockCodegen;
@@ -300,12 +566,12 @@ void codegen (Ref<AstNode> statement, CodegenState* pState)
         types [AST_POSTFIXOP] = postfixOpCodegen;
         types [AST_ACTOR] = actorCodegen;
         types [AST_CONNECT] = connectCodegen;
-        types [AST_INPUT] = messageCodegen;
-        types [AST_OUTPUT] = messageCodegen;
+        types [AST_INPUT] = invalidNodeCodegen;
+        types [AST_OUTPUT] = invalidNodeCodegen;
         types [AST_CLASS] = classCodegen;
         types [AST_EXPORT] = exportCodegen;
         types [AST_IMPORT] = importCodegen;
-    }
+    });
     
     auto oldPos = pState->curPos;
     pState->curPos = statement->position();
@@ -413,9 +679,31 @@ void varCodegen (Ref<AstNode> node, CodegenState* pState)
     if (isLocal)
     {
         pState->declare(name);
-
+        
+        if (pState->boxed.count(name) > 0)
+        {
+            //Box is created before the initialization, which may capture it.
+            pushNull(pState);
+            instruction8(OC_NEW_BOX, pState);   //[box]
+            copyInstruction(0, pState);         //[box, box]
+            if (!childCodegen(node, 0, pState))
+                pushNull(pState);               //[box, box, value]
+            instruction8(OC_WR_BOX, pState);    //[box, value]
+            instruction8(OC_POP, pState);       //[box]
+        }
+        else if (!childCodegen(node, 0, pState))
+            pushNull(pState);
+    }
+    else if (pState->module.notNull())
+    {
+        pushConstant(globalSlot(name, pState), pState);    //[slot]
+        
         if (!childCodegen(node, 0, pState))
             pushNull(pState);
+                                            //[slot, value]
+        const int writeInst = isConst ? OC_NEW_CONST_GLOBAL : OC_WR_GLOBAL;
+        instruction8(writeInst, pState);    //[value]
+        instruction8(OC_POP, pState);       //[]
     }
     else
     {
@@ -506,14 +794,43 @@ void forCodegen (Ref<AstNode> statement, CodegenState* pState)
 {
     //For loops define its own scope
     const int initialStack = pState->stackSize;
+    LoopReads loopReads;
     
     //Loop initialization
     if (!childCodegen (statement, 0, pState))
         pushNull(pState);
     
-    const int conditionBlock = curBlockId(pState)+1;
+    if (invariantReads(statement, pState, &loopReads))
+        versionedLoopCodegen(statement, loopReads, pState);
+    else
+    {
+        endBlock (curBlockId(pState)+1, curBlockId(pState)+1, pState);
+        const int exitBlock = forLoopCodegen(statement, pState);
+
+        //Fix condition jump destination
+        setFalseJump(exitBlock, curBlockId(pState), pState);
+    }
+    
+    //Remove loop scope
+    clearLocals(initialStack, pState);
+    
+    //Non-expression statements leave a 'null' on the stack.
+    pushNull(pState);
+}
+
+/**
+ * Generates code for the condition, body and increment of a 'for' loop. 
+ * The loop begins at the current block, which shall be empty.
+ * @param statement
+ * @param pState
+ * @return Id of the condition block, whose false jump shall be set to the 
+ * loop exit.
+ */
+int forLoopCodegen (Ref<AstNode> statement, CodegenState* pState)
+{
+    const int conditionBlock = curBlockId(pState);
+    
     //Generate code for condition
-    endBlock (conditionBlock, conditionBlock, pState);
     if (!childCodegen(statement, 1, pState))
     {
         //If there is no condition, we replace it by an 'always true' condition
@@ -529,17 +846,217 @@ void forCodegen (Ref<AstNode> statement, CodegenState* pState)
     if (!childCodegen (statement, 2, pState))
         pushNull(pState);
     
-    const int nextBlock = curBlockId(pState)+1;
     endBlock(conditionBlock, conditionBlock, pState);
     
-    //Fix condition jump destination
-    setFalseJump(bodyBegin-1, nextBlock, pState);    
+    return bodyBegin-1;
+}
+
+/**
+ * Generates a 'for' loop whose invariant field reads are hoisted out of it.
+ * Reads are only invariant if the objects they read from are frozen, which 
+ * is not known until run time. So two versions of the loop are generated:
+ * one which uses the values read before the loop, and the original one, which
+ * runs if any of the read objects is mutable.
+ * @param statement
+ * @param loopReads
+ * @param pState
+ */
+void versionedLoopCodegen (Ref<AstNode> statement, const LoopReads& loopReads, CodegenState* pState)
+{
+    const ScriptPosition    pos = statement->position();
+    map<string, Ref<AstNode> >  objects;
     
-    //Remove loop scope
-    clearLocals(initialStack, pState);
+    instruction8(OC_POP, pState);               //Initialization result.
     
-    //Non-expression statements leave a 'null' on the stack.
-    pushNull(pState);
+    //Read the values into hidden locals, which cannot clash with script names.
+    for (auto it = loopReads.reads.begin(); it != loopReads.reads.end(); ++it)
+    {
+        const AstNodeList&  nodes = it->second;
+        const string        name = "@hoisted" + to_string(pState->stackSize);
+        
+        pState->declare(name);
+        codegen (nodes.front(), pState);        //[value]
+        
+        for (auto itNode = nodes.begin(); itNode != nodes.end(); ++itNode)
+            pState->hoisted[itNode->getPointer()] = name;
+        
+        //Every object in the access chain shall be frozen.
+        for (auto obj = nodes.front()->children()[0]; ; obj = obj->children()[0])
+        {
+            objects[accessPath(obj)] = obj;
+            if (obj->getType() != AST_MEMBER_ACCESS)
+                break;
+        }
+    }
+    
+    //Check objects mutability.
+    map<const AstNode*, string> hoisted;
+    hoisted.swap(pState->hoisted);
+    
+    for (auto it = objects.begin(); it != objects.end(); ++it)
+        codegen (it->second, pState);
+    callCodegen("@areFrozen", (int)objects.size(), pState, pos);     //[frozen]
+    
+    const int guardBlock = curBlockId(pState);
+    endBlock (guardBlock+1, -1, pState);
+    
+    //Loop version which uses hoisted values.
+    hoisted.swap(pState->hoisted);
+    const int fastExit = forLoopCodegen(statement, pState);
+    pState->hoisted.clear();
+    
+    //Original loop.
+    setFalseJump(guardBlock, curBlockId(pState), pState);
+    const int slowExit = forLoopCodegen(statement, pState);
+    
+    setFalseJump(fastExit, curBlockId(pState), pState);
+    setFalseJump(slowExit, curBlockId(pState), pState);
+}
+
+/**
+ * Finds the field reads of a loop which can be moved out of it. They are reads
+ * through a chain of member accesses ('this.a.b') which begins with 'this' or 
+ * with a local variable not modified by the loop.
+ * @param statement     'for' loop node
+ * @param pState
+ * @param pReads        [out] Hoistable reads
+ * @return true if there are hoistable reads, and the loop can be versioned.
+ */
+bool invariantReads (Ref<AstNode> statement, CodegenState* pState, LoopReads* pReads)
+{
+    //Nested loops are not versioned again.
+    if (!pState->hoisted.empty())
+        return false;
+    
+    auto& children = statement->children();
+    for (size_t i = 1; i < children.size(); ++i)
+        loopReadsAnalysis(children[i], pReads);
+    
+    if (!pReads->duplicable || pReads->nodes > MAX_VERSIONED_LOOP_NODES)
+        return false;
+    
+    for (auto it = pReads->reads.begin(); it != pReads->reads.end();)
+    {
+        const string    root = it->first.substr(0, it->first.find('.'));
+        bool            invariant = root == "this";
+        
+        if (!invariant && pState->isDeclared(root) && !isBoxedVar(root, pState))
+            invariant = pReads->assigned.count(root) == 0 && pReads->declared.count(root) == 0;
+        
+        if (invariant)
+            ++it;
+        else
+            it = pReads->reads.erase(it);
+    }
+    
+    return !pReads->reads.empty();
+}
+
+/**
+ * Collects the field reads of a loop, and the variables it writes.
+ * @param node
+ * @param pReads
+ */
+void loopReadsAnalysis (Ref<AstNode> node, LoopReads* pReads)
+{
+    if (node.isNull())
+        return;
+    
+    const AstNodeTypes  type = node->getType();
+    auto&               children = node->children();
+    
+    ++pReads->nodes;
+    
+    switch (type)
+    {
+    case AST_FUNCTION:
+    case AST_CLASS:
+    case AST_ACTOR:
+        //Their code would be generated twice.
+        pReads->duplicable = false;
+        return;
+        
+    case AST_VAR:
+    case AST_CONST:
+        pReads->declared.insert(node->getName());
+        break;
+        
+    case AST_FOR_EACH:
+        pReads->declared.insert(children.front()->getName());
+        break;
+        
+    case AST_ASSIGNMENT:
+    case AST_PREFIXOP:
+    case AST_POSTFIXOP:
+        if (type == AST_ASSIGNMENT || node.staticCast<AstOperator>()->code == LEX_PLUSPLUS
+            || node.staticCast<AstOperator>()->code == LEX_MINUSMINUS)
+        {
+            auto lvalue = children.front();
+            
+            if (lvalue->getType() == AST_IDENTIFIER)
+                pReads->assigned.insert(lvalue->getName());
+            else if (lvalue->getType() == AST_MEMBER_ACCESS)
+            {
+                //The written field is not read, only the object which contains it.
+                loopReadsAnalysis (lvalue->children()[0], pReads);
+                for (size_t i = 1; i < children.size(); ++i)
+                    loopReadsAnalysis (children[i], pReads);
+                return;
+            }
+        }
+        break;
+        
+    case AST_FNCALL:
+        if (children.front()->getType() == AST_MEMBER_ACCESS)
+        {
+            //The method is read by the call, only its object is hoistable.
+            loopReadsAnalysis (children.front()->children()[0], pReads);
+            for (size_t i = 1; i < children.size(); ++i)
+                loopReadsAnalysis (children[i], pReads);
+            return;
+        }
+        break;
+        
+    case AST_MEMBER_ACCESS:
+        {
+            const string path = accessPath(node);
+            
+            if (!path.empty())
+            {
+                pReads->reads[path].push_back(node);
+                return;
+            }
+        }
+        break;
+        
+    default:
+        break;
+    }
+    
+    for (auto it = children.begin(); it != children.end(); ++it)
+        loopReadsAnalysis(*it, pReads);
+}
+
+/**
+ * Gets the access path of a chain of member accesses which begins with an 
+ * identifier ('a.b.c').
+ * @param node
+ * @return The access path, or an empty string if the expression is not an 
+ * access chain.
+ */
+string accessPath (Ref<AstNode> node)
+{
+    if (node->getType() == AST_IDENTIFIER)
+        return node->getName();
+    else if (node->getType() != AST_MEMBER_ACCESS)
+        return "";
+    
+    const string base = accessPath(node->children()[0]);
+    
+    if (base.empty())
+        return "";
+    else
+        return base + "." + node->children()[1]->getName();
 }
 
 /**
@@ -579,6 +1096,8 @@ void forEachCodegen (Ref<AstNode> node, CodegenState* pState)
     pushConstant("head", pState);               //["head", iterator, iterator]
     instruction8(OC_RD_FIELD, pState);          //[headFn, iterator]
     callInstruction(0, pState, node->children().front()->position());   //[item, iterator]
+    if (pState->boxed.count(itemVarName) > 0)
+        instruction8(OC_NEW_BOX, pState);       //[box, iterator]
     
     childCodegen(node, 2, pState);              //[body_result, item, iterator]
     instruction8(OC_POP, pState);               //[item, iterator]
@@ -613,6 +1132,8 @@ void returnCodegen (Ref<AstNode> node, CodegenState* pState)
 {
     //It just pushes return expression value on the stack, and sets next block 
     //indexes to (-1), which means that the current function shall end.
+    const int initialStack = pState->stackSize;
+    
     if (!childCodegen(node, 0, pState))
     {
         //If it is an empty return statement, push a 'null' value on the stack
@@ -633,6 +1154,10 @@ void returnCodegen (Ref<AstNode> node, CodegenState* pState)
     ASSERT (pState->stackSize == 1);
     
     endBlock(-1, -1, pState);
+    
+    //Code after 'return' is unreachable, but it is generated with the stack 
+    //layout of the enclosing statements (as if 'return' had left a result).
+    pState->stackSize = initialStack + 1;
 }
 
 /**
@@ -642,31 +1167,57 @@ void returnCodegen (Ref<AstNode> node, CodegenState* pState)
  */
 void functionCodegen (Ref<AstNode> node, CodegenState* pState)
 {
-    //TODO: Closure code generation. Necessary to access globals
-    auto    function = createFunction(node, pState);
+    const string    name = node->getName();
+    const bool      isLocal = !name.empty() && pState->curScope()->isBlock;
+    const bool      isBoxed = isLocal && pState->boxed.count(name) > 0;
+    ClosureInfo     closure;
+    
+    if (isBoxed)
+    {
+        //Boxed function variable. It is declared before compiling the function,
+        //so the function can reference itself.
+        pState->declare(name);
+        pushNull(pState);
+        instruction8(OC_NEW_BOX, pState);           //[box]
+    }
     
-    if (node->getName().empty())
-        closureCodegen(function, pState);   //Unnamed function
+    auto            function = createFunction(node, pState, &closure);
+    
+    if (name.empty())
+        closureCodegen(function, closure, pState);   //Unnamed function
     else
     {
-        const string name = node->getName();
-        const bool isLocal = pState->curScope()->isBlock;
-
-        if (isLocal)
+        if (isBoxed)
+        {
+            copyInstruction (0, pState);                //[box, box]
+            closureCodegen(function, closure, pState);  //[box, box, function]
+            instruction8(OC_WR_BOX, pState);            //[box, function]
+        }
+        else if (isLocal)
         {
             pState->declare(name);
 
             //Functions are expressions, even named ones
-            closureCodegen(function, pState);
+            closureCodegen(function, closure, pState);
             copyInstruction (0, pState);
             
             //[function, function] (local variable and result)
         }
+        else if (pState->module.notNull())
+        {
+            pushConstant(globalSlot(name, pState), pState);   //[slot]
+            closureCodegen(function, closure, pState);  //[slot, function]
+            
+            instruction8(OC_NEW_CONST_GLOBAL, pState);  //[function]
+            
+            if (closure.captures.empty())
+                registerInlineFunction (node, pState);
+        }
         else
         {
             getEnvCodegen(pState);              //[env]
             pushConstant(name, pState);         //[env, name]
-            closureCodegen(function, pState);   //[env, name, function]
+            closureCodegen(function, closure, pState);  //[env, name, function]
                                                 
             instruction8(OC_NEW_CONST_FIELD, pState);  //[function]
         }
@@ -675,50 +1226,1041 @@ void functionCodegen (Ref<AstNode> node, CodegenState* pState)
 
 /**
  * Generates code for a closure
- * A closure is a function + environment.
+ * A closure is a function + environment + captured variables. The environment
+ * is only passed to functions which access globals.
  * @param fn
+ * @param info      Closure information, generated by 'createFunction'
  * @param pState
  */
-void closureCodegen (Ref<JSFunction> fn, CodegenState* pState)
+void closureCodegen (Ref<JSFunction> fn, const ClosureInfo& info, CodegenState* pState)
 {
-    //TODO: This first version just passes the current environment.
-    getEnvCodegen(pState);                                  //[env]
-    pushConstant(fn->value(), pState);                      //[env, function]
-    callCodegen("@makeClosure", 2, pState, pState->curPos); //[closure]
+    if (info.usesEnv)
+        getEnvCodegen(pState);                              //[env]
+    else
+        pushNull(pState);                                   //[null]
+    
+    //Captured variables (or their boxes)
+    for (auto it = info.captures.begin(); it != info.captures.end(); ++it)
+        varStorageCodegen(*it, pState);                     //[captures, env]
+    
+    const int nParams = (int)info.captures.size() + 2;
+    
+    pushConstant(fn->value(), pState);                      //[function, captures, env]
+    callCodegen("@makeClosure", nParams, pState, pState->curPos); //[closure]
 }
 
 
 /**
- * Compiles and creates a function.
+ * Creates a function. Its code is generated on its first call if it does not
+ * depend on the state of the enclosing function; otherwise, it is generated now.
  * @param node
  * @param pState
+ * @param pClosure  If not NULL, the function is compiled as a closure, which 
+ * can capture variables from the enclosing function. It receives the information
+ * needed to create the closure.
  * @return 
  */
-Ref<JSFunction> createFunction (Ref<AstNode> node, CodegenState* pState)
+Ref<JSFunction> createFunction (Ref<AstNode> node, CodegenState* pState, ClosureInfo* pClosure)
 {
     Ref<AstFunction>    fnNode = node.staticCast<AstFunction>();
     const AstFunction::Params& params = fnNode->getParams();
     
-    CodegenState    fnState = initFunctionState(node, pState->pCodeMap);
-
-    auto    function = JSFunction::createJS(fnNode->getName(), params, fnState.curRoutine);
-
-    codegen (fnNode->getCode(), &fnState);
-    
-    return function;
+    if (canDeferCodegen(node, pState, pClosure))
+    {
+        //The environment is always passed, as it is not known yet if the 
+        //function accesses globals.
+        if (pClosure != NULL)
+            pClosure->usesEnv = true;
+        
+        return deferredFunction(node, fnNode->getName(), params, pState);
+    }
+    else
+    {
+        auto code = functionBodyCodegen(node, pState, pClosure);
+        return JSFunction::createJS(fnNode->getName(), params, code);
+    }
 }
 
 /**
- * Generates code for assignments
+ * Checks if the code generation of a function can be deferred until its first
+ * call: the function shall not reference variables of the enclosing function,
+ * whose state is no longer available then.
  * @param node
  * @param pState
+ * @param pClosure
+ * @return 
  */
-void assignmentCodegen (Ref<AstNode> node, CodegenState* pState)
+bool canDeferCodegen (Ref<AstNode> node, CodegenState* pState, ClosureInfo* pClosure)
 {
-    auto& children = node->children();
-    ASSERT (children.size() == 2);
+    if (pState->context.isNull() || pState->inlineDepth > 0)
+        return false;
     
-    auto& lvalue = children[0];
+    //Functions which are not closures cannot capture variables.
+    if (pClosure == NULL)
+        return true;
+    
+    VarUsage    usage;
+    
+    varUsageAnalysis(node.staticCast<AstFunction>()->getCode(), true, &usage);
+    for (auto it = usage.captured.begin(); it != usage.captured.end(); ++it)
+    {
+        if (isLocalName(*it, pState))
+            return false;
+    }
+    
+    return true;
+}
+
+/**
+ * Generates the code of a deferred function, on its first call.
+ * @return 
+ */
+Ref<RefCountObj> LazyFunctionCode::compile()
+{
+    std::lock_guard<std::mutex> lock (m_context->mutex);
+    CodegenState                state = contextState(m_context);
+    
+    return generate(&state);
+}
+
+/**
+ * Generates the code of a deferred function.
+ * @param pState    State which references the shared script state. 
+ * @return 
+ */
+Ref<MvmRoutine> LazyFunctionCode::generate (CodegenState* pState)
+{
+    switch (m_node->getType())
+    {
+    case AST_FUNCTION:
+    case AST_INPUT:
+        return functionBodyCodegen(m_node, pState, NULL);
+    case AST_ACTOR:
+        return actorBodyCodegen(m_node, m_params, pState);
+    default:
+        return constructorBodyCodegen(m_node, m_params, pState);
+    }
+}
+
+/**
+ * Creates a function whose code generation is deferred. 
+ * @param node      Function, class or actor node.
+ * @param name
+ * @param params
+ * @param pState
+ * @return 
+ */
+Ref<JSFunction> deferredFunction (Ref<AstNode> node, 
+                                  const string& name, 
+                                  const StringVector& params, 
+                                  CodegenState* pState)
+{
+    auto    context = pState->context;
+    auto    lazyCode = LazyFunctionCode::create(node, params, context);
+    auto    function = JSFunction::createLazyJS(name, params, lazyCode);
+    
+    if (context->recordDeferred)
+        context->deferred.push_back(make_pair(function, lazyCode));
+    
+    return function;
+}
+
+/**
+ * Generates the code of the deferred functions of a script with several 
+ * threads. Each function is compiled with its own inline state, and the
+ * generated routines are assigned in creation order, so the result does not
+ * depend on thread scheduling.
+ * Functions whose compilation fails remain deferred: the error is reported
+ * on their first call.
+ * @param context
+ * @param nThreads
+ */
+void parallelCodegen (Ref<CodegenContext> context, int nThreads)
+{
+    const auto              deferred = context->deferred;
+    const size_t            n = deferred.size();
+    vector<Ref<MvmRoutine>> routines (n);
+    std::atomic<size_t>     next (0);
+    
+    //Functions created by the compiled functions are compiled on their first call.
+    context->recordDeferred = false;
+    context->deferred.clear();
+    
+    auto worker = [&]()
+    {
+        for (size_t i = next++; i < n; i = next++)
+        {
+            InlineState     inlineState = context->inlineState;
+            CodegenState    state = contextState(context);
+            
+            state.pInline = &inlineState;
+            
+            try
+            {
+                routines[i] = deferred[i].second.staticCast<LazyFunctionCode>()->generate(&state);
+            }
+            catch (const CScriptException&)
+            {
+                routines[i] = Ref<MvmRoutine>();
+            }
+        }
+    };
+    
+    vector<std::thread>     threads;
+    
+    for (int i = 1; i < nThreads && i < (int)n; ++i)
+        threads.push_back(std::thread(worker));
+    worker();
+    for (auto it = threads.begin(); it != threads.end(); ++it)
+        it->join();
+    
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (routines[i].notNull())
+            deferred[i].first->setCompiledCode(routines[i]);
+    }
+}
+
+/**
+ * Assigns module slots to the globals which the code of a script may reference,
+ * before generating it. So slot indexes do not depend on the order in which
+ * deferred functions are compiled, and module snapshots taken by actors 
+ * already contain the slots which their code accesses.
+ * All fields of the module get a slot, as well as all the identifiers used 
+ * in the script (even if they are local variables; the slots of undefined
+ * symbols are not visible).
+ * @param module
+ * @param script
+ */
+void declareScriptSlots (Ref<JSModule> module, Ref<AstNode> script)
+{
+    StringVector names;
+    
+    if (module.isNull())
+        return;
+    
+    auto fields = module->getFields(false);
+    names.assign(fields.begin(), fields.end());
+    
+    collectIdentifiers(script, &names);
+    
+    for (auto it = names.begin(); it != names.end(); ++it)
+        module->declareSlot(*it);
+}
+
+/**
+ * Collects the names of the identifiers of an AST, in tree order.
+ * @param node
+ * @param pNames    [out]
+ */
+void collectIdentifiers (Ref<AstNode> node, StringVector* pNames)
+{
+    if (node.isNull())
+        return;
+    
+    const AstNodeTypes  type = node->getType();
+    
+    if (type == AST_IDENTIFIER)
+        pNames->push_back(node->getName());
+    else if (type == AST_FUNCTION || type == AST_INPUT || type == AST_OUTPUT)
+    {
+        collectIdentifiers(node.staticCast<AstFunction>()->getCode(), pNames);
+        return;
+    }
+    
+    auto& children = node->children();
+    for (auto it = children.begin(); it != children.end(); ++it)
+        collectIdentifiers(*it, pNames);
+}
+
+/**
+ * Creates a code generation state which references the shared state of a
+ * script compilation.
+ * @param context
+ * @return 
+ */
+CodegenState contextState (Ref<CodegenContext> context)
+{
+    CodegenState    state;
+    
+    state.context = context;
+    state.module = context->module;
+    state.pInline = &context->inlineState;
+    state.pipeline = context->pipeline;
+    
+    return state;
+}
+
+/**
+ * Generates the code of a function.
+ * @param node
+ * @param pState
+ * @param pClosure  If not NULL, the function is compiled as a closure. 
+ * See 'createFunction'.
+ * @return 
+ */
+Ref<MvmRoutine> functionBodyCodegen (Ref<AstNode> node, CodegenState* pState, ClosureInfo* pClosure)
+{
+    Ref<AstFunction>    fnNode = node.staticCast<AstFunction>();
+    const AstFunction::Params& params = fnNode->getParams();
+    
+    CodegenState    fnState = initFunctionState(node);
+
+    fnState.module = pState->module;
+    fnState.context = pState->context;
+    fnState.pInline = pState->pInline;
+    fnState.boxed = boxedVariables(AstNodeList(1, fnNode->getCode()), params);
+    fnState.varTypes = inferLocalTypes(fnNode, params, AstNodeList(1, fnNode->getCode()), fnState.boxed);
+    fnState.pipeline = pState->pipeline;
+    if (pClosure != NULL)
+        fnState.parent = pState;
+    
+    bool    generated = false;
+
+    if (fnState.pipeline == CGP_SSA)
+        generated = ssaCodegen (fnNode, &fnState, pState);
+    
+    if (!generated)
+    {
+        boxParamsCodegen (params, &fnState);
+        codegen (fnNode->getCode(), &fnState);
+    }
+    mvmOptimize (fnState.curRoutine);
+    
+    if (pClosure != NULL)
+    {
+        pClosure->captures = fnState.captures;
+        pClosure->usesEnv = fnState.usesEnv;
+    }
+    
+    return fnState.curRoutine;
+}
+
+/**
+ * Copies boxed parameters into local variables which hold their boxes.
+ * @param params
+ * @param pState
+ */
+void boxParamsCodegen (const StringVector& params, CodegenState* pState)
+{
+    pState->pushScope(pState->curScope()->ownerNode, true, false);
+    
+    for (auto it = params.begin(); it != params.end(); ++it)
+    {
+        if (pState->boxed.count(*it) == 0)
+            continue;
+        
+        const int index = pState->getParamIndex(*it);
+        
+        pState->declare(*it);
+        pushConstant(jsInt(index), pState);     //[index]
+        instruction8(OC_RD_PARAM, pState);      //[value]
+        instruction8(OC_NEW_BOX, pState);       //[box]
+    }
+}
+
+/**
+ * Generates the code of a function through the SSA intermediate representation.
+ * @param fnNode
+ * @param pFnState  Function code generation state.
+ * @param pState    Enclosing code generation state.
+ * @return false if the function is not supported by the SSA builder. In that
+ * case, no code has been generated.
+ */
+bool ssaCodegen (Ref<AstFunction> fnNode, CodegenState* pFnState, CodegenState* pState)
+{
+    //Variables of enclosing functions would need to be captured.
+    auto isGlobal = [pState](const string& name) {
+        return !isLocalName(name, pState);
+    };
+    
+    auto fn = ssaBuildFunction(fnNode, isGlobal);
+    
+    if (fn.isNull())
+        return false;
+    
+    ssaOptimize(*fn.getPointer());
+    ssaLowering(*fn.getPointer(), pFnState);
+    return true;
+}
+
+/**
+ * Lowers a function in SSA form to MVM code.
+ * @param fn
+ * @param pState
+ */
+void ssaLowering (const SsaFunction& fn, CodegenState* pState)
+{
+    SsaLoweringState    state (fn, pState);
+    vector<int>         blockIds (fn.blocks.size(), -1);
+    int                 nBlocks = 0;
+    
+    state.uses = fn.countUses();
+    state.types = ssaInferTypes(fn);
+    ssaAssignSlots(&state);
+    
+    for (size_t b = 0; b < fn.blocks.size(); ++b)
+    {
+        if (!fn.blocks[b].removed)
+            blockIds[b] = nBlocks++;
+    }
+    
+    //Slots initialization
+    for (int i = 0; i < state.nSlots; ++i)
+        pushNull(pState);
+    
+    //Edges which need a block to copy the arguments of the target phis. 
+    //(source block, 'true' or 'false' side)
+    vector< pair<int, int> >    edgeBlocks;
+    
+    for (size_t b = 0; b < fn.blocks.size(); ++b)
+    {
+        const SsaBlock& block = fn.blocks[b];
+        
+        if (block.removed)
+            continue;
+        
+        ASSERT (curBlockId(pState) == blockIds[b]);
+        for (auto it = block.code.begin(); it != block.code.end(); ++it)
+            ssaValueCodegen(*it, &state);
+        
+        switch (block.exitType)
+        {
+        case SSA_EXIT_JUMP:
+            ssaPhiCopies((int)b, block.next[0], &state);
+            pushNull(pState);
+            endBlock(blockIds[block.next[0]], blockIds[block.next[0]], pState);
+            break;
+            
+        case SSA_EXIT_BRANCH:
+            ssaPushValue(block.exitValue, &state);
+            endBlock(blockIds[block.next[1]], blockIds[block.next[0]], pState);
+            
+            for (int k = 0; k < 2; ++k)
+            {
+                if (!fn.blocks[block.next[k]].phis.empty())
+                    edgeBlocks.push_back(make_pair((int)b, k));
+            }
+            break;
+            
+        default:
+            ssaPushValue(block.exitValue, &state);
+            if (pState->stackSize > 1)
+            {
+                writeInstruction(pState->stackSize-2, pState);
+                while (pState->stackSize > 1)
+                    instruction8(OC_POP, pState);
+            }
+            endBlock(-1, -1, pState);
+            break;
+        }
+        
+        pState->stackSize = state.nSlots;
+    }
+    
+    //Blocks for the phi copies of conditional jumps.
+    for (auto it = edgeBlocks.begin(); it != edgeBlocks.end(); ++it)
+    {
+        const int   source = it->first;
+        const int   target = fn.blocks[source].next[it->second];
+        const int   edgeBlock = curBlockId(pState);
+        
+        ssaPhiCopies(source, target, &state);
+        pushNull(pState);
+        endBlock(blockIds[target], blockIds[target], pState);
+        
+        if (it->second == 1)
+            setTrueJump(blockIds[source], edgeBlock, pState);
+        else
+            setFalseJump(blockIds[source], edgeBlock, pState);
+        pState->stackSize = state.nSlots;
+    }
+}
+
+/**
+ * Gets the argument of a value which is pushed first by its code.
+ * @param v
+ * @return Value id, or (-1)
+ */
+int ssaFirstPushed (const SsaValue& v)
+{
+    if (v.args.empty() || v.op == SSA_WR_GLOBAL || v.op == SSA_PHI)
+        return -1;
+    else
+        return v.args[0];
+}
+
+/**
+ * Checks if a value is pushed again on each use, instead of being stored.
+ * @param v
+ * @return 
+ */
+bool ssaIsRematerialized (const SsaValue& v)
+{
+    return v.op == SSA_CONST || v.op == SSA_PARAM || v.op == SSA_THIS;
+}
+
+/**
+ * Decides which values are stored in slots, and assigns the slots. Values 
+ * alive at the same time get different slots.
+ * @param pState
+ */
+void ssaAssignSlots (SsaLoweringState* pState)
+{
+    const SsaFunction&  fn = pState->fn;
+    const size_t        nValues = fn.values.size();
+    vector<bool>        stored (nValues, false);
+    
+    pState->slots.assign(nValues, -1);
+    pState->onStack.assign(nValues, false);
+    
+    //Values used only by the following instruction are left on the stack.
+    for (auto itBlock = fn.blocks.begin(); itBlock != fn.blocks.end(); ++itBlock)
+    {
+        vector<int> emitted;
+        
+        for (auto it = itBlock->code.begin(); it != itBlock->code.end(); ++it)
+        {
+            if (!ssaIsRematerialized(fn.values[*it]))
+                emitted.push_back(*it);
+        }
+        
+        for (size_t i = 0; i < emitted.size(); ++i)
+        {
+            const int v = emitted[i];
+            
+            if (pState->uses[v] != 1)
+                continue;
+            
+            if (i + 1 < emitted.size())
+            {
+                const SsaValue& next = fn.values[emitted[i+1]];
+                
+                pState->onStack[v] = ssaFirstPushed(next) == v 
+                        && std::count(next.args.begin(), next.args.end(), v) == 1;
+            }
+            else 
+            {
+                pState->onStack[v] = itBlock->exitValue == v;
+            }
+        }
+        
+        for (auto it = itBlock->phis.begin(); it != itBlock->phis.end(); ++it)
+            stored[*it] = true;
+        for (auto it = emitted.begin(); it != emitted.end(); ++it)
+            stored[*it] = pState->uses[*it] > 0 && !pState->onStack[*it];
+    }
+    
+    //Liveness of stored values.
+    const size_t        nBlocks = fn.blocks.size();
+    vector< set<int> >  liveIn (nBlocks);
+    vector< set<int> >  liveOut (nBlocks);
+    bool                changed = true;
+    
+    while (changed)
+    {
+        changed = false;
+        
+        for (size_t b = nBlocks; b-- > 0;)
+        {
+            const SsaBlock& block = fn.blocks[b];
+            set<int>        live;
+            
+            if (block.removed)
+                continue;
+            
+            for (int i = 0; i < block.nSuccessors(); ++i)
+            {
+                const int       nextId = block.successor(i);
+                const SsaBlock& next = fn.blocks[nextId];
+                const size_t    predIndex = std::find(next.preds.begin(), next.preds.end(), (int)b) - next.preds.begin();
+                
+                live.insert(liveIn[nextId].begin(), liveIn[nextId].end());
+                for (auto it = next.phis.begin(); it != next.phis.end(); ++it)
+                {
+                    live.erase(*it);
+                    
+                    const int arg = fn.values[*it].args[predIndex];
+                    if (stored[arg])
+                        live.insert(arg);
+                }
+            }
+            
+            liveOut[b] = live;
+            ssaBlockLiveness(fn, (int)b, stored, live, NULL);
+            
+            if (live != liveIn[b])
+            {
+                liveIn[b] = live;
+                changed = true;
+            }
+        }
+    }
+    
+    //Interference graph.
+    vector< set<int> >  interference (nValues);
+    
+    for (size_t b = 0; b < nBlocks; ++b)
+    {
+        if (!fn.blocks[b].removed)
+        {
+            set<int> live = liveOut[b];
+            ssaBlockLiveness(fn, (int)b, stored, live, &interference);
+        }
+    }
+    
+    //Slot assignment.
+    for (size_t v = 0; v < nValues; ++v)
+    {
+        if (!stored[v])
+            continue;
+        
+        set<int>    used;
+        int         slot = 0;
+        
+        for (auto it = interference[v].begin(); it != interference[v].end(); ++it)
+        {
+            if (pState->slots[*it] >= 0)
+                used.insert(pState->slots[*it]);
+        }
+        
+        while (used.count(slot) > 0)
+            ++slot;
+        
+        pState->slots[v] = slot;
+        pState->nSlots = max(pState->nSlots, slot + 1);
+    }
+}
+
+/**
+ * Walks a block backwards, from the values alive at its end to the values
+ * alive at its beginning.
+ * @param fn
+ * @param b
+ * @param stored        Values stored in slots. Other values are ignored.
+ * @param live          [in/out] Alive values.
+ * @param pInterference [out] If not NULL, receives the interferences between 
+ * values.
+ */
+void ssaBlockLiveness (const SsaFunction& fn, 
+                       int b, 
+                       const vector<bool>& stored, 
+                       set<int>& live, 
+                       vector< set<int> >* pInterference)
+{
+    const SsaBlock& block = fn.blocks[b];
+    
+    auto interfere = [&](int v) {
+        if (pInterference == NULL)
+            return;
+        for (auto it = live.begin(); it != live.end(); ++it)
+        {
+            if (*it != v)
+            {
+                (*pInterference)[v].insert(*it);
+                (*pInterference)[*it].insert(v);
+            }
+        }
+    };
+    
+    if (block.exitValue >= 0 && stored[block.exitValue])
+        live.insert(block.exitValue);
+    
+    for (auto it = block.code.rbegin(); it != block.code.rend(); ++it)
+    {
+        const SsaValue& v = fn.values[*it];
+        
+        if (stored[*it])
+        {
+            interfere(*it);
+            live.erase(*it);
+        }
+        
+        for (auto itArg = v.args.begin(); itArg != v.args.end(); ++itArg)
+        {
+            if (stored[*itArg])
+                live.insert(*itArg);
+        }
+    }
+    
+    //Phis are written at the same time, at the beginning of the block.
+    live.insert(block.phis.begin(), block.phis.end());
+    for (auto it = block.phis.begin(); it != block.phis.end(); ++it)
+        interfere(*it);
+}
+
+/**
+ * Pushes a value on the stack.
+ * @param id
+ * @param pState
+ */
+void ssaPushValue (int id, SsaLoweringState* pState)
+{
+    const SsaValue& v = pState->fn.values[id];
+    CodegenState*   pCgState = pState->pState;
+    
+    if (pState->pending == id)
+    {
+        //Already on the stack.
+        pState->pending = -1;
+        return;
+    }
+    
+    ASSERT (pState->pending < 0);
+    
+    switch (v.op)
+    {
+    case SSA_CONST:
+        pushConstant(v.constant, pCgState);
+        break;
+    case SSA_PARAM:
+        pushConstant(jsInt(v.index), pCgState);
+        instruction8(OC_RD_PARAM, pCgState);
+        break;
+    case SSA_THIS:
+        instruction8(OC_PUSH_THIS, pCgState);
+        break;
+    default:
+        ASSERT (pState->slots[id] >= 0);
+        copyInstruction(pCgState->stackSize - pState->slots[id] - 1, pCgState);
+        break;
+    }
+}
+
+/**
+ * Generates the code of a SSA value.
+ * @param id
+ * @param pState
+ */
+void ssaValueCodegen (int id, SsaLoweringState* pState)
+{
+    const SsaValue& v = pState->fn.values[id];
+    CodegenState*   pCgState = pState->pState;
+    const int       nArgs = (int)v.args.size();
+    
+    if (ssaIsRematerialized(v))
+        return;
+    
+    pCgState->curPos = v.pos;
+    
+    switch (v.op)
+    {
+    case SSA_RD_GLOBAL:
+        varReadCodegen(v.name, pCgState);                           //[value]
+        break;
+        
+    case SSA_WR_GLOBAL:
+        if (pCgState->module.notNull())
+        {
+            pushConstant(globalSlot(v.name, pCgState), pCgState);   //[slot]
+            ssaPushValue(v.args[0], pState);                        //[slot, value]
+            instruction8(OC_WR_GLOBAL, pCgState);                   //[value]
+        }
+        else
+        {
+            getEnvCodegen(pCgState);                                //[env]
+            pushConstant(v.name, pCgState);                         //[env, name]
+            ssaPushValue(v.args[0], pState);                        //[env, name, value]
+            instruction8(OC_WR_FIELD, pCgState);                    //[value]
+        }
+        break;
+        
+    case SSA_RD_FIELD:
+        ssaPushValue(v.args[0], pState);                            //[object]
+        pushConstant(v.name, pCgState);                             //[object, field]
+        instruction8(OC_RD_FIELD, pCgState);                        //[value]
+        break;
+        
+    case SSA_WR_FIELD:
+        ssaPushValue(v.args[0], pState);                            //[object]
+        pushConstant(v.name, pCgState);                             //[object, field]
+        ssaPushValue(v.args[1], pState);                            //[object, field, value]
+        instruction8(OC_WR_FIELD, pCgState);                        //[value]
+        break;
+        
+    case SSA_RD_INDEX:
+    case SSA_WR_INDEX:
+        for (int i = 0; i < nArgs; ++i)
+            ssaPushValue(v.args[i], pState);                        //[object, index, (value)]
+        instruction8(v.op == SSA_RD_INDEX ? OC_RD_INDEX : OC_WR_INDEX, pCgState);
+        break;
+        
+    case SSA_BINARY:
+        {
+            const bool numeric = pState->types[v.args[0]] == ET_NUMBER
+                              && pState->types[v.args[1]] == ET_NUMBER;
+            
+            ssaPushValue(v.args[0], pState);                        //[a]
+            ssaPushValue(v.args[1], pState);                        //[a, b]
+            binaryOperatorCode(v.index, pCgState, v.pos, numeric);  //[result]
+        }
+        break;
+        
+    case SSA_CALL:
+        for (int i = 0; i < nArgs; ++i)
+            ssaPushValue(v.args[i], pState);                        //[function, params]
+        callInstruction(nArgs-1, pCgState, v.pos);                  //[result]
+        break;
+        
+    case SSA_METHOD_CALL:
+        for (int i = 0; i < nArgs; ++i)
+            ssaPushValue(v.args[i], pState);                        //[this, params]
+        instruction8(OC_WR_THISP, pCgState);
+        pushConstant(v.name, pCgState);                             //[name, this, params]
+        instruction8(OC_RD_FIELD, pCgState);                        //[function, params]
+        callInstruction(nArgs-1, pCgState, v.pos);                  //[result]
+        break;
+        
+    default:
+        ssaPushValue(v.args[0], pState);                            //[value]
+        break;
+    }
+    
+    if (pState->uses[id] == 0)
+        instruction8(OC_POP, pCgState);
+    else if (pState->onStack[id])
+        pState->pending = id;
+    else
+    {
+        writeInstruction(pCgState->stackSize - pState->slots[id] - 2, pCgState);
+        instruction8(OC_POP, pCgState);
+    }
+}
+
+/**
+ * Copies the arguments of the phis of a block, for the edge from one of its
+ * predecessors. Copies are made in parallel: all arguments are pushed 
+ * before writing any phi.
+ * @param source    Predecessor block
+ * @param target    Block with the phis
+ * @param pState
+ */
+void ssaPhiCopies (int source, int target, SsaLoweringState* pState)
+{
+    const SsaFunction&  fn = pState->fn;
+    const SsaBlock&     block = fn.blocks[target];
+    CodegenState*       pCgState = pState->pState;
+    const size_t        predIndex = std::find(block.preds.begin(), block.preds.end(), source) - block.preds.begin();
+    
+    ASSERT (predIndex < block.preds.size());
+    
+    for (auto it = block.phis.begin(); it != block.phis.end(); ++it)
+        ssaPushValue(fn.values[*it].args[predIndex], pState);
+    
+    for (auto it = block.phis.rbegin(); it != block.phis.rend(); ++it)
+    {
+        writeInstruction(pCgState->stackSize - pState->slots[*it] - 2, pCgState);
+        instruction8(OC_POP, pCgState);
+    }
+}
+
+/**
+ * Finds the variables of a function which need to be boxed: the ones which are
+ * captured by nested functions and modified. 
+ * The analysis works with names, so it may box more variables than strictly 
+ * necessary (which is safe).
+ * @param statements    Function code
+ * @param params        Function parameters
+ * @return 
+ */
+set<string> boxedVariables (const AstNodeList& statements, const StringVector& params)
+{
+    VarUsage    usage;
+    set<string> result;
+    
+    usage.declared.insert(params.begin(), params.end());
+    
+    for (auto it = statements.begin(); it != statements.end(); ++it)
+        varUsageAnalysis(*it, false, &usage);
+    
+    for (auto it = usage.declared.begin(); it != usage.declared.end(); ++it)
+    {
+        if (usage.captured.count(*it) > 0 && usage.mutated.count(*it) > 0)
+            result.insert(*it);
+    }
+    
+    return result;
+}
+
+/**
+ * Collects variable usage information of an AST subtree.
+ * @param node
+ * @param nested    true if the node is inside a nested function.
+ * @param pUsage
+ */
+void varUsageAnalysis (Ref<AstNode> node, bool nested, VarUsage* pUsage)
+{
+    if (node.isNull())
+        return;
+    
+    const AstNodeTypes  type = node->getType();
+    
+    if (type == AST_CLASS || type == AST_ACTOR)
+        return;         //Class and actor members do not capture variables.
+    else if (type == AST_FUNCTION)
+    {
+        const string name = node->getName();
+        
+        //Named functions may reference themselves, so they are boxed if captured.
+        if (!nested && !name.empty())
+        {
+            pUsage->declared.insert(name);
+            pUsage->mutated.insert(name);
+        }
+        varUsageAnalysis(node.staticCast<AstFunction>()->getCode(), true, pUsage);
+        return;
+    }
+    else if (type == AST_IDENTIFIER)
+    {
+        if (nested)
+            pUsage->captured.insert(node->getName());
+        return;
+    }
+    else if (type == AST_VAR || type == AST_CONST)
+    {
+        const string    name = node->getName();
+        VarUsage        initUsage;
+        
+        if (!nested)
+            pUsage->declared.insert(name);
+        
+        //A variable captured by its own initialization also needs a box.
+        if (!node->children().empty())
+            varUsageAnalysis(node->children().front(), nested, &initUsage);
+        if (initUsage.captured.count(name) > 0)
+            pUsage->mutated.insert(name);
+        
+        pUsage->declared.insert(initUsage.declared.begin(), initUsage.declared.end());
+        pUsage->captured.insert(initUsage.captured.begin(), initUsage.captured.end());
+        pUsage->mutated.insert(initUsage.mutated.begin(), initUsage.mutated.end());
+        return;
+    }
+    else if (type == AST_ASSIGNMENT)
+    {
+        auto lvalue = node->children().front();
+        
+        if (lvalue->getType() == AST_IDENTIFIER)
+            pUsage->mutated.insert(lvalue->getName());
+    }
+    else if (type == AST_PREFIXOP || type == AST_POSTFIXOP)
+    {
+        auto        child = node->children().front();
+        const int   opCode = node.staticCast<AstOperator>()->code;
+        
+        if (child->getType() == AST_IDENTIFIER && (opCode == LEX_PLUSPLUS || opCode == LEX_MINUSMINUS))
+            pUsage->mutated.insert(child->getName());
+    }
+    
+    auto& children = node->children();
+    for (auto it = children.begin(); it != children.end(); ++it)
+        varUsageAnalysis(*it, nested, pUsage);
+}
+
+/**
+ * Gets the index of a variable captured from the enclosing functions. 
+ * It is added to the captured variables list on its first use.
+ * @param name
+ * @param pState
+ * @return Capture index, or -1 if the variable is not declared in any 
+ * enclosing function (it is a global).
+ */
+int captureIndex (const string& name, CodegenState* pState)
+{
+    //Inlined functions only see their parameters and globals.
+    if (pState->inlineDepth > 0)
+        return -1;
+    
+    StringVector&   captures = pState->captures;
+    
+    for (size_t i = 0; i < captures.size(); ++i)
+    {
+        if (captures[i] == name)
+            return (int)i;
+    }
+    
+    CodegenState*   parent = pState->parent;
+    
+    if (parent == NULL || name == "this")
+        return -1;
+    
+    if (!parent->isDeclared(name) && captureIndex(name, parent) < 0)
+        return -1;
+    
+    captures.push_back(name);
+    return (int)captures.size() - 1;
+}
+
+/**
+ * Checks if a local or captured variable is stored in a box.
+ * @param name
+ * @param pState
+ * @return 
+ */
+bool isBoxedVar (const string& name, CodegenState* pState)
+{
+    for (; pState != NULL; pState = pState->parent)
+    {
+        if (pState->isDeclared(name))
+            return pState->boxed.count(name) > 0;
+    }
+    
+    return false;
+}
+
+/**
+ * Generates code which reads the storage of a local or captured variable:
+ * its value, or its box if it is a boxed variable.
+ * @param name
+ * @param pState
+ */
+void varStorageCodegen (const string& name, CodegenState* pState)
+{
+    if (pState->isDeclared(name))
+    {
+        if (!pState->isParam(name))
+            copyInstruction (pState->getLocalVarOffset(name), pState);  //[value]
+        else
+        {
+            pushConstant(jsInt(pState->getParamIndex(name)), pState);   //[index]
+            instruction8 (OC_RD_PARAM, pState);                         //[value]
+        }
+    }
+    else
+    {
+        const int index = captureIndex(name, pState);
+        
+        ASSERT (index >= 0);
+        pushConstant(jsInt(index), pState);     //[index]
+        instruction8 (OC_RD_CAPTURE, pState);   //[value]
+    }
+}
+
+/**
+ * Gets the slot of a module global symbol.
+ * @param name
+ * @param pState
+ * @return 
+ */
+int globalSlot (const string& name, CodegenState* pState)
+{
+    //Module is reached through the environment.
+    pState->usesEnv = true;
+    
+    ModuleLock  lock (pState);
+    return pState->module->declareSlot(name);
+}
+
+/**
+ * Generates code for assignments
+ * @param node
+ * @param pState
+ */
+void assignmentCodegen (Ref<AstNode> node, CodegenState* pState)
+{
+    auto& children = node->children();
+    ASSERT (children.size() == 2);
+    
+    auto& lvalue = children[0];
     
     switch (lvalue->getType())
     {
@@ -748,8 +2290,9 @@ void varWriteCodegen (Ref<AstNode> node, CodegenState* pState)
 {
     string  name = node->children().front()->getName();
     int     op = getAssignOp(node);
+    const bool boxed = isBoxedVar(name, pState);
     
-    if (pState->isDeclared(name))
+    if (pState->isDeclared(name) && !boxed)
     {
         const bool isParam = pState->isParam(name);
         
@@ -761,9 +2304,12 @@ void varWriteCodegen (Ref<AstNode> node, CodegenState* pState)
             childCodegen(node, 1, pState);                      //[..., result]
         else
         {
+            const bool numeric = localVarType(name, pState) == ET_NUMBER
+                              && exprType(node->children()[1], pState) == ET_NUMBER;
+            
             childCodegen(node, 0, pState);                      //[..., lvalue]
             childCodegen(node, 1, pState);                      //[..., lvalue, rvalue]
-            binaryOperatorCode (op, pState, node->position());  //[..., result]          
+            binaryOperatorCode (op, pState, node->position(), numeric);  //[..., result]          
         }
         
         if (pState->isParam(name))
@@ -771,108 +2317,358 @@ void varWriteCodegen (Ref<AstNode> node, CodegenState* pState)
         else
             writeInstruction(pState->getLocalVarOffset(name)-1, pState);    //[result]
     }
-    else
+    else if (pState->isDeclared(name) || captureIndex(name, pState) >= 0)
+    {
+        //Boxed local or captured variable.
+        if (!boxed)
+            errorAt (node->position(), "Cannot modify captured variable '%s'", name.c_str());
+        
+        varStorageCodegen(name, pState);        //[box]
+        if (op == '=')
+            childCodegen(node, 1, pState);      //[box, result]
+        else
+        {
+            copyInstruction(0, pState);                         //[box, box]
+            instruction8(OC_RD_BOX, pState);                    //[box, lvalue]
+            childCodegen(node, 1, pState);                      //[box, lvalue, rvalue]
+            binaryOperatorCode (op, pState, node->position());  //[box, result]
+        }
+        instruction8(OC_WR_BOX, pState);        //[result]
+    }
+    else if (pState->module.notNull())
+    {
+        //Module global variable
+        pushConstant(globalSlot(name, pState), pState);   //[slot]
+        if (op == '=')
+            childCodegen(node, 1, pState);      //[slot, result]
+        else
+        {
+            copyInstruction(0, pState);                         //[slot, slot]
+            instruction8(OC_RD_GLOBAL, pState);                 //[slot, lvalue]
+            childCodegen(node, 1, pState);                      //[slot, lvalue, rvalue]
+            binaryOperatorCode (op, pState, node->position());  //[slot, result]
+        }
+        instruction8(OC_WR_GLOBAL, pState);     //[result]
+    }
+    else
+    {
+        //environment-based variable (global, closure...)
+        getEnvCodegen(pState);                  //[env]
+        pushConstant(name, pState);             //[env, name]
+        if (op == '=')
+            childCodegen(node, 1, pState);      //[env, name, result]
+        else
+        {
+            copyInstruction(1, pState);                         //[env, name, env]
+            copyInstruction(1, pState);                         //[env, name, env, name]
+            instruction8(OC_RD_FIELD, pState);                  //[env, name, lvalue];
+            childCodegen(node, 1, pState);                      //[env, name, lvalue, rvalue];
+            binaryOperatorCode (op, pState, node->position());  //[env, name, result];
+        }
+        instruction8(OC_WR_FIELD, pState);  //[result]
+    }
+}
+
+/**
+ * Generates code to write into a field
+ * @param node
+ * @param pState
+ */
+void fieldWriteCodegen (Ref<AstNode> node, CodegenState* pState)
+{
+    int     op = getAssignOp(node);
+    auto    lexpr = node->children().front();
+    auto    field = lexpr->children()[1]->getName();
+    
+    //Object access codegen
+    childCodegen(lexpr, 0 , pState);        //[object]
+    pushConstant(field, pState);            //[object, field]
+
+    if (op == '=')
+        childCodegen (node, 1, pState);     //[object, field, result]
+    else
+    {
+        copyInstruction(1, pState);                         //[object, field, object]
+        copyInstruction(1, pState);                         //[object, field, object, field]
+        instruction8(OC_RD_FIELD, pState);                  //[object, field, lvalue];
+        childCodegen(node, 1, pState);                      //[object, field, lvalue, rvalue];
+        binaryOperatorCode (op, pState, node->position());  //[object, field, result];
+    }
+    instruction8(OC_WR_FIELD, pState);      //[result]
+}
+
+
+/**
+ * Generates code to write an array element
+ * @param node
+ * @param pState
+ */
+void arrayWriteCodegen (Ref<AstNode> node, CodegenState* pState)
+{
+    int     op = getAssignOp(node);
+    auto    lexpr = node->children().front();
+    auto    field = lexpr->children()[1]->getName();
+    
+    //Array access and index codegen
+    childCodegen(lexpr, 0, pState);         //[array]
+    childCodegen(lexpr, 1, pState);         //[array, index]
+
+    if (op == '=')
+        childCodegen (node, 1, pState);     //[array, index, result]
+    else
+    {
+        copyInstruction(1, pState);                         //[array, index, array]
+        copyInstruction(1, pState);                         //[array, index, array, index]
+        instruction8(OC_RD_INDEX, pState);                  //[array, index, lvalue];
+        childCodegen(node, 1, pState);                      //[array, index, lvalue, rvalue];
+        binaryOperatorCode (op, pState, node->position());  //[array, index, result];
+    }
+    instruction8(OC_WR_INDEX, pState);      //[result]
+}
+
+
+/**
+ * Generates code for a function call
+ * @param node
+ * @param pState
+ */
+void fncallCodegen (Ref<AstNode> node, CodegenState* pState)
+{
+    const AstNodeTypes fnExprType = node->children()[0]->getType();
+
+    //If the expression to get the function reference is an object member access,
+    //then use generate a 'this' call.
+    if (fnExprType == AST_MEMBER_ACCESS)
+        thisCallCodegen (node, pState);
+    else if (fnExprType == AST_IDENTIFIER && inlineCallCodegen (node, pState))
+        return;
+    else
+    {
+        //Parameters evaluation
+        const int nChilds = (int)node->children().size();
+        for (int i = 1; i < nChilds; ++i)
+            childCodegen(node, i, pState);
+
+        //Evaluate function reference expression
+        childCodegen(node, 0, pState);
+
+        callInstruction (nChilds-1, pState, node->position());
+    }
+}
+
+/**
+ * Tries to inline a function call. Only calls to module functions whose body 
+ * is a small 'return' expression are inlined.
+ * Inlined code keeps the positions of the function body nodes, so the position
+ * tables attribute errors to the function source lines.
+ * @param node      Function call node
+ * @param pState
+ * @return true if the call has been inlined.
+ */
+bool inlineCallCodegen (Ref<AstNode> node, CodegenState* pState)
+{
+    const string    fnName = node->children().front()->getName();
+    
+    if (pState->pInline == NULL || pState->module.isNull())
+        return false;
+    
+    auto&   functions = pState->pInline->functions;
+    auto&   expanding = pState->pInline->expanding;
+    auto    itFn = functions.find(fnName);
+    
+    if (itFn == functions.end() || isLocalName(fnName, pState))
+        return false;
+    if (expanding.count(fnName) > 0 || (int)expanding.size() >= MAX_INLINE_DEPTH)
+        return false;
+    
+    auto                    fnNode = itFn->second;
+    const StringVector&     params = fnNode->getParams();
+    const int               nArgs = (int)node->children().size() - 1;
+    const int               nSlots = max (nArgs, (int)params.size());
+    const int               initialStack = pState->stackSize;
+    
+    //Arguments are evaluated before entering the function scope.
+    for (int i = 1; i <= nArgs; ++i)
+        childCodegen(node, i, pState);          //[args]
+    for (int i = nArgs; i < (int)params.size(); ++i)
+        pushNull(pState);                       //[nulls, args]
+    
+    //Non-block scope, which hides caller local variables.
+    pState->pushScope(fnNode, false, false);
+    for (size_t i = 0; i < params.size(); ++i)
+        pState->curScope()->declare(params[i], initialStack + (int)i);
+    
+    set<string>     callerBoxed;
+    
+    callerBoxed.swap(pState->boxed);
+    ++pState->inlineDepth;
+    expanding.insert(fnName);
+    
+    codegen (inlineExpression(fnNode), pState);    //[result, args]
+    
+    expanding.erase(fnName);
+    --pState->inlineDepth;
+    callerBoxed.swap(pState->boxed);
+    pState->popScope();
+    
+    //Remove arguments from the stack
+    if (nSlots > 0)
+    {
+        writeInstruction(nSlots-1, pState);
+        clearLocals(initialStack + 1, pState);  //[result]
+    }
+    
+    return true;
+}
+
+/**
+ * Gets the returned expression of an inlinable function.
+ * @param fnNode
+ * @return The expression, or a NULL reference if the function body is not a 
+ * single 'return' statement with an expression.
+ */
+Ref<AstNode> inlineExpression (Ref<AstFunction> fnNode)
+{
+    auto code = fnNode->getCode();
+    
+    if (code.isNull() || code->getType() != AST_BLOCK || code->children().size() != 1)
+        return Ref<AstNode>();
+    
+    auto ret = code->children().front();
+    
+    if (ret.isNull() || ret->getType() != AST_RETURN || ret->children().empty())
+        return Ref<AstNode>();
+    else
+        return ret->children().front();
+}
+
+/**
+ * Checks if an expression can be inlined. It shall not be larger than the
+ * budget, reference 'this' or the function itself, nor define functions or 
+ * classes.
+ * @param node
+ * @param fnName
+ * @param pBudget   Remaining number of nodes.
+ * @return 
+ */
+bool canInline (Ref<AstNode> node, const string& fnName, int* pBudget)
+{
+    if (node.isNull())
+        return true;
+    
+    if (--(*pBudget) < 0)
+        return false;
+    
+    switch (node->getType())
+    {
+    case AST_FUNCTION:
+    case AST_CLASS:
+    case AST_ACTOR:
+        return false;
+        
+    case AST_IDENTIFIER:
+        return node->getName() != "this" && node->getName() != fnName;
+        
+    default:
+        break;
+    }
+    
+    auto& children = node->children();
+    for (auto it = children.begin(); it != children.end(); ++it)
     {
-        //environment-based variable (global, closure...)
-        getEnvCodegen(pState);                  //[env]
-        pushConstant(name, pState);             //[env, name]
-        if (op == '=')
-            childCodegen(node, 1, pState);      //[env, name, result]
-        else
-        {
-            copyInstruction(1, pState);                         //[env, name, env]
-            copyInstruction(1, pState);                         //[env, name, env, name]
-            instruction8(OC_RD_FIELD, pState);                  //[env, name, lvalue];
-            childCodegen(node, 1, pState);                      //[env, name, lvalue, rvalue];
-            binaryOperatorCode (op, pState, node->position());  //[env, name, result];
-        }
-        instruction8(OC_WR_FIELD, pState);  //[result]
+        if (!canInline(*it, fnName, pBudget))
+            return false;
     }
+    
+    return true;
 }
 
 /**
- * Generates code to write into a field
+ * Registers a module function for inlining, if it is small enough.
  * @param node
  * @param pState
  */
-void fieldWriteCodegen (Ref<AstNode> node, CodegenState* pState)
+void registerInlineFunction (Ref<AstNode> node, CodegenState* pState)
 {
-    int     op = getAssignOp(node);
-    auto    lexpr = node->children().front();
-    auto    field = lexpr->children()[1]->getName();
+    if (pState->pInline == NULL)
+        return;
     
-    //Object access codegen
-    childCodegen(lexpr, 0 , pState);        //[object]
-    pushConstant(field, pState);            //[object, field]
+    auto    fnNode = node.staticCast<AstFunction>();
+    auto    expr = inlineExpression(fnNode);
+    int     budget = MAX_INLINE_NODES;
+    
+    if (expr.notNull() && canInline(expr, fnNode->getName(), &budget))
+        pState->pInline->functions[fnNode->getName()] = fnNode;
+}
 
-    if (op == '=')
-        childCodegen (node, 1, pState);     //[object, field, result]
-    else
+/**
+ * Checks if a name refers to a local variable of the current function or of
+ * any enclosing function.
+ * @param name
+ * @param pState
+ * @return 
+ */
+bool isLocalName (const string& name, CodegenState* pState)
+{
+    for (; pState != NULL; pState = pState->parent)
     {
-        copyInstruction(1, pState);                         //[object, field, object]
-        copyInstruction(1, pState);                         //[object, field, object, field]
-        instruction8(OC_RD_FIELD, pState);                  //[object, field, lvalue];
-        childCodegen(node, 1, pState);                      //[object, field, lvalue, rvalue];
-        binaryOperatorCode (op, pState, node->position());  //[object, field, result];
+        if (pState->isDeclared(name))
+            return true;
     }
-    instruction8(OC_WR_FIELD, pState);      //[result]
+    
+    return false;
 }
 
-
 /**
- * Generates code to write an array element
+ * Checks if the value of an expression is known at compile time. It is the case
+ * of module constants which are already defined, and of fields of frozen 
+ * objects which are known at compile time (such as 'Math.pow').
  * @param node
  * @param pState
+ * @param pValue    [out] Expression value
+ * @return 
  */
-void arrayWriteCodegen (Ref<AstNode> node, CodegenState* pState)
+bool knownValue (Ref<AstNode> node, CodegenState* pState, ASValue* pValue)
 {
-    int     op = getAssignOp(node);
-    auto    lexpr = node->children().front();
-    auto    field = lexpr->children()[1]->getName();
-    
-    //Array access and index codegen
-    childCodegen(lexpr, 0, pState);         //[array]
-    childCodegen(lexpr, 1, pState);         //[array, index]
-
-    if (op == '=')
-        childCodegen (node, 1, pState);     //[array, index, result]
-    else
+    if (node->getType() == AST_IDENTIFIER)
+        return knownValue(node->getName(), pState, pValue);
+    else if (node->getType() == AST_MEMBER_ACCESS)
     {
-        copyInstruction(1, pState);                         //[array, index, array]
-        copyInstruction(1, pState);                         //[array, index, array, index]
-        instruction8(OC_RD_INDEX, pState);                  //[array, index, lvalue];
-        childCodegen(node, 1, pState);                      //[array, index, lvalue, rvalue];
-        binaryOperatorCode (op, pState, node->position());  //[array, index, result];
+        ASValue object;
+        
+        if (!knownValue(node->children()[0], pState, &object))
+            return false;
+        if (object.getType() != VT_OBJECT || object.isMutable())
+            return false;
+        
+        *pValue = object.readField(node->children()[1]->getName());
+        return true;
     }
-    instruction8(OC_WR_INDEX, pState);      //[result]
+    else
+        return false;
 }
 
-
 /**
- * Generates code for a function call
- * @param node
+ * Checks if a name refers to a module constant which is already defined.
+ * Only deep-frozen values are known: code is shared by all actors, which see
+ * deep-frozen snapshots of the module globals instead of the original objects.
+ * @param name
  * @param pState
+ * @param pValue    [out] Constant value
+ * @return 
  */
-void fncallCodegen (Ref<AstNode> node, CodegenState* pState)
+bool knownValue (const string& name, CodegenState* pState, ASValue* pValue)
 {
-    const AstNodeTypes fnExprType = node->children()[0]->getType();
-
-    //If the expression to get the function reference is an object member access,
-    //then use generate a 'this' call.
-    if (fnExprType == AST_MEMBER_ACCESS)
-        thisCallCodegen (node, pState);
-    else
-    {
-        //Parameters evaluation
-        const int nChilds = (int)node->children().size();
-        for (int i = 1; i < nChilds; ++i)
-            childCodegen(node, i, pState);
-
-        //Evaluate function reference expression
-        childCodegen(node, 0, pState);
+    if (pState->module.isNull() || name == "this" || isLocalName(name, pState))
+        return false;
+    
+    ModuleLock  lock (pState);
+    
+    if (pState->module->isWritable(name))
+        return false;
 
-        callInstruction (nChilds-1, pState, node->position());
-    }
+    *pValue = pState->module->readField(name);
+    return !pValue->isNull() && pValue->getMutability() == MT_DEEPFROZEN;
 }
 
 /**
@@ -890,12 +2686,25 @@ void thisCallCodegen (Ref<AstNode> node, CodegenState* pState)
         childCodegen(node, i, pState);
 
                                             //[[params]]
-    childCodegen(fnExpr, 0, pState);        //[this, [params]]
-    instruction8 (OC_WR_THISP, pState);     //[this, [params]]
+    ASValue function;
     
-    const string  fnName = fnExpr->children()[1]->getName();
-    pushConstant(fnName, pState);           //[fnName, this, [params]]
-    instruction8(OC_RD_FIELD, pState);      //[function, [params]]
+    if (knownValue(fnExpr, pState, &function))
+    {
+        //Method of a frozen constant object.
+        childCodegen(fnExpr, 0, pState);        //[this, [params]]
+        instruction8 (OC_WR_THISP, pState);     //[this, [params]]
+        instruction8 (OC_POP, pState);          //[[params]]
+        pushConstant(function, pState);         //[function, [params]]
+    }
+    else
+    {
+        childCodegen(fnExpr, 0, pState);        //[this, [params]]
+        instruction8 (OC_WR_THISP, pState);     //[this, [params]]
+
+        const string  fnName = fnExpr->children()[1]->getName();
+        pushConstant(fnName, pState);           //[fnName, this, [params]]
+        instruction8(OC_RD_FIELD, pState);      //[function, [params]]
+    }
     
     callInstruction (nChilds-1, pState, node->position());
 }
@@ -935,18 +2744,22 @@ void varReadCodegen (const string& name, CodegenState* pState)
     {
         instruction8(OC_PUSH_THIS, pState);                 //[thisPtr]
     }
-    else if (pState->isDeclared(name))
+    else if (pState->isDeclared(name) || captureIndex(name, pState) >= 0)
     {
-        if (!pState->isParam(name))
-        {
-            const int offset = pState->getLocalVarOffset(name);
-            copyInstruction (offset, pState);               //[varValue]
-        }
+        varStorageCodegen(name, pState);                    //[varValue / box]
+        if (isBoxedVar(name, pState))
+            instruction8 (OC_RD_BOX, pState);               //[varValue]
+    }
+    else if (pState->module.notNull())
+    {
+        ASValue value;
+        
+        if (knownValue(name, pState, &value))
+            pushConstant(value, pState);                    //[varValue]
         else
         {
-            const int index = pState->getParamIndex(name);
-            pushConstant(jsInt(index), pState);             //[index]
-            instruction8 (OC_RD_PARAM, pState);             //[paramValue]
+            pushConstant(globalSlot(name, pState), pState);   //[slot]
+            instruction8(OC_RD_GLOBAL, pState);     //[varValue]
         }
     }
     else
@@ -1033,11 +2846,21 @@ void arrayAccessCodegen (Ref<AstNode> statement, CodegenState* pState)
  */
 void memberAccessCodegen(Ref<AstNode> statement, CodegenState* pState)
 {
-    childCodegen(statement, 0, pState);
+    auto    itHoisted = pState->hoisted.find(statement.getPointer());
+    ASValue value;
     
-    const string  fieldId = statement->children()[1]->getName();
-    pushConstant(fieldId, pState);
-    instruction8 (OC_RD_FIELD, pState);
+    if (itHoisted != pState->hoisted.end())
+        varReadCodegen(itHoisted->second, pState);
+    else if (knownValue(statement, pState, &value))
+        pushConstant(value, pState);
+    else
+    {
+        childCodegen(statement, 0, pState);
+
+        const string  fieldId = statement->children()[1]->getName();
+        pushConstant(fieldId, pState);
+        instruction8 (OC_RD_FIELD, pState);
+    }
 }
 
 /**
@@ -1069,8 +2892,11 @@ void binaryOpCodegen (Ref<AstNode> statement, CodegenState* pState)
     }
     else
     {
+        const bool numeric = exprType(statement->children()[0], pState) == ET_NUMBER
+                          && exprType(statement->children()[1], pState) == ET_NUMBER;
+        
         childrenCodegen(statement, pState);
-        binaryOperatorCode(opCode, pState, statement->position());
+        binaryOperatorCode(opCode, pState, statement->position(), numeric);
     }    
 }
 
@@ -1098,16 +2924,9 @@ void prefixOpCodegen(Ref<AstNode> node, CodegenState* pState)
     else if (opCode != '+')     //Plus unary operator does nothing, so no code is generated
     {
         childrenCodegen(node, pState);
-        const char* function;
+        const string function = prefixOperatorFunction(opCode);
         
-        switch (opCode)
-        {
-        case '-':       function = "@negate"; break;
-        case '~':       function = "@binNot"; break;
-        case '!':       function = "@logicNot"; break;
-        default:
-            ASSERT (!"Unexpected operator");
-        }
+        ASSERT (!function.empty());
         
         //Call function
         callCodegen(function, 1, pState, node->position());
@@ -1126,8 +2945,19 @@ void postfixOpCodegen (Ref<AstNode> node, CodegenState* pState)
     
     //Calls prefix code generation, and calls the opposite function to
     //recover the previous value.
-    prefixOpCodegen(node, pState);                      //[inc-value]
-    callCodegen(fnName, 1, pState,node->position());   //[prev-value]
+    if (exprType(node->children()[0], pState) == ET_NUMBER)
+    {
+        const int numOp = opNode->code == LEX_MINUSMINUS ? OC_ADD_NUM : OC_SUB_NUM;
+        
+        prefixOpCodegen(node, pState);                  //[inc-value]
+        pushConstant(1, pState);                        //[1, inc-value]
+        instruction8(numOp, pState);                    //[prev-value]
+    }
+    else
+    {
+        prefixOpCodegen(node, pState);                      //[inc-value]
+        callCodegen(fnName, 1, pState,node->position());   //[prev-value]
+    }
 }
 
 /**
@@ -1169,69 +2999,130 @@ void logicalOpCodegen (const int opCode, Ref<AstNode> statement, CodegenState* p
  */
 void actorCodegen (Ref<AstNode> node, CodegenState* pState)
 {
-    errorAt (node->position(), "Actors code generation disabled temporarily");
-//    auto  params = node->getParams();
-//    CodegenState            actorState = initFunctionState(node, pState->pCodeMap);
-//    
-//    auto constructor = AsEndPoint::createInput("@start",
-//                                               params,
-//                                               actorState.curRoutine);
-//    
-//    childrenCodegen(node, &actorState);
-//    
-//    VarMap members = actorState.members;
-//    members["@start"] = VarProperties(constructor, true);
-//    
-//    auto actor = AsActorClass::create(node->getName(), members, params);
-//    
-//    //Create a new constant, and yield actor class reference
-//    pushConstant( actor, pState);
-//    pushConstant(node->getName(), pState);
-//    instruction8(OC_CP+1, pState);
-//    instruction8(OC_NEW_CONST, pState);
+    auto            constructorFn = actorConstructorCodegen(node, pState);
+    auto            children = node->children();
+    VarMap          inputs;
+    StringVector    outputs;
+    
+    for (auto it = children.begin(); it != children.end(); ++it)
+    {
+        auto child = *it;
+        
+        if (child.isNull())
+            continue;
+        else if (child->getType() == AST_INPUT)
+        {
+            auto function = createFunction(child, pState);
+            inputs.checkedVarWrite (function->getName(), function->value(), true);
+        }
+        else if (child->getType() == AST_OUTPUT)
+            outputs.push_back(child->getName());
+    }
+    
+    auto cls = AsActorClass::create(node->getName(), 
+                                    node->getParams(), 
+                                    constructorFn, 
+                                    inputs, 
+                                    outputs);
+    
+    //Create a new constant, and yield actor class reference
+    if (pState->module.notNull())
+    {
+        pushConstant(globalSlot(node->getName(), pState), pState); //[slot]
+        pushConstant(cls->value(), pState);         //[class, slot]
+        instruction8(OC_NEW_CONST_GLOBAL, pState);  //[class]
+    }
+    else
+    {
+        getEnvCodegen(pState);                  //[env]
+        pushConstant(node->getName(), pState);  //[name, env]
+        pushConstant(cls->value(), pState);     //[class, name, env]
+        instruction8(OC_NEW_CONST_FIELD, pState);//[class]
+    }
+}
+
+/**
+ * Creates an actor constructor function. Its code is generated on its first call.
+ * @param node
+ * @param pState
+ * @return 
+ */
+Ref<JSFunction> actorConstructorCodegen (Ref<AstNode> node, CodegenState* pState)
+{
+    auto            params = node->getParams();
+    
+    if (pState->context.isNull())
+        return JSFunction::createJS("", params, actorBodyCodegen(node, params, pState));
+    else
+        return deferredFunction(node, "", params, pState);
 }
 
 /**
- * Generates code for 'connect' operator
+ * Generates the code of an actor constructor function. It initializes actor
+ * variables and connects its input messages. 
+ * Constructor parameters are written as actor fields when the actor is created.
  * @param node
+ * @param params
  * @param pState
+ * @return 
  */
-void connectCodegen (Ref<AstNode> node, CodegenState* pState)
+Ref<MvmRoutine> actorBodyCodegen (Ref<AstNode> node, const StringVector& params, CodegenState* pState)
 {
-    errorAt (node->position(), "Actors code generation disabled temporarily");
-//    pushConstant("this", pState);
-//    instruction8(OC_RD_LOCAL, pState);
-//    pushConstant(node->children().front()->getName(), pState);
-//    instruction8(OC_RD_FIELD, pState);
-//    childCodegen(node, 1, pState);
-//    callCodegen("@connect", 2, pState, node->position());
+    CodegenState    fnState = initFunctionState(node, params);
+    auto            children = node->children();
+    
+    fnState.module = pState->module;
+    fnState.context = pState->context;
+    fnState.pInline = pState->pInline;
+    fnState.pipeline = pState->pipeline;
+    fnState.boxed = boxedVariables(children, params);
+    pState = &fnState;
+    boxParamsCodegen (params, pState);
+    instruction8(OC_PUSH_THIS, pState);             //[actor]
+    
+    for (auto it = children.begin(); it != children.end(); ++it)
+    {
+        auto child = *it;
+        
+        if (child.isNull())
+            continue;
+        
+        auto type = child->getType();
+
+        if (type == AST_VAR || type == AST_CONST)
+        {
+            instruction8(OC_CP, pState);            //[actor, actor]
+            pushConstant (child->getName(), pState);//[name, actor, actor]
+            if (!childCodegen(child, 0, pState))    //[value, name, actor, actor]
+                pushConstant (jsNull(), pState);
+
+            const int opCode = type == AST_CONST ? OC_NEW_CONST_FIELD : OC_WR_FIELD;
+            instruction8 (opCode, pState);          //[value, actor]
+            instruction8 (OC_POP, pState);          //[actor]
+        }
+        else if (type == AST_CONNECT)
+        {
+            connectCodegen (child, pState);         //[null, actor]
+            instruction8 (OC_POP, pState);          //[actor]
+        }
+    }
+    
+    //Stack:[actor]
+    
+    mvmOptimize (fnState.curRoutine);
+    return fnState.curRoutine;
 }
 
 /**
- * Generates code for a message declared inside an actor.
+ * Generates code for 'connect' operator
  * @param node
  * @param pState
  */
-void messageCodegen (Ref<AstNode> node, CodegenState* pState)
+void connectCodegen (Ref<AstNode> node, CodegenState* pState)
 {
-    errorAt (node->position(), "Actors code generation disabled temporarily");
-//    Ref<AsEndPoint>  msg = AsEndPoint::create(node->getName(), 
-//                                              node->getParams(), 
-//                                              node->getType() == AST_INPUT);
-//
-//    if (node->getType() == AST_INPUT)
-//    {
-//        //TODO: This code is very simular in function, actor, and message code generation
-//        Ref<MvmRoutine>         code = MvmRoutine::create();
-//
-//        CodegenState    fnState = initFunctionState(node, pState->pCodeMap);
-//        msg->setCodeMVM (code);
-//        fnState.curRoutine = code;
-//
-//        codegen (node.staticCast<AstFunction>()->getCode(), &fnState);
-//    }
-//
-//    pState->members[msg->getName()] = VarProperties(msg, true);
+    pushConstant(node->children().front()->getName(), pState);    //[inputName]
+    childCodegen(node, 1, pState);                                  //[output, inputName]
+    callCodegen("@connect", 2, pState, node->position());           //[null]
 }
 
 /**
@@ -1278,17 +3169,26 @@ void classCodegen (Ref<AstNode> node, CodegenState* pState)
     
     //Create a new constant, and yield class reference
     getEnvCodegen(pState);                  //[env]
-    copyInstruction(0, pState);             //[env, env]
-    pushConstant(node->getName(), pState);  //[name, env, env]
-    pushConstant( cls->value(), pState);    //[class, name, env, env]
-    instruction8(OC_NEW_CONST_FIELD, pState);//[class, env]
+    if (pState->module.notNull())
+    {
+        pushConstant(globalSlot(node->getName(), pState), pState); //[slot, env]
+        pushConstant( cls->value(), pState);        //[class, slot, env]
+        instruction8(OC_NEW_CONST_GLOBAL, pState);  //[class, env]
+    }
+    else
+    {
+        copyInstruction(0, pState);             //[env, env]
+        pushConstant(node->getName(), pState);  //[name, env, env]
+        pushConstant( cls->value(), pState);    //[class, name, env, env]
+        instruction8(OC_NEW_CONST_FIELD, pState);//[class, env]
+    }
     
     //Set environment.
     callCodegen("@setClassEnv", 2, pState, node->position());   //[class]
 }
 
 /**
- * Generates the code for a class constructor function.
+ * Creates a class constructor function. Its code is generated on its first call.
  * @param node
  * @param pState
  * @return 
@@ -1296,19 +3196,38 @@ void classCodegen (Ref<AstNode> node, CodegenState* pState)
 Ref<JSFunction> classConstructorCodegen (Ref<AstNode> node, CodegenState* pState)
 {
     auto            params = classConstructorParams(node, pState);
-    CodegenState    fnState = initFunctionState(node, params, pState->pCodeMap);
+    
+    if (pState->context.isNull())
+        return JSFunction::createJS("", params, constructorBodyCodegen(node, params, pState));
+    else
+        return deferredFunction(node, "", params, pState);
+}
 
-    auto            function = JSFunction::createJS("", params, fnState.curRoutine);
+/**
+ * Generates the code of a class constructor function.
+ * @param node
+ * @param params
+ * @param pState
+ * @return 
+ */
+Ref<MvmRoutine> constructorBodyCodegen (Ref<AstNode> node, const StringVector& params, CodegenState* pState)
+{
+    CodegenState    fnState = initFunctionState(node, params);
     auto            children = node->children();
     set<string>     vars;
     
+    fnState.module = pState->module;
+    fnState.context = pState->context;
+    fnState.pInline = pState->pInline;
+    fnState.pipeline = pState->pipeline;
+    fnState.boxed = boxedVariables(children, params);
     pState = &fnState;
+    boxParamsCodegen (params, pState);
     baseConstructorCallCodegen (node, pState);      //[newObj]
     
-    //Set object class. First parameter of constructor closure.
-    getEnvCodegen(pState);                          //[env,newObj]
-    pushConstant(0, pState);                        //[0, env,newObj]
-    instruction8(OC_RD_INDEX, pState);              //[class, newObj]
+    //Set object class. First captured value of constructor closure.
+    pushConstant(0, pState);                        //[0, newObj]
+    instruction8(OC_RD_CAPTURE, pState);            //[class, newObj]
     callCodegen ("@setObjClass", 2, pState, node->position());  //[newObj]
     
     for (auto it = children.begin(); it != children.end(); ++it)
@@ -1354,8 +3273,9 @@ Ref<JSFunction> classConstructorCodegen (Ref<AstNode> node, CodegenState* pState
     }
     
     //Stack:[newObj]
-
-    return function;
+    
+    mvmOptimize (fnState.curRoutine);
+    return fnState.curRoutine;
 }
 
 /**
@@ -1665,14 +3585,11 @@ void instruction8 (int opCode, CodegenState* pState)
     
     const auto routine = pState->curRoutine;
     
-    routine->blocks.rbegin()->instructions.push_back(opCode);
+    const int   blockIdx = (int)routine->blocks.size()-1;
+    ByteVector& block = routine->blocks[blockIdx].instructions;
     
-    if (pState->pCodeMap != NULL)
-    {
-        const int blockIdx = (int)routine->blocks.size()-1;
-        VmPosition  pos (routine, blockIdx, (int)routine->blocks[blockIdx].instructions.size()-1);
-        pState->pCodeMap->add(pos, pState->curPos);
-    }
+    block.push_back(opCode);
+    routine->positions.add(blockIdx, (int)block.size()-1, pState->curPos);
     
     //Update stack position
     pState->stackSize += calcStackOffset8(opCode);
@@ -1691,18 +3608,13 @@ void instruction16 (int opCode, CodegenState* pState)
     
     opCode |= 0x8000;   //16 bits indicator
     
-    ByteVector&     block = pState->curRoutine->blocks.rbegin()->instructions;
+    const auto      routine = pState->curRoutine;
+    const int       blockIdx = (int)routine->blocks.size()-1;
+    ByteVector&     block = routine->blocks[blockIdx].instructions;
     
     block.push_back((unsigned char)(opCode >> 8));
     block.push_back((unsigned char)(opCode & 0xff));
-    
-    if (pState->pCodeMap != NULL)
-    {
-        const auto routine = pState->curRoutine;
-        const int blockIdx = (int)routine->blocks.size()-1;
-        VmPosition  pos (routine, blockIdx, (int)block.size()-2);
-        pState->pCodeMap->add(pos, pState->curPos);
-    }
+    routine->positions.add(blockIdx, (int)block.size()-2, pState->curPos);
     
     //Update stack position
     pState->stackSize += calcStackOffset16(opCode);
@@ -1746,12 +3658,105 @@ int  getLastInstruction (CodegenState* pState)
  * @param pState
  * @param pos
  */
-void binaryOperatorCode (int tokenCode, CodegenState* pState, const ScriptPosition& pos)
+void binaryOperatorCode (int tokenCode, CodegenState* pState, const ScriptPosition& pos, bool numeric)
+{
+    int     opCode = -1;
+    bool    swap = false;
+    
+    switch (tokenCode)
+    {
+    case '+':           opCode = numeric ? OC_ADD_NUM : OC_ADD;     break;
+    case '-':           opCode = numeric ? OC_SUB_NUM : OC_SUB;     break;
+    case '*':           opCode = numeric ? OC_MUL_NUM : OC_MUL;     break;
+    case '/':           opCode = numeric ? OC_DIV_NUM : OC_DIV;     break;
+    case '<':           opCode = numeric ? OC_LT_NUM : OC_LT;       break;
+    case LEX_LEQUAL:    opCode = numeric ? OC_LE_NUM : OC_LE;       break;
+        
+    //'a > b' is 'b < a' for numbers.
+    case '>':           
+        if (numeric)
+        {
+            opCode = OC_LT_NUM; 
+            swap = true;
+        }
+        break;
+    case LEX_GEQUAL:
+        if (numeric)
+        {
+            opCode = OC_LE_NUM;
+            swap = true;
+        }
+        break;
+    }
+    
+    if (opCode < 0)
+    {
+        const string fnName = binaryOperatorFunction(tokenCode);
+
+        ASSERT (!fnName.empty());
+        callCodegen(fnName, 2, pState, pos);
+    }
+    else
+    {
+        const auto oldPos = pState->curPos;
+        
+        pState->curPos = pos;
+        if (swap)
+            instruction8(OC_SWAP, pState);
+        instruction8(opCode, pState);
+        pState->curPos = oldPos;
+    }
+}
+
+/**
+ * Gets the inferred type of an expression.
+ * @param node
+ * @param pState
+ * @return 
+ */
+ExprType exprType (Ref<AstNode> node, CodegenState* pState)
+{
+    return inferExprType(node, CodegenTypeResolver(pState));
+}
+
+/**
+ * Gets the inferred type of a local variable.
+ * @param name
+ * @param pState
+ * @return 'ET_UNKNOWN' if it is not a local variable, or its type has not 
+ * been inferred.
+ */
+ExprType localVarType (const string& name, CodegenState* pState)
+{
+    if (!pState->isDeclared(name) || pState->isParam(name) || isBoxedVar(name, pState))
+        return ET_UNKNOWN;
+    
+    auto it = pState->varTypes.find(LocalVarKey(pState->getDeclaringScope(name), name));
+    
+    if (it == pState->varTypes.end())
+        return ET_UNKNOWN;
+    else
+        return it->second;
+}
+
+ExprType CodegenTypeResolver::identifierType (Ref<AstNode> identifier)const
+{
+    return localVarType(identifier->getName(), m_pState);
+}
+
+/**
+ * Gets the name of the native function which implements a binary operator.
+ * @param tokenCode
+ * @return The function name, or an empty string if the operator is not 
+ * implemented by a function call.
+ */
+std::string binaryOperatorFunction (int tokenCode)
 {
     typedef map <int, string> OpMap;
     static OpMap operators;
+    static std::once_flag initialized;
     
-    if (operators.empty())
+    std::call_once (initialized, []()
     {
         operators['+'] =                "@add";
         operators['-'] =                "@sub";
@@ -1773,12 +3778,31 @@ void binaryOperatorCode (int tokenCode, CodegenState* pState, const ScriptPositi
         operators[LEX_NTYPEEQUAL] =     "@notTypeEqual";
         operators[LEX_LEQUAL] =         "@lequal";
         operators[LEX_GEQUAL] =         "@gequal";
-    }
+    });
     
     OpMap::const_iterator it = operators.find(tokenCode);
     
-    ASSERT (it != operators.end());
-    callCodegen(it->second, 2, pState, pos);
+    if (it == operators.end())
+        return "";
+    else
+        return it->second;
+}
+
+/**
+ * Gets the name of the native function which implements an unary prefix operator.
+ * @param tokenCode
+ * @return The function name, or an empty string if the operator is not 
+ * implemented by a function call.
+ */
+std::string prefixOperatorFunction (int tokenCode)
+{
+    switch (tokenCode)
+    {
+    case '-':       return "@negate";
+    case '~':       return "@binNot";
+    case '!':       return "@logicNot";
+    default:        return "";
+    }
 }
 
 /**
@@ -1787,6 +3811,7 @@ void binaryOperatorCode (int tokenCode, CodegenState* pState, const ScriptPositi
  */
 void getEnvCodegen (CodegenState* pState)
 {
+    pState->usesEnv = true;
     copyInstruction(pState->stackSize, pState);
 }
 
@@ -1881,6 +3906,21 @@ int calcStackOffset8(int opCode)
         case OC_WR_FIELD:   return -2;    
         case OC_WR_INDEX:   return -2;  
         case OC_NEW_CONST_FIELD:   return -2;
+        case OC_WR_GLOBAL:  return -1;
+        case OC_NEW_CONST_GLOBAL:  return -1;
+        case OC_WR_BOX:     return -1;
+        case OC_ADD:
+        case OC_SUB:
+        case OC_MUL:
+        case OC_DIV:
+        case OC_LT:
+        case OC_LE:
+        case OC_ADD_NUM:
+        case OC_SUB_NUM:
+        case OC_MUL_NUM:
+        case OC_DIV_NUM:
+        case OC_LT_NUM:
+        case OC_LE_NUM:     return -1;
         case OC_WR_PARAM:   return -1;
         case OC_NUM_PARAMS: return 1;
         case OC_PUSH_THIS:  return 1;
@@ -1916,9 +3956,9 @@ int calcStackOffset16(int opCode)
  * @param node
  * @return 
  */
-CodegenState initFunctionState (Ref<AstNode> node, CodeMap* pMap)
+CodegenState initFunctionState (Ref<AstNode> node)
 {
-    return initFunctionState(node, node->getParams(), pMap);
+    return initFunctionState(node, node->getParams());
 }
 
 /**
@@ -1927,13 +3967,12 @@ CodegenState initFunctionState (Ref<AstNode> node, CodeMap* pMap)
  * @param params
  * @return 
  */
-CodegenState initFunctionState (Ref<AstNode> node, const StringVector& params, CodeMap* pMap)
+CodegenState initFunctionState (Ref<AstNode> node, const StringVector& params)
 {
     Ref<MvmRoutine>         code = MvmRoutine::create();
     CodegenState            fnState;
     
     fnState.curPos = node->position();
-    fnState.pCodeMap = pMap;
     fnState.curRoutine = code;
     fnState.pushScope(node, false, true);
 
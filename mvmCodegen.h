@@ -13,9 +13,37 @@
 
 #include "microVM.h"
 #include "ast.h"
+#include "asObjects.h"
 #include <vector>
 
-Ref<MvmRoutine> scriptCodegen ( Ref<AstNode> script, CodeMap* pMap);
+/**
+ * How function code is generated.
+ */
+enum CodegenPipeline
+{
+    CGP_DIRECT,     //Directly from the AST
+    CGP_SSA         //Through the SSA intermediate representation, when supported.
+};
+
+/**
+ * Code generation options.
+ */
+struct CodegenOptions
+{
+    CodegenPipeline pipeline = CGP_DIRECT;
+    
+    //Threads which generate the code of functions. If greater than 1, functions
+    //are compiled in parallel, after the script code. Otherwise, each function 
+    //is compiled on its first call.
+    int             threads = 1;
+};
+
+Ref<MvmRoutine> scriptCodegen ( Ref<AstNode> script, 
+                                Ref<JSObject> globals = Ref<JSObject>(),
+                                const CodegenOptions& options = CodegenOptions());
+
+std::string     binaryOperatorFunction (int tokenCode);
+std::string     prefixOperatorFunction (int tokenCode);
 
 
 
@@ -121,6 +121,7 @@ string disassembly8bitInst (int opCode, const ValueVector& constants)
         case OC_CP+5:       return "CP(5)";
         case OC_CP+6:       return "CP(6)";
         case OC_CP+7:       return "CP(7)";
+        case OC_WR:         return "WR(0)";
         case OC_WR+1:       return "WR(1)";
         case OC_WR+2:       return "WR(2)";
         case OC_WR+3:       return "WR(3)";
@@ -140,6 +141,29 @@ string disassembly8bitInst (int opCode, const ValueVector& constants)
         case OC_NUM_PARAMS:     return "OC_NUM_PARAMS";
         case OC_PUSH_THIS:      return "OC_PUSH_THIS";
         case OC_WR_THISP:       return "OC_WR_THISP";
+        case OC_JMP:            return "JMP";
+        case OC_JT:             return "JT";
+        case OC_JF:             return "JF";
+        case OC_RET:            return "RET";
+        case OC_RD_GLOBAL:      return "RD_GLOBAL";
+        case OC_WR_GLOBAL:      return "WR_GLOBAL";
+        case OC_NEW_CONST_GLOBAL:return "NEW_CONST_GLOBAL";
+        case OC_RD_CAPTURE:     return "RD_CAPTURE";
+        case OC_NEW_BOX:        return "NEW_BOX";
+        case OC_RD_BOX:         return "RD_BOX";
+        case OC_WR_BOX:         return "WR_BOX";
+        case OC_ADD:            return "ADD";
+        case OC_SUB:            return "SUB";
+        case OC_MUL:            return "MUL";
+        case OC_DIV:            return "DIV";
+        case OC_LT:             return "LT";
+        case OC_LE:             return "LE";
+        case OC_ADD_NUM:        return "ADD_NUM";
+        case OC_SUB_NUM:        return "SUB_NUM";
+        case OC_MUL_NUM:        return "MUL_NUM";
+        case OC_DIV_NUM:        return "DIV_NUM";
+        case OC_LT_NUM:         return "LT_NUM";
+        case OC_LE_NUM:         return "LE_NUM";
         case OC_NOP:            return "NOP";
         default:
             return "BAD_OP_CODE_8";
@@ -301,6 +325,8 @@ Ref<JSObject> disassemblyFunction (Ref<JSFunction> function)
     obj->writeField ("header", jsString(function->toString() ), false);
     if (function->isNative())
         obj->writeField("code", jsString("native"), false);
+    else if (!function->isCompiled())
+        obj->writeField("code", jsString("not compiled"), false);
     else
     {
         obj->writeField("code", 
@@ -13,6 +13,7 @@
 #include "scriptMain.h"
 #include "ScriptException.h"
 #include "modules.h"
+#include "actorRuntime.h"
 
 #include <math.h>
 #include <string>
@@ -68,9 +69,19 @@ ASValue mvmNegate (ExecutionContext* ec)
  */
 ASValue mvmAdd (ExecutionContext* ec)
 {
-    ASValue opA = ec->getParam(0);
-    ASValue opB = ec->getParam(1);
-    
+    return mvmAddValues (ec->getParam(0), ec->getParam(1), ec);
+}
+
+/**
+ * Implementation of 'add' operation. Also used by 'ADD' instruction when
+ * operands are not numbers.
+ * @param opA
+ * @param opB
+ * @param ec
+ * @return 
+ */
+ASValue mvmAddValues (const ASValue& opA, const ASValue& opB, ExecutionContext* ec)
+{
     const JSValueTypes typeA = opA.getType();
     const JSValueTypes typeB = opB.getType();
 
@@ -87,10 +98,12 @@ ASValue mvmAdd (ExecutionContext* ec)
  */
 ASValue mvmSub (ExecutionContext* ec)
 {
-    const double valA = ec->getParam(0).toDouble(ec);
-    const double valB = ec->getParam(1).toDouble(ec);
-    
-    return jsDouble( valA - valB );
+    return mvmSubValues (ec->getParam(0), ec->getParam(1), ec);
+}
+
+ASValue mvmSubValues (const ASValue& opA, const ASValue& opB, ExecutionContext* ec)
+{
+    return jsDouble( opA.toDouble(ec) - opB.toDouble(ec) );
 }
 
 /**
@@ -100,10 +113,12 @@ ASValue mvmSub (ExecutionContext* ec)
  */
 ASValue mvmMultiply (ExecutionContext* ec)
 {
-    const double valA = ec->getParam(0).toDouble(ec);
-    const double valB = ec->getParam(1).toDouble(ec);
-    
-    return jsDouble( valA * valB );
+    return mvmMultiplyValues (ec->getParam(0), ec->getParam(1), ec);
+}
+
+ASValue mvmMultiplyValues (const ASValue& opA, const ASValue& opB, ExecutionContext* ec)
+{
+    return jsDouble( opA.toDouble(ec) * opB.toDouble(ec) );
 }
 
 /**
@@ -113,10 +128,12 @@ ASValue mvmMultiply (ExecutionContext* ec)
  */
 ASValue mvmDivide (ExecutionContext* ec)
 {
-    const double valA = ec->getParam(0).toDouble(ec);
-    const double valB = ec->getParam(1).toDouble(ec);
-    
-    return jsDouble( valA / valB );
+    return mvmDivideValues (ec->getParam(0), ec->getParam(1), ec);
+}
+
+ASValue mvmDivideValues (const ASValue& opA, const ASValue& opB, ExecutionContext* ec)
+{
+    return jsDouble( opA.toDouble(ec) / opB.toDouble(ec) );
 }
 
 /**
@@ -254,9 +271,11 @@ ASValue mvmRshiftu (ExecutionContext* ec)
  */
 ASValue mvmLess (ExecutionContext* ec)
 {
-    ASValue opA = ec->getParam(0);
-    ASValue opB = ec->getParam(1);
-    
+    return mvmLessValues (ec->getParam(0), ec->getParam(1), ec);
+}
+
+ASValue mvmLessValues (const ASValue& opA, const ASValue& opB, ExecutionContext* ec)
+{
     if (opA.isNull() || opB.isNull())
         return jsFalse();
     else
@@ -286,9 +305,11 @@ ASValue mvmGreater (ExecutionContext* ec)
  */
 ASValue mvmLequal (ExecutionContext* ec)
 {
-    ASValue opA = ec->getParam(0);
-    ASValue opB = ec->getParam(1);
-    
+    return mvmLequalValues (ec->getParam(0), ec->getParam(1), ec);
+}
+
+ASValue mvmLequalValues (const ASValue& opA, const ASValue& opB, ExecutionContext* ec)
+{
     if (opA.isNull() || opB.isNull())
         return jsFalse();
     else
@@ -296,7 +317,7 @@ ASValue mvmLequal (ExecutionContext* ec)
 }
 
 /**
- * '<=' comparison operation
+ * '>=' comparison operation
  * @param pScope
  * @return 
  */
@@ -308,7 +329,7 @@ ASValue mvmGequal (ExecutionContext* ec)
     if (opA.isNull() || opB.isNull())
         return jsFalse();
     else
-        return jsBool (opA.compare(opB, ec) <= 0);
+        return jsBool (opA.compare(opB, ec) >= 0);
 }
 
 /**
@@ -321,7 +342,7 @@ ASValue mvmAreEqual (ExecutionContext* ec)
     ASValue opA = ec->getParam(0);
     ASValue opB = ec->getParam(1);
  
-    return jsBool (opA.compare(opB, ec) == 0);
+    return jsBool (opA.equals(opB, ec));
 }
 
 ASValue mvmAreTypeEqual (ExecutionContext* ec)
@@ -329,7 +350,7 @@ ASValue mvmAreTypeEqual (ExecutionContext* ec)
     ASValue opA = ec->getParam(0);
     ASValue opB = ec->getParam(1);
 
-    return jsBool (opA.typedCompare(opB, ec) == 0);
+    return jsBool (opA.getType() == opB.getType() && opA.equals(opB, ec));
 }
 
 /**
@@ -345,7 +366,7 @@ ASValue mvmNotEqual (ExecutionContext* ec)
     if (opA.isNull() || opB.isNull())
         return jsBool( !(opA.isNull() && opB.isNull()) );
     else
-        return jsBool (opA.compare (opB, ec) != 0);
+        return jsBool (!opA.equals (opB, ec));
 }
 
 /**
@@ -358,7 +379,7 @@ ASValue mvmNotTypeEqual (ExecutionContext* ec)
     ASValue opA = ec->getParam(0);
     ASValue opB = ec->getParam(1);
 
-    return jsBool (opA.typedCompare(opB, ec) != 0);
+    return jsBool (opA.getType() != opB.getType() || !opA.equals(opB, ec));
 }
 
 ASValue mvmToString (ExecutionContext* ec)
@@ -406,6 +427,28 @@ ASValue mvmMakeClosure (ExecutionContext* ec)
     return JSClosure::create(fn.staticCast<JSFunction>(), paramsBegin, nParams-1)->value();
 }
 
+/**
+ * Checks if all parameters are frozen (or deep frozen) values.
+ * Used to check the conditions of loops whose field reads have been hoisted.
+ * @param ec
+ * @return 
+ */
+ASValue mvmAreFrozen (ExecutionContext* ec)
+{
+    ASSERT (!ec->frames.empty());
+    
+    const CallFrame&    curFrame = ec->frames.back();
+    const ASValue*      params = &ec->stack[curFrame.paramsIndex];
+    
+    for (size_t i = 0; i < curFrame.numParams; ++i)
+    {
+        if (params[i].isMutable())
+            return jsFalse();
+    }
+    
+    return jsTrue();
+}
+
 /**
  * Gets the iterator of a given object
  * @param ec
@@ -527,10 +570,13 @@ void registerMvmFunctions(Ref<JSObject> scope)
     addNative2("@makeClosure", "env", "fn", mvmMakeClosure, scope);
     
     addNative1("@iterator", "obj", mvmIterator, scope);
+    addNative1("@areFrozen", "values", mvmAreFrozen, scope);
     
     addNative2("@setClassEnv", "env", "cls", JSClass::scSetEnv, scope);
     addNative2("@setObjClass", "obj", "cls", JSObject::scSetObjClass, scope);
     
     addNative2("@exportSymbol", "name", "env", mvmExportSymbol, scope);
     addNative2("@importModule", "path", "env", mvmImportModule, scope);
+    
+    addNative2("@connect", "input", "src", actorConnect, scope);
 }
@@ -17,6 +17,14 @@
 
 void registerMvmFunctions(Ref<JSObject> scope);
 
+//Operators implementation, used by arithmetic instructions.
+ASValue mvmAddValues (const ASValue& opA, const ASValue& opB, ExecutionContext* ec);
+ASValue mvmSubValues (const ASValue& opA, const ASValue& opB, ExecutionContext* ec);
+ASValue mvmMultiplyValues (const ASValue& opA, const ASValue& opB, ExecutionContext* ec);
+ASValue mvmDivideValues (const ASValue& opA, const ASValue& opB, ExecutionContext* ec);
+ASValue mvmLessValues (const ASValue& opA, const ASValue& opB, ExecutionContext* ec);
+ASValue mvmLequalValues (const ASValue& opA, const ASValue& opB, ExecutionContext* ec);
+
 
 #endif	/* MVMFUNCTIONS_H */
 
@@ -0,0 +1,448 @@
+/* 
+ * File:   mvmOptimizer.cpp
+ * Author: ghernan
+ * 
+ * Peephole and control flow optimizations over generated Micro VM code.
+ * 
+ * Code generator emits code in a simple way, which leaves redundant sequences,
+ * such as values pushed and immediately discarded, and lots of small blocks.
+ * This pass:
+ *  - Removes pure push + 'POP' pairs, 'SWAP' pairs and 'NOP's.
+ *  - Threads jumps through blocks which just push a value and jump.
+ *  - Merges straight-line blocks (a block whose only predecessor jumps to it 
+ * unconditionally)
+ *  - Removes unreachable blocks and renumbers the remaining ones.
+ * The position table is rebuilt, so each instruction keeps its source position.
+ *
+ * Created on October 18, 2026, 4:05 PM
+ */
+
+#include "ascript_pch.hpp"
+#include "mvmOptimizer.h"
+
+using namespace std;
+
+/**
+ * Decoded instruction.
+ */
+struct OptInstruction
+{
+    int     opCode;         ///< Full op code, including 16 bit flag on 16 bit instructions.
+    int     srcBlock;       ///< Original block. (-1) for instructions added by the optimizer.
+    int     srcOffset;      ///< Original offset, in bytes.
+    
+    OptInstruction (int op, int block, int offset)
+    : opCode(op), srcBlock(block), srcOffset(offset)
+    {}
+    
+    bool is16bit()const
+    {
+        return (opCode & OC16_16BIT_FLAG) != 0;
+    }
+};
+typedef vector<OptInstruction>  OptInstructions;
+
+/**
+ * Decoded block
+ */
+struct OptBlock
+{
+    OptInstructions instructions;
+    int             nextBlocks[2];
+    
+    bool isUnconditional()const
+    {
+        return nextBlocks[0] == nextBlocks[1];
+    }
+};
+typedef vector<OptBlock>    OptBlocks;
+
+void decodeRoutine (Ref<MvmRoutine> routine, OptBlocks& blocks);
+void encodeRoutine (const OptBlocks& blocks, Ref<MvmRoutine> routine);
+bool peephole (OptInstructions& instructions);
+bool threadJumps (OptBlocks& blocks);
+bool mergeBlocks (OptBlocks& blocks);
+void removeUnreachable (OptBlocks& blocks);
+vector<int> countPredecessors (const OptBlocks& blocks);
+bool isPurePush (const OptInstruction& inst);
+void rebuildPositions (Ref<MvmRoutine> routine, const OptBlocks& blocks);
+
+/**
+ * Optimizes a routine. The routine is modified in place.
+ * @param routine
+ */
+void mvmOptimize (Ref<MvmRoutine> routine)
+{
+    OptBlocks   blocks;
+    
+    decodeRoutine(routine, blocks);
+    
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        
+        for (size_t i = 0; i < blocks.size(); ++i)
+            changed = peephole(blocks[i].instructions) || changed;
+        
+        changed = threadJumps(blocks) || changed;
+        changed = mergeBlocks(blocks) || changed;
+    }
+    
+    removeUnreachable(blocks);
+    
+    rebuildPositions(routine, blocks);
+    
+    encodeRoutine(blocks, routine);
+    
+    //Block code has changed, flat code must be regenerated.
+    routine->flatCode.clear();
+    routine->blockStarts.clear();
+}
+
+/**
+ * Decodes routine blocks.
+ * @param routine
+ * @param blocks    [out]
+ */
+void decodeRoutine (Ref<MvmRoutine> routine, OptBlocks& blocks)
+{
+    blocks.resize(routine->blocks.size());
+    
+    for (size_t b = 0; b < routine->blocks.size(); ++b)
+    {
+        const MvmBlock&     src = routine->blocks[b];
+        OptBlock&           dest = blocks[b];
+        
+        dest.nextBlocks[0] = src.nextBlocks[0];
+        dest.nextBlocks[1] = src.nextBlocks[1];
+        
+        for (size_t i = 0; i < src.instructions.size(); )
+        {
+            const int   offset = (int)i;
+            int         opCode = src.instructions[i++];
+            
+            if ((opCode & OC_EXT_FLAG) && i < src.instructions.size())
+                opCode = (opCode << 8) | src.instructions[i++];
+            
+            dest.instructions.push_back(OptInstruction(opCode, (int)b, offset));
+        }
+    }
+}
+
+/**
+ * Encodes optimized blocks into the routine.
+ * @param blocks
+ * @param routine
+ */
+void encodeRoutine (const OptBlocks& blocks, Ref<MvmRoutine> routine)
+{
+    routine->blocks.clear();
+    
+    for (size_t b = 0; b < blocks.size(); ++b)
+    {
+        const OptBlock& src = blocks[b];
+        MvmBlock        dest (src.nextBlocks[1], src.nextBlocks[0]);
+        
+        for (size_t i = 0; i < src.instructions.size(); ++i)
+        {
+            const OptInstruction&   inst = src.instructions[i];
+            
+            if (inst.is16bit())
+            {
+                dest.instructions.push_back((unsigned char)(inst.opCode >> 8));
+                dest.instructions.push_back((unsigned char)(inst.opCode & 0xff));
+            }
+            else
+                dest.instructions.push_back((unsigned char)inst.opCode);
+        }
+        
+        routine->blocks.push_back(dest);
+    }
+}
+
+/**
+ * Removes redundant instruction sequences inside a block.
+ * @param instructions
+ * @return true if any change has been made.
+ */
+bool peephole (OptInstructions& instructions)
+{
+    OptInstructions     result;
+    
+    result.reserve(instructions.size());
+    
+    for (size_t i = 0; i < instructions.size(); ++i)
+    {
+        const OptInstruction&   inst = instructions[i];
+        
+        if (!inst.is16bit() && inst.opCode == OC_NOP)
+            continue;
+        
+        result.push_back(inst);
+        
+        bool reduced = true;
+        while (reduced && result.size() >= 2)
+        {
+            const size_t            n = result.size();
+            const OptInstruction&   last = result[n-1];
+            const OptInstruction&   prev = result[n-2];
+            reduced = false;
+            
+            if (last.opCode == OC_POP && isPurePush(prev))
+            {
+                //Pushed value is discarded.
+                result.erase(result.end()-2, result.end());
+                reduced = true;
+            }
+            else if (last.opCode == OC_SWAP && prev.opCode == OC_SWAP)
+            {
+                result.erase(result.end()-2, result.end());
+                reduced = true;
+            }
+            else if (n >= 3 && last.opCode == OC_POP && prev.opCode == OC_WR_THISP 
+                     && result[n-3].opCode == OC_CP)
+            {
+                //'CP(0) WR_THISP POP' is the same as 'WR_THISP'
+                result[n-3] = prev;
+                result.erase(result.end()-2, result.end());
+                reduced = true;
+            }
+        }
+    }
+    
+    const bool changed = result.size() != instructions.size();
+    instructions.swap(result);
+    
+    return changed;
+}
+
+/**
+ * Checks if the instruction just pushes a value, with no other effect.
+ * @param inst
+ * @return 
+ */
+bool isPurePush (const OptInstruction& inst)
+{
+    if (inst.is16bit())
+    {
+        const int decoded = inst.opCode & 0x3FFF;
+        
+        return decoded >= OC16_PUSHC || (decoded >= OC16_CP && decoded <= OC16_CP_MAX);
+    }
+    else
+        return inst.opCode >= OC_PUSHC || (inst.opCode >= OC_CP && inst.opCode <= OC_CP_MAX);
+}
+
+/**
+ * Checks if a block is a 'forwarding' block: It just pushes a value, which
+ * is discarded at block end, and jumps to another block.
+ * @param blocks
+ * @param index
+ * @return 
+ */
+static bool isForwardingBlock (const OptBlocks& blocks, int index)
+{
+    if (index < 0)
+        return false;
+    
+    const OptBlock& block = blocks[index];
+    
+    return block.isUnconditional() 
+            && block.nextBlocks[0] >= 0
+            && block.nextBlocks[0] != index
+            && block.instructions.size() == 1
+            && isPurePush(block.instructions[0]);
+}
+
+/**
+ * Makes jumps which target forwarding blocks to jump to their final destination.
+ * @param blocks
+ * @return true if any change has been made.
+ */
+bool threadJumps (OptBlocks& blocks)
+{
+    bool changed = false;
+    
+    for (size_t b = 0; b < blocks.size(); ++b)
+    {
+        OptBlock&   block = blocks[b];
+        int         targets[2];
+        
+        for (int k = 0; k < 2; ++k)
+        {
+            int target = block.nextBlocks[k];
+            
+            for (size_t steps = 0; steps < blocks.size() && isForwardingBlock(blocks, target); ++steps)
+                target = blocks[target].nextBlocks[0];
+            
+            targets[k] = target;
+        }
+        
+        //A conditional jump cannot be made unconditional, because condition 
+        //evaluation may call 'toBoolean' script functions.
+        if (!block.isUnconditional() && targets[0] == targets[1])
+            continue;
+        
+        if (targets[0] != block.nextBlocks[0] || targets[1] != block.nextBlocks[1])
+        {
+            block.nextBlocks[0] = targets[0];
+            block.nextBlocks[1] = targets[1];
+            changed = true;
+        }
+    }
+    
+    return changed;
+}
+
+/**
+ * Merges blocks with its successor, when the successor has no other predecessor
+ * and the block jumps unconditionally to it.
+ * @param blocks
+ * @return true if any change has been made.
+ */
+bool mergeBlocks (OptBlocks& blocks)
+{
+    vector<int> predecessors = countPredecessors(blocks);
+    bool        changed = false;
+    
+    for (size_t b = 0; b < blocks.size(); ++b)
+    {
+        OptBlock&   block = blocks[b];
+        
+        if (b > 0 && predecessors[b] == 0)
+            continue;
+        
+        while (block.isUnconditional())
+        {
+            const int next = block.nextBlocks[0];
+            
+            if (next <= 0 || next == (int)b || predecessors[next] != 1)
+                break;
+            
+            OptBlock&   nextBlock = blocks[next];
+            
+            //The value which was discarded at block end is now explicitly popped.
+            block.instructions.push_back(OptInstruction(OC_POP, -1, -1));
+            block.instructions.insert(block.instructions.end(), 
+                                      nextBlock.instructions.begin(),
+                                      nextBlock.instructions.end());
+            block.nextBlocks[0] = nextBlock.nextBlocks[0];
+            block.nextBlocks[1] = nextBlock.nextBlocks[1];
+            
+            nextBlock.instructions.clear();
+            nextBlock.nextBlocks[0] = nextBlock.nextBlocks[1] = -1;
+            predecessors[next] = 0;
+            changed = true;
+        }
+    }
+    
+    return changed;
+}
+
+/**
+ * Counts the predecessors of each block. Only reachable blocks are taken into
+ * account. Entry block has an implicit predecessor.
+ * @param blocks
+ * @return 
+ */
+vector<int> countPredecessors (const OptBlocks& blocks)
+{
+    vector<int>     result (blocks.size(), 0);
+    vector<bool>    visited (blocks.size(), false);
+    vector<int>     pending;
+    
+    result[0] = 1;
+    pending.push_back(0);
+    visited[0] = true;
+    
+    while (!pending.empty())
+    {
+        const int       b = pending.back();
+        const OptBlock& block = blocks[b];
+        
+        pending.pop_back();
+        
+        for (int k = 0; k < 2; ++k)
+        {
+            const int next = block.nextBlocks[k];
+            
+            if (next < 0 || (k == 1 && block.isUnconditional()))
+                continue;
+            
+            ++result[next];
+            if (!visited[next])
+            {
+                visited[next] = true;
+                pending.push_back(next);
+            }
+        }
+    }
+    
+    return result;
+}
+
+/**
+ * Removes unreachable blocks, and renumbers the remaining ones.
+ * @param blocks
+ */
+void removeUnreachable (OptBlocks& blocks)
+{
+    const vector<int>   predecessors = countPredecessors(blocks);
+    vector<int>         newIndexes (blocks.size(), -1);
+    OptBlocks           result;
+    
+    for (size_t b = 0; b < blocks.size(); ++b)
+    {
+        if (predecessors[b] > 0)
+        {
+            newIndexes[b] = (int)result.size();
+            result.push_back(blocks[b]);
+        }
+    }
+    
+    for (size_t b = 0; b < result.size(); ++b)
+    {
+        for (int k = 0; k < 2; ++k)
+        {
+            int& next = result[b].nextBlocks[k];
+            
+            if (next >= 0)
+                next = newIndexes[next];
+        }
+    }
+    
+    blocks.swap(result);
+}
+
+/**
+ * Rebuilds the position table of the routine, so each instruction keeps the
+ * script position it had before the optimization.
+ * @param routine
+ * @param blocks
+ */
+void rebuildPositions (Ref<MvmRoutine> routine, const OptBlocks& blocks)
+{
+    PositionTable   positions;
+    
+    for (size_t b = 0; b < blocks.size(); ++b)
+    {
+        const OptInstructions&  instructions = blocks[b].instructions;
+        int                     offset = 0;
+        
+        for (size_t i = 0; i < instructions.size(); ++i)
+        {
+            const OptInstruction&   inst = instructions[i];
+            
+            if (inst.srcBlock >= 0)
+            {
+                const ScriptPosition scPos = routine->positions.get(inst.srcBlock, inst.srcOffset);
+                positions.add((int)b, offset, scPos);
+            }
+            
+            offset += inst.is16bit() ? 2 : 1;
+        }
+    }
+    
+    routine->positions = positions;
+}
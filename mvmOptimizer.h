@@ -0,0 +1,19 @@
+/* 
+ * File:   mvmOptimizer.h
+ * Author: ghernan
+ * 
+ * Peephole and control flow optimizations over generated Micro VM code.
+ *
+ * Created on October 18, 2026, 4:05 PM
+ */
+
+#pragma once
+#ifndef MVMOPTIMIZER_H
+#define	MVMOPTIMIZER_H
+
+#include "microVM.h"
+
+void mvmOptimize (Ref<MvmRoutine> routine);
+
+#endif	/* MVMOPTIMIZER_H */
+
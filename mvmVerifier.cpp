@@ -0,0 +1,271 @@
+/*
+ * File:   mvmVerifier.cpp
+ * Author: ghernan
+ *
+ * Static verification of Micro VM routines.
+ *
+ * The verifier follows the control flow of a routine from its entry block,
+ * tracking the stack depth (relative to the frame parameters) at each
+ * instruction. It checks that:
+ *  - All op codes are valid. Jump instructions are only valid in flat code.
+ *  - Constant indexes are inside the constants table.
+ *  - Block exit targets are valid blocks, and all the predecessors of a block
+ * reach it with the same stack depth.
+ *  - Routine exits leave just the return value on the stack.
+ * It also computes the maximum stack depth of the routine, and how many 
+ * parameters it accesses directly on the stack (scripts access their 
+ * environment this way), which the caller shall provide.
+ *
+ * Created on October 18, 2026, 7:10 PM
+ */
+
+#include "ascript_pch.hpp"
+#include "mvmVerifier.h"
+
+#include <algorithm>
+
+using namespace std;
+
+/**
+ * Stack requirements of an instruction.
+ */
+struct StackEffect
+{
+    int needed = 0;     ///< Stack elements the instruction accesses.
+    int delta = 0;      ///< Stack size variation.
+
+    StackEffect (int _needed = 0, int _delta = 0) : needed(_needed), delta(_delta)
+    {}
+};
+
+static bool effect8 (int opCode, size_t nConstants, StackEffect* pEffect);
+static bool effect16 (int opCode, size_t nConstants, StackEffect* pEffect);
+static bool verifyError (std::string* pError, int block, size_t offset, const char* message);
+
+/**
+ * Verifies a routine. If it is correct, it is marked as verified, and its
+ * maximum stack depth and stack parameters are recorded.
+ * @param routine
+ * @param pError    [out] Optional. Receives the description of the first
+ * error found.
+ * @return true if the routine is correct.
+ */
+bool mvmVerify (Ref<MvmRoutine> routine, std::string* pError)
+{
+    const BlockVector&  blocks = routine->blocks;
+    const int           nBlocks = (int)blocks.size();
+    const size_t        nConstants = routine->constants.size();
+    vector<int>         entryDepth (nBlocks, -1);
+    vector<int>         pending;
+    int                 maxDepth = 0;
+    int                 stackParams = 0;
+
+    routine->verified = false;
+    routine->maxStack = 0;
+    routine->stackParams = 0;
+
+    if (nBlocks == 0)
+    {
+        routine->verified = true;
+        return true;
+    }
+
+    entryDepth[0] = 0;
+    pending.push_back(0);
+
+    while (!pending.empty())
+    {
+        const int           b = pending.back();
+        const MvmBlock&     block = blocks[b];
+        const ByteVector&   code = block.instructions;
+        int                 depth = entryDepth[b];
+
+        pending.pop_back();
+
+        for (size_t i = 0; i < code.size();)
+        {
+            const size_t    start = i;
+            StackEffect     effect;
+            bool            valid;
+
+            if (code[i] & OC_EXT_FLAG)
+            {
+                if (i + 1 >= code.size())
+                    return verifyError(pError, b, start, "Unexpected end of instruction");
+
+                valid = effect16 ((code[i] << 8) | code[i+1], nConstants, &effect);
+                i += 2;
+            }
+            else
+                valid = effect8 (code[i++], nConstants, &effect);
+
+            if (!valid)
+                return verifyError(pError, b, start, "Invalid instruction");
+
+            //Elements below the routine base are parameters.
+            stackParams = max (stackParams, effect.needed - depth);
+
+            depth += effect.delta;
+            maxDepth = max (maxDepth, depth);
+        }
+
+        //Block exits consume the value on the top of the stack (as condition,
+        //discarded value or return value).
+        for (int e = 0; e < 2; ++e)
+        {
+            const int next = block.nextBlocks[e];
+
+            if (next < 0)
+            {
+                if (depth != 1)
+                    return verifyError(pError, b, code.size(), "Unbalanced stack at routine exit");
+            }
+            else if (next >= nBlocks)
+                return verifyError(pError, b, code.size(), "Invalid block exit");
+            else if (depth < 1)
+                return verifyError(pError, b, code.size(), "Stack underflow at block exit");
+            else if (entryDepth[next] < 0)
+            {
+                entryDepth[next] = depth - 1;
+                pending.push_back(next);
+            }
+            else if (entryDepth[next] != depth - 1)
+                return verifyError(pError, b, code.size(), "Unbalanced stack at block exit");
+        }
+    }
+
+    routine->verified = true;
+    routine->maxStack = maxDepth;
+    routine->stackParams = stackParams;
+    return true;
+}
+
+/**
+ * Gets the stack effect of an 8 bit instruction.
+ * @param opCode
+ * @param nConstants    Size of the routine constants table.
+ * @param pEffect       [out]
+ * @return false if it is not a valid instruction.
+ */
+static bool effect8 (int opCode, size_t nConstants, StackEffect* pEffect)
+{
+    if (opCode >= OC_PUSHC)
+    {
+        *pEffect = StackEffect(0, 1);
+        return size_t(opCode - OC_PUSHC) < nConstants;
+    }
+    else if (opCode <= OC_CALL_MAX)
+    {
+        const int nArgs = opCode - OC_CALL;
+
+        *pEffect = StackEffect(nArgs + 1, -nArgs);
+        return true;
+    }
+    else if (opCode <= OC_CP_MAX)
+    {
+        *pEffect = StackEffect(opCode - OC_CP + 1, 1);
+        return true;
+    }
+    else if (opCode <= OC_WR_MAX)
+    {
+        *pEffect = StackEffect(opCode - OC_WR + 2, 0);
+        return true;
+    }
+
+    switch (opCode)
+    {
+    case OC_NOP:            *pEffect = StackEffect(0, 0);   break;
+    case OC_NUM_PARAMS:
+    case OC_PUSH_THIS:      *pEffect = StackEffect(0, 1);   break;
+    case OC_POP:            *pEffect = StackEffect(1, -1);  break;
+    case OC_WR_THISP:
+    case OC_RD_PARAM:
+    case OC_RD_GLOBAL:
+    case OC_RD_CAPTURE:
+    case OC_NEW_BOX:
+    case OC_RD_BOX:         *pEffect = StackEffect(1, 0);   break;
+    case OC_SWAP:           *pEffect = StackEffect(2, 0);   break;
+    case OC_RD_FIELD:
+    case OC_RD_INDEX:
+    case OC_WR_PARAM:
+    case OC_WR_GLOBAL:
+    case OC_NEW_CONST_GLOBAL:
+    case OC_WR_BOX:
+    case OC_ADD:
+    case OC_SUB:
+    case OC_MUL:
+    case OC_DIV:
+    case OC_LT:
+    case OC_LE:
+    case OC_ADD_NUM:
+    case OC_SUB_NUM:
+    case OC_MUL_NUM:
+    case OC_DIV_NUM:
+    case OC_LT_NUM:
+    case OC_LE_NUM:         *pEffect = StackEffect(2, -1);  break;
+    case OC_WR_FIELD:
+    case OC_WR_INDEX:
+    case OC_NEW_CONST_FIELD:*pEffect = StackEffect(3, -2);  break;
+    default:
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Gets the stack effect of a 16 bit instruction.
+ * @param opCode        Including 16 bit flag.
+ * @param nConstants    Size of the routine constants table.
+ * @param pEffect       [out]
+ * @return false if it is not a valid instruction.
+ */
+static bool effect16 (int opCode, size_t nConstants, StackEffect* pEffect)
+{
+    if (opCode & OC16_32BIT_FLAG)
+        return false;
+
+    const int decoded = opCode & 0x3FFF;
+
+    if (decoded >= OC16_PUSHC)
+    {
+        *pEffect = StackEffect(0, 1);
+        return size_t(decoded - (OC16_PUSHC - 64)) < nConstants;
+    }
+    else if (decoded <= OC16_CALL_MAX)
+    {
+        const int nArgs = (OC_CALL_MAX - OC_CALL) + 1 + (decoded - OC16_CALL);
+
+        *pEffect = StackEffect(nArgs + 1, -nArgs);
+    }
+    else if (decoded <= OC16_CP_MAX)
+        *pEffect = StackEffect((decoded - OC16_CP) + (OC_CP_MAX - OC_CP) + 2, 1);
+    else if (decoded <= OC16_WR_MAX)
+        *pEffect = StackEffect((decoded - OC16_WR) + (OC_WR_MAX - OC_WR) + 3, 0);
+    else
+        return false;
+
+    return true;
+}
+
+/**
+ * Reports a verification error.
+ * @param pError    [out] Can be NULL.
+ * @param block
+ * @param offset
+ * @param message
+ * @return Always false.
+ */
+static bool verifyError (std::string* pError, int block, size_t offset, const char* message)
+{
+    if (pError != NULL)
+    {
+        char buffer[256];
+
+        snprintf (buffer, sizeof(buffer), "%s (block: %d, offset: %d)",
+                  message, block, (int)offset);
+        *pError = buffer;
+    }
+
+    return false;
+}
@@ -0,0 +1,20 @@
+/*
+ * File:   mvmVerifier.h
+ * Author: ghernan
+ *
+ * Static verification of Micro VM routines. Verified routines are executed
+ * without run time stack checks.
+ *
+ * Created on October 18, 2026, 7:10 PM
+ */
+
+#pragma once
+#ifndef MVMVERIFIER_H
+#define	MVMVERIFIER_H
+
+#include "microVM.h"
+
+bool mvmVerify (Ref<MvmRoutine> routine, std::string* pError = NULL);
+
+#endif	/* MVMVERIFIER_H */
+
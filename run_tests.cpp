@@ -8,6 +8,7 @@
 #include "mvmCodegen.h"
 #include "jsParser.h"
 #include "semanticCheck.h"
+#include "astOptimizer.h"
 #include "TinyJS_Functions.h"
 //#include "actorRuntime.h"
 #include "jsArray.h"
@@ -149,6 +150,37 @@ ASValue expectError(ExecutionContext* ec)
     return jsFalse();
 }
 
+/**
+ * Runs some code as a top level script, with its own actor system, configured
+ * with the given options. Errors raised by the script or its actors make the 
+ * calling test fail.
+ * @param ec
+ * @return 
+ */
+ASValue runScript(ExecutionContext* ec)
+{
+    string      code =  ec->getParam(0).toString(ec);
+    auto        params = ec->getParam(1);
+    EvalOptions options;
+    auto        globals = createDefaultGlobals();
+    
+    if (!params.isNull())
+    {
+        const double    drainQuota = params.readField("drainQuota").toDouble();
+        const double    actorThreads = params.readField("actorThreads").toDouble();
+        
+        if (drainQuota > 0)
+            options.drainQuota = (size_t)drainQuota;
+        if (actorThreads > 0)
+            options.actorThreads = (int)actorThreads;
+    }
+    
+    addNative("function assert(value, text)", assertFunction, globals);
+    evaluate (code.c_str(), globals, ec->modulePath, NULL, options);
+    
+    return jsTrue();
+}
+
 
 /**
  * Function to write on standard output
@@ -228,9 +260,11 @@ ASValue asParse(ExecutionContext* ec)
  * @param szFile        Path to the test script.
  * @param testDir       Directory in which the test script is located.
  * @param resultsDir    Directory in which tests results are written
+ * @param options       Code generation options.
  * @return 
  */
-bool run_test(const std::string& szFile, const string &testDir, const string& resultsDir)
+bool run_test(const std::string& szFile, const string &testDir, const string& resultsDir,
+              const CodegenOptions& options)
 {
     printf("TEST %s ", szFile.c_str());
     
@@ -252,6 +286,7 @@ bool run_test(const std::string& szFile, const string &testDir, const string& re
     addNative("function assert(value, text)", assertFunction, globals);
     addNative("function printLn(text)", printLn, globals);
     addNative("function expectError(code)", expectError, globals);
+    addNative("function runScript(code, options)", runScript, globals);
     addNative("function asParse(code)", asParse, globals);
     addNative("function enableCallLog()", enableCallLog, globals);
     addNative("function enableTraceLog()", enableTraceLog, globals);
@@ -271,10 +306,12 @@ bool run_test(const std::string& szFile, const string &testDir, const string& re
         
         //Semantic analysis
         semanticCheck(ast);
+        
+        //Optimization
+        optimizeAst(ast);
 
         //Code generation.
-        CodeMap                 cMap;
-        const Ref<MvmRoutine>   code = scriptCodegen(ast, &cMap);
+        const Ref<MvmRoutine>   code = scriptCodegen(ast, globals, options);
 
         //Write disassembly
         writeTextFile(testResultsDir + testName + ".asm.json", mvmDisassembly(code));
@@ -289,7 +326,7 @@ bool run_test(const std::string& szFile, const string &testDir, const string& re
         resetFile (s_traceLoggerPath.c_str());
 
         //Execution
-        evaluate (code, &cMap, globals, szFile, NULL);
+        evaluate (code, globals, szFile, NULL);
 
         auto result = globals->readField("result");
         if (result.toString() != "exception")
@@ -327,6 +364,18 @@ int main(int argc, char **argv)
     const string testsDir = "./tests/";
     const string resultsDir = "./tests/results/";
     
+    //Tests are run with the direct code generator, and with the SSA pipeline
+    //compiling functions in parallel. The results of each are written in
+    //its own directory.
+    CodegenOptions  ssaOptions;
+    
+    ssaOptions.pipeline = CGP_SSA;
+    ssaOptions.threads = 4;
+    
+    const CodegenOptions    pipelines[] = {CodegenOptions(), ssaOptions};
+    const string            pipelineNames[] = {"direct", "ssa"};
+    const int               nPipelines = 2;
+    
     printf("TinyJS test runner\n");
     printf("USAGE:\n");
     printf("   ./run_tests test.js       : run just one test\n");
@@ -335,33 +384,45 @@ int main(int argc, char **argv)
     {
         printf("Running test: %s\n", argv[1]);
         
-        return !run_test(testsDir + argv[1], testsDir, resultsDir);
+        bool pass = true;
+        for (int i = 0; i < nPipelines; i++)
+        {
+            printf("Pipeline: %s\n", pipelineNames[i].c_str());
+            pass = run_test(testsDir + argv[1], testsDir, 
+                            resultsDir + pipelineNames[i] + '/', pipelines[i]) && pass;
+        }
+        return !pass;
     }
     else
         printf("Running all tests!\n");
 
-    int test_num = 1;
     int count = 0;
     int passed = 0;
     
     //TODO: Run all tests in the directory (or even in subdirectories). Do not depend
     //on test numbers.
 
-    while (test_num < 1000)
+    for (int i = 0; i < nPipelines; i++)
     {
-        char name[32];
-        sprintf_s(name, "test%03d.js", test_num);
-        
-        const string    szPath = testsDir + name;
-        // check if the file exists - if not, assume we're at the end of our tests
-        FILE *f = fopen(szPath.c_str(), "r");
-        if (!f) break;
-        fclose(f);
-
-        if (run_test(szPath, testsDir, resultsDir))
-            passed++;
-        count++;
-        test_num++;
+        printf("Pipeline: %s\n", pipelineNames[i].c_str());
+
+        int test_num = 1;
+        while (test_num < 1000)
+        {
+            char name[32];
+            sprintf_s(name, "test%03d.js", test_num);
+
+            const string    szPath = testsDir + name;
+            // check if the file exists - if not, assume we're at the end of our tests
+            FILE *f = fopen(szPath.c_str(), "r");
+            if (!f) break;
+            fclose(f);
+
+            if (run_test(szPath, testsDir, resultsDir + pipelineNames[i] + '/', pipelines[i]))
+                passed++;
+            count++;
+            test_num++;
+        }
     }
 
     printf("Done. %d tests, %d pass, %d fail\n", count, passed, count - passed);
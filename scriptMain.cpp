@@ -16,10 +16,12 @@
 #include "TinyJS_MathFunctions.h"
 #include "mvmFunctions.h"
 #include "semanticCheck.h"
+#include "astOptimizer.h"
 #include "asObjects.h"
 #include "ScriptException.h"
 #include "utils.h"
 #include "modules.h"
+#include "actorRuntime.h"
 
 using namespace std;
 
@@ -27,6 +29,52 @@ using namespace std;
 //////////////////////////////////////////
 StringVector parseArgumentList(CScriptToken token);
 
+/**
+ * Reads a positive integer from an environment variable.
+ * @param name
+ * @return The value, or zero if it is not defined or not valid.
+ */
+static long positiveEnvInteger (const char* name)
+{
+    const char* text = getenv(name);
+    char*       end = NULL;
+    
+    if (text == NULL)
+        return 0;
+    
+    const long  value = strtol(text, &end, 10);
+    
+    if (end == text || *end != 0 || value <= 0)
+        return 0;
+    else
+        return value;
+}
+
+/**
+ * Reads evaluation options from environment variables:
+ * - 'ASCRIPT_PIPELINE': Code generation pipeline, 'direct' or 'ssa'.
+ * - 'ASCRIPT_CODEGEN_THREADS': Threads which compile functions in parallel.
+ * - 'ASCRIPT_DRAIN_QUOTA': Actor runtime drain quota.
+ * - 'ASCRIPT_ACTOR_THREADS': Actor runtime worker threads.
+ * Missing or invalid values leave the defaults.
+ * @return 
+ */
+EvalOptions evalOptionsFromEnvironment()
+{
+    EvalOptions options;
+    const char* pipeline = getenv("ASCRIPT_PIPELINE");
+    const long  codegenThreads = positiveEnvInteger("ASCRIPT_CODEGEN_THREADS");
+    
+    if (pipeline != NULL && string(pipeline) == "ssa")
+        options.codegen.pipeline = CGP_SSA;
+    if (codegenThreads > 0)
+        options.codegen.threads = (int)codegenThreads;
+    options.drainQuota = (size_t)positiveEnvInteger("ASCRIPT_DRAIN_QUOTA");
+    options.actorThreads = (int)positiveEnvInteger("ASCRIPT_ACTOR_THREADS");
+    
+    return options;
+}
+
 /**
  * Script evaluation function. Runs a script, and returns its result.
  *
@@ -46,12 +94,14 @@ ASValue evaluate (const char* script, Ref<JSObject> globals)
  * @param globals   Global symbols
  * @param scriptPath
  * @param parentEC
+ * @param options
  * @return 
  */
 ASValue evaluate (const char* script, 
                   Ref<JSObject> globals, 
                   const std::string& scriptPath, 
-                  ExecutionContext* parentEC)
+                  ExecutionContext* parentEC,
+                  const EvalOptions& options)
 {
     CScriptToken    token (script);
     
@@ -62,62 +112,89 @@ ASValue evaluate (const char* script,
     //Semantic check
     semanticCheck(ast);
     
+    //Optimization
+    optimizeAst(ast);
+    
     //Code generation.
-    CodeMap                 cMap;
-    const Ref<MvmRoutine>   code = scriptCodegen(ast, &cMap);
+    const Ref<MvmRoutine>   code = scriptCodegen(ast, globals, options.codegen);
     
     //Execution
-    return evaluate (code, &cMap, globals, scriptPath, parentEC);
+    return evaluate (code, globals, scriptPath, parentEC, options);
 }
 
 /**
  * Evaluates a compiled script.
  * @param code
- * @param codeMap
  * @param globals
+ * @param scriptPath
+ * @param parentEC
+ * @param options
  * @return 
  */
 ASValue evaluate (Ref<MvmRoutine> code, 
-                  const CodeMap* codeMap, 
                   Ref<JSObject> globals,
                   const std::string& scriptPath,
-                  ExecutionContext* parentEC)
+                  ExecutionContext* parentEC,
+                  const EvalOptions& options)
 {
-    try
+    string path;
+
+    if (scriptPath.empty())
+        path = getCurrentDirectory();
+    else
+        path = normalizePath(scriptPath);
+    
+    Modules             mods;
+    ExecutionContext    newEC (path, parentEC != NULL ? parentEC->modules : &mods);
+    Ref<ActorRuntime>   actors;
+    ASValue             result;
+
+    if (parentEC == NULL)
     {
-        string path;
+        size_t  drainQuota = ActorRuntime::DEFAULT_DRAIN_QUOTA;
         
-        if (scriptPath.empty())
-            path = getCurrentDirectory();
-        else
-            path = normalizePath(scriptPath);
+        if (options.drainQuota > 0)
+            drainQuota = options.drainQuota;
         
-        if (parentEC == NULL)
-        {
-            Modules             mods;
-            ExecutionContext    newEC (path, &mods);
-            
-            mods.modules[path] = globals->value();
-            newEC.stack.push_back(globals->value());
-            return mvmExecRoutine(code, &newEC, 1);
-        }
-        else
-        {
-            ExecutionContext    newEC (path, parentEC->modules);
-            
-            newEC.stack.push_back(globals->value());
-            return mvmExecRoutine(code, &newEC, 1);
-        }
+        mods.modules[path] = globals->value();
+        actors = ActorRuntime::create(path, &mods, options.actorThreads, drainQuota);
+        newEC.actors = actors.getPointer();
+    }
+    else
+    {
+        newEC.actors = parentEC->actors;
+        newEC.curActor = parentEC->curActor;
+    }
+    newEC.stack.push_back(globals->value());
+    
+    try
+    {
+        result = mvmExecRoutine(code, &newEC, 1);
     }
     catch (const RuntimeError& e)
     {
-        ScriptPosition pos;
+        //Errors are located from the frames left by the failed execution.
+        VmPosition  pos = e.Position;
         
-        if (codeMap != NULL)
-            pos = codeMap->get(e.Position);
-        errorAt(pos, "%s", e.what());
+        if (pos.Routine.isNull())
+            pos = mvmCurrentPosition(&newEC);
+        
+        errorAt(mvmSourcePosition(pos), "%s", e.what());
         return jsNull();        //Not executed
     }
+    
+    //Actors created by the script run until they have no messages left.
+    if (actors.notNull())
+    {
+        string          message;
+        ScriptPosition  pos;
+        
+        actors->run();
+        if (actors->getError(&message, &pos))
+            errorAt(pos, "%s", message.c_str());
+    }
+    
+    return result;
 }
 
 
@@ -127,11 +204,25 @@ ASValue evaluate (Ref<MvmRoutine> code,
  */
 Ref<JSObject> createDefaultGlobals()
 {
-    auto    globals = JSObject::create();
+    auto    globals = JSModule::create();
     
     registerMvmFunctions(globals);
     registerFunctions(globals);
     registerMathFunctions(globals);
+    registerActorFunctions(globals);
+    
+    //Native namespaces ('Math', 'JSON'...) are frozen, so the code generator 
+    //can resolve their functions at compile time. As their members are native
+    //functions, they become deep-frozen: scripts cannot add or replace their
+    //members, and writes to them are ignored, as with any frozen object.
+    auto fields = globals->getFields(false);
+    for (auto it = fields.begin(); it != fields.end(); ++it)
+    {
+        ASValue value = globals->readField(*it);
+        
+        if (value.getType() == VT_OBJECT && !globals->isWritable(*it))
+            value.staticCast<JSObject>()->setFrozen();
+    }
     
     return globals;
 }
@@ -14,24 +14,45 @@
 
 #include "jsVars.h"
 #include "asObjects.h"
+#include "mvmCodegen.h"
 #include <string>
 
 class MvmRoutine;
 struct ExecutionContext;
 typedef void (*TraceFN)(int opCode, const ExecutionContext* ec);
 
+/**
+ * Script evaluation options. Actor runtime options only apply to top level 
+ * scripts, which start the actor system.
+ */
+struct EvalOptions
+{
+    //How the script code is generated.
+    CodegenOptions  codegen;
+    
+    //Maximum number of messages processed each time an actor runs. If zero,
+    //the actor runtime default is used.
+    size_t  drainQuota = 0;
+    
+    //Actor runtime worker threads. If zero, one per hardware thread.
+    int     actorThreads = 0;
+};
+
+EvalOptions evalOptionsFromEnvironment();
+
 ASValue    evaluate (const char* script, Ref<JSObject> globals);
 
 ASValue    evaluate (const char* script, 
                      Ref<JSObject> globals, 
                      const std::string& scriptPath, 
-                     ExecutionContext *ec);
+                     ExecutionContext *ec,
+                     const EvalOptions& options = evalOptionsFromEnvironment());
 
 ASValue    evaluate (Ref<MvmRoutine> code, 
-                     const CodeMap* codeMap, 
                      Ref<JSObject> globals,
                      const std::string& scriptPath,
-                     ExecutionContext* parentEC);
+                     ExecutionContext* parentEC,
+                     const EvalOptions& options = evalOptionsFromEnvironment());
 
 Ref<JSObject> createDefaultGlobals();
 
@@ -15,6 +15,7 @@
 #include <string>
 #include <set>
 #include <vector>
+#include <mutex>
 
 using namespace std;
 
@@ -88,8 +89,9 @@ void semanticCheck(Ref<AstNode> script)
 void semCheck (Ref<AstNode> node, SemCheckState* pState)
 {
     static SemcheckFN types[AST_TYPES_COUNT] = {NULL, NULL};
+    static std::once_flag initialized;
     
-    if (types [0] == NULL)
+    std::call_once (initialized, []()
     {
         types [AST_SCRIPT] = childrenSemCheck;
         types [AST_BLOCK] = childrenSemCheck;
@@ -121,7 +123,7 @@ void semCheck (Ref<AstNode> node, SemCheckState* pState)
         types [AST_EXTENDS] = childrenSemCheck;
         types [AST_EXPORT] = exportSemCheck;
         types [AST_IMPORT] = importSemCheck;
-    }
+    });
 
     pState->nodeStack.push_back(node);
     types[node->getType()](node, pState);
@@ -302,14 +304,15 @@ void importSemCheck (Ref<AstNode> node, SemCheckState* pState)
 void checkReservedNames (const std::string& name, ScriptPosition pos, const char* errorMsg)
 {
     static set <string>     reserved;
+    static std::once_flag   initialized;
     
-    if (reserved.empty())
+    std::call_once (initialized, []()
     {
         //TODO: probably 'this' would need more checks.
         reserved.insert("this");
         reserved.insert("arguments");
         reserved.insert("eval");
-    }
+    });
     
     if (reserved.count(name) > 0)
         errorAt(pos, errorMsg, name.c_str());
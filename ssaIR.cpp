@@ -0,0 +1,1173 @@
+/*
+ * File:   ssaIR.cpp
+ * Author: ghernan
+ *
+ * SSA (static single assignment) intermediate representation of functions.
+ *
+ * The builder translates a function AST into SSA form directly, with the
+ * algorithm described in 'Simple and Efficient Construction of Static Single
+ * Assignment Form' (Braun et al.): each block records the last value written
+ * to each local variable, and reads of variables not written in the block
+ * look for their value in the predecessors, creating 'phi' values on joins.
+ *
+ * Only a subset of the language is supported: functions which declare
+ * nested functions or classes, or which access variables of the enclosing
+ * functions, are not translated and use the direct code generator.
+ *
+ * Created on October 18, 2026, 5:20 PM
+ */
+
+#include "ascript_pch.hpp"
+#include "ssaIR.h"
+#include "jsLexer.h"
+#include "mvmCodegen.h"
+
+#include <sstream>
+#include <algorithm>
+
+using namespace std;
+
+/**
+ * Translates a function AST into SSA form.
+ */
+class SsaBuilder
+{
+public:
+    SsaBuilder (Ref<AstFunction> node, SsaGlobalFilter isGlobal)
+    : m_fn(SsaFunction::create(node)), m_isGlobal(isGlobal)
+    {}
+
+    Ref<SsaFunction> build();
+
+private:
+    int     statement (Ref<AstNode> node);
+    int     expression (Ref<AstNode> node);
+
+    int     blockStatement (Ref<AstNode> node);
+    int     varStatement (Ref<AstNode> node);
+    int     ifStatement (Ref<AstNode> node);
+    int     forStatement (Ref<AstNode> node);
+    int     returnStatement (Ref<AstNode> node);
+
+    int     identifier (Ref<AstNode> node);
+    int     assignment (Ref<AstNode> node);
+    int     assignment (Ref<AstNode> node, int op, Ref<AstNode> lexpr, int rvalue);
+    int     functionCall (Ref<AstNode> node);
+    int     binaryOp (Ref<AstNode> node);
+    int     logicalOp (Ref<AstNode> node, int opCode);
+    int     conditional (Ref<AstNode> node);
+    int     prefixOp (Ref<AstNode> node);
+    int     postfixOp (Ref<AstNode> node);
+
+    int     value (SsaOpCode op, const ScriptPosition& pos);
+    int     value (SsaOpCode op, const ScriptPosition& pos, int a);
+    int     value (SsaOpCode op, const ScriptPosition& pos, int a, int b);
+    int     binary (int opCode, const ScriptPosition& pos, int a, int b);
+    int     nullValue (const ScriptPosition& pos);
+    int     phi (int block, const ScriptPosition& pos);
+
+    int     newBlock ();
+    void    jump (int target);
+    void    branch (int condition, int trueTarget, int falseTarget);
+    void    sealBlock (int block);
+
+    void    declareVar (const string& name, int value);
+    int     findVar (const string& name)const;
+    void    writeVar (int var, int block, int value);
+    int     readVar (int var, int block, const ScriptPosition& pos);
+    int     readVarRecursive (int var, int block, const ScriptPosition& pos);
+    void    addPhiOperands (int var, int phi);
+
+    //Unsupported constructs abort the translation.
+    struct Unsupported {};
+
+    Ref<SsaFunction>        m_fn;
+    SsaGlobalFilter         m_isGlobal;
+    int                     m_curBlock = 0;
+
+    vector< map<int, int> > m_definitions;      //Per block: variable -> value
+    vector< map<int, int> > m_incompletePhis;   //Per block: variable -> phi
+    vector<bool>            m_sealed;
+    vector< map<string, int> >  m_scopes;       //name -> variable
+    int                     m_nVars = 0;
+};
+
+/**
+ * Translates a function to SSA form.
+ * @param node
+ * @param isGlobal  Tells which non-local names can be accessed as globals.
+ * @return The function in SSA form, or a NULL pointer if it uses constructs
+ * not supported by the SSA builder.
+ */
+Ref<SsaFunction> ssaBuildFunction (Ref<AstFunction> node, SsaGlobalFilter isGlobal)
+{
+    SsaBuilder  builder (node, isGlobal);
+
+    return builder.build();
+}
+
+/**
+ * Builds the SSA function.
+ * @return
+ */
+Ref<SsaFunction> SsaBuilder::build()
+{
+    auto& params = m_fn->node->getParams();
+
+    try
+    {
+        m_curBlock = newBlock();
+        sealBlock(m_curBlock);
+        m_scopes.push_back(map<string, int>());
+
+        for (size_t i = 0; i < params.size(); ++i)
+        {
+            const int p = value(SSA_PARAM, m_fn->node->position());
+            m_fn->values[p].index = (int)i;
+            declareVar(params[i], p);
+        }
+
+        //Function code result is the function result, if there is no 'return'.
+        const int result = statement(m_fn->node->getCode());
+        SsaBlock& block = m_fn->blocks[m_curBlock];
+
+        block.exitType = SSA_EXIT_RETURN;
+        block.exitValue = result;
+    }
+    catch (Unsupported&)
+    {
+        return Ref<SsaFunction>();
+    }
+
+    return m_fn;
+}
+
+/**
+ * Translates a statement.
+ * @param node
+ * @return Statement value. Non-expression statements evaluate to 'null'.
+ */
+int SsaBuilder::statement (Ref<AstNode> node)
+{
+    if (node.isNull())
+        return nullValue(m_fn->node->position());
+
+    switch (node->getType())
+    {
+    case AST_BLOCK:     return blockStatement(node);
+    case AST_VAR:
+    case AST_CONST:     return varStatement(node);
+    case AST_IF:        return ifStatement(node);
+    case AST_FOR:       return forStatement(node);
+    case AST_RETURN:    return returnStatement(node);
+    default:            return expression(node);
+    }
+}
+
+/**
+ * Translates an expression.
+ * @param node
+ * @return Expression value.
+ */
+int SsaBuilder::expression (Ref<AstNode> node)
+{
+    const ScriptPosition    pos = node->position();
+    auto&                   children = node->children();
+
+    switch (node->getType())
+    {
+    case AST_LITERAL:
+        return m_fn->addConstant(node->getValue(), m_curBlock, pos);
+
+    case AST_IDENTIFIER:    return identifier(node);
+    case AST_ASSIGNMENT:    return assignment(node);
+    case AST_FNCALL:        return functionCall(node);
+    case AST_CONDITIONAL:   return conditional(node);
+    case AST_BINARYOP:      return binaryOp(node);
+    case AST_PREFIXOP:      return prefixOp(node);
+    case AST_POSTFIXOP:     return postfixOp(node);
+
+    case AST_ARRAY_ACCESS:
+        {
+            const int array = expression(children[0]);
+            return value (SSA_RD_INDEX, pos, array, expression(children[1]));
+        }
+
+    case AST_MEMBER_ACCESS:
+        {
+            const int v = value (SSA_RD_FIELD, pos, expression(children[0]));
+            m_fn->values[v].name = children[1]->getName();
+            return v;
+        }
+
+    default:
+        throw Unsupported();
+    }
+}
+
+/**
+ * Translates a block of statements.
+ * @param node
+ * @return
+ */
+int SsaBuilder::blockStatement (Ref<AstNode> node)
+{
+    auto& children = node->children();
+
+    m_scopes.push_back(map<string, int>());
+    for (auto it = children.begin(); it != children.end(); ++it)
+    {
+        if (it->notNull())
+            statement(*it);
+    }
+    m_scopes.pop_back();
+
+    return nullValue(node->position());
+}
+
+/**
+ * Translates a variable or constant declaration.
+ * @param node
+ * @return
+ */
+int SsaBuilder::varStatement (Ref<AstNode> node)
+{
+    int initValue;
+
+    if (node->childExists(0))
+        initValue = expression(node->children()[0]);
+    else
+        initValue = nullValue(node->position());
+
+    declareVar(node->getName(), initValue);
+    return nullValue(node->position());
+}
+
+/**
+ * Translates an 'if' statement.
+ * @param node
+ * @return
+ */
+int SsaBuilder::ifStatement (Ref<AstNode> node)
+{
+    const int condition = expression(node->children()[0]);
+    const int thenBlock = newBlock();
+    const int nextBlock = newBlock();
+    int       elseBlock = nextBlock;
+
+    if (node->childExists(2))
+        elseBlock = newBlock();
+
+    branch (condition, thenBlock, elseBlock);
+    sealBlock(thenBlock);
+
+    m_curBlock = thenBlock;
+    statement(node->children()[1]);
+    jump(nextBlock);
+
+    if (elseBlock != nextBlock)
+    {
+        sealBlock(elseBlock);
+        m_curBlock = elseBlock;
+        statement(node->children()[2]);
+        jump(nextBlock);
+    }
+
+    sealBlock(nextBlock);
+    m_curBlock = nextBlock;
+
+    return nullValue(node->position());
+}
+
+/**
+ * Translates a 'for' loop (also used for 'while' loops)
+ * @param node
+ * @return
+ */
+int SsaBuilder::forStatement (Ref<AstNode> node)
+{
+    auto&   children = node->children();
+
+    m_scopes.push_back(map<string, int>());
+    if (node->childExists(0))
+        statement(children[0]);
+
+    const int conditionBlock = newBlock();
+    const int bodyBlock = newBlock();
+    const int nextBlock = newBlock();
+
+    jump (conditionBlock);
+    m_curBlock = conditionBlock;
+
+    int condition;
+    if (node->childExists(1))
+        condition = expression(children[1]);
+    else
+        condition = m_fn->addConstant(jsTrue(), m_curBlock, node->position());
+
+    branch (condition, bodyBlock, nextBlock);
+    sealBlock(bodyBlock);
+
+    m_curBlock = bodyBlock;
+    if (node->childExists(3))
+        statement(children[3]);
+    if (node->childExists(2))
+        statement(children[2]);
+    jump (conditionBlock);
+
+    //The condition block is not sealed until the back edge is known.
+    sealBlock(conditionBlock);
+    sealBlock(nextBlock);
+    m_curBlock = nextBlock;
+    m_scopes.pop_back();
+
+    return nullValue(node->position());
+}
+
+/**
+ * Translates a 'return' statement.
+ * @param node
+ * @return
+ */
+int SsaBuilder::returnStatement (Ref<AstNode> node)
+{
+    int result;
+
+    if (node->childExists(0))
+        result = expression(node->children()[0]);
+    else
+        result = nullValue(node->position());
+
+    SsaBlock& block = m_fn->blocks[m_curBlock];
+    block.exitType = SSA_EXIT_RETURN;
+    block.exitValue = result;
+
+    //Code after 'return' goes to an unreachable block.
+    m_curBlock = newBlock();
+    sealBlock(m_curBlock);
+
+    return nullValue(node->position());
+}
+
+/**
+ * Translates an identifier read.
+ * @param node
+ * @return
+ */
+int SsaBuilder::identifier (Ref<AstNode> node)
+{
+    const string    name = node->getName();
+    const int       var = findVar(name);
+
+    if (var >= 0)
+        return readVar(var, m_curBlock, node->position());
+    else if (name == "this")
+        return value(SSA_THIS, node->position());
+    else if (m_isGlobal(name))
+    {
+        const int v = value(SSA_RD_GLOBAL, node->position());
+        m_fn->values[v].name = name;
+        return v;
+    }
+    else
+        throw Unsupported();
+}
+
+/**
+ * Translates an assignment expression.
+ * @param node
+ * @return
+ */
+int SsaBuilder::assignment (Ref<AstNode> node)
+{
+    const int   opCode = node.staticCast<AstOperator>()->code;
+    const int   op = opCode == '=' ? '=' : opCode - LEX_ASSIGN_BASE;
+    auto        lexpr = node->children()[0];
+
+    if (lexpr->getType() == AST_IDENTIFIER)
+        return assignment(node, op, lexpr, -1);
+
+    //Object and index are evaluated before the right side.
+    const int object = expression(lexpr->children()[0]);
+
+    if (lexpr->getType() == AST_MEMBER_ACCESS)
+    {
+        const string    field = lexpr->children()[1]->getName();
+        int             result;
+
+        if (op == '=')
+            result = expression(node->children()[1]);
+        else
+        {
+            const int lvalue = value(SSA_RD_FIELD, node->position(), object);
+
+            m_fn->values[lvalue].name = field;
+            result = binary(op, node->position(), lvalue, expression(node->children()[1]));
+        }
+
+        const int write = value(SSA_WR_FIELD, node->position(), object, result);
+        m_fn->values[write].name = field;
+        return write;
+    }
+    else if (lexpr->getType() == AST_ARRAY_ACCESS)
+    {
+        const int   index = expression(lexpr->children()[1]);
+        int         result;
+
+        if (op == '=')
+            result = expression(node->children()[1]);
+        else
+        {
+            const int lvalue = value(SSA_RD_INDEX, node->position(), object, index);
+            result = binary(op, node->position(), lvalue, expression(node->children()[1]));
+        }
+
+        const int write = value(SSA_WR_INDEX, node->position(), object, index);
+        m_fn->values[write].args.push_back(result);
+        return write;
+    }
+    else
+        throw Unsupported();
+}
+
+/**
+ * Translates an assignment to a variable.
+ * @param node      Node, for its position.
+ * @param op        '=' or binary operator.
+ * @param lexpr     Identifier node.
+ * @param rvalue    Right side value. If (-1), it is the right child of 'node'
+ * @return
+ */
+int SsaBuilder::assignment (Ref<AstNode> node, int op, Ref<AstNode> lexpr, int rvalue)
+{
+    const ScriptPosition    pos = node->position();
+    const string            name = lexpr->getName();
+    const int               var = findVar(name);
+    int                     result;
+
+    if (var < 0 && (name == "this" || !m_isGlobal(name)))
+        throw Unsupported();
+
+    if (op == '=')
+        result = rvalue >= 0 ? rvalue : expression(node->children()[1]);
+    else
+    {
+        const int lvalue = identifier(lexpr);
+
+        if (rvalue < 0)
+            rvalue = expression(node->children()[1]);
+        result = binary(op, pos, lvalue, rvalue);
+    }
+
+    if (var >= 0)
+    {
+        writeVar(var, m_curBlock, result);
+        return result;
+    }
+    else
+    {
+        const int write = value(SSA_WR_GLOBAL, pos, result);
+        m_fn->values[write].name = name;
+        return write;
+    }
+}
+
+/**
+ * Translates a function call. Calls through a member access expression are
+ * method calls, which receive a 'this' reference.
+ * @param node
+ * @return
+ */
+int SsaBuilder::functionCall (Ref<AstNode> node)
+{
+    auto&       children = node->children();
+    auto        fnExpr = children[0];
+    vector<int> args;
+
+    for (size_t i = 1; i < children.size(); ++i)
+        args.push_back(expression(children[i]));
+
+    int call;
+
+    if (fnExpr->getType() == AST_MEMBER_ACCESS)
+    {
+        args.push_back(expression(fnExpr->children()[0]));
+        call = value(SSA_METHOD_CALL, node->position());
+        m_fn->values[call].name = fnExpr->children()[1]->getName();
+    }
+    else
+    {
+        args.push_back(expression(fnExpr));
+        call = value(SSA_CALL, node->position());
+    }
+
+    m_fn->values[call].args = args;
+    return call;
+}
+
+/**
+ * Translates a binary operator.
+ * @param node
+ * @return
+ */
+int SsaBuilder::binaryOp (Ref<AstNode> node)
+{
+    const int opCode = node.staticCast<AstOperator>()->code;
+
+    if (opCode == LEX_ANDAND || opCode == LEX_OROR)
+        return logicalOp(node, opCode);
+
+    const int a = expression(node->children()[0]);
+    const int b = expression(node->children()[1]);
+
+    return binary(opCode, node->position(), a, b);
+}
+
+/**
+ * Translates logical operators, which short-circuit the evaluation of the
+ * right side. The result is the value of the last evaluated side.
+ * @param node
+ * @param opCode
+ * @return
+ */
+int SsaBuilder::logicalOp (Ref<AstNode> node, int opCode)
+{
+    const int a = expression(node->children()[0]);
+    const int rightBlock = newBlock();
+    const int nextBlock = newBlock();
+
+    if (opCode == LEX_ANDAND)
+        branch(a, rightBlock, nextBlock);
+    else
+        branch(a, nextBlock, rightBlock);
+    sealBlock(rightBlock);
+
+    m_curBlock = rightBlock;
+    const int b = expression(node->children()[1]);
+    jump(nextBlock);
+    sealBlock(nextBlock);
+
+    m_curBlock = nextBlock;
+    const int result = phi(nextBlock, node->position());
+    m_fn->values[result].args.push_back(a);
+    m_fn->values[result].args.push_back(b);
+
+    return result;
+}
+
+/**
+ * Translates the conditional operator ('a ? b : c')
+ * @param node
+ * @return
+ */
+int SsaBuilder::conditional (Ref<AstNode> node)
+{
+    const int condition = expression(node->children()[0]);
+    const int thenBlock = newBlock();
+    const int elseBlock = newBlock();
+    const int nextBlock = newBlock();
+
+    branch (condition, thenBlock, elseBlock);
+    sealBlock(thenBlock);
+    sealBlock(elseBlock);
+
+    m_curBlock = thenBlock;
+    const int a = expression(node->children()[1]);
+    jump(nextBlock);
+
+    m_curBlock = elseBlock;
+    const int b = expression(node->children()[2]);
+    jump(nextBlock);
+
+    sealBlock(nextBlock);
+    m_curBlock = nextBlock;
+
+    const int result = phi(nextBlock, node->position());
+    m_fn->values[result].args.push_back(a);
+    m_fn->values[result].args.push_back(b);
+
+    return result;
+}
+
+/**
+ * Translates a prefix operator. Operators other than '++' and '--' are
+ * calls to the operator functions.
+ * @param node
+ * @return
+ */
+int SsaBuilder::prefixOp (Ref<AstNode> node)
+{
+    const ScriptPosition    pos = node->position();
+    const int               opCode = node.staticCast<AstOperator>()->code;
+    auto                    child = node->children()[0];
+
+    if (opCode == LEX_PLUSPLUS || opCode == LEX_MINUSMINUS)
+    {
+        //Same as '+= 1' or '-= 1'
+        const int   op = opCode == LEX_PLUSPLUS ? '+' : '-';
+
+        if (child->getType() == AST_IDENTIFIER)
+            return assignment(node, op, child, m_fn->addConstant(jsInt(1), m_curBlock, pos));
+
+        Ref<AstNode> equivalent = astCreateAssignment(pos,
+                                                      LEX_ASSIGN_BASE + op,
+                                                      child,
+                                                      AstLiteral::create(pos, 1));
+        return assignment(equivalent);
+    }
+    else if (opCode == '+')
+        return expression(child);
+
+    const string fnName = prefixOperatorFunction(opCode);
+    if (fnName.empty())
+        throw Unsupported();
+
+    const int a = expression(child);
+    const int fn = value(SSA_RD_GLOBAL, pos);
+    m_fn->values[fn].name = fnName;
+
+    return value(SSA_CALL, pos, a, fn);
+}
+
+/**
+ * Translates a postfix operator ('++' or '--'). The previous value is
+ * recovered from the new one with the inverse operation.
+ * @param node
+ * @return
+ */
+int SsaBuilder::postfixOp (Ref<AstNode> node)
+{
+    const ScriptPosition    pos = node->position();
+    const int               opCode = node.staticCast<AstOperator>()->code;
+    const int               newValue = prefixOp(node);
+    const int               one = m_fn->addConstant(jsInt(1), m_curBlock, pos);
+
+    return binary(opCode == LEX_PLUSPLUS ? '-' : '+', pos, newValue, one);
+}
+
+/**
+ * Adds a value to the current block.
+ * @param op
+ * @param pos
+ * @return
+ */
+int SsaBuilder::value (SsaOpCode op, const ScriptPosition& pos)
+{
+    return m_fn->addValue(op, m_curBlock, pos);
+}
+
+int SsaBuilder::value (SsaOpCode op, const ScriptPosition& pos, int a)
+{
+    const int v = value(op, pos);
+
+    m_fn->values[v].args.push_back(a);
+    return v;
+}
+
+int SsaBuilder::value (SsaOpCode op, const ScriptPosition& pos, int a, int b)
+{
+    const int v = value(op, pos, a);
+
+    m_fn->values[v].args.push_back(b);
+    return v;
+}
+
+int SsaBuilder::binary (int opCode, const ScriptPosition& pos, int a, int b)
+{
+    const int v = value(SSA_BINARY, pos, a, b);
+
+    m_fn->values[v].index = opCode;
+    return v;
+}
+
+int SsaBuilder::nullValue (const ScriptPosition& pos)
+{
+    return m_fn->addConstant(jsNull(), m_curBlock, pos);
+}
+
+/**
+ * Creates a phi value, without arguments, at the beginning of a block.
+ * @param block
+ * @param pos
+ * @return
+ */
+int SsaBuilder::phi (int block, const ScriptPosition& pos)
+{
+    const int v = m_fn->addValue(SSA_PHI, block, pos);
+
+    m_fn->blocks[block].code.pop_back();
+    m_fn->blocks[block].phis.push_back(v);
+    return v;
+}
+
+/**
+ * Creates a new, empty, block.
+ * @return
+ */
+int SsaBuilder::newBlock ()
+{
+    m_definitions.push_back(map<int,int>());
+    m_incompletePhis.push_back(map<int,int>());
+    m_sealed.push_back(false);
+
+    return m_fn->addBlock();
+}
+
+/**
+ * Ends current block with an unconditional jump.
+ * @param target
+ */
+void SsaBuilder::jump (int target)
+{
+    SsaBlock& block = m_fn->blocks[m_curBlock];
+
+    ASSERT (block.exitType == SSA_EXIT_NONE);
+    block.exitType = SSA_EXIT_JUMP;
+    block.next[0] = target;
+    block.next[1] = target;
+    m_fn->addEdge(m_curBlock, target);
+}
+
+/**
+ * Ends current block with a conditional jump.
+ * @param condition
+ * @param trueTarget
+ * @param falseTarget
+ */
+void SsaBuilder::branch (int condition, int trueTarget, int falseTarget)
+{
+    SsaBlock& block = m_fn->blocks[m_curBlock];
+
+    ASSERT (block.exitType == SSA_EXIT_NONE);
+    block.exitType = SSA_EXIT_BRANCH;
+    block.exitValue = condition;
+    block.next[1] = trueTarget;
+    block.next[0] = falseTarget;
+    m_fn->addEdge(m_curBlock, trueTarget);
+    m_fn->addEdge(m_curBlock, falseTarget);
+}
+
+/**
+ * Seals a block: all its predecessors are known, so the phis created while
+ * they were unknown can be completed.
+ * @param block
+ */
+void SsaBuilder::sealBlock (int block)
+{
+    auto& incomplete = m_incompletePhis[block];
+
+    for (auto it = incomplete.begin(); it != incomplete.end(); ++it)
+        addPhiOperands(it->first, it->second);
+
+    incomplete.clear();
+    m_sealed[block] = true;
+}
+
+/**
+ * Declares a variable in the current scope.
+ * @param name
+ * @param value     Initial value
+ */
+void SsaBuilder::declareVar (const string& name, int value)
+{
+    const int var = m_nVars++;
+
+    m_scopes.back()[name] = var;
+    writeVar(var, m_curBlock, value);
+}
+
+/**
+ * Looks for a variable in the scopes.
+ * @param name
+ * @return Variable id, or (-1) if not found.
+ */
+int SsaBuilder::findVar (const string& name)const
+{
+    for (auto it = m_scopes.rbegin(); it != m_scopes.rend(); ++it)
+    {
+        auto itVar = it->find(name);
+
+        if (itVar != it->end())
+            return itVar->second;
+    }
+
+    return -1;
+}
+
+void SsaBuilder::writeVar (int var, int block, int value)
+{
+    m_definitions[block][var] = value;
+}
+
+/**
+ * Reads the current value of a variable in a block.
+ * @param var
+ * @param block
+ * @param pos
+ * @return
+ */
+int SsaBuilder::readVar (int var, int block, const ScriptPosition& pos)
+{
+    auto it = m_definitions[block].find(var);
+
+    if (it != m_definitions[block].end())
+        return it->second;
+    else
+        return readVarRecursive(var, block, pos);
+}
+
+int SsaBuilder::readVarRecursive (int var, int block, const ScriptPosition& pos)
+{
+    const auto& preds = m_fn->blocks[block].preds;
+    int         result;
+
+    if (!m_sealed[block])
+    {
+        result = phi(block, pos);
+        m_incompletePhis[block][var] = result;
+    }
+    else if (preds.empty())
+    {
+        //Unreachable block.
+        result = m_fn->addConstant(jsNull(), block, pos);
+    }
+    else if (preds.size() == 1)
+        result = readVar(var, preds[0], pos);
+    else
+    {
+        //The phi is written before reading the predecessors, to break cycles.
+        result = phi(block, pos);
+        writeVar(var, block, result);
+        addPhiOperands(var, result);
+    }
+
+    writeVar(var, block, result);
+    return result;
+}
+
+void SsaBuilder::addPhiOperands (int var, int phi)
+{
+    const SsaValue& phiValue = m_fn->values[phi];
+    const int       block = phiValue.block;
+    const auto      pos = phiValue.pos;
+    const auto      preds = m_fn->blocks[block].preds;
+
+    for (auto it = preds.begin(); it != preds.end(); ++it)
+    {
+        const int arg = readVar(var, *it, pos);
+        m_fn->values[phi].args.push_back(arg);
+    }
+}
+
+// SsaFunction
+//
+//////////////////////////////////////////////////
+
+int SsaFunction::addBlock()
+{
+    blocks.push_back(SsaBlock());
+    return (int)blocks.size() - 1;
+}
+
+/**
+ * Appends a value to the code of a block.
+ * @param op
+ * @param block
+ * @param pos
+ * @return
+ */
+int SsaFunction::addValue (SsaOpCode op, int block, const ScriptPosition& pos)
+{
+    const int id = (int)values.size();
+
+    values.push_back(SsaValue(op, block, pos));
+    blocks[block].code.push_back(id);
+    return id;
+}
+
+int SsaFunction::addConstant (ASValue value, int block, const ScriptPosition& pos)
+{
+    const int id = addValue(SSA_CONST, block, pos);
+
+    values[id].constant = value;
+    return id;
+}
+
+void SsaFunction::addEdge (int from, int to)
+{
+    blocks[to].preds.push_back(from);
+}
+
+/**
+ * Removes a control flow edge. The phi arguments for the edge are removed.
+ * The exit of 'from' block shall be updated by the caller.
+ * @param from
+ * @param to
+ */
+void SsaFunction::removeEdge (int from, int to)
+{
+    SsaBlock&   target = blocks[to];
+
+    for (size_t i = 0; i < target.preds.size(); ++i)
+    {
+        if (target.preds[i] != from)
+            continue;
+
+        target.preds.erase(target.preds.begin() + i);
+        for (auto it = target.phis.begin(); it != target.phis.end(); ++it)
+        {
+            auto& args = values[*it].args;
+            args.erase(args.begin() + i);
+        }
+        return;
+    }
+
+    ASSERT (!"Edge not found");
+}
+
+/**
+ * Replaces all uses of a value by another one.
+ * @param oldValue
+ * @param newValue
+ */
+void SsaFunction::replaceUses (int oldValue, int newValue)
+{
+    for (auto it = values.begin(); it != values.end(); ++it)
+    {
+        if (it->removed)
+            continue;
+
+        for (auto itArg = it->args.begin(); itArg != it->args.end(); ++itArg)
+        {
+            if (*itArg == oldValue)
+                *itArg = newValue;
+        }
+    }
+
+    for (auto it = blocks.begin(); it != blocks.end(); ++it)
+    {
+        if (it->exitValue == oldValue)
+            it->exitValue = newValue;
+    }
+}
+
+/**
+ * Removes a value from the function. It shall not be used.
+ * @param id
+ */
+void SsaFunction::removeValue (int id)
+{
+    SsaValue&   v = values[id];
+    auto&       block = blocks[v.block];
+    auto&       list = v.op == SSA_PHI ? block.phis : block.code;
+
+    list.erase(std::find(list.begin(), list.end(), id));
+    v.removed = true;
+    v.args.clear();
+}
+
+/**
+ * Counts the uses of each value, by other values and by block exits.
+ * @return
+ */
+vector<int> SsaFunction::countUses ()const
+{
+    vector<int> uses (values.size(), 0);
+
+    for (auto it = values.begin(); it != values.end(); ++it)
+    {
+        if (it->removed)
+            continue;
+        for (auto itArg = it->args.begin(); itArg != it->args.end(); ++itArg)
+            ++uses[*itArg];
+    }
+
+    for (auto it = blocks.begin(); it != blocks.end(); ++it)
+    {
+        if (!it->removed && it->exitValue >= 0)
+            ++uses[it->exitValue];
+    }
+
+    return uses;
+}
+
+/**
+ * Checks if a value can be removed when it is not used: it has no side effects
+ * and cannot fail.
+ * @param id
+ * @param types     Inferred types of the function values.
+ * @return
+ */
+bool SsaFunction::isPure (int id, const vector<ExprType>& types)const
+{
+    const SsaValue& v = values[id];
+
+    switch (v.op)
+    {
+    case SSA_CONST:
+    case SSA_PARAM:
+    case SSA_THIS:
+    case SSA_PHI:
+    case SSA_COPY:
+    case SSA_RD_GLOBAL:
+    case SSA_RD_FIELD:
+        return true;
+
+    case SSA_BINARY:
+        //Operators on numbers do not call any script code.
+        return types[v.args[0]] == ET_NUMBER && types[v.args[1]] == ET_NUMBER;
+
+    default:
+        return false;
+    }
+}
+
+/**
+ * Infers the types of the values of a function. Like the AST based inference,
+ * it is optimistic: phis are assumed to have the type of their arguments
+ * until a different type is found.
+ * @param fn
+ * @return
+ */
+vector<ExprType> ssaInferTypes (const SsaFunction& fn)
+{
+    vector<ExprType>    types (fn.values.size(), ET_PENDING);
+    bool                changed = true;
+
+    while (changed)
+    {
+        changed = false;
+
+        for (size_t i = 0; i < fn.values.size(); ++i)
+        {
+            const SsaValue& v = fn.values[i];
+            ExprType        type = ET_UNKNOWN;
+
+            if (v.removed)
+                continue;
+
+            switch (v.op)
+            {
+            case SSA_CONST:
+                switch (v.constant.getType())
+                {
+                case VT_NUMBER:     type = ET_NUMBER;   break;
+                case VT_BOOL:       type = ET_BOOL;     break;
+                case VT_STRING:     type = ET_STRING;   break;
+                default:            type = ET_UNKNOWN;  break;
+                }
+                break;
+
+            case SSA_COPY:
+                type = types[v.args[0]];
+                break;
+
+            case SSA_PHI:
+                type = ET_PENDING;
+                for (auto it = v.args.begin(); it != v.args.end(); ++it)
+                {
+                    const ExprType argType = types[*it];
+
+                    if (argType == ET_PENDING || argType == type)
+                        continue;
+                    else if (type == ET_PENDING)
+                        type = argType;
+                    else
+                        type = ET_UNKNOWN;
+                }
+                break;
+
+            case SSA_BINARY:
+                type = binaryOpType(v.index, types[v.args[0]], types[v.args[1]]);
+                break;
+
+            default:
+                type = ET_UNKNOWN;
+                break;
+            }
+
+            if (type != types[i])
+            {
+                //Types only go down, from 'pending' to 'unknown'.
+                if (types[i] != ET_PENDING && type != ET_UNKNOWN)
+                    type = ET_UNKNOWN;
+
+                if (type != types[i])
+                {
+                    types[i] = type;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    //Values in unreachable cycles.
+    for (auto it = types.begin(); it != types.end(); ++it)
+    {
+        if (*it == ET_PENDING)
+            *it = ET_UNKNOWN;
+    }
+
+    return types;
+}
+
+/**
+ * Text representation of a SSA function, for debugging.
+ * @param fn
+ * @return
+ */
+string ssaToString (const SsaFunction& fn)
+{
+    static const char* opNames[] = {"const", "param", "this", "phi", "copy",
+        "rdGlobal", "wrGlobal", "rdField", "wrField", "rdIndex", "wrIndex",
+        "binary", "call", "methodCall"};
+    ostringstream   output;
+
+    for (size_t i = 0; i < fn.blocks.size(); ++i)
+    {
+        const SsaBlock& block = fn.blocks[i];
+
+        if (block.removed)
+            continue;
+
+        output << "B" << i << ":\n";
+
+        vector<int> values (block.phis);
+        values.insert(values.end(), block.code.begin(), block.code.end());
+
+        for (auto it = values.begin(); it != values.end(); ++it)
+        {
+            const SsaValue& v = fn.values[*it];
+
+            output << "  v" << *it << " = " << opNames[v.op];
+            if (v.op == SSA_CONST)
+                output << " " << v.constant.toString();
+            else if (!v.name.empty())
+                output << " '" << v.name << "'";
+            else if (v.op == SSA_PARAM || v.op == SSA_BINARY)
+                output << " " << v.index;
+
+            for (auto itArg = v.args.begin(); itArg != v.args.end(); ++itArg)
+                output << " v" << *itArg;
+            output << "\n";
+        }
+
+        switch (block.exitType)
+        {
+        case SSA_EXIT_JUMP:
+            output << "  jump B" << block.next[0] << "\n";
+            break;
+        case SSA_EXIT_BRANCH:
+            output << "  branch v" << block.exitValue << " B" << block.next[1]
+                    << " B" << block.next[0] << "\n";
+            break;
+        case SSA_EXIT_RETURN:
+            output << "  return v" << block.exitValue << "\n";
+            break;
+        default:
+            break;
+        }
+    }
+
+    return output.str();
+}
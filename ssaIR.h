@@ -0,0 +1,148 @@
+/*
+ * File:   ssaIR.h
+ * Author: ghernan
+ *
+ * SSA (static single assignment) intermediate representation of functions.
+ * It sits between the AST and the MVM code: functions are translated to SSA
+ * by 'ssaBuildFunction', optimized by the passes in 'ssaOptimizer.h' and
+ * lowered to MVM blocks by the code generator.
+ *
+ * Created on October 18, 2026, 5:20 PM
+ */
+
+#pragma once
+#ifndef SSAIR_H
+#define	SSAIR_H
+
+#include "ast.h"
+#include "typeInference.h"
+
+#include <vector>
+#include <functional>
+
+/**
+ * SSA value operations.
+ */
+enum SsaOpCode
+{
+    SSA_CONST,          //'constant'
+    SSA_PARAM,          //Function parameter. 'index' is the parameter index.
+    SSA_THIS,           //'this' reference
+    SSA_PHI,            //One argument for each predecessor of its block.
+    SSA_COPY,           //Copy of its only argument.
+    SSA_RD_GLOBAL,      //Global variable 'name'
+    SSA_WR_GLOBAL,      //Writes global 'name'. Args: value.
+    SSA_RD_FIELD,       //Reads field 'name'. Args: object.
+    SSA_WR_FIELD,       //Writes field 'name'. Args: object, value.
+    SSA_RD_INDEX,       //Args: object, index.
+    SSA_WR_INDEX,       //Args: object, index, value.
+    SSA_BINARY,         //Binary operator 'index'. Args: a, b.
+    SSA_CALL,           //Args: parameters, function.
+    SSA_METHOD_CALL     //Calls method 'name'. Args: parameters, object.
+};
+
+/**
+ * SSA value. Values are identified by its index in the function values vector.
+ * Writes and calls are also values (their result).
+ */
+struct SsaValue
+{
+    SsaOpCode           op;
+    std::vector<int>    args;
+    ASValue             constant;
+    std::string         name;
+    int                 index = 0;
+    int                 block = -1;
+    ScriptPosition      pos;
+    bool                removed = false;
+
+    SsaValue (SsaOpCode _op, int _block, const ScriptPosition& _pos)
+    : op (_op), block(_block), pos(_pos)
+    {}
+};
+
+/**
+ * How a block ends.
+ */
+enum SsaExitType
+{
+    SSA_EXIT_NONE,          //Not terminated yet (only during construction)
+    SSA_EXIT_JUMP,          //To 'next[0]'
+    SSA_EXIT_BRANCH,        //To 'next[1]' if 'exitValue' is true, to 'next[0]' if it is false.
+    SSA_EXIT_RETURN         //Returns 'exitValue'
+};
+
+/**
+ * SSA basic block.
+ */
+struct SsaBlock
+{
+    std::vector<int>    phis;
+    std::vector<int>    code;       //Non-phi values, in execution order.
+    std::vector<int>    preds;
+    SsaExitType         exitType = SSA_EXIT_NONE;
+    int                 exitValue = -1;
+    int                 next[2] = {-1, -1};
+    bool                removed = false;
+
+    int nSuccessors()const
+    {
+        switch (exitType)
+        {
+        case SSA_EXIT_JUMP:     return 1;
+        case SSA_EXIT_BRANCH:   return 2;
+        default:                return 0;
+        }
+    }
+
+    int successor (int i)const
+    {
+        return exitType == SSA_EXIT_BRANCH ? next[1-i] : next[0];
+    }
+};
+
+/**
+ * Function in SSA form. Block 0 is the entry block, which has no predecessors.
+ */
+class SsaFunction : public RefCountObj
+{
+public:
+    static Ref<SsaFunction> create(Ref<AstFunction> node)
+    {
+        return refFromNew (new SsaFunction(node));
+    }
+
+    int     addBlock();
+    int     addValue (SsaOpCode op, int block, const ScriptPosition& pos);
+    int     addConstant (ASValue value, int block, const ScriptPosition& pos);
+
+    void    addEdge (int from, int to);
+    void    removeEdge (int from, int to);
+
+    void    replaceUses (int oldValue, int newValue);
+    void    removeValue (int id);
+
+    std::vector<int>    countUses ()const;
+
+    bool    isPure (int id, const std::vector<ExprType>& types)const;
+
+    Ref<AstFunction>        node;
+    std::vector<SsaValue>   values;
+    std::vector<SsaBlock>   blocks;
+
+protected:
+    SsaFunction (Ref<AstFunction> _node) : node(_node)
+    {}
+};
+
+/**
+ * Decides if a name which is not a local variable of the function can be
+ * accessed as a global.
+ */
+typedef std::function<bool (const std::string&)> SsaGlobalFilter;
+
+Ref<SsaFunction>        ssaBuildFunction (Ref<AstFunction> node, SsaGlobalFilter isGlobal);
+std::vector<ExprType>   ssaInferTypes (const SsaFunction& fn);
+std::string             ssaToString (const SsaFunction& fn);
+
+#endif	/* SSAIR_H */
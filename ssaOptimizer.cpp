@@ -0,0 +1,403 @@
+/*
+ * File:   ssaOptimizer.cpp
+ * Author: ghernan
+ *
+ * Optimization passes over the SSA intermediate representation:
+ *  - Unreachable blocks removal.
+ *  - Constant propagation: folds operators on constant numbers, and branches
+ * on constant conditions.
+ *  - Copy propagation: removes copies and phis whose arguments are all the
+ * same value.
+ *  - Dead code elimination: removes unused values without side effects.
+ *  - Block merging: merges a block with its successor when it is the only
+ * predecessor of it.
+ *
+ * Created on October 18, 2026, 5:55 PM
+ */
+
+#include "ascript_pch.hpp"
+#include "ssaOptimizer.h"
+#include "jsLexer.h"
+
+#include <algorithm>
+#include <mutex>
+
+using namespace std;
+
+///Maximum number of times the pass sequence is run.
+static const int MAX_SSA_ITERATIONS = 8;
+
+/**
+ * Adds a pass at the end of the sequence.
+ * @param name
+ * @param pass
+ */
+void SsaPassManager::addPass (const std::string& name, SsaPassFN pass)
+{
+    m_passes.push_back(make_pair(name, pass));
+}
+
+/**
+ * Runs the passes on a function.
+ * @param fn
+ */
+void SsaPassManager::run (SsaFunction& fn)const
+{
+    bool changed = true;
+
+    for (int i = 0; changed && i < MAX_SSA_ITERATIONS; ++i)
+    {
+        changed = false;
+
+        for (auto it = m_passes.begin(); it != m_passes.end(); ++it)
+            changed = it->second(fn) || changed;
+    }
+}
+
+/**
+ * Default pass sequence.
+ * @return
+ */
+const SsaPassManager& SsaPassManager::defaultPasses()
+{
+    static SsaPassManager passes;
+    static std::once_flag initialized;
+
+    std::call_once (initialized, []()
+    {
+        passes.addPass("removeUnreachable", ssaRemoveUnreachable);
+        passes.addPass("constantPropagation", ssaConstantPropagation);
+        passes.addPass("copyPropagation", ssaCopyPropagation);
+        passes.addPass("deadCodeElimination", ssaDeadCodeElimination);
+        passes.addPass("mergeBlocks", ssaMergeBlocks);
+    });
+
+    return passes;
+}
+
+/**
+ * Optimizes a function with the default passes.
+ * @param fn
+ */
+void ssaOptimize (SsaFunction& fn)
+{
+    SsaPassManager::defaultPasses().run(fn);
+}
+
+/**
+ * Removes a block and its values.
+ * @param fn
+ * @param b
+ */
+static void removeBlock (SsaFunction& fn, int b)
+{
+    SsaBlock&   block = fn.blocks[b];
+
+    for (int i = 0; i < block.nSuccessors(); ++i)
+        fn.removeEdge(b, block.successor(i));
+
+    auto values = block.phis;
+    values.insert(values.end(), block.code.begin(), block.code.end());
+
+    for (auto it = values.begin(); it != values.end(); ++it)
+    {
+        fn.values[*it].removed = true;
+        fn.values[*it].args.clear();
+    }
+
+    block.phis.clear();
+    block.code.clear();
+    block.preds.clear();
+    block.exitType = SSA_EXIT_NONE;
+    block.exitValue = -1;
+    block.removed = true;
+}
+
+/**
+ * Removes the blocks which cannot be reached from the entry block.
+ * @param fn
+ * @return
+ */
+bool ssaRemoveUnreachable (SsaFunction& fn)
+{
+    vector<bool>    reached (fn.blocks.size(), false);
+    vector<int>     pending (1, 0);
+    bool            changed = false;
+
+    reached[0] = true;
+    while (!pending.empty())
+    {
+        const SsaBlock& block = fn.blocks[pending.back()];
+
+        pending.pop_back();
+        for (int i = 0; i < block.nSuccessors(); ++i)
+        {
+            const int next = block.successor(i);
+
+            if (!reached[next])
+            {
+                reached[next] = true;
+                pending.push_back(next);
+            }
+        }
+    }
+
+    for (size_t b = 0; b < fn.blocks.size(); ++b)
+    {
+        if (!reached[b] && !fn.blocks[b].removed)
+        {
+            removeBlock(fn, (int)b);
+            changed = true;
+        }
+    }
+
+    return changed;
+}
+
+/**
+ * Evaluates an operator on two constant numbers.
+ * @param opCode
+ * @param a
+ * @param b
+ * @param pResult   [out]
+ * @return false if the operator is not folded.
+ */
+static bool foldNumbers (int opCode, double a, double b, ASValue* pResult)
+{
+    switch (opCode)
+    {
+    case '+':           *pResult = jsDouble(a + b);     break;
+    case '-':           *pResult = jsDouble(a - b);     break;
+    case '*':           *pResult = jsDouble(a * b);     break;
+    case '/':           *pResult = jsDouble(a / b);     break;
+    case '<':           *pResult = jsBool(a < b);       break;
+    case '>':           *pResult = jsBool(a > b);       break;
+    case LEX_LEQUAL:    *pResult = jsBool(a <= b);      break;
+    case LEX_GEQUAL:    *pResult = jsBool(a >= b);      break;
+    case LEX_EQUAL:
+    case LEX_TYPEEQUAL: *pResult = jsBool(a == b);      break;
+    case LEX_NEQUAL:
+    case LEX_NTYPEEQUAL:*pResult = jsBool(a != b);      break;
+    default:
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Folds operators on constant numbers, and branches on constant conditions.
+ * @param fn
+ * @return
+ */
+bool ssaConstantPropagation (SsaFunction& fn)
+{
+    bool changed = false;
+
+    for (auto it = fn.values.begin(); it != fn.values.end(); ++it)
+    {
+        if (it->removed || it->op != SSA_BINARY)
+            continue;
+
+        const SsaValue& a = fn.values[it->args[0]];
+        const SsaValue& b = fn.values[it->args[1]];
+        ASValue         result;
+
+        if (a.op != SSA_CONST || b.op != SSA_CONST)
+            continue;
+        if (a.constant.getType() != VT_NUMBER || b.constant.getType() != VT_NUMBER)
+            continue;
+
+        if (foldNumbers(it->index, a.constant.getNumber(), b.constant.getNumber(), &result))
+        {
+            it->op = SSA_CONST;
+            it->constant = result;
+            it->args.clear();
+            changed = true;
+        }
+    }
+
+    for (size_t b = 0; b < fn.blocks.size(); ++b)
+    {
+        SsaBlock& block = fn.blocks[b];
+
+        if (block.removed || block.exitType != SSA_EXIT_BRANCH)
+            continue;
+
+        const SsaValue& condition = fn.values[block.exitValue];
+        const JSValueTypes type = condition.constant.getType();
+
+        if (condition.op != SSA_CONST || (type != VT_BOOL && type != VT_NUMBER && type != VT_NULL))
+            continue;
+
+        const bool  value = condition.constant.toBoolean(NULL);
+        const int   taken = block.next[value ? 1 : 0];
+        const int   notTaken = block.next[value ? 0 : 1];
+
+        if (taken != notTaken)
+            fn.removeEdge((int)b, notTaken);
+
+        block.exitType = SSA_EXIT_JUMP;
+        block.exitValue = -1;
+        block.next[0] = block.next[1] = taken;
+        changed = true;
+    }
+
+    return changed;
+}
+
+/**
+ * Replaces copies, and phis whose arguments are all the same value, by
+ * the copied value.
+ * @param fn
+ * @return
+ */
+bool ssaCopyPropagation (SsaFunction& fn)
+{
+    bool changed = false;
+
+    for (size_t i = 0; i < fn.values.size(); ++i)
+    {
+        const SsaValue& v = fn.values[i];
+        int             source = -1;
+
+        if (v.removed)
+            continue;
+
+        if (v.op == SSA_COPY)
+            source = v.args[0];
+        else if (v.op == SSA_PHI)
+        {
+            for (auto it = v.args.begin(); it != v.args.end(); ++it)
+            {
+                if (*it == (int)i || *it == source)
+                    continue;
+                else if (source < 0)
+                    source = *it;
+                else
+                {
+                    source = -1;
+                    break;
+                }
+            }
+        }
+
+        if (source >= 0 && source != (int)i)
+        {
+            fn.replaceUses((int)i, source);
+            fn.removeValue((int)i);
+            changed = true;
+        }
+    }
+
+    return changed;
+}
+
+/**
+ * Removes the values without side effects which are not used.
+ * @param fn
+ * @return
+ */
+bool ssaDeadCodeElimination (SsaFunction& fn)
+{
+    const vector<ExprType>  types = ssaInferTypes(fn);
+    vector<bool>            live (fn.values.size(), false);
+    vector<int>             pending;
+    bool                    changed = false;
+
+    //Roots: values with side effects and block exits.
+    for (size_t i = 0; i < fn.values.size(); ++i)
+    {
+        if (!fn.values[i].removed && !fn.isPure((int)i, types))
+            pending.push_back((int)i);
+    }
+
+    for (auto it = fn.blocks.begin(); it != fn.blocks.end(); ++it)
+    {
+        if (!it->removed && it->exitValue >= 0)
+            pending.push_back(it->exitValue);
+    }
+
+    while (!pending.empty())
+    {
+        const int id = pending.back();
+
+        pending.pop_back();
+        if (live[id])
+            continue;
+
+        live[id] = true;
+        pending.insert(pending.end(), fn.values[id].args.begin(), fn.values[id].args.end());
+    }
+
+    for (size_t i = 0; i < fn.values.size(); ++i)
+    {
+        if (!fn.values[i].removed && !live[i])
+        {
+            fn.removeValue((int)i);
+            changed = true;
+        }
+    }
+
+    return changed;
+}
+
+/**
+ * Merges blocks which jump unconditionally to a block which has no other
+ * predecessor.
+ * @param fn
+ * @return
+ */
+bool ssaMergeBlocks (SsaFunction& fn)
+{
+    bool changed = false;
+
+    for (size_t b = 0; b < fn.blocks.size(); ++b)
+    {
+        SsaBlock& block = fn.blocks[b];
+
+        if (block.removed)
+            continue;
+
+        while (block.exitType == SSA_EXIT_JUMP)
+        {
+            const int   nextId = block.next[0];
+            SsaBlock&   next = fn.blocks[nextId];
+
+            if (nextId == 0 || nextId == (int)b || next.preds.size() != 1)
+                break;
+
+            //Phis of a block with a single predecessor are copies.
+            auto phis = next.phis;
+            for (auto it = phis.begin(); it != phis.end(); ++it)
+            {
+                fn.replaceUses(*it, fn.values[*it].args[0]);
+                fn.removeValue(*it);
+            }
+
+            for (auto it = next.code.begin(); it != next.code.end(); ++it)
+                fn.values[*it].block = (int)b;
+            block.code.insert(block.code.end(), next.code.begin(), next.code.end());
+
+            block.exitType = next.exitType;
+            block.exitValue = next.exitValue;
+            block.next[0] = next.next[0];
+            block.next[1] = next.next[1];
+
+            for (int i = 0; i < next.nSuccessors(); ++i)
+            {
+                auto& preds = fn.blocks[next.successor(i)].preds;
+                std::replace(preds.begin(), preds.end(), nextId, (int)b);
+            }
+
+            next.code.clear();
+            next.preds.clear();
+            next.exitType = SSA_EXIT_NONE;
+            next.exitValue = -1;
+            next.removed = true;
+            changed = true;
+        }
+    }
+
+    return changed;
+}
@@ -0,0 +1,45 @@
+/*
+ * File:   ssaOptimizer.h
+ * Author: ghernan
+ *
+ * Optimization passes over the SSA intermediate representation, and the
+ * pass manager which runs them.
+ *
+ * Created on October 18, 2026, 5:55 PM
+ */
+
+#pragma once
+#ifndef SSAOPTIMIZER_H
+#define	SSAOPTIMIZER_H
+
+#include "ssaIR.h"
+
+/**
+ * SSA pass function. Returns 'true' if it has modified the function.
+ */
+typedef bool (*SsaPassFN)(SsaFunction& fn);
+
+/**
+ * Runs a sequence of passes until none of them modifies the function.
+ */
+class SsaPassManager
+{
+public:
+    void    addPass (const std::string& name, SsaPassFN pass);
+    void    run (SsaFunction& fn)const;
+
+    static const SsaPassManager& defaultPasses();
+
+private:
+    std::vector< std::pair<std::string, SsaPassFN> >   m_passes;
+};
+
+bool ssaRemoveUnreachable (SsaFunction& fn);
+bool ssaConstantPropagation (SsaFunction& fn);
+bool ssaCopyPropagation (SsaFunction& fn);
+bool ssaDeadCodeElimination (SsaFunction& fn);
+bool ssaMergeBlocks (SsaFunction& fn);
+
+void ssaOptimize (SsaFunction& fn);
+
+#endif	/* SSAOPTIMIZER_H */
@@ -0,0 +1,50 @@
+// Test of value interning (hash-consing of deep-frozen values)
+
+var a = {x:1, y:[1, 2, "three"], z:{w:"text"}};
+var b = {x:1, y:[1, 2, "three"], z:{w:"text"}};
+
+assert (a != b, "a != b");
+
+var ia = a.intern();
+var ib = b.intern();
+
+assert (ia == ib, "ia == ib");
+assert (ia.isDeepFrozen(), "ia.isDeepFrozen");
+assert (ia.y == ib.y, "ia.y == ib.y");
+assert (ia.z == ib.z, "ia.z == ib.z");
+assert (ia.x == 1, "ia.x == 1");
+assert (ia.y[2] == "three", "ia.y[2] == 'three'");
+
+//Original objects are not modified
+a.x = 5;
+assert (ia.x == 1, "ia.x == 1 (after modifying 'a')");
+
+var c = {x:2, y:[1, 2, "three"], z:{w:"text"}}.intern();
+assert (c != ia, "c != ia");
+assert (c.y == ia.y, "c.y == ia.y");
+
+//Interning an interned value returns the same value
+assert (ia.intern() == ia, "ia.intern() == ia");
+
+//Strings
+var s1 = "abc".intern();
+var s2 = ("ab" + "c").intern();
+assert (s1 == s2, "s1 == s2");
+assert (s1 != "abd".intern(), "s1 != 'abd'");
+
+//Shared and cyclic structures
+var shared = {v:[3,4]};
+var d = {p:shared, q:shared}.intern();
+assert (d.p == d.q, "d.p == d.q");
+
+var cyc = {name:"cyc"};
+cyc.self = cyc;
+var icyc = cyc.intern();
+assert (icyc.name == "cyc", "icyc.name == 'cyc'");
+assert (icyc.self.self.name == "cyc", "icyc.self.self.name == 'cyc'");
+
+//Cyclic structures cannot be written as JSON by the test harness
+cyc = null;
+icyc = null;
+
+result = 1;
@@ -0,0 +1,60 @@
+// Constant folding tests.
+// Folded expressions must give the same results as runtime operations, so
+// each constant expression is compared with the same expression on variables.
+
+var two = 2;
+var three = 3;
+var five = 5;
+var yes = true;
+var no = false;
+var s = "s";
+
+assert (2*60*1000 == two*60*1000, "2*60*1000");
+assert ("prefix" + "-" + "suffix" == "prefix" + "-" + s + "uffix", "string concatenation");
+assert (five + "a" + "b" == "5ab", "five + 'a' + 'b'");
+assert (1 + 2 + "x" == "3x", "1 + 2 + 'x'");
+assert ("x" + 1 + 2 == "x12", "'x' + 1 + 2");
+assert (5 % 3 == five % three, "5 % 3");
+assert (2 ** 3 == two ** three, "2 ** 3");
+assert ((5 << 2) == (five << two), "5 << 2");
+assert ((5 & 3 | 8) == (five & three | 8), "5 & 3 | 8");
+assert (-3 == -three, "-3");
+assert (~5 == ~five, "~5");
+assert (!true == !yes, "!true");
+assert (+5 == five, "+5");
+assert ((2 < 3) === (two < three), "2 < 3");
+assert ((3 >= 2) === (three >= two), "3 >= 2");
+assert (("a" == "a") === (s == "s"), "'a' == 'a'");
+assert ((2 !== "2") === (two !== "2"), "2 !== '2'");
+
+//Logical operators yield the last evaluated operand
+assert ((true && "yes") == "yes", "true && 'yes'");
+assert ((false || five) == 5, "false || five");
+assert ((0 && five) === 0, "0 && five");
+assert ((1 || five) === 1, "1 || five");
+
+//Conditional operator
+assert ((1 ? "a" : five) == "a", "1 ? 'a' : five");
+assert ((null ? five : "b") == "b", "null ? five : 'b'");
+
+//Dead 'if' branches
+var r = "none";
+if (1 > 2) r = "then"; else r = "else";
+assert (r == "else", "r == 'else'");
+
+if (true) { r = "block"; }
+assert (r == "block", "r == 'block'");
+
+if (false) r = "dead";
+assert (r == "block", "r == 'block' (2)");
+
+if (true) var declared = 7;
+assert (declared == 7, "declared == 7");
+
+//Folding inside functions
+function minutes(n) {
+    return n * 60 * 1000 + (false ? 1 : 0);
+}
+assert (minutes(2) == 120000, "minutes(2)");
+
+result = 1;
@@ -0,0 +1,52 @@
+// Tests for MVM code optimizer (peephole, block merging and jump threading).
+// Checks that optimized control flow keeps its semantics.
+
+function early(x) {
+    if (x > 10)
+        return "big";
+    return "small";
+    var unreachable = 1;
+}
+
+function nested(a, b) {
+    var r = 0;
+    for (var i = 0; i < a; i++) {
+        if (i % 2 == 0) {
+            if (b) r += 2;
+            else r += 1;
+        } else {
+            r = r + (b ? 10 : 20);
+        }
+    }
+    return r;
+}
+
+function logical(a, b, c) {
+    return (a && b) || c;
+}
+
+assert (early(11) == "big", "early(11)");
+assert (early(1) == "small", "early(1)");
+assert (nested(4, true) == 24, "nested(4, true) = " + nested(4, true));
+assert (nested(4, false) == 42, "nested(4, false) = " + nested(4, false));
+assert (logical(1, 2, 3) == 2, "logical(1, 2, 3)");
+assert (logical(0, 2, 3) == 3, "logical(0, 2, 3)");
+assert (logical(1, 0, null) == null, "logical(1, 0, null)");
+
+//Empty branches
+var count = 0;
+for (var j = 0; j < 5; j++) {
+    if (j > 2) {} else {}
+    count++;
+}
+assert (count == 5, "count == 5");
+
+//Member calls ('this' parameter) and array literals
+var obj = {
+    v: 3,
+    get: function () { return [this.v, this.v * 2]; }
+};
+var arr = obj.get();
+assert (arr[0] == 3 && arr[1] == 6, "obj.get()");
+
+result = 1;
@@ -0,0 +1,72 @@
+// Tests for flat code execution (jump instructions instead of block transitions).
+// Exercises conditional jumps, fall through, early returns and 'toBoolean' calls.
+
+class Yes() {
+    function toBoolean() { return true; }
+}
+
+class No() {
+    function toBoolean() { return false; }
+}
+
+function firstOver(list, limit) {
+    for (var i = 0; i < list.length; i++) {
+        if (list[i] > limit)
+            return i;
+    }
+    return -1;
+}
+
+function classify(x) {
+    return x < 0 ? "neg" : (x == 0 ? "zero" : (x < 10 ? "small" : "big"));
+}
+
+function countFlags(flags) {
+    var n = 0;
+    for (var i = 0; i < flags.length; i++) {
+        if (flags[i]) n++;
+    }
+    return n;
+}
+
+function collatz(n) {
+    var steps = 0;
+    while (n != 1) {
+        if (n % 2 == 0) n = n / 2;
+        else n = 3 * n + 1;
+        steps++;
+    }
+    return steps;
+}
+
+assert (firstOver([1, 5, 9, 12, 3], 8) == 2, "firstOver 8");
+assert (firstOver([1, 5], 8) == -1, "firstOver not found");
+assert (classify(-3) == "neg", "classify(-3)");
+assert (classify(0) == "zero", "classify(0)");
+assert (classify(7) == "small", "classify(7)");
+assert (classify(70) == "big", "classify(70)");
+assert (collatz(27) == 111, "collatz(27) = " + collatz(27));
+
+//Conditions which call script 'toBoolean' functions
+var flags = [Yes(), No(), Yes(), Yes()];
+assert (countFlags(flags) == 3, "countFlags");
+assert ((No() || "x") == "x", "No() || 'x'");
+assert ((Yes() && "y") == "y", "Yes() && 'y'");
+assert ((No() ? 1 : 2) == 2, "No() ? 1 : 2");
+
+//Long loop body: jump targets beyond 8 bits
+var acc = 0;
+for (var k = 0; k < 3; k++) {
+    acc += k; acc += k; acc += k; acc += k; acc += k; acc += k; acc += k; acc += k;
+    acc += k; acc += k; acc += k; acc += k; acc += k; acc += k; acc += k; acc += k;
+    acc += k; acc += k; acc += k; acc += k; acc += k; acc += k; acc += k; acc += k;
+    acc += k; acc += k; acc += k; acc += k; acc += k; acc += k; acc += k; acc += k;
+    acc += k; acc += k; acc += k; acc += k; acc += k; acc += k; acc += k; acc += k;
+    acc += k; acc += k; acc += k; acc += k; acc += k; acc += k; acc += k; acc += k;
+    acc += k; acc += k; acc += k; acc += k; acc += k; acc += k; acc += k; acc += k;
+    acc += k; acc += k; acc += k; acc += k; acc += k; acc += k; acc += k; acc += k;
+}
+assert (acc == 192, "acc = " + acc);
+
+flags = null;
+result = 1;
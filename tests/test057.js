@@ -0,0 +1,51 @@
+// Tests for module globals stored in slots (RD_GLOBAL / WR_GLOBAL).
+
+var counter = 0;
+const limit = 3;
+
+function increment(n) {
+    counter += n;
+    return counter;
+}
+
+function readLater() {
+    return defined_later;
+}
+
+//Locals shadow globals.
+function shadow(counter) {
+    counter = counter * 2;
+    return counter;
+}
+
+class Point(x, y) {
+    function sum() { return this.x + this.y; }
+}
+
+assert (readLater() == null, "Global read before definition");
+var defined_later = "ok";
+assert (readLater() == "ok", "Global read after definition");
+
+for (var i = 0; i < limit; i++)
+    increment(i + 1);
+
+assert (counter == 6, "counter == " + counter);
+assert (shadow(5) == 10, "shadow(5)");
+assert (counter == 6, "counter unchanged by local");
+
+//Classes and natives are also reached through slots.
+var p = Point(2, 3);
+assert (p.sum() == 5, "p.sum()");
+assert (Math.abs(-4) == 4, "Math.abs");
+
+//Nested functions access the same globals table.
+function outer() {
+    function inner() {
+        counter = counter + 100;
+    }
+    inner();
+    return counter;
+}
+assert (outer() == 106, "outer() modifies global");
+
+result = 1;
@@ -0,0 +1,67 @@
+// Closures: captured variables, and boxes for modified captured variables.
+
+//Counter: modifies a captured variable.
+function makeCounter (start) {
+    var count = start;
+    
+    return function () {
+        count++;
+        return count;
+    };
+}
+
+//Captures a variable which is not modified after the closure creation.
+function makeAdder (n) {
+    return function (x) {
+        return x + n;
+    };
+}
+
+//Multi-level capture.
+function nested (a) {
+    var b = a * 2;
+    
+    return function (c) {
+        return function () {
+            return a + b + c;
+        };
+    };
+}
+
+//Recursive local function.
+function factorial (n) {
+    function fact (x) {
+        if (x <= 1)
+            return 1;
+        else
+            return x * fact (x - 1);
+    }
+    return fact (n);
+}
+
+//Modified parameter, shared by two closures.
+function accumulator (total) {
+    var add = function (x) { total += x; };
+    var get = function () { return total; };
+    
+    add (5);
+    total = total * 2;
+    add (1);
+    return get();
+}
+
+var c1 = makeCounter (10);
+var c2 = makeCounter (0);
+
+c1();
+assert (c1() === 12, "Counter 1");
+assert (c2() === 1, "Counter 2");
+
+var add3 = makeAdder (3);
+assert (add3 (4) === 7, "Adder");
+
+assert (nested (1)(10)() === 13, "Nested capture");
+assert (factorial (5) === 120, "Recursive local function");
+assert (accumulator (1) === 13, "Modified parameter");
+
+result = 1;
@@ -0,0 +1,48 @@
+// Inlining of calls to small module functions.
+
+var base = 100;
+
+function add (a, b) { return a + b; }
+function square (x) { return x * x; }
+function sumSquares (a, b) { return add (square(a), square(b)); }
+function isEven (n) { return n % 2 == 0; }
+function getBase () { return base; }
+function ignoreSecond (a, b) { return a; }
+
+//Mutually recursive: should not be expanded forever.
+function even (n) { return n == 0 ? true : odd (n - 1); }
+function odd (n) { return n == 0 ? false : even (n - 1); }
+
+function useLocals (a) {
+    var b = 5;
+    var base = 1;       //Shall not be seen by 'getBase'
+    
+    return add (a, b) + getBase();
+}
+
+function countEven (list) {
+    var count = 0;
+    for (var i = 0; i < list.length; i++) {
+        if (isEven (list[i]))
+            count++;
+    }
+    return count;
+}
+
+function shadowed (add) {
+    return add (2, 3);
+}
+
+assert (add (2, 3) === 5, "add");
+assert (sumSquares (3, 4) === 25, "Nested inlining");
+assert (useLocals (1) === 106, "Caller locals hidden from inlined code");
+assert (countEven ([1, 2, 3, 4, 6]) === 3, "Inlined predicate");
+assert (ignoreSecond (7) === 7, "Missing arguments");
+assert (add (1, 2, 3) === 3, "Extra arguments");
+assert (even (10) && odd (7), "Mutual recursion");
+assert (shadowed (function (a, b) { return a * b; }) === 6, "Shadowed function");
+
+base = 200;
+assert (getBase() === 200, "Inlined global read");
+
+result = 1;
@@ -0,0 +1,79 @@
+// Type inference and numeric instructions.
+
+class PolynomicFunction (coefficients) {
+    function value (x) {
+        var result = 0;
+        var xn = 1;
+        
+        for (var i = 0; i < this.coefficients.length; i++) {
+            result += this.coefficients[i] * xn;
+            xn *= x;
+        }
+        return result;
+    }
+}
+
+//Counted loop: 'i' and 'sum' are always numbers.
+function sumTo (n) {
+    var sum = 0;
+    for (var i = 1; i <= n; i++)
+        sum += i;
+    return sum;
+}
+
+//'s' becomes a string: no numeric specialization.
+function concat (n) {
+    var s = 0;
+    for (var i = 0; i < n; i++)
+        s = s + "x";
+    return s;
+}
+
+//Unknown types: generic operators on the slow path.
+function operate (a, b) {
+    return [a + b, a - b, a * b, a / b, a < b, a <= b, a > b, a >= b];
+}
+
+function compareNumbers () {
+    var a = 3;
+    var b = 5;
+    var c = 5;
+    
+    return [a > b, a >= b, b >= c, b > c, a < b, a <= b, c <= b, b < c];
+}
+
+function postfix () {
+    var i = 10;
+    var old = i++;
+    var old2 = i--;
+    
+    return [old, old2, i];
+}
+
+var p = PolynomicFunction ([1, 2, 3]);
+assert (p.value(2) === 17, "Polynomial");
+assert (sumTo (100) === 5050, "Counted loop");
+assert (concat (3) === "0xxx", "String accumulation");
+
+var r = operate (6, 3);
+assert (r[0] === 9 && r[1] === 3 && r[2] === 18 && r[3] === 2, "Numeric arithmetic");
+assert (r[4] === false && r[5] === false && r[6] === true && r[7] === true, "Numeric compare");
+
+r = operate ("a", "b");
+assert (r[0] === "ab" && r[4] === true && r[7] === false, "String operators");
+
+r = operate (true, 2);
+assert (r[0] === 3 && r[2] === 2, "Boolean operands");
+
+r = operate (null, 1);
+assert (r[4] === false && r[5] === false, "Null comparison");
+
+r = compareNumbers ();
+assert (!r[0] && !r[1] && r[2] && !r[3] && r[4] && r[5] && r[6] && !r[7], "Proven numbers compare");
+
+r = postfix();
+assert (r[0] === 10 && r[1] === 11 && r[2] === 10, "Postfix operators");
+
+assert (3 >= 2 && !(2 >= 3), "'>=' operator");
+
+result = 1;
@@ -0,0 +1,58 @@
+// Field reads hoisted out of loops, and fields of frozen constants.
+
+//Polynomial evaluation. Coefficients are read from a frozen object.
+function evalPoly(poly, x) {
+    var result = 0;
+    for (var i = poly.coefficients.length - 1; i >= 0; i--)
+        result = result * x + poly.coefficients[i];
+    return result;
+}
+
+var poly = {coefficients: [1, 2, 3].freeze()}.freeze();
+assert (evalPoly(poly, 2) === 17, "Frozen polynomial");
+
+//Same code with mutable objects.
+var mpoly = {coefficients: [1, 2, 3]};
+assert (evalPoly(mpoly, 2) === 17, "Mutable polynomial");
+
+//Fields modified inside the loop shall be read again on each iteration.
+function countDown(counter) {
+    var steps = 0;
+    for (; counter.state.value > 0; steps++)
+        counter.state.value = counter.state.value - 1;
+    return steps;
+}
+assert (countDown({state: {value: 5}}) === 5, "Modified fields");
+
+//Objects replaced inside the loop.
+function replaced(obj) {
+    var sum = 0;
+    for (var i = 0; i < 3; i++) {
+        sum = sum + obj.data.x;
+        obj = {data: {x: obj.data.x + 1}};
+    }
+    return sum;
+}
+assert (replaced({data: {x: 1}.freeze()}.freeze()) === 6, "Replaced object");
+
+//Methods using 'this'.
+class Scaler (factor) {
+    function scaleAll (values) {
+        var result = [];
+        for (var i = 0; i < values.length; i++)
+            result.push(values[i] * this.factor);
+        return result;
+    }
+}
+var scaled = Scaler(3).freeze().scaleAll([1, 2]);
+assert (scaled[0] === 3 && scaled[1] === 6, "Frozen 'this'");
+scaled = Scaler(2).scaleAll([1, 2]);
+assert (scaled[0] === 2 && scaled[1] === 4, "Mutable 'this'");
+
+//Math functions are resolved at compile time.
+var total = 0;
+for (var i = 1; i <= 3; i++)
+    total = total + Math.pow(i, 2);
+assert (total === 14, "Math.pow in loop");
+
+result = 1;
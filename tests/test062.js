@@ -0,0 +1,85 @@
+// Functions compiled through the SSA intermediate representation.
+
+//Loop with several variables alive at the same time (phis).
+function fibonacci(n) {
+    var a = 0;
+    var b = 1;
+    for (var i = 0; i < n; i++) {
+        var t = a + b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+assert (fibonacci(10) === 55, "fibonacci(10)");
+assert (fibonacci(0) === 0, "fibonacci(0)");
+
+//Swap of variables in a loop: phi copies must be done in parallel.
+function swapCount(n) {
+    var x = 1;
+    var y = 2;
+    for (var i = 0; i < n; i++) {
+        var t = x;
+        x = y;
+        y = t;
+    }
+    return x * 10 + y;
+}
+assert (swapCount(3) === 21, "swapCount(3)");
+assert (swapCount(4) === 12, "swapCount(4)");
+
+//Logical and conditional operators.
+function classify(a, b) {
+    if (a > 0 && b > 0)
+        return "both";
+    else if (a > 0 || b > 0)
+        return "one";
+    return a == b ? "equal" : "none";
+}
+assert (classify(1, 1) === "both", "classify both");
+assert (classify(0, 1) === "one", "classify one");
+assert (classify(-1, -1) === "equal", "classify equal");
+assert (classify(-1, -2) === "none", "classify none");
+
+//Postfix and prefix operators, compound assignments.
+function counters(n) {
+    var i = 0;
+    var j = 10;
+    var k = i++;
+    --j;
+    k += j--;
+    var m = n++;
+    return i + "," + j + "," + k + "," + m + "," + n;
+}
+assert (counters(5) === "1,8,9,5,6", "counters: " + counters(5));
+
+//Constant conditions are folded.
+function folded(x) {
+    if (2 > 1)
+        x = x * 2;
+    else
+        x = x - 100;
+    return x + (3 * 4);
+}
+assert (folded(5) === 22, "folded");
+
+//Globals, fields, indexes and method calls.
+var total = 0;
+function accumulate(list) {
+    for (var i = 0; i < list.length; i++)
+        total += list[i];
+    list[0] = total;
+    return list.join("-");
+}
+assert (accumulate([1, 2, 3]) === "6-2-3", "accumulate");
+assert (total === 6, "global written");
+
+class Point (x, y) {
+    function norm1() {
+        var r = this.x < 0 ? -this.x : this.x;
+        return r + (this.y < 0 ? -this.y : this.y);
+    }
+}
+assert (Point(-3, 4).norm1() === 7, "method");
+
+result = 1;
@@ -0,0 +1,61 @@
+// Functions compiled on their first call.
+
+//Mutual recursion: 'isOdd' is defined after 'isEven'.
+function isEven(n) {
+    return n == 0 ? true : isOdd(n - 1);
+}
+function isOdd(n) {
+    return n == 0 ? false : isEven(n - 1);
+}
+assert (isEven(10), "isEven(10)");
+assert (isOdd(7), "isOdd(7)");
+
+//Functions which are never called are never compiled.
+function neverCalled(a) {
+    var total = 0;
+    for (var i = 0; i < a.length; i++)
+        total += a[i];
+    return total;
+}
+
+//Closures created by deferred functions.
+function makeCounter(start) {
+    var count = start;
+    return function () {
+        count = count + 1;
+        return count;
+    };
+}
+var counter = makeCounter(10);
+counter();
+assert (counter() === 12, "counter");
+
+//Functions stored in objects, called several times.
+var ops = {twice: function (x) {return x * 2;}};
+assert (ops.twice(3) === 6 && ops.twice(4) === 8, "function in object");
+
+//Class constructors and methods.
+class Vector (x, y) {
+    var len2 = x * x + y * y;
+    function dot(v) {return this.x * v.x + this.y * v.y;}
+}
+var v = Vector(3, 4);
+assert (v.len2 === 25, "constructor");
+assert (v.dot(Vector(1, 2)) === 11, "method");
+
+//Exceptions thrown by deferred functions.
+function checked(x) {
+    if (x < 0)
+        throw "negative";
+    return x;
+}
+var failed = false;
+try {
+    checked(-1);
+} catch (e) {
+    failed = true;
+}
+assert (failed, "exception on first call");
+assert (checked(5) === 5, "call after exception");
+
+result = 1;
@@ -0,0 +1,28 @@
+// Function bodies compiled in parallel. Results shall not depend on the 
+// order in which functions are compiled.
+
+const SCALE = 3;
+var calls = 0;
+
+function f1(x) {calls++; return f2(x) + 1;}
+function f2(x) {calls++; return f3(x) * 2;}
+function f3(x) {calls++; return f4(x) - 1;}
+function f4(x) {calls++; return x * SCALE;}
+
+class Accumulator (initial) {
+    var total = initial;
+    function add(x) {this.total = this.total + f4(x); return this;}
+}
+
+function sumTo(n) {
+    var acc = Accumulator(0);
+    for (var i = 1; i <= n; i++)
+        acc.add(i);
+    return acc.total;
+}
+
+assert (f1(2) === 11, "call chain: " + f1(2));
+assert (calls === 8, "calls: " + calls);
+assert (sumTo(4) === 30, "sumTo: " + sumTo(4));
+
+result = 1;
@@ -0,0 +1,26 @@
+// Runtime errors inside long functions (position tables with several checkpoints)
+
+function longFunction(list, n) {
+    var total = 0;
+    for (var i = 0; i < n; i++) {
+        total = total + i;
+        if (total > 1000)
+            total = total - 1000;
+        list.push(total);
+    }
+    var a = total * 2;
+    var b = a + total;
+    var c = b - a;
+    var d = c + 1;
+    var e = d * d;
+    assert (c == total, "c == total");
+    assert (e == (total + 1) * (total + 1), "e value");
+    
+    list.length = n - 100;     //Fails if 'n' is less than 100
+    return total;
+}
+
+assert (longFunction([], 120) >= 0, "longFunction([], 120)");
+
+result = "exception";
+longFunction([], 10);
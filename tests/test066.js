@@ -0,0 +1,24 @@
+// Runtime errors thrown from deep call stacks
+
+function recurse(list, n) {
+    if (n <= 0) {
+        list.length = -1;
+        return 0;
+    }
+    return recurse(list, n - 1) + 1;
+}
+
+function depth(n) {
+    if (n <= 0)
+        return 0;
+    return depth(n - 1) + 1;
+}
+
+//Errors in nested evaluations do not affect the caller execution.
+assert (expectError("function f(l, n) { if (n <= 0) { l.length = -1; return 0; } return f(l, n-1); } f([], 50);"), 
+        "error in nested evaluation");
+assert (expectError("var a = [1]; a.length = -5;"), "error at top level");
+assert (depth(200) == 200, "depth(200) after errors");
+
+result = "exception";
+recurse([], 300);
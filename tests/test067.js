@@ -0,0 +1,33 @@
+// Verified code execution: wide stack frames, many constants and deep recursion
+
+function manyLocals(x) {
+    var a1 = x + 1;   var a2 = a1 + 2;  var a3 = a2 + 3;  var a4 = a3 + 4;
+    var a5 = a4 + 5;  var a6 = a5 + 6;  var a7 = a6 + 7;  var a8 = a7 + 8;
+    var a9 = a8 + 9;  var a10 = a9 + 10; var a11 = a10 + 11; var a12 = a11 + 12;
+    
+    a1 = a12 - a11;
+    return a1 + a2 + a3 + a4 + a5 + a6 + a7 + a8 + a9 + a10 + a11 + a12;
+}
+
+function manyConstants() {
+    var names = ["c00", "c01", "c02", "c03", "c04", "c05", "c06", "c07", "c08", "c09",
+                 "c10", "c11", "c12", "c13", "c14", "c15", "c16", "c17", "c18", "c19",
+                 "c20", "c21", "c22", "c23", "c24", "c25", "c26", "c27", "c28", "c29",
+                 "c30", "c31", "c32", "c33", "c34", "c35", "c36", "c37", "c38", "c39",
+                 "c40", "c41", "c42", "c43", "c44", "c45", "c46", "c47", "c48", "c49",
+                 "c50", "c51", "c52", "c53", "c54", "c55", "c56", "c57", "c58", "c59",
+                 "c60", "c61", "c62", "c63", "c64", "c65", "c66", "c67", "c68", "c69"];
+    return names[0] + names[69];
+}
+
+function sumTo(n) {
+    if (n <= 0)
+        return 0;
+    return n + sumTo(n - 1);
+}
+
+assert (manyLocals(0) == 375, "manyLocals(0)");
+assert (manyConstants() == "c00c69", "manyConstants()");
+assert (sumTo(500) == 125250, "sumTo(500)");
+
+result = 1;
@@ -0,0 +1,65 @@
+// Actor runtime: messages dispatched to several actors in parallel
+
+function triangle (n) {
+    var sum = 0;
+    for (var i = 1; i <= n; i++)
+        sum = sum + i;
+    return sum;
+}
+
+actor Worker (id, master)
+{
+    input compute (n)
+    {
+        this.master.collect (this.id, triangle (n));
+    }
+}
+
+actor Sequence ()
+{
+    var next = 0;
+
+    input add (k)
+    {
+        assert (k == this.next, "Messages to an actor are processed in order: " + k);
+        this.next = k + 1;
+    }
+}
+
+actor Master (count, n, expected)
+{
+    var received = 0;
+    var total = 0;
+    var seq = Sequence();
+
+    input start ()
+    {
+        for (var i = 0; i < this.count; i++)
+        {
+            Worker (i, this).compute (this.n + i);
+            this.seq.add (i);
+        }
+    }
+
+    input collect (id, sum)
+    {
+        assert (sum == triangle (this.n + id), "Worker result: " + id);
+        this.received = this.received + 1;
+        this.total = this.total + sum;
+
+        if (this.received == this.count)
+            assert (this.total == this.expected, "All workers results");
+    }
+}
+
+var expected = 0;
+for (var i = 0; i < 32; i++)
+    expected = expected + triangle (500 + i);
+
+Master (32, 500, expected).start();
+Master (8, 100, 8 * triangle (100) + 28 * 100 + 84).start();
+
+//Outputs can only be sent by their own actor.
+assert (expectError ("actor A() { output o(x); } A().o(1);"), "Output sent from outside its actor");
+
+result = 1;
@@ -0,0 +1,41 @@
+// Actor mailboxes: many producers sending messages to one aggregator actor
+
+actor Aggregator (expectedCount, expectedSum)
+{
+    var count = 0;
+    var sum = 0;
+
+    input add (value)
+    {
+        this.count = this.count + 1;
+        this.sum = this.sum + value;
+
+        if (this.count == this.expectedCount)
+            assert (this.sum == this.expectedSum, "All messages received: " + this.sum);
+        assert (this.count <= this.expectedCount, "No duplicated messages");
+    }
+}
+
+actor Producer (target, base)
+{
+    input run (n)
+    {
+        for (var i = 0; i < n; i++)
+            this.target.add (this.base + i);
+    }
+}
+
+const producers = 16;
+const messages = 200;
+var expectedSum = 0;
+
+for (var p = 0; p < producers; p++)
+    for (var i = 0; i < messages; i++)
+        expectedSum = expectedSum + p * 1000 + i;
+
+var aggregator = Aggregator (producers * messages, expectedSum);
+
+for (var p = 0; p < producers; p++)
+    Producer (aggregator, p * 1000).run (messages);
+
+result = 1;
@@ -0,0 +1,35 @@
+// Actor messages: deep-frozen values are shared, mutable values are sent as deep-frozen copies
+
+var data = [];
+for (var i = 0; i < 20000; i++)
+    data.push({index: i, square: i * i});
+
+const shared = data.deepFreeze();
+
+actor Receiver (original, count)
+{
+    var received = 0;
+
+    input check (value, mutable)
+    {
+        assert (value === this.original, "Deep-frozen value passed by reference");
+        assert (value[19999].square === 19999 * 19999, "Shared value content");
+        assert (mutable.isDeepFrozen(), "Mutable values are deep-frozen");
+        assert (mutable.items[0] === 1, "Copied value content");
+        this.received = this.received + 1;
+        assert (this.received <= this.count, "Message count");
+    }
+}
+
+var mutable = {items: [1, 2, 3]};
+
+for (var r = 0; r < 4; r++)
+{
+    var receiver = Receiver (shared, 50);
+    for (var m = 0; m < 50; m++)
+        receiver.check (shared, mutable);
+}
+
+assert (!mutable.isDeepFrozen(), "Sender value is not modified");
+
+result = 1;
@@ -0,0 +1,36 @@
+// Batched dispatch: messages queued after an actor has failed are discarded
+
+actor Failing (limit)
+{
+    var count = 0;
+
+    input msg (k)
+    {
+        this.count = this.count + 1;
+        assert (k < this.limit, "Message over the limit");
+        assert (this.count == k + 1, "Messages processed in order");
+    }
+}
+
+actor Parent ()
+{
+    var child = Failing (10);
+    var stopped = 0;
+
+    input start ()
+    {
+        for (var i = 0; i < 100; i++)
+            this.child.msg (i);
+    }
+
+    input childStopped (child, result, error)
+    {
+        this.stopped = this.stopped + 1;
+        assert (this.stopped == 1, "Child stopped once");
+        assert (error != null, "Child error reported");
+    }
+}
+
+Parent().start();
+
+result = 1;
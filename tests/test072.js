@@ -0,0 +1,94 @@
+// Actor runtime: bounded mailboxes and overflow policies
+
+actor Sequence (first, last)
+{
+    var next = first;
+
+    input add (k)
+    {
+        assert (k == this.next, "Message in sequence: " + k + " (expected " + this.next + ")");
+        assert (k <= this.last, "Message out of range: " + k);
+        this.next = k + 1;
+    }
+
+    input finish ()
+    {
+        var stats = Mailbox.stats (this);
+
+        assert (this.next == this.last + 1, "Messages received: " + this.next);
+        assert (stats.highWatermark <= stats.capacity, "Mailbox bounded: " + stats.highWatermark);
+    }
+}
+
+//Messages sent from the main script are queued before any actor runs.
+//The constructor message also takes room in the mailbox.
+var newest = Sequence (0, 2);
+Mailbox.setLimit (newest, 4, "dropNewest");
+for (var i = 0; i < 10; i++)
+    newest.add (i);
+
+var stats = Mailbox.stats (newest);
+assert (stats.depth == 4, "dropNewest depth: " + stats.depth);
+assert (stats.highWatermark == 4, "dropNewest high watermark");
+assert (stats.dropped == 7, "dropNewest dropped: " + stats.dropped);
+assert (stats.capacity == 4 && stats.policy == "dropNewest", "dropNewest limits");
+
+//New messages evict the oldest ones. The constructor message is not evicted.
+var oldest = Sequence (7, 9);
+Mailbox.setLimit (oldest, 4, "dropOldest");
+for (var i = 0; i < 10; i++)
+    oldest.add (i);
+
+stats = Mailbox.stats (oldest);
+assert (stats.depth == 4, "dropOldest depth: " + stats.depth);
+assert (stats.highWatermark == 4, "dropOldest high watermark: " + stats.highWatermark);
+assert (stats.dropped == 7, "dropOldest dropped: " + stats.dropped);
+
+//Producers are suspended until the consumer has room in its mailbox. They
+//handle their next messages meanwhile, so message numbers are taken just 
+//before sending them.
+actor Producer (sink, total)
+{
+    var next = 0;
+
+    input produce (count)
+    {
+        for (var i = 0; i < count; i++)
+        {
+            var k = this.next;
+            this.next = k + 1;
+            this.sink.add (k);
+
+            var depth = Mailbox.stats(this.sink).depth;
+            assert (depth <= 2, "Consumer mailbox depth: " + depth);
+        }
+
+        if (this.next == this.total)
+            this.sink.finish ();
+    }
+}
+
+var sink = Sequence (0, 99);
+var producer = Producer (sink, 100);
+
+Mailbox.setLimit (sink, 2, "block");
+for (var i = 0; i < 5; i++)
+    producer.produce (20);
+
+//The main script is not suspended: its messages wait out of the full mailbox.
+var held = Sequence (0, 9);
+Mailbox.setLimit (held, 2, "block");
+for (var i = 0; i < 10; i++)
+    held.add (i);
+held.finish ();
+
+stats = Mailbox.stats (held);
+assert (stats.depth == 2 && stats.highWatermark == 2, "Held messages out of the mailbox: " + stats.depth);
+
+//Failed sends raise an error in the sender.
+assert (expectError ("actor A() { input m(x) {} } var a = A(); Mailbox.setLimit(a, 2, 'fail'); a.m(1); a.m(2);"), 
+        "Send to a full mailbox with 'fail' policy");
+assert (expectError ("actor A() {} Mailbox.setLimit(A(), 2, 'wait');"), "Unknown overflow policy");
+assert (expectError ("Mailbox.stats({});"), "Mailbox of a non actor");
+
+result = 1;
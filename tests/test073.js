@@ -0,0 +1,69 @@
+// Actor runtime: delayed and periodic messages
+
+actor Sequence (first, last)
+{
+    var next = first;
+
+    input add (k)
+    {
+        assert (k == this.next, "Message in sequence: " + k + " (expected " + this.next + ")");
+        assert (k <= this.last, "Message out of range: " + k);
+        this.next = k + 1;
+    }
+}
+
+//Timers expire in order.
+var seq = Sequence (1, 3);
+Timer.after (30, seq.add, 3);
+Timer.after (10, seq.add, 1);
+Timer.after (20, seq.add, 2);
+
+var cancelled = Timer.after (15, seq.add, 99);
+assert (Timer.cancel (cancelled), "Pending timer cancelled");
+assert (!Timer.cancel (cancelled), "Timer cancelled twice");
+
+//Periodic timers run until cancelled.
+actor Clock (period, count)
+{
+    var ticks = 0;
+    var timer = Timer.every (this.period, this.tick, "tick");
+
+    input tick (name)
+    {
+        assert (name == "tick", "Periodic timer message parameter");
+        this.ticks++;
+
+        if (this.ticks == this.count)
+            assert (Timer.cancel (this.timer), "Periodic timer cancelled");
+    }
+}
+
+Clock (2, 5);
+Clock (1, 20);
+
+//Many pending timers.
+actor Counter ()
+{
+    var count = 0;
+
+    input add ()
+    {
+        this.count++;
+    }
+
+    input check (expected)
+    {
+        assert (this.count == expected, "All timers expired: " + this.count);
+    }
+}
+
+var counter = Counter();
+for (var i = 0; i < 20000; i++)
+    Timer.after (i % 600, counter.add);
+Timer.after (700, counter.check, 20000);
+
+assert (expectError ("Timer.after (-1, Counter().add);"), "Negative delay");
+assert (expectError ("Timer.every (0, Counter().add);"), "Zero period");
+assert (expectError ("Timer.after (1, function(){});"), "Timer message is not an input");
+
+result = 1;
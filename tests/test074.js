@@ -0,0 +1,98 @@
+// Actor runtime: I/O actors over pipes, Unix domain and loopback TCP sockets
+
+//Echo server. Accepted sockets events are sent through the server outputs.
+actor EchoServer (kind, clients)
+{
+    var closed = 0;
+    const server = (kind == "tcp") ? IO.TcpServer (0) : IO.UnixServer ("/tmp/asyncscript-test074.sock");
+
+    onListening <- this.server.listening;
+    onData <- this.server.data;
+    onClosed <- this.server.closed;
+
+    input onListening (address)
+    {
+        for (var i = 0; i < this.clients; i++)
+            EchoClient (this.kind, address, i).start();
+    }
+
+    input onData (conn, text)
+    {
+        conn.write (text);
+    }
+
+    input onClosed (conn, error)
+    {
+        assert (error == null, "Server socket error: " + error);
+        conn.close();
+
+        this.closed++;
+        if (this.closed == this.clients)
+            this.server.close();
+    }
+}
+
+actor EchoClient (kind, address, id)
+{
+    var received = "";
+    const stream = (kind == "tcp") ? IO.TcpSocket (address) : IO.UnixSocket (address);
+
+    onData <- this.stream.data;
+    onClosed <- this.stream.closed;
+
+    input start ()
+    {
+        for (var i = 0; i < 3; i++)
+            this.stream.write ("[" + this.id + ":" + i + "]");
+        this.stream.close();
+    }
+
+    input onData (conn, text)
+    {
+        this.received = this.received + text;
+    }
+
+    input onClosed (conn, error)
+    {
+        var expected = "";
+        for (var i = 0; i < 3; i++)
+            expected = expected + "[" + this.id + ":" + i + "]";
+
+        assert (error == null, "Client socket error: " + error);
+        assert (this.received == expected, "Echo received by client " + this.id + ": " + this.received);
+    }
+}
+
+//Data written to a pipe is read back from it.
+actor PipeTest (count)
+{
+    var received = 0;
+    const pipe = IO.Pipe ();
+
+    onData <- this.pipe.data;
+    onClosed <- this.pipe.closed;
+
+    input start ()
+    {
+        for (var i = 0; i < this.count; i++)
+            this.pipe.write ("0123456789");
+        this.pipe.close();
+    }
+
+    input onData (stream, text)
+    {
+        this.received = this.received + text.length;
+    }
+
+    input onClosed (stream, error)
+    {
+        assert (error == null, "Pipe error: " + error);
+        assert (this.received == this.count * 10, "Pipe data length: " + this.received);
+    }
+}
+
+EchoServer ("tcp", 10);
+EchoServer ("unix", 10);
+PipeTest (20000).start();
+
+result = 1;
@@ -0,0 +1,109 @@
+// Actor runtime: asynchronous file actors
+
+//Writes a file with many pipelined writes, and reads it back when closed.
+actor Writer (path, lines)
+{
+    var total = 0;
+    const file = IO.File (path, "w");
+
+    onWritten <- this.file.written;
+    onClosed <- this.file.closed;
+
+    input start ()
+    {
+        for (var i = 0; i < this.lines; i++)
+            this.file.write ("line " + i + "\n");
+        this.file.close();
+    }
+
+    input onWritten (file, bytes)
+    {
+        this.total = this.total + bytes;
+    }
+
+    input onClosed (file, error)
+    {
+        assert (error == null, "Write error: " + error);
+        Reader (this.path, this.lines, this.total).start();
+    }
+}
+
+//Reads a file in pipelined chunks, and its first line at an explicit offset.
+//Completions arrive in request order.
+actor Reader (path, lines, size)
+{
+    var text = "";
+    var nextOffset = 0;
+    var header = "";
+    const file = IO.File (path);
+
+    onData <- this.file.data;
+    onClosed <- this.file.closed;
+
+    input start ()
+    {
+        this.file.read (100, 0);
+        for (var i = 1; i * 100 < this.size; i++)
+            this.file.read (100);
+        this.file.read (100);
+        this.file.read (6, 0);
+        this.file.close();
+    }
+
+    input onData (file, offset, chunk)
+    {
+        if (offset == 0 && this.nextOffset > 0)
+        {
+            this.header = chunk;
+            return;
+        }
+        assert (offset == this.nextOffset, "Chunk offset: " + offset);
+        this.text = this.text + chunk;
+        this.nextOffset = offset + 100;
+    }
+
+    input onClosed (file, error)
+    {
+        var expected = "";
+        for (var i = 0; i < this.lines; i++)
+            expected = expected + "line " + i + "\n";
+
+        assert (error == null, "Read error: " + error);
+        assert (this.header == "line 0", "Header: " + this.header);
+        assert (this.size == expected.length, "Written size: " + this.size);
+        assert (this.text == expected, "File contents length: " + this.text.length);
+    }
+}
+
+//I/O errors close the file, and are sent in the 'closed' message.
+actor ErrorTest (path)
+{
+    var dataCount = 0;
+    var error = null;
+    const file = IO.File (path, "r");
+
+    onData <- this.file.data;
+    onClosed <- this.file.closed;
+
+    input start ()
+    {
+        this.file.write ("Not writable");
+        this.file.read (10, 0);
+    }
+
+    input onData (file, offset, chunk)
+    {
+        this.dataCount++;
+    }
+
+    input onClosed (file, error)
+    {
+        assert (error != null, "Write on a read-only file shall fail");
+        assert (this.dataCount == 0, "Data after an error");
+    }
+}
+
+Writer ("/tmp/asyncscript-test075.txt", 2000).start();
+ErrorTest ("/dev/null").start();
+
+result = 1;
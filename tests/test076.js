@@ -0,0 +1,104 @@
+// Actor runtime: request messages and futures
+
+actor Worker (factor)
+{
+    input multiply (x)
+    {
+        return { value: x * this.factor };
+    }
+
+    input fail (text)
+    {
+        assert (false, text);
+    }
+}
+
+//Fans out requests to several workers, and fans in their replies.
+actor Client (workers)
+{
+    var pool = [];
+    var replies = 0;
+    var allDone = false;
+    var failed = false;
+    var stopped = false;
+    var childErrors = 0;
+
+    input start ()
+    {
+        for (var i = 0; i < this.workers; i++)
+            this.pool.push (Worker (i + 1));
+
+        var futures = [];
+        for (var i = 0; i < this.pool.length; i++)
+            futures.push (Future.request (this.pool[i].multiply, 10));
+
+        //Continuations of a future are called in registration order, so all
+        //replies are received before the combined one.
+        for (var i = 0; i < this.pool.length; i++)
+            Future.then (futures[i], this.onReply, i);
+
+        Future.then (Future.all (futures), this.onAll, "tag");
+    }
+
+    input onReply (value, error, index)
+    {
+        assert (error == null, "Reply error: " + error);
+        assert (value.value == (index + 1) * 10, "Reply " + index + ": " + value.value);
+        this.replies++;
+    }
+
+    input onAll (values, error, tag)
+    {
+        var sum = 0;
+        for (var i = 0; i < values.length; i++)
+            sum = sum + values[i].value;
+
+        assert (error == null, "Fan-in error: " + error);
+        assert (tag == "tag", "Continuation parameter: " + tag);
+        assert (values.length == this.workers, "Fan-in values: " + values.length);
+        assert (sum == 10 * this.workers * (this.workers + 1) / 2, "Fan-in sum: " + sum);
+        assert (this.replies == this.workers, "Replies received: " + this.replies);
+        this.allDone = true;
+
+        Future.then (Future.request (this.pool[0].fail, "Request failed"), this.onFailed);
+    }
+
+    input onFailed (value, error)
+    {
+        assert (value == null, "Failed request value");
+        assert (error != null, "Failed request error");
+        this.failed = true;
+
+        //The worker has stopped, so new requests fail.
+        Future.then (Future.request (this.pool[0].multiply, 1), this.onStopped);
+    }
+
+    input onStopped (value, error)
+    {
+        assert (error != null, "Request to a stopped actor shall fail");
+        assert (this.allDone, "Fan-in completed");
+        assert (this.childErrors == 1, "Worker failure reported");
+        this.stopped = true;
+    }
+
+    //Sent by a timer, independently of the continuations, so it fails if any
+    //of them has not run.
+    input check ()
+    {
+        assert (this.replies == this.workers, "Replies received: " + this.replies);
+        assert (this.allDone, "Fan-in continuation called");
+        assert (this.failed, "Failed request continuation called");
+        assert (this.stopped, "Stopped actor continuation called");
+    }
+
+    input childStopped (child, result, error)
+    {
+        this.childErrors++;
+    }
+}
+
+var client = Client (8);
+client.start();
+Timer.after (500, client.check);
+
+result = 1;
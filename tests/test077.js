@@ -0,0 +1,112 @@
+// Actor runtime: suspendable message handlers
+
+actor Worker ()
+{
+    input double (x)
+    {
+        return x * 2;
+    }
+
+    //The reply is sent when the suspended handler finishes.
+    input slowIncrement (x)
+    {
+        Future.await (Timer.delay (2));
+        return x + 1;
+    }
+
+    input fail (text)
+    {
+        assert (false, text);
+    }
+}
+
+//Suspended from a function called by the handler.
+function doublePlusOne (worker, x)
+{
+    return Future.await (Future.request (worker.double, x)) + 1;
+}
+
+actor Client ()
+{
+    var worker = null;
+    var pings = 0;
+    var finished = false;
+
+    input run ()
+    {
+        this.worker = Worker ();
+
+        var a = Future.await (Future.request (this.worker.double, 21));
+        assert (a == 42, "Awaited reply: " + a);
+
+        var b = doublePlusOne (this.worker, 10);
+        assert (b == 21, "Awaited in a called function: " + b);
+
+        //Locals survive many suspensions.
+        var sum = 0;
+        for (var i = 0; i < 100; i++)
+            sum = sum + Future.await (Future.request (this.worker.double, i));
+        assert (sum == 9900, "Sum of awaited replies: " + sum);
+
+        //The actor handles other messages while suspended.
+        this.ping ();
+        Future.await (Timer.delay (20));
+        assert (this.pings == 1, "Messages handled while suspended: " + this.pings);
+
+        var c = Future.await (Future.request (this.worker.slowIncrement, 7));
+        assert (c == 8, "Reply of a suspended handler: " + c);
+
+        var values = Future.await (Future.all ([Future.request (this.worker.double, 1),
+                                                Future.request (this.worker.slowIncrement, 1)]));
+        assert (values[0] == 2 && values[1] == 2, "Awaited fan-in: " + values);
+
+        this.finished = true;
+    }
+
+    input ping ()
+    {
+        this.pings++;
+    }
+
+    //Sent by a timer, so it fails if the handler has not been resumed to
+    //its end.
+    input check ()
+    {
+        assert (this.finished, "Handler finished");
+    }
+}
+
+//Errors of awaited futures are raised by 'Future.await'.
+actor Awaiter (target)
+{
+    input run ()
+    {
+        Future.await (Future.request (this.target.fail, "Failed request"));
+        assert (false, "Execution shall not resume after an error");
+    }
+}
+
+actor ErrorTest ()
+{
+    var errors = 0;
+
+    input run ()
+    {
+        Awaiter (Worker ()).run ();
+    }
+
+    input childStopped (child, result, error)
+    {
+        this.errors++;
+        assert (error != null && error.indexOf ("Failed request") >= 0, "Awaited error: " + error);
+    }
+}
+
+var client = Client ();
+client.run ();
+Timer.after (1000, client.check);
+ErrorTest ().run ();
+
+expectError ("Future.await (Timer.delay (1))");
+
+result = 1;
@@ -0,0 +1,34 @@
+// Code generation: only deep-frozen module constants are folded into code
+
+const items = [];
+const settings = {limit: 10}.deepFreeze();
+
+function isItemsFrozen ()
+{
+    return items.isDeepFrozen();
+}
+
+function limit ()
+{
+    return settings.limit;
+}
+
+//Functions are compiled on their first call, once module constants are defined.
+items.push (1);
+assert (!isItemsFrozen (), "Module constant in the main script");
+assert (limit () == 10, "Deep-frozen module constant");
+
+//Actors see deep-frozen snapshots of module globals, which cannot be replaced
+//by the objects of the main script folded into the code.
+actor Reader ()
+{
+    input run ()
+    {
+        assert (isItemsFrozen (), "Module constant in an actor");
+        assert (limit () == 10, "Deep-frozen module constant in an actor");
+    }
+}
+
+Reader ().run ();
+
+result = 1;
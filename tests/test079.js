@@ -0,0 +1,65 @@
+// Closures: variables captured by frozen closures cannot be modified
+
+function makeCounter ()
+{
+    var count = 0;
+    return function () {
+        count++;
+        return count;
+    };
+}
+
+function makeReader (value)
+{
+    var current = value;
+    var reader = function () {
+        return current;
+    };
+    current = current * 2;
+    return reader;
+}
+
+const counter = makeCounter ();
+const reader = makeReader (21);
+
+assert (counter () == 1 && counter () == 2, "Mutable closure");
+
+//Actors see deep-frozen copies of module globals, so the captured variables
+//of their closures are read-only.
+actor ReadTest ()
+{
+    input run ()
+    {
+        assert (reader () == 42, "Read of a frozen captured variable");
+    }
+}
+
+actor WriteTest ()
+{
+    input run ()
+    {
+        counter ();
+        assert (false, "Write to a frozen captured variable shall fail");
+    }
+}
+
+actor Parent ()
+{
+    var errors = 0;
+
+    input run ()
+    {
+        ReadTest ().run ();
+        WriteTest ().run ();
+    }
+
+    input childStopped (child, result, error)
+    {
+        this.errors++;
+        assert (error != null && error.indexOf ("frozen closure") >= 0, "Write error: " + error);
+    }
+}
+
+Parent ().run ();
+
+result = 1;
@@ -0,0 +1,43 @@
+// Actor runtime: class code uses the module globals of the actor
+
+var items = [];
+var counter = 0;
+
+class Item (value)
+{
+    var itemsFrozen = items.isDeepFrozen ();
+
+    function isItemsFrozen ()
+    {
+        return items.isDeepFrozen ();
+    }
+
+    function next ()
+    {
+        counter++;
+        return counter;
+    }
+}
+
+items.push (1);
+assert (!Item (1).isItemsFrozen (), "Class method in the main script");
+
+//Actor globals are a deep-frozen copy of the module globals. Class constructors
+//and methods shall use it, even on objects created by the main script.
+actor Reader (item)
+{
+    input run ()
+    {
+        var local = Item (2);
+
+        assert (local.itemsFrozen, "Class constructor in an actor");
+        assert (local.isItemsFrozen (), "Class method in an actor");
+        assert (this.item.isItemsFrozen (), "Method of an object received by an actor");
+        assert (local.next () == 1 && local.next () == 2, "Module variable written by a class method");
+    }
+}
+
+Reader (Item (3)).run ();
+Reader (Item (4)).run ();
+
+result = 1;
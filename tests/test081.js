@@ -0,0 +1,40 @@
+// Actor runtime: socket connections completed by the I/O reactor
+
+//Finds a free port, and connects to it once its server is closed.
+actor PortFinder ()
+{
+    const server = IO.TcpServer (0);
+
+    onListening <- this.server.listening;
+
+    input onListening (port)
+    {
+        Future.await (Future.request (this.server.close));
+        Refused (port);
+    }
+}
+
+//Connection errors are sent in the 'closed' message.
+actor Refused (port)
+{
+    var dataCount = 0;
+    const stream = IO.TcpSocket (port);
+
+    onData <- this.stream.data;
+    onClosed <- this.stream.closed;
+
+    input onData (conn, text)
+    {
+        this.dataCount++;
+    }
+
+    input onClosed (conn, error)
+    {
+        assert (error != null && error.indexOf ("connect") >= 0, "Connection error: " + error);
+        assert (this.dataCount == 0, "Data from a refused connection");
+    }
+}
+
+PortFinder ();
+
+result = 1;
@@ -0,0 +1,35 @@
+// Actor runtime: drain quota and interleaving of actors
+
+//Two senders receive the same number of messages. Each one reports the messages
+//it handles to a recorder. With a single worker thread, the order of the
+//reports shows how the scheduler has interleaved both senders.
+function interleaving (drainQuota, expected)
+{
+    var code = "actor Recorder (expected) {" +
+    "    var order = '';" +
+    "    input record (name) { this.order = this.order + name; }" +
+    "    input check () { assert (this.order == this.expected, 'Interleaving: ' + this.order); }" +
+    "}" +
+    "actor Sender (name, recorder) {" +
+    "    input ping () { this.recorder.record (this.name); }" +
+    "}" +
+    "actor Starter (a, b) {" +
+    "    input go (count) {" +
+    "        for (var i = 0; i < count; i++) this.a.ping ();" +
+    "        for (var i = 0; i < count; i++) this.b.ping ();" +
+    "    }" +
+    "}" +
+    "var recorder = Recorder ('" + expected + "');" +
+    "Starter (Sender ('a', recorder), Sender ('b', recorder)).go (4);" +
+    "Timer.after (100, recorder.check);";
+
+    runScript (code, {drainQuota: drainQuota, actorThreads: 1});
+}
+
+//Each activation handles a single message, so both senders alternate.
+interleaving (1, "abababab");
+
+//The senders handle all their messages on a single activation.
+interleaving (32, "aaaabbbb");
+
+result = 1;
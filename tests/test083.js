@@ -0,0 +1,29 @@
+// Native namespaces (Math, JSON, Integer) are frozen constants
+
+assert (Math.isFrozen (), "Math is frozen");
+assert (JSON.isFrozen (), "JSON is frozen");
+assert (Integer.isFrozen (), "Integer is frozen");
+assert (Math.isDeepFrozen (), "Math is deep-frozen");
+
+//Writes to their members are ignored.
+Math.pow = function (x, y) { return 0; };
+Math.answer = 42;
+JSON.stringify = null;
+assert (Math.pow (2, 3) == 8, "Math member replaced");
+assert (Math.answer == null, "Math member added");
+assert (JSON.stringify != null, "JSON member replaced");
+
+//Which allows the code generator to resolve their functions at compile time.
+function power (x)
+{
+    return Math.pow (x, 2);
+}
+
+assert (power (3) == 9, "Folded native function call");
+
+//Other objects are not affected.
+var point = {x: 1};
+point.x = 2;
+assert (point.x == 2 && !point.isFrozen (), "User objects stay mutable");
+
+result = 1;
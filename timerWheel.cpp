@@ -0,0 +1,182 @@
+/*
+ * File:   timerWheel.cpp
+ * Author: ghernan
+ *
+ * Hierarchical timer wheel.
+ *
+ * Created on October 18, 2026, 9:40 PM
+ */
+
+#include "ascript_pch.hpp"
+#include "timerWheel.h"
+
+static const uint64_t SLOT_MASK = TimerWheel::SLOTS - 1;
+static const uint64_t MAX_DELTA = (uint64_t(1) << (TimerWheel::SLOT_BITS * TimerWheel::LEVELS)) - 1;
+
+/**
+ * Creates an empty timer wheel.
+ * @param current   First tick to process.
+ */
+TimerWheel::TimerWheel (uint64_t current)
+: m_current(current), m_count(0)
+{
+}
+
+/**
+ * Inserts an entry. Entries whose expiration tick has already been processed
+ * expire on the next processed tick. Entries beyond the wheel range are
+ * placed at its end, and re-inserted when they are reached.
+ * @param entry     It shall not be in the wheel.
+ */
+void TimerWheel::insert (TimerEntry* entry)
+{
+    uint64_t    expires = entry->expires;
+
+    if (expires < m_current)
+        expires = m_current;
+    else if (expires - m_current > MAX_DELTA)
+        expires = m_current + MAX_DELTA;
+
+    const uint64_t  delta = expires - m_current;
+    unsigned        level = 0;
+
+    while (level < LEVELS - 1 && delta >= (uint64_t(1) << (SLOT_BITS * (level + 1))))
+        ++level;
+
+    const unsigned  slot = (unsigned)((expires >> (SLOT_BITS * level)) & SLOT_MASK);
+
+    entry->insertBefore(&m_slots[level][slot]);
+    ++m_count;
+}
+
+/**
+ * Removes an entry from the wheel.
+ * @param entry
+ * @return false if the entry was not in the wheel.
+ */
+bool TimerWheel::remove (TimerEntry* entry)
+{
+    if (!entry->isLinked())
+        return false;
+
+    entry->unlink();
+    --m_count;
+    return true;
+}
+
+/**
+ * Processes all ticks up to 'now', included.
+ * @param now
+ * @param pExpired  [out] The expired entries are appended to it, in
+ * expiration order. They are no longer in the wheel.
+ */
+void TimerWheel::advance (uint64_t now, std::vector<TimerEntry*>* pExpired)
+{
+    while (m_current <= now)
+    {
+        if (m_count == 0)
+        {
+            m_current = now + 1;
+            break;
+        }
+        tick (pExpired);
+    }
+}
+
+/**
+ * Removes all entries from the wheel.
+ * @param pEntries  [out] The entries are appended to it.
+ */
+void TimerWheel::clear (std::vector<TimerEntry*>* pEntries)
+{
+    for (unsigned level = 0; level < LEVELS; ++level)
+    {
+        for (unsigned slot = 0; slot < SLOTS; ++slot)
+        {
+            TimerLink&  head = m_slots[level][slot];
+
+            while (head.isLinked())
+            {
+                TimerLink*  link = head.next;
+
+                link->unlink();
+                pEntries->push_back(static_cast<TimerEntry*>(link));
+            }
+        }
+    }
+    m_count = 0;
+}
+
+/**
+ * Gets the next tick at which there may be work to do: the first one with
+ * entries on the first level, or the next cascade.
+ * @return
+ */
+uint64_t TimerWheel::nextTick ()const
+{
+    for (uint64_t t = m_current; ; ++t)
+    {
+        const unsigned slot = (unsigned)(t & SLOT_MASK);
+
+        if (slot == 0 || m_slots[0][slot].isLinked())
+            return t;
+    }
+}
+
+/**
+ * Processes the current tick.
+ * @param pExpired  [out]
+ */
+void TimerWheel::tick (std::vector<TimerEntry*>* pExpired)
+{
+    unsigned    index = (unsigned)(m_current & SLOT_MASK);
+
+    //When a level completes a rotation, the next slot of the upper level is
+    //cascaded. It may complete a rotation too.
+    for (unsigned level = 1; index == 0 && level < LEVELS; ++level)
+    {
+        index = (unsigned)((m_current >> (SLOT_BITS * level)) & SLOT_MASK);
+        cascade (level, index);
+    }
+
+    TimerLink&  head = m_slots[0][m_current & SLOT_MASK];
+
+    while (head.isLinked())
+    {
+        TimerLink*  link = head.next;
+
+        link->unlink();
+        --m_count;
+        pExpired->push_back(static_cast<TimerEntry*>(link));
+    }
+
+    ++m_current;
+}
+
+/**
+ * Moves the entries of an upper level slot to the lower levels.
+ * @param level
+ * @param slot
+ */
+void TimerWheel::cascade (unsigned level, unsigned slot)
+{
+    TimerLink&  head = m_slots[level][slot];
+    TimerLink   pending;
+
+    //Entries are moved to a temporary list first, so the ones re-inserted in
+    //the same slot are not visited again.
+    if (!head.isLinked())
+        return;
+
+    pending.insertBefore(&head);
+    head.unlink();
+
+    while (pending.isLinked())
+    {
+        TimerLink*  link = pending.next;
+
+        link->unlink();
+        --m_count;
+        insert (static_cast<TimerEntry*>(link));
+    }
+}
@@ -0,0 +1,112 @@
+/*
+ * File:   timerWheel.h
+ * Author: ghernan
+ *
+ * Hierarchical timer wheel. Keeps a large number of pending timeouts with
+ * constant time insertion and cancellation.
+ *
+ * Created on October 18, 2026, 9:40 PM
+ */
+
+#ifndef TIMERWHEEL_H
+#define	TIMERWHEEL_H
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+/**
+ * Link of the circular lists of timer wheel slots. An unlinked entry points
+ * to itself.
+ */
+struct TimerLink
+{
+    TimerLink*  prev;
+    TimerLink*  next;
+
+    TimerLink() : prev(this), next(this)
+    {}
+
+    bool isLinked()const
+    {
+        return next != this;
+    }
+
+    void unlink()
+    {
+        prev->next = next;
+        next->prev = prev;
+        prev = next = this;
+    }
+
+    void insertBefore (TimerLink* link)
+    {
+        prev = link->prev;
+        next = link;
+        prev->next = this;
+        link->prev = this;
+    }
+
+private:
+    //Copy operations forbidden
+    TimerLink(const TimerLink&);
+    TimerLink& operator=(const TimerLink&);
+};
+
+/**
+ * Timer wheel entry. Timer objects derive from it. The wheel does not own
+ * its entries.
+ */
+struct TimerEntry : public TimerLink
+{
+    uint64_t    expires = 0;    //Expiration tick.
+};
+
+/**
+ * Hierarchical timer wheel.
+ *
+ * It has several levels of slots. The first level has a slot for each of the
+ * next ticks; each slot of the following levels covers all the ticks of a
+ * full rotation of the previous level. When a level completes a rotation, the
+ * entries of the next slot of the upper level are moved ('cascaded') to the
+ * lower levels. So inserting and removing entries take constant time, and
+ * expiring them, amortized constant time.
+ */
+class TimerWheel
+{
+public:
+    static const unsigned   SLOT_BITS = 8;
+    static const unsigned   SLOTS = 1 << SLOT_BITS;
+    static const unsigned   LEVELS = 4;
+
+    TimerWheel (uint64_t current = 0);
+
+    void insert (TimerEntry* entry);
+    bool remove (TimerEntry* entry);
+    void advance (uint64_t now, std::vector<TimerEntry*>* pExpired);
+    void clear (std::vector<TimerEntry*>* pEntries);
+
+    uint64_t nextTick ()const;
+
+    uint64_t currentTick()const
+    {
+        return m_current;
+    }
+
+    size_t size()const
+    {
+        return m_count;
+    }
+
+private:
+    void tick (std::vector<TimerEntry*>* pExpired);
+    void cascade (unsigned level, unsigned slot);
+
+    TimerLink   m_slots[LEVELS][SLOTS];
+    uint64_t    m_current;      //Next tick to process.
+    size_t      m_count;
+};
+
+#endif	/* TIMERWHEEL_H */
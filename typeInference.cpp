@@ -0,0 +1,532 @@
+/*
+ * File:   typeInference.cpp
+ * Author: ghernan
+ *
+ * Local type inference. Finds local variables and expressions which are
+ * always numbers, booleans or strings, so the code generator can emit
+ * specialized instructions for them.
+ *
+ * The analysis is optimistic: every local variable starts with a 'pending'
+ * type, which is refined with the types of the values assigned to it until
+ * no type changes. Variables which receive values of different (or unknown)
+ * types are 'unknown'. Parameters, global variables and boxed variables
+ * (modified by closures) are always 'unknown'.
+ *
+ * Created on October 18, 2026, 4:10 PM
+ */
+
+#include "ascript_pch.hpp"
+#include "typeInference.h"
+#include "jsLexer.h"
+
+using namespace std;
+
+/**
+ * Value written into a local variable.
+ */
+struct TypeSource
+{
+    Ref<AstNode>    expr;       //NULL for '++' and '--'
+    int             op;         //'=' or binary operator
+};
+
+/**
+ * Local variable found by the analysis.
+ */
+struct LocalBinding
+{
+    LocalVarKey         key;
+    ExprType            type;
+    vector<TypeSource>  sources;
+};
+
+/**
+ * Scope, with the same structure as the code generator scopes.
+ */
+struct TypeScope
+{
+    const AstNode*      owner;
+    bool                isBlock;
+    map<string, int>    bindings;
+};
+
+/**
+ * Local types analysis of a function (or a script) body.
+ */
+class LocalTypeAnalysis : public TypeResolver
+{
+public:
+    LocalTypeAnalysis (const set<string>& boxed) : m_boxed(boxed)
+    {}
+
+    void        pushScope (const AstNode* owner, bool isBlock);
+    void        popScope ();
+    int         declare (const string& name, ExprType type);
+
+    void        walk (Ref<AstNode> node);
+    void        solve ();
+    LocalTypes  result ()const;
+
+    virtual ExprType identifierType (Ref<AstNode> identifier)const;
+
+private:
+    int         resolve (const string& name)const;
+    void        addSource (Ref<AstNode> identifier, Ref<AstNode> expr, int op);
+    ExprType    sourceType (const LocalBinding& binding, const TypeSource& source)const;
+
+    const set<string>&          m_boxed;
+    vector<LocalBinding>        m_bindings;
+    vector<TypeScope>           m_scopes;
+    map<const AstNode*, int>    m_resolved;
+};
+
+ExprType joinTypes (ExprType a, ExprType b);
+ExprType literalType (ASValue value);
+
+/**
+ * Infers the types of the local variables of a function or script.
+ * @param scopeNode     Node which owns the outermost scope (the function or
+ * script node).
+ * @param params        Function parameters.
+ * @param statements    Code
+ * @param boxed         Boxed variables, whose type is never inferred.
+ * @return
+ */
+LocalTypes inferLocalTypes (Ref<AstNode> scopeNode,
+                            const StringVector& params,
+                            const AstNodeList& statements,
+                            const std::set<std::string>& boxed)
+{
+    LocalTypeAnalysis   analysis (boxed);
+
+    analysis.pushScope(scopeNode.getPointer(), false);
+    for (auto it = params.begin(); it != params.end(); ++it)
+        analysis.declare(*it, ET_UNKNOWN);
+
+    for (auto it = statements.begin(); it != statements.end(); ++it)
+        analysis.walk (*it);
+
+    analysis.solve();
+    return analysis.result();
+}
+
+/**
+ * Infers the type of an expression.
+ * @param expr
+ * @param resolver      Gives the types of the referenced variables.
+ * @return
+ */
+ExprType inferExprType (Ref<AstNode> expr, const TypeResolver& resolver)
+{
+    if (expr.isNull())
+        return ET_UNKNOWN;
+
+    switch (expr->getType())
+    {
+    case AST_LITERAL:
+        return literalType (expr->getValue());
+
+    case AST_IDENTIFIER:
+        return resolver.identifierType(expr);
+
+    case AST_BINARYOP:
+    {
+        const int       opCode = expr.staticCast<AstOperator>()->code;
+        const ExprType  typeA = inferExprType (expr->children()[0], resolver);
+        const ExprType  typeB = inferExprType (expr->children()[1], resolver);
+
+        if (opCode == LEX_OROR || opCode == LEX_ANDAND)
+            return joinTypes (typeA, typeB);
+        else
+            return binaryOpType (opCode, typeA, typeB);
+    }
+
+    case AST_PREFIXOP:
+    {
+        const int       opCode = expr.staticCast<AstOperator>()->code;
+        const ExprType  type = inferExprType (expr->children()[0], resolver);
+
+        switch (opCode)
+        {
+        case LEX_PLUSPLUS:      return binaryOpType ('+', type, ET_NUMBER);
+        case LEX_MINUSMINUS:    return binaryOpType ('-', type, ET_NUMBER);
+        case '-':               return ET_NUMBER;
+        case '~':               return ET_NUMBER;
+        case '!':               return ET_BOOL;
+        case '+':               return type;
+        default:                return ET_UNKNOWN;
+        }
+    }
+
+    case AST_POSTFIXOP:
+        return ET_NUMBER;       //'@inc' / '@dec' always return numbers.
+
+    case AST_ASSIGNMENT:
+    {
+        const int       opCode = expr.staticCast<AstOperator>()->code;
+        const ExprType  rType = inferExprType (expr->children()[1], resolver);
+
+        if (opCode == '=')
+            return rType;
+        else
+        {
+            const ExprType lType = inferExprType (expr->children()[0], resolver);
+            return binaryOpType (opCode - LEX_ASSIGN_BASE, lType, rType);
+        }
+    }
+
+    case AST_CONDITIONAL:
+        return joinTypes (inferExprType (expr->children()[1], resolver),
+                          inferExprType (expr->children()[2], resolver));
+
+    default:
+        return ET_UNKNOWN;
+    }
+}
+
+/**
+ * Type of the result of a binary operator, given the types of its operands.
+ * It follows the rules of the operator native functions ('@add', '@sub'...).
+ * @param opCode
+ * @param typeA
+ * @param typeB
+ * @return
+ */
+ExprType binaryOpType (int opCode, ExprType typeA, ExprType typeB)
+{
+    switch (opCode)
+    {
+    case '+':
+        if (typeA == ET_STRING || typeB == ET_STRING)
+            return ET_STRING;
+        else if (typeA == ET_UNKNOWN || typeB == ET_UNKNOWN)
+            return ET_UNKNOWN;
+        else if (typeA == ET_PENDING || typeB == ET_PENDING)
+            return ET_PENDING;
+        else
+            return ET_NUMBER;
+
+    case '-':
+    case '*':
+    case '/':
+    case '%':
+    case '&':
+    case '|':
+    case '^':
+    case LEX_POWER:
+    case LEX_LSHIFT:
+    case LEX_RSHIFT:
+    case LEX_RSHIFTUNSIGNED:
+        return ET_NUMBER;
+
+    case '<':
+    case '>':
+    case LEX_LEQUAL:
+    case LEX_GEQUAL:
+    case LEX_EQUAL:
+    case LEX_NEQUAL:
+    case LEX_TYPEEQUAL:
+    case LEX_NTYPEEQUAL:
+        return ET_BOOL;
+
+    default:
+        return ET_UNKNOWN;
+    }
+}
+
+/**
+ * Joins the types of two values which can reach the same place.
+ * @param a
+ * @param b
+ * @return
+ */
+ExprType joinTypes (ExprType a, ExprType b)
+{
+    if (a == ET_PENDING)
+        return b;
+    else if (b == ET_PENDING || a == b)
+        return a;
+    else
+        return ET_UNKNOWN;
+}
+
+/**
+ * Type of a literal value
+ * @param value
+ * @return
+ */
+ExprType literalType (ASValue value)
+{
+    switch (value.getType())
+    {
+    case VT_NUMBER:     return ET_NUMBER;
+    case VT_BOOL:       return ET_BOOL;
+    case VT_STRING:     return ET_STRING;
+    default:            return ET_UNKNOWN;
+    }
+}
+
+void LocalTypeAnalysis::pushScope (const AstNode* owner, bool isBlock)
+{
+    TypeScope   scope;
+
+    scope.owner = owner;
+    scope.isBlock = isBlock;
+    m_scopes.push_back(scope);
+}
+
+void LocalTypeAnalysis::popScope ()
+{
+    m_scopes.pop_back();
+}
+
+/**
+ * Declares a variable in the current scope. A variable declared twice in the
+ * same scope is the same variable for the code generator.
+ * @param name
+ * @param type      Initial type.
+ * @return Binding index.
+ */
+int LocalTypeAnalysis::declare (const string& name, ExprType type)
+{
+    TypeScope&  scope = m_scopes.back();
+    auto        it = scope.bindings.find(name);
+
+    if (m_boxed.count(name) > 0)
+        type = ET_UNKNOWN;
+
+    if (it != scope.bindings.end())
+    {
+        LocalBinding&   binding = m_bindings[it->second];
+
+        binding.type = joinTypes (binding.type, type);
+        return it->second;
+    }
+
+    LocalBinding    binding;
+
+    binding.key = LocalVarKey (scope.owner, name);
+    binding.type = type;
+    m_bindings.push_back(binding);
+
+    const int index = (int)m_bindings.size() - 1;
+    scope.bindings[name] = index;
+
+    return index;
+}
+
+/**
+ * Collects the declarations, assignments and variable references of an AST
+ * subtree. Nested functions and classes are not analyzed.
+ * @param node
+ */
+void LocalTypeAnalysis::walk (Ref<AstNode> node)
+{
+    if (node.isNull())
+        return;
+
+    auto&   children = node->children();
+
+    switch (node->getType())
+    {
+    case AST_FUNCTION:
+        if (!node->getName().empty() && m_scopes.back().isBlock)
+            declare (node->getName(), ET_UNKNOWN);
+        return;
+
+    case AST_CLASS:
+    case AST_ACTOR:
+        return;
+
+    case AST_BLOCK:
+        pushScope (node.getPointer(), true);
+        for (auto it = children.begin(); it != children.end(); ++it)
+            walk (*it);
+        popScope ();
+        return;
+
+    case AST_FOR_EACH:
+        walk (children[1]);
+        pushScope (node.getPointer(), true);
+        declare (children[0]->getName(), ET_UNKNOWN);
+        walk (children[2]);
+        popScope ();
+        return;
+
+    case AST_VAR:
+    case AST_CONST:
+    {
+        Ref<AstNode>    init = children.empty() ? Ref<AstNode>() : children[0];
+
+        if (m_scopes.back().isBlock)
+        {
+            //Same order as the code generator: variable is declared before
+            //its initialization.
+            const int index = declare (node->getName(), ET_PENDING);
+
+            if (init.isNull())
+                m_bindings[index].type = ET_UNKNOWN;
+            else
+            {
+                TypeSource  source = {init, '='};
+                m_bindings[index].sources.push_back(source);
+            }
+        }
+        walk (init);
+        return;
+    }
+
+    case AST_IDENTIFIER:
+    {
+        const int index = resolve (node->getName());
+
+        if (index >= 0)
+            m_resolved[node.getPointer()] = index;
+        return;
+    }
+
+    case AST_ASSIGNMENT:
+    {
+        const int   opCode = node.staticCast<AstOperator>()->code;
+
+        for (auto it = children.begin(); it != children.end(); ++it)
+            walk (*it);
+        addSource (children[0], children[1], opCode == '=' ? '=' : opCode - LEX_ASSIGN_BASE);
+        return;
+    }
+
+    case AST_PREFIXOP:
+    case AST_POSTFIXOP:
+    {
+        const int   opCode = node.staticCast<AstOperator>()->code;
+
+        walk (children[0]);
+        if (opCode == LEX_PLUSPLUS)
+            addSource (children[0], Ref<AstNode>(), '+');
+        else if (opCode == LEX_MINUSMINUS)
+            addSource (children[0], Ref<AstNode>(), '-');
+        return;
+    }
+
+    default:
+        for (auto it = children.begin(); it != children.end(); ++it)
+            walk (*it);
+        return;
+    }
+}
+
+/**
+ * Refines the types of the variables until a fixed point is reached.
+ * Types only move from 'pending' to a concrete type, and from a concrete type
+ * to 'unknown', so it always ends.
+ */
+void LocalTypeAnalysis::solve ()
+{
+    bool    changed = true;
+
+    while (changed)
+    {
+        changed = false;
+
+        for (auto it = m_bindings.begin(); it != m_bindings.end(); ++it)
+        {
+            if (it->type == ET_UNKNOWN)
+                continue;
+
+            ExprType    type = it->type;
+
+            for (size_t i = 0; i < it->sources.size(); ++i)
+                type = joinTypes (type, sourceType (*it, it->sources[i]));
+
+            if (type != it->type)
+            {
+                it->type = type;
+                changed = true;
+            }
+        }
+    }
+}
+
+/**
+ * Gets the inferred types. Variables which are still 'pending' are read before
+ * being written, so they are 'unknown'.
+ * @return
+ */
+LocalTypes LocalTypeAnalysis::result ()const
+{
+    LocalTypes  types;
+
+    for (auto it = m_bindings.begin(); it != m_bindings.end(); ++it)
+    {
+        if (it->type != ET_UNKNOWN && it->type != ET_PENDING)
+            types[it->key] = it->type;
+    }
+
+    return types;
+}
+
+ExprType LocalTypeAnalysis::identifierType (Ref<AstNode> identifier)const
+{
+    auto it = m_resolved.find(identifier.getPointer());
+
+    if (it == m_resolved.end())
+        return ET_UNKNOWN;
+    else
+        return m_bindings[it->second].type;
+}
+
+/**
+ * Finds the binding of a name, with the same rules as the code generator.
+ * @param name
+ * @return Binding index, or -1 if it is not a local variable.
+ */
+int LocalTypeAnalysis::resolve (const string& name)const
+{
+    for (auto it = m_scopes.rbegin(); it != m_scopes.rend(); ++it)
+    {
+        auto itBinding = it->bindings.find(name);
+
+        if (itBinding != it->bindings.end())
+            return itBinding->second;
+        else if (!it->isBlock)
+            return -1;
+    }
+
+    return -1;
+}
+
+/**
+ * Registers a value written into a variable.
+ * @param identifier
+ * @param expr
+ * @param op
+ */
+void LocalTypeAnalysis::addSource (Ref<AstNode> identifier, Ref<AstNode> expr, int op)
+{
+    if (identifier->getType() != AST_IDENTIFIER)
+        return;
+
+    auto it = m_resolved.find(identifier.getPointer());
+
+    if (it != m_resolved.end())
+    {
+        TypeSource  source = {expr, op};
+        m_bindings[it->second].sources.push_back(source);
+    }
+}
+
+/**
+ * Type of a value written into a variable, given the current known types.
+ * @param binding
+ * @param source
+ * @return
+ */
+ExprType LocalTypeAnalysis::sourceType (const LocalBinding& binding, const TypeSource& source)const
+{
+    const ExprType exprType = source.expr.isNull() ? ET_NUMBER : inferExprType (source.expr, *this);
+
+    if (source.op == '=')
+        return exprType;
+    else
+        return binaryOpType (source.op, binding.type, exprType);
+}
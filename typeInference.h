@@ -0,0 +1,59 @@
+/*
+ * File:   typeInference.h
+ * Author: ghernan
+ *
+ * Local type inference. Finds local variables and expressions which are
+ * always numbers, booleans or strings, so the code generator can emit
+ * specialized instructions for them.
+ *
+ * Created on October 18, 2026, 4:10 PM
+ */
+
+#pragma once
+#ifndef TYPEINFERENCE_H
+#define	TYPEINFERENCE_H
+
+#include "ast.h"
+
+#include <set>
+#include <map>
+
+/**
+ * Inferred type of an expression.
+ */
+enum ExprType
+{
+    ET_UNKNOWN = 0,
+    ET_NUMBER,
+    ET_BOOL,
+    ET_STRING,
+    ET_PENDING      //Not yet known. Only used during the analysis.
+};
+
+/**
+ * Types of local variables. They are identified by the AST node which owns
+ * the scope in which they are declared (the same one used by the code
+ * generator), and their name.
+ */
+typedef std::pair<const AstNode*, std::string>  LocalVarKey;
+typedef std::map<LocalVarKey, ExprType>         LocalTypes;
+
+/**
+ * Gives the types of the variables referenced by an expression.
+ */
+class TypeResolver
+{
+public:
+    virtual ExprType identifierType (Ref<AstNode> identifier)const = 0;
+};
+
+LocalTypes inferLocalTypes (Ref<AstNode> scopeNode,
+                            const StringVector& params,
+                            const AstNodeList& statements,
+                            const std::set<std::string>& boxed);
+
+ExprType inferExprType (Ref<AstNode> expr, const TypeResolver& resolver);
+ExprType binaryOpType (int opCode, ExprType typeA, ExprType typeB);
+
+#endif	/* TYPEINFERENCE_H */
+
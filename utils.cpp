@@ -268,6 +268,18 @@ double getNaN()
     return nan("");
 }
 
+/**
+ * Mixes a new value into a hash seed. Used to build hashes of compound values.
+ * (Same mixing function as 'boost::hash_combine')
+ * @param seed
+ * @param value
+ * @return 
+ */
+size_t hashCombine (size_t seed, size_t value)
+{
+    return seed ^ (value + 0x9e3779b9 + (seed << 6) + (seed >> 2));
+}
+
 /**
  * Reads a text file an returns its contents as a string
  * @param szPath
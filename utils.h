@@ -48,6 +48,8 @@ std::string double_to_string(double x);
 
 double getNaN();
 
+size_t hashCombine (size_t seed, size_t value);
+
 std::string readTextFile (const std::string& szPath);
 bool writeTextFile (const std::string& szPath, const std::string& szContent);
 bool createDirIfNotExist (const std::string& szPath);